@@ -0,0 +1,235 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/**
+ * @file common/hash_calls.c
+ * @brief Fast non-cryptographic hashing definitions
+ */
+
+#if defined(HAVE_CONFIG_H)
+#include <config_ac.h>
+#endif
+
+#include <pthread.h>
+#include <string.h>
+
+#if defined(__GNUC__) && (defined(__x86_64__) || defined(__i386__))
+#define HASH_CRC32C_SSE42
+#include <nmmintrin.h>
+#elif defined(__aarch64__) && defined(__ARM_FEATURE_CRC32)
+#define HASH_CRC32C_ARMV8
+#include <arm_acle.h>
+#endif
+
+#include "hash_calls.h"
+
+/* reflected Castagnoli polynomial */
+#define CRC32C_POLY 0x82F63B78
+
+static pthread_once_t g_crc32c_once = PTHREAD_ONCE_INIT;
+static uint32_t g_crc32c_table[8][256];
+static hash_crc32c_proc g_crc32c_proc;
+static const char *g_crc32c_name;
+
+static void
+hash_crc32c_init(void);
+
+/*****************************************************************************/
+unsigned int
+g_hash_crc32c_sw(unsigned int crc, const void *data, int bytes)
+{
+    const uint8_t *p;
+    uint32_t c;
+    uint32_t lo;
+    uint32_t hi;
+
+    pthread_once(&g_crc32c_once, hash_crc32c_init);
+    p = (const uint8_t *) data;
+    c = ~((uint32_t) crc);
+    while ((bytes > 0) && (((uintptr_t) p) & 7) != 0)
+    {
+        c = g_crc32c_table[0][(c ^ *(p++)) & 0xFF] ^ (c >> 8);
+        bytes--;
+    }
+    /* slicing by 8 */
+    while (bytes >= 8)
+    {
+        lo = p[0] | (p[1] << 8) | (p[2] << 16) | ((uint32_t) p[3] << 24);
+        hi = p[4] | (p[5] << 8) | (p[6] << 16) | ((uint32_t) p[7] << 24);
+        lo ^= c;
+        c = g_crc32c_table[7][lo & 0xFF] ^
+            g_crc32c_table[6][(lo >> 8) & 0xFF] ^
+            g_crc32c_table[5][(lo >> 16) & 0xFF] ^
+            g_crc32c_table[4][lo >> 24] ^
+            g_crc32c_table[3][hi & 0xFF] ^
+            g_crc32c_table[2][(hi >> 8) & 0xFF] ^
+            g_crc32c_table[1][(hi >> 16) & 0xFF] ^
+            g_crc32c_table[0][hi >> 24];
+        p += 8;
+        bytes -= 8;
+    }
+    while (bytes > 0)
+    {
+        c = g_crc32c_table[0][(c ^ *(p++)) & 0xFF] ^ (c >> 8);
+        bytes--;
+    }
+    return ~c;
+}
+
+#if defined(HASH_CRC32C_SSE42)
+/*****************************************************************************/
+__attribute__((target("sse4.2")))
+static unsigned int
+hash_crc32c_sse42(unsigned int crc, const void *data, int bytes)
+{
+    const uint8_t *p;
+    uint32_t c;
+#if defined(__x86_64__)
+    uint64_t c64;
+    uint64_t v64;
+#else
+    uint32_t v32;
+#endif
+
+    p = (const uint8_t *) data;
+    c = ~((uint32_t) crc);
+    while ((bytes > 0) && (((uintptr_t) p) & 7) != 0)
+    {
+        c = _mm_crc32_u8(c, *(p++));
+        bytes--;
+    }
+#if defined(__x86_64__)
+    c64 = c;
+    while (bytes >= 8)
+    {
+        memcpy(&v64, p, 8);
+        c64 = _mm_crc32_u64(c64, v64);
+        p += 8;
+        bytes -= 8;
+    }
+    c = (uint32_t) c64;
+#else
+    while (bytes >= 4)
+    {
+        memcpy(&v32, p, 4);
+        c = _mm_crc32_u32(c, v32);
+        p += 4;
+        bytes -= 4;
+    }
+#endif
+    while (bytes > 0)
+    {
+        c = _mm_crc32_u8(c, *(p++));
+        bytes--;
+    }
+    return ~c;
+}
+#endif
+
+#if defined(HASH_CRC32C_ARMV8)
+/*****************************************************************************/
+static unsigned int
+hash_crc32c_armv8(unsigned int crc, const void *data, int bytes)
+{
+    const uint8_t *p;
+    uint32_t c;
+    uint64_t v64;
+
+    p = (const uint8_t *) data;
+    c = ~((uint32_t) crc);
+    while ((bytes > 0) && (((uintptr_t) p) & 7) != 0)
+    {
+        c = __crc32cb(c, *(p++));
+        bytes--;
+    }
+    while (bytes >= 8)
+    {
+        memcpy(&v64, p, 8);
+        c = __crc32cd(c, v64);
+        p += 8;
+        bytes -= 8;
+    }
+    while (bytes > 0)
+    {
+        c = __crc32cb(c, *(p++));
+        bytes--;
+    }
+    return ~c;
+}
+#endif
+
+/*****************************************************************************/
+static void
+hash_crc32c_init(void)
+{
+    uint32_t c;
+    int index;
+    int bit;
+    int slice;
+
+    for (index = 0; index < 256; index++)
+    {
+        c = index;
+        for (bit = 0; bit < 8; bit++)
+        {
+            c = (c & 1) ? (c >> 1) ^ CRC32C_POLY : c >> 1;
+        }
+        g_crc32c_table[0][index] = c;
+    }
+    for (index = 0; index < 256; index++)
+    {
+        c = g_crc32c_table[0][index];
+        for (slice = 1; slice < 8; slice++)
+        {
+            c = g_crc32c_table[0][c & 0xFF] ^ (c >> 8);
+            g_crc32c_table[slice][index] = c;
+        }
+    }
+
+    g_crc32c_proc = g_hash_crc32c_sw;
+    g_crc32c_name = "table";
+#if defined(HASH_CRC32C_SSE42)
+    if (__builtin_cpu_supports("sse4.2"))
+    {
+        g_crc32c_proc = hash_crc32c_sse42;
+        g_crc32c_name = "sse4.2";
+    }
+#elif defined(HASH_CRC32C_ARMV8)
+    g_crc32c_proc = hash_crc32c_armv8;
+    g_crc32c_name = "armv8 crc";
+#endif
+}
+
+/*****************************************************************************/
+hash_crc32c_proc
+g_hash_crc32c_get_proc(const char **name)
+{
+    pthread_once(&g_crc32c_once, hash_crc32c_init);
+    if (name != NULL)
+    {
+        *name = g_crc32c_name;
+    }
+    return g_crc32c_proc;
+}
+
+/*****************************************************************************/
+unsigned int
+g_hash_crc32c(unsigned int crc, const void *data, int bytes)
+{
+    pthread_once(&g_crc32c_once, hash_crc32c_init);
+    return g_crc32c_proc(crc, data, bytes);
+}
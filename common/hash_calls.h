@@ -0,0 +1,72 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ */
+
+/**
+ * @file common/hash_calls.h
+ * @brief Fast non-cryptographic hashing declarations
+ */
+
+#ifndef HASH_CALLS_H
+#define HASH_CALLS_H
+
+#include "arch.h"
+
+/**
+ * Signature of a CRC32C implementation
+ *
+ * @param crc Result of a previous call to continue from, or 0 to start
+ * @param data Data to add
+ * @param bytes Length of data
+ * @return CRC32C of all the data so far
+ */
+typedef unsigned int (*hash_crc32c_proc)(unsigned int crc, const void *data,
+        int bytes);
+
+/**
+ * CRC32C (Castagnoli) using the fastest implementation for this CPU
+ *
+ * SSE4.2 or ARMv8 CRC instructions are used when available, otherwise a
+ * table driven version that does eight bytes at a time. All of them give
+ * the same results.
+ *
+ * @param crc Result of a previous call to continue from, or 0 to start
+ * @param data Data to add
+ * @param bytes Length of data
+ * @return CRC32C of all the data so far
+ */
+unsigned int
+g_hash_crc32c(unsigned int crc, const void *data, int bytes);
+
+/**
+ * CRC32C (Castagnoli), table driven version
+ *
+ * Parameters as for g_hash_crc32c(). This is always available and is
+ * exposed for testing and benchmarking.
+ */
+unsigned int
+g_hash_crc32c_sw(unsigned int crc, const void *data, int bytes);
+
+/**
+ * Returns the implementation used by g_hash_crc32c()
+ *
+ * @param[out] name Name of the implementation, for logging. Can be NULL
+ * @return The implementation
+ */
+hash_crc32c_proc
+g_hash_crc32c_get_proc(const char **name);
+
+#endif
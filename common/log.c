@@ -45,6 +45,62 @@
 /* Here we store the current state and configuration of the log */
 static struct log_config *g_staticLogConfig = NULL;
 
+/* Most file output the async writer hands to one write() */
+#define LOG_ASYNC_BATCH_SIZE (64 * 1024)
+
+/* A message in the async ring, followed by its text */
+struct log_async_record
+{
+    int len; /* of the text */
+    int to_file;
+    int syslog_priority; /* -1 if not for syslog */
+};
+
+/* State for EnableAsync. Callers copy their messages into a ring and a
+ * writer thread does the file writes and syslog calls */
+struct log_async
+{
+    pthread_t thread;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    char *buf;
+    unsigned int size;
+    unsigned int head; /* next byte to fill, callers only, under lock */
+    unsigned int tail; /* next byte to write, writer thread only */
+    unsigned int used; /* bytes between tail and head, under lock */
+    unsigned int dropped; /* not yet reported, under lock */
+    unsigned int dropped_total;
+    int stop;
+    int fd;
+    int pid; /* the thread only exists in this process */
+};
+
+static struct log_async *g_log_async = NULL;
+
+/* The most verbose level any destination or logger accepts. Anything
+ * above it is dropped before looking at where it was logged from */
+static enum logLevels g_log_max_level = LOG_LEVEL_NEVER;
+
+#ifdef LOG_PER_LOGGER_LEVEL
+/* smallest size of the call site table */
+#define LOG_SITES_MIN 256
+
+/* What the per logger levels say about one LOG call site. The key is the
+ * pair of __func__ and __FILE__ pointers, not the strings */
+struct log_site
+{
+    const char *function_name; /* NULL if the entry is unused */
+    const char *file_name;
+    int overrides;
+    enum logLevels log_level;
+};
+
+static pthread_mutex_t g_log_sites_lock = PTHREAD_MUTEX_INITIALIZER;
+static struct log_site *g_log_sites = NULL;
+static int g_log_sites_mask = 0;
+static int g_log_sites_count = 0;
+#endif
+
 /* This file first start with all private functions.
    In the end of the file the public functions is defined */
 
@@ -148,6 +204,284 @@ internal_log_lvl2str(const enum logLevels lvl, char *str)
     }
 }
 
+/******************************************************************************/
+/* copies into the ring at pos, wrapping, returns the next pos */
+static unsigned int
+log_async_ring_put(struct log_async *la, unsigned int pos, const void *data,
+                   unsigned int bytes)
+{
+    unsigned int part;
+
+    part = MIN(bytes, la->size - pos);
+    g_memcpy(la->buf + pos, data, part);
+    g_memcpy(la->buf, (const char *)data + part, bytes - part);
+    return (pos + bytes) % la->size;
+}
+
+/******************************************************************************/
+/* copies out of the ring at pos, wrapping, returns the next pos */
+static unsigned int
+log_async_ring_get(struct log_async *la, unsigned int pos, void *data,
+                   unsigned int bytes)
+{
+    unsigned int part;
+
+    part = MIN(bytes, la->size - pos);
+    g_memcpy(data, la->buf + pos, part);
+    g_memcpy((char *)data + part, la->buf, bytes - part);
+    return (pos + bytes) % la->size;
+}
+
+/******************************************************************************/
+static void
+log_async_write_file(struct log_async *la, const char *data, int bytes)
+{
+    int written;
+
+    while (bytes > 0)
+    {
+        written = g_file_write(la->fd, data, bytes);
+        if (written <= 0)
+        {
+            break;
+        }
+        data += written;
+        bytes -= written;
+    }
+}
+
+/******************************************************************************/
+static void *
+log_async_thread(void *arg)
+{
+    struct log_async *la = (struct log_async *)arg;
+    struct log_async_record rec;
+    char *batch;
+    char text[LOG_BUFFER_SIZE + 64];
+    unsigned int avail;
+    unsigned int consumed;
+    unsigned int dropped;
+    int batch_len;
+
+    batch = (char *)g_malloc(LOG_ASYNC_BATCH_SIZE, 0);
+    pthread_mutex_lock(&la->lock);
+    for (;;)
+    {
+        while (la->used == 0 && la->dropped == 0 && !la->stop)
+        {
+            pthread_cond_wait(&la->cond, &la->lock);
+        }
+        if (la->used == 0 && la->dropped == 0)
+        {
+            break;
+        }
+        avail = la->used;
+        dropped = la->dropped;
+        la->dropped = 0;
+        pthread_mutex_unlock(&la->lock);
+
+        /* callers only fill space past head, so what is between tail and
+           tail + avail can be read without the lock */
+        batch_len = 0;
+        consumed = 0;
+        while (consumed < avail)
+        {
+            la->tail = log_async_ring_get(la, la->tail, &rec, sizeof(rec));
+            la->tail = log_async_ring_get(la, la->tail, text, rec.len);
+            consumed += sizeof(rec) + rec.len;
+            if (rec.syslog_priority >= 0 && rec.len > 20)
+            {
+                /* as internal_log_message(), less the date */
+                syslog(rec.syslog_priority, "%.*s", rec.len - 20, text + 20);
+            }
+            if (!rec.to_file || batch == NULL)
+            {
+                if (rec.to_file)
+                {
+                    log_async_write_file(la, text, rec.len);
+                }
+                continue;
+            }
+            if (batch_len + rec.len > LOG_ASYNC_BATCH_SIZE)
+            {
+                log_async_write_file(la, batch, batch_len);
+                batch_len = 0;
+            }
+            g_memcpy(batch + batch_len, text, rec.len);
+            batch_len += rec.len;
+        }
+        if (batch_len > 0)
+        {
+            log_async_write_file(la, batch, batch_len);
+        }
+        if (dropped > 0 && la->fd >= 0)
+        {
+            getFormattedDateTime(text, 32);
+            internal_log_lvl2str(LOG_LEVEL_WARNING, text + 31);
+            batch_len = 39 + g_snprintf(text + 39, sizeof(text) - 39,
+                                        "%u log messages dropped, the log "
+                                        "buffer was full\n", dropped);
+            log_async_write_file(la, text, batch_len);
+        }
+
+        pthread_mutex_lock(&la->lock);
+        la->used -= consumed;
+    }
+    pthread_mutex_unlock(&la->lock);
+    g_free(batch);
+    return NULL;
+}
+
+/******************************************************************************/
+static void
+log_async_delete(struct log_async *la)
+{
+    if (la != NULL)
+    {
+        pthread_cond_destroy(&la->cond);
+        pthread_mutex_destroy(&la->lock);
+        g_free(la->buf);
+        g_free(la);
+    }
+}
+
+/******************************************************************************/
+static enum logReturns
+log_async_start(struct log_config *l_cfg)
+{
+    struct log_async *la;
+    int kb;
+
+    la = g_new0(struct log_async, 1);
+    if (la == NULL)
+    {
+        return LOG_ERROR_MALLOC;
+    }
+    kb = l_cfg->async_buffer_kb;
+    if (kb < 64)
+    {
+        kb = 64;
+    }
+    la->size = kb * 1024;
+    la->buf = (char *)g_malloc(la->size, 0);
+    la->fd = l_cfg->fd;
+    la->pid = g_getpid();
+    pthread_mutex_init(&la->lock, NULL);
+    pthread_cond_init(&la->cond, NULL);
+    if (la->buf == NULL)
+    {
+        log_async_delete(la);
+        return LOG_ERROR_MALLOC;
+    }
+    if (pthread_create(&la->thread, NULL, log_async_thread, la) != 0)
+    {
+        g_writeln("could not start the async log thread");
+        log_async_delete(la);
+        return LOG_GENERAL_ERROR;
+    }
+    g_log_async = la;
+    return LOG_STARTUP_OK;
+}
+
+/******************************************************************************/
+/* writes out what is queued and stops the writer thread */
+static void
+log_async_stop(void)
+{
+    struct log_async *la;
+
+    la = g_log_async;
+    if (la == NULL)
+    {
+        return;
+    }
+    g_log_async = NULL;
+    if (la->pid != g_getpid())
+    {
+        /* forked, the thread is in the parent */
+        g_free(la->buf);
+        g_free(la);
+        return;
+    }
+    pthread_mutex_lock(&la->lock);
+    la->stop = 1;
+    pthread_cond_signal(&la->cond);
+    pthread_mutex_unlock(&la->lock);
+    pthread_join(la->thread, NULL);
+    log_async_delete(la);
+}
+
+/******************************************************************************/
+/* starts a writer thread in a forked child, with an empty queue, what
+   was queued at the fork is the parent's to write */
+static void
+log_async_restart(void)
+{
+    struct log_async *la;
+
+    la = g_log_async;
+    if (la == NULL || la->pid == g_getpid())
+    {
+        return;
+    }
+    /* another thread may have held these at the fork */
+    pthread_mutex_init(&la->lock, NULL);
+    pthread_cond_init(&la->cond, NULL);
+    la->head = 0;
+    la->tail = 0;
+    la->used = 0;
+    la->dropped = 0;
+    la->dropped_total = 0;
+    la->stop = 0;
+    la->pid = g_getpid();
+    if (pthread_create(&la->thread, NULL, log_async_thread, la) != 0)
+    {
+        g_writeln("could not restart the async log thread");
+        g_log_async = NULL;
+        log_async_delete(la);
+    }
+}
+
+/******************************************************************************/
+/* returns non zero if the message was queued */
+static int
+log_async_put(const char *text, int len, int to_file, int syslog_priority)
+{
+    struct log_async *la;
+    struct log_async_record rec;
+    unsigned int bytes;
+
+    la = g_log_async;
+    if (la == NULL || la->pid != g_getpid())
+    {
+        /* a forked child writes for itself, unless log_after_fork()
+           started a writer for it */
+        return 0;
+    }
+    rec.len = len;
+    rec.to_file = to_file;
+    rec.syslog_priority = syslog_priority;
+    bytes = sizeof(rec) + len;
+    pthread_mutex_lock(&la->lock);
+    if (la->used + bytes > la->size)
+    {
+        la->dropped++;
+        la->dropped_total++;
+    }
+    else
+    {
+        la->head = log_async_ring_put(la, la->head, &rec, sizeof(rec));
+        la->head = log_async_ring_put(la, la->head, text, len);
+        if (la->used == 0)
+        {
+            pthread_cond_signal(&la->cond);
+        }
+        la->used += bytes;
+    }
+    pthread_mutex_unlock(&la->lock);
+    return 1;
+}
+
 /******************************************************************************/
 enum logReturns
 internal_log_start(struct log_config *l_cfg)
@@ -194,6 +528,16 @@ internal_log_start(struct log_config *l_cfg)
     pthread_mutex_init(&(l_cfg->log_lock), &(l_cfg->log_lock_attr));
 #endif
 
+    if (l_cfg->enable_async && g_log_async == NULL)
+    {
+        ret = log_async_start(l_cfg);
+        if (ret != LOG_STARTUP_OK)
+        {
+            /* carry on writing from the callers */
+            g_writeln("async logging not available");
+        }
+    }
+
     return LOG_STARTUP_OK;
 }
 
@@ -209,6 +553,9 @@ internal_log_end(struct log_config *l_cfg)
         return ret;
     }
 
+    /* everything queued goes out before the file is closed */
+    log_async_stop();
+
     if (-1 != l_cfg->fd)
     {
         /* closing logfile... */
@@ -315,6 +662,8 @@ internal_config_read_logging(int file,
     lc->syslog_level = LOG_LEVEL_INFO;
     lc->dump_on_start = 0;
     lc->enable_pid = 0;
+    lc->enable_async = 0;
+    lc->async_buffer_kb = LOG_ASYNC_BUFFER_KB_DEFAULT;
 
     g_snprintf(section_name, 511, "%s%s", section_prefix, SESMAN_CFG_LOGGING);
     file_read_section(file, section_name, param_n, param_v);
@@ -368,6 +717,16 @@ internal_config_read_logging(int file,
         {
             lc->enable_pid = g_text2bool((char *)list_get_item(param_v, i));
         }
+
+        if (0 == g_strcasecmp(buf, SESMAN_CFG_LOG_ENABLE_ASYNC))
+        {
+            lc->enable_async = g_text2bool((char *)list_get_item(param_v, i));
+        }
+
+        if (0 == g_strcasecmp(buf, SESMAN_CFG_LOG_ASYNC_BUFFER))
+        {
+            lc->async_buffer_kb = g_atoi((char *)list_get_item(param_v, i));
+        }
     }
 
     if (0 == lc->log_file)
@@ -455,6 +814,15 @@ internal_log_config_dump(struct log_config *config)
     }
     g_printf("\tSyslogLevel:   %s\r\n", str_level);
 
+    if (config->enable_async)
+    {
+        g_printf("\tAsync buffer:  %d KiB\r\n", config->async_buffer_kb);
+    }
+    else
+    {
+        g_printf("\tAsync buffer:  %s\r\n", "<disabled>");
+    }
+
 #ifdef LOG_PER_LOGGER_LEVEL
     g_printf("per logger configuration:\r\n");
     for (i = 0; i < config->per_logger_level->count; i++)
@@ -479,6 +847,7 @@ internalInitAndAllocStruct(void)
     {
         ret->fd = -1;
         ret->enable_syslog = 0;
+        ret->async_buffer_kb = LOG_ASYNC_BUFFER_KB_DEFAULT;
 #ifdef LOG_PER_LOGGER_LEVEL
         ret->per_logger_level = list_create();
         if (ret->per_logger_level != NULL)
@@ -564,6 +933,8 @@ internal_log_config_copy(struct log_config *dest, const struct log_config *src)
         dest->program_name = src->program_name;
         dest->enable_pid = src->enable_pid;
         dest->dump_on_start = src->dump_on_start;
+        dest->enable_async = src->enable_async;
+        dest->async_buffer_kb = src->async_buffer_kb;
 
         internal_log_config_copy_levels(dest, src);
     }
@@ -614,19 +985,147 @@ internal_log_is_enabled_for_level(const enum logLevels log_level,
     }
 }
 
-bool_t
-internal_log_location_overrides_level(const char *function_name,
-                                      const char *file_name,
-                                      enum logLevels *log_level_return)
+/******************************************************************************/
+/* works out g_log_max_level for the running configuration */
+static void
+log_update_max_level(void)
 {
+    enum logLevels max_level;
 #ifdef LOG_PER_LOGGER_LEVEL
-    struct log_logger_level *logger = NULL;
+    struct log_logger_level *logger;
     int i;
+#endif
 
     if (g_staticLogConfig == NULL)
+    {
+        /* let calls through to report the log isn't running */
+        g_log_max_level = LOG_LEVEL_NEVER;
+        return;
+    }
+    max_level = LOG_LEVEL_ALWAYS;
+    if (g_staticLogConfig->fd >= 0
+            && g_staticLogConfig->log_level > max_level)
+    {
+        max_level = g_staticLogConfig->log_level;
+    }
+    if (g_staticLogConfig->enable_syslog
+            && g_staticLogConfig->syslog_level > max_level)
+    {
+        max_level = g_staticLogConfig->syslog_level;
+    }
+    if (g_staticLogConfig->enable_console
+            && g_staticLogConfig->console_level > max_level)
+    {
+        max_level = g_staticLogConfig->console_level;
+    }
+#ifdef LOG_PER_LOGGER_LEVEL
+    for (i = 0; i < g_staticLogConfig->per_logger_level->count; i++)
+    {
+        logger = (struct log_logger_level *)
+                 list_get_item(g_staticLogConfig->per_logger_level, i);
+        if (logger->log_level > max_level)
+        {
+            max_level = logger->log_level;
+        }
+    }
+#endif
+    g_log_max_level = max_level;
+}
+
+#ifdef LOG_PER_LOGGER_LEVEL
+/******************************************************************************/
+static unsigned int
+log_site_hash(const char *function_name, const char *file_name)
+{
+    tui64 key;
+
+    key = (tui64) (tintptr) function_name * 31 + (tui64) (tintptr) file_name;
+    return (unsigned int) ((key * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+/******************************************************************************/
+/* forgets every call site, for when the per logger levels change */
+static void
+log_sites_clear(void)
+{
+    pthread_mutex_lock(&g_log_sites_lock);
+    g_free(g_log_sites);
+    g_log_sites = NULL;
+    g_log_sites_mask = 0;
+    g_log_sites_count = 0;
+    pthread_mutex_unlock(&g_log_sites_lock);
+}
+
+/******************************************************************************/
+/* returns the slot for a call site, either its entry or the empty slot it
+   goes in. Called with g_log_sites_lock held */
+static struct log_site *
+log_sites_find(struct log_site *sites, int mask,
+               const char *function_name, const char *file_name)
+{
+    struct log_site *site;
+    int index;
+
+    index = log_site_hash(function_name, file_name) & mask;
+    for (;;)
+    {
+        site = sites + index;
+        if (site->function_name == NULL
+                || (site->function_name == function_name
+                    && site->file_name == file_name))
+        {
+            return site;
+        }
+        index = (index + 1) & mask;
+    }
+}
+
+/******************************************************************************/
+/* makes room for another call site, kept at most half full. Called with
+   g_log_sites_lock held, returns 0 on success */
+static int
+log_sites_grow(void)
+{
+    struct log_site *sites;
+    struct log_site *site;
+    int size;
+    int index;
+
+    size = g_log_sites_mask + 1;
+    if (g_log_sites != NULL && (g_log_sites_count + 1) * 2 <= size)
     {
         return 0;
     }
+    size = (g_log_sites == NULL) ? LOG_SITES_MIN : size * 2;
+    sites = g_new0(struct log_site, size);
+    if (sites == NULL)
+    {
+        return 1;
+    }
+    for (index = 0; index <= g_log_sites_mask && g_log_sites != NULL; index++)
+    {
+        site = g_log_sites + index;
+        if (site->function_name != NULL)
+        {
+            *log_sites_find(sites, size - 1, site->function_name,
+                            site->file_name) = *site;
+        }
+    }
+    g_free(g_log_sites);
+    g_log_sites = sites;
+    g_log_sites_mask = size - 1;
+    return 0;
+}
+
+/******************************************************************************/
+/* looks a call site up in the per logger levels, the slow way */
+static bool_t
+log_site_resolve(const char *function_name, const char *file_name,
+                 enum logLevels *log_level_return)
+{
+    struct log_logger_level *logger = NULL;
+    int i;
+
     for (i = 0; i < g_staticLogConfig->per_logger_level->count; i++)
     {
         logger = (struct log_logger_level *)list_get_item(g_staticLogConfig->per_logger_level, i);
@@ -640,9 +1139,61 @@ internal_log_location_overrides_level(const char *function_name,
             return 1;
         }
     }
+    return 0;
+}
 #endif
 
+/******************************************************************************/
+bool_t
+internal_log_location_overrides_level(const char *function_name,
+                                      const char *file_name,
+                                      enum logLevels *log_level_return)
+{
+#ifdef LOG_PER_LOGGER_LEVEL
+    struct log_site *site;
+    bool_t rv;
+
+    if (g_staticLogConfig == NULL
+            || g_staticLogConfig->per_logger_level->count == 0)
+    {
+        return 0;
+    }
+    if (function_name == NULL)
+    {
+        return log_site_resolve(function_name, file_name, log_level_return);
+    }
+    /* each call site is resolved once, after that it's a hash lookup */
+    pthread_mutex_lock(&g_log_sites_lock);
+    site = NULL;
+    if (g_log_sites != NULL)
+    {
+        site = log_sites_find(g_log_sites, g_log_sites_mask,
+                              function_name, file_name);
+    }
+    if (site == NULL || site->function_name == NULL)
+    {
+        rv = log_site_resolve(function_name, file_name, log_level_return);
+        if (log_sites_grow() == 0)
+        {
+            site = log_sites_find(g_log_sites, g_log_sites_mask,
+                                  function_name, file_name);
+            site->function_name = function_name;
+            site->file_name = file_name;
+            site->overrides = rv;
+            site->log_level = *log_level_return;
+            g_log_sites_count++;
+        }
+    }
+    else
+    {
+        rv = site->overrides;
+        *log_level_return = site->log_level;
+    }
+    pthread_mutex_unlock(&g_log_sites_lock);
+    return rv;
+#else
     return 0;
+#endif
 }
 
 /*
@@ -783,6 +1334,10 @@ log_restart_from_param(const struct log_config *lc)
 
         /* ... and the log levels */
         internal_log_config_copy_levels(g_staticLogConfig, lc);
+#ifdef LOG_PER_LOGGER_LEVEL
+        log_sites_clear();
+#endif
+        log_update_max_level();
         rv = LOG_STARTUP_OK;
     }
     return rv;
@@ -822,6 +1377,10 @@ log_start_from_param(const struct log_config *src_log_config)
             log_config_free(g_staticLogConfig);
             g_staticLogConfig = NULL;
         }
+#ifdef LOG_PER_LOGGER_LEVEL
+        log_sites_clear();
+#endif
+        log_update_max_level();
     }
 
     return ret;
@@ -884,6 +1443,10 @@ log_end(void)
     ret = internal_log_end(g_staticLogConfig);
     log_config_free(g_staticLogConfig);
     g_staticLogConfig = NULL;
+#ifdef LOG_PER_LOGGER_LEVEL
+    log_sites_clear();
+#endif
+    log_update_max_level();
 
     return ret;
 }
@@ -915,6 +1478,10 @@ log_hexdump_with_location(const char *function_name,
     enum logLevels override_log_level = LOG_LEVEL_NEVER;
     bool_t override_destination_level = 0;
 
+    if (log_level > g_log_max_level)
+    {
+        return LOG_STARTUP_OK;
+    }
     override_destination_level = internal_log_location_overrides_level(
         function_name,
         file_name,
@@ -982,6 +1549,10 @@ log_message_with_location(const char *function_name,
         return LOG_ERROR_NO_CFG;
     }
 
+    if (level > g_log_max_level)
+    {
+        return LOG_STARTUP_OK;
+    }
     override_destination_level = internal_log_location_overrides_level(
         function_name,
         file_name,
@@ -1006,6 +1577,10 @@ log_message(const enum logLevels lvl, const char *msg, ...)
     va_list ap;
     enum logReturns rv;
 
+    if (lvl > g_log_max_level)
+    {
+        return LOG_STARTUP_OK;
+    }
     va_start(ap, msg);
     rv = internal_log_message(lvl, 0, LOG_LEVEL_NEVER, msg, ap);
     va_end(ap);
@@ -1023,6 +1598,8 @@ internal_log_message(const enum logLevels lvl,
     int len = 0;
     enum logReturns rv = LOG_STARTUP_OK;
     int writereply = 0;
+    int to_syslog;
+    int to_file;
 
     if (g_staticLogConfig == NULL)
     {
@@ -1078,9 +1655,23 @@ internal_log_message(const enum logLevels lvl,
 #endif
 #endif
 
-    if (g_staticLogConfig->enable_syslog
-            && ((override_destination_level && lvl <= override_log_level)
-                || (!override_destination_level && lvl <= g_staticLogConfig->syslog_level)))
+    to_syslog = g_staticLogConfig->enable_syslog
+                && ((override_destination_level && lvl <= override_log_level)
+                    || (!override_destination_level && lvl <= g_staticLogConfig->syslog_level));
+    to_file = g_staticLogConfig->fd >= 0
+              && ((override_destination_level && lvl <= override_log_level)
+                  || (!override_destination_level && lvl <= g_staticLogConfig->log_level));
+
+    if ((to_syslog || to_file)
+            && log_async_put(buff, g_strlen(buff), to_file,
+                             to_syslog ? internal_log_xrdp2syslog(lvl) : -1))
+    {
+        /* the writer thread has it */
+        to_syslog = 0;
+        to_file = 0;
+    }
+
+    if (to_syslog)
     {
         /* log to syslog*/
         /* %s fix compiler warning 'not a string literal' */
@@ -1095,32 +1686,63 @@ internal_log_message(const enum logLevels lvl,
         g_printf("%s", buff);
     }
 
-    if ((override_destination_level && lvl <= override_log_level)
-            || (!override_destination_level && lvl <= g_staticLogConfig->log_level))
+    if (to_file)
     {
         /* log to application logfile */
-        if (g_staticLogConfig->fd >= 0)
-        {
 #ifdef LOG_ENABLE_THREAD
-            pthread_mutex_lock(&(g_staticLogConfig->log_lock));
+        pthread_mutex_lock(&(g_staticLogConfig->log_lock));
 #endif
 
-            writereply = g_file_write(g_staticLogConfig->fd, buff, g_strlen(buff));
+        writereply = g_file_write(g_staticLogConfig->fd, buff, g_strlen(buff));
 
-            if (writereply <= 0)
-            {
-                rv = LOG_ERROR_NULL_FILE;
-            }
+        if (writereply <= 0)
+        {
+            rv = LOG_ERROR_NULL_FILE;
+        }
 
 #ifdef LOG_ENABLE_THREAD
-            pthread_mutex_unlock(&(g_staticLogConfig->log_lock));
+        pthread_mutex_unlock(&(g_staticLogConfig->log_lock));
 #endif
-        }
     }
 
     return rv;
 }
 
+/******************************************************************************/
+void
+log_after_fork(void)
+{
+    log_async_restart();
+}
+
+/******************************************************************************/
+int
+log_is_async(void)
+{
+    struct log_async *la;
+
+    la = g_log_async;
+    return (la != NULL && la->pid == g_getpid());
+}
+
+/******************************************************************************/
+unsigned int
+log_get_async_dropped(void)
+{
+    struct log_async *la;
+    unsigned int rv;
+
+    la = g_log_async;
+    if (la == NULL)
+    {
+        return 0;
+    }
+    pthread_mutex_lock(&la->lock);
+    rv = la->dropped_total;
+    pthread_mutex_unlock(&la->lock);
+    return rv;
+}
+
 /**
  * Return the configured log file name
  * @return
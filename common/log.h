@@ -69,6 +69,11 @@ enum logReturns
 #define SESMAN_CFG_LOG_ENABLE_SYSLOG  "EnableSyslog"
 #define SESMAN_CFG_LOG_SYSLOG_LEVEL   "SyslogLevel"
 #define SESMAN_CFG_LOG_ENABLE_PID     "EnableProcessId"
+#define SESMAN_CFG_LOG_ENABLE_ASYNC   "EnableAsync"
+#define SESMAN_CFG_LOG_ASYNC_BUFFER   "AsyncBufferSize"
+
+/* default AsyncBufferSize, in KiB */
+#define LOG_ASYNC_BUFFER_KB_DEFAULT   1024
 
 /* enable threading */
 /*#define LOG_ENABLE_THREAD*/
@@ -208,6 +213,8 @@ struct log_config
 #endif
     int dump_on_start;
     int enable_pid;
+    int enable_async; /* file and syslog output from a writer thread */
+    int async_buffer_kb; /* memory for messages waiting to be written */
 #ifdef LOG_ENABLE_THREAD
     pthread_mutex_t log_lock;
     pthread_mutexattr_t log_lock_attr;
@@ -427,6 +434,30 @@ log_hexdump_with_location(const char *function_name,
                           const char *p,
                           int len);
 
+/**
+ * Starts asynchronous logging in a forked child that goes on logging.
+ *
+ * The writer thread is not copied by fork(), so until this is called a
+ * child writes its messages itself. Children that exec or exit soon
+ * after the fork need not call it.
+ */
+void
+log_after_fork(void);
+
+/**
+ * Returns non zero if this process hands its messages to the
+ * asynchronous writer thread
+ */
+int
+log_is_async(void);
+
+/**
+ * Returns how many messages have been dropped because the asynchronous
+ * log buffer was full, since logging started
+ */
+unsigned int
+log_get_async_dropped(void);
+
 /**
  * This function returns the configured file name for the logfile
  * @param replybuf the buffer where the reply is stored
@@ -66,6 +66,18 @@
 #define RNS_UD_COLOR_16BPP_565         0xCA03
 #define RNS_UD_COLOR_24BPP             0xCA04
 
+/* Client Core Data: earlyCapabilityFlags (2.2.1.3.2) */
+#define RNS_UD_CS_SUPPORT_ERRINFO_PDU          0x0001
+#define RNS_UD_CS_WANT_32BPP_SESSION           0x0002
+#define RNS_UD_CS_SUPPORT_STATUSINFO_PDU       0x0004
+#define RNS_UD_CS_STRONG_ASYMMETRIC_KEYS       0x0008
+#define RNS_UD_CS_VALID_CONNECTION_TYPE        0x0020
+#define RNS_UD_CS_SUPPORT_MONITOR_LAYOUT_PDU   0x0040
+#define RNS_UD_CS_SUPPORT_NETCHAR_AUTODETECT   0x0080
+#define RNS_UD_CS_SUPPORT_DYNVC_GFX_PROTOCOL   0x0100
+#define RNS_UD_CS_SUPPORT_DYNAMIC_TIME_ZONE    0x0200
+#define RNS_UD_CS_SUPPORT_HEARTBEAT_PDU        0x0400
+
 /* Client Core Data: connectionType  (2.2.1.3.2) */
 #define CONNECTION_TYPE_MODEM          0x01
 #define CONNECTION_TYPE_BROADBAND_LOW  0x02
@@ -194,10 +206,13 @@
 
 #define CAPSTYPE_BITMAPCACHE_HOSTSUPPORT        0x0012
 #define CAPSTYPE_BITMAPCACHE_HOSTSUPPORT_LEN    0x08
+#define TS_BITMAPCACHE_REV2                     0x01
 
 #define CAPSTYPE_BITMAPCACHE_REV2               0x0013
 #define CAPSTYPE_BITMAPCACHE_REV2_LEN           0x28
 #define BMPCACHE2_FLAG_PERSIST                  ((long)1<<31)
+#define PERSISTENT_KEYS_EXPECTED_FLAG           0x0001
+#define ALLOW_CACHE_WAITING_LIST_FLAG           0x0002
 
 #define CAPSTYPE_VIRTUALCHANNEL                 0x0014
 #define CAPSTYPE_VIRTUALCHANNEL_LEN             0x08
@@ -430,8 +445,13 @@
 #define PDUTYPE2_SHUTDOWN_DENIED       37
 #define RDP_DATA_PDU_LOGON             38
 #define RDP_DATA_PDU_FONT2             39
+#define PDUTYPE2_BITMAPCACHE_PERSISTENT_LIST 43
 #define RDP_DATA_PDU_DISCONNECT        47
 
+/* TS_BITMAPCACHE_PERSISTENT_LIST_PDU: bBitMask (2.2.1.17.1) */
+#define PERSIST_FIRST_PDU              0x01
+#define PERSIST_LAST_PDU               0x02
+
 /* TS_SECURITY_HEADER: flags (2.2.8.1.1.2.1) */
 /* TODO: to be renamed */
 #define SEC_CLIENT_RANDOM              0x0001 /* SEC_EXCHANGE_PKT? */
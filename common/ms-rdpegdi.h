@@ -56,4 +56,10 @@
 #define TS_CACHE_BRUSH                      0x07
 #define TS_CACHE_BITMAP_COMPRESSED_REV3     0x08
 
+/* Cache Bitmap - Revision 2: header.extraFlags (2.2.2.2.1.2.3) */
+#define CBR2_HEIGHT_SAME_AS_WIDTH           0x01
+#define CBR2_PERSISTENT_KEY_PRESENT         0x02
+#define CBR2_NO_BITMAP_COMPRESSION_HDR      0x08
+#define CBR2_DO_NOT_CACHE                   0x10
+
 #endif /* MS_RDPEGDI_H */
@@ -45,6 +45,7 @@
 #include <linux/vm_sockets.h>
 #endif
 #include <sys/un.h>
+#include <sys/uio.h>
 #include <sys/time.h>
 #include <sys/times.h>
 #include <sys/types.h>
@@ -93,6 +94,12 @@ extern char **environ;
 #include <linux/unistd.h>
 #endif
 
+#if defined(HAVE_SYS_EPOLL_H)
+#include <sys/epoll.h>
+#elif !defined(_WIN32)
+#include <poll.h>
+#endif
+
 /* sys/ucred.h needs to be included to use struct xucred
  * in FreeBSD and OS X. No need for other BSDs except GNU/kFreeBSD */
 #if defined(__FreeBSD__) || defined(__APPLE__) || defined(__FreeBSD_kernel__)
@@ -1428,6 +1435,37 @@ g_sck_send(int sck, const void *ptr, int len, int flags)
 #endif
 }
 
+/*****************************************************************************/
+int
+g_sck_send_vec(int sck, const void *const ptrs[], const int lens[], int count)
+{
+#if defined(_WIN32)
+    if (count < 1)
+    {
+        return 0;
+    }
+    return send(sck, (const char *)ptrs[0], lens[0], 0);
+#else
+    struct iovec iov[G_SCK_SEND_VEC_MAX];
+    struct msghdr msg;
+    int index;
+
+    if (count > G_SCK_SEND_VEC_MAX)
+    {
+        count = G_SCK_SEND_VEC_MAX;
+    }
+    for (index = 0; index < count; index++)
+    {
+        iov[index].iov_base = (void *)ptrs[index];
+        iov[index].iov_len = lens[index];
+    }
+    g_memset(&msg, 0, sizeof(msg));
+    msg.msg_iov = iov;
+    msg.msg_iovlen = count;
+    return sendmsg(sck, &msg, 0);
+#endif
+}
+
 /*****************************************************************************/
 /* returns boolean */
 int
@@ -1969,6 +2007,313 @@ g_obj_wait(tintptr *read_objs, int rcount, tintptr *write_objs, int wcount,
 #endif
 }
 
+/*****************************************************************************/
+struct g_wait_set
+{
+#if defined(HAVE_SYS_EPOLL_H)
+    int epfd;
+#else
+    struct pollfd *fds;
+    void **data;
+    int count;
+    int alloc;
+#endif
+};
+
+/* wait objects keep the read end of their pipe in the low 16 bits, see
+   g_create_wait_obj() */
+#define WAIT_SET_FD(_obj) ((int) ((_obj) & 0xffff))
+
+#if defined(HAVE_SYS_EPOLL_H)
+/*****************************************************************************/
+static int
+wait_set_epoll_ctl(struct g_wait_set *ws, int op, tintptr obj, int events,
+                   void *data)
+{
+    struct epoll_event ev;
+
+    g_memset(&ev, 0, sizeof(ev));
+    if (events & G_WAIT_READ)
+    {
+        ev.events |= EPOLLIN;
+    }
+    if (events & G_WAIT_WRITE)
+    {
+        ev.events |= EPOLLOUT;
+    }
+    ev.data.ptr = data;
+    if (epoll_ctl(ws->epfd, op, WAIT_SET_FD(obj), &ev) != 0)
+    {
+        LOG(LOG_LEVEL_ERROR, "wait_set_epoll_ctl: epoll_ctl failed for %d: %s",
+            WAIT_SET_FD(obj), g_get_strerror());
+        return 1;
+    }
+    return 0;
+}
+#elif !defined(_WIN32)
+/*****************************************************************************/
+static int
+wait_set_poll_find(struct g_wait_set *ws, tintptr obj)
+{
+    int index;
+
+    for (index = 0; index < ws->count; index++)
+    {
+        if (ws->fds[index].fd == WAIT_SET_FD(obj))
+        {
+            return index;
+        }
+    }
+    return -1;
+}
+
+/*****************************************************************************/
+static short
+wait_set_poll_events(int events)
+{
+    short rv;
+
+    rv = 0;
+    if (events & G_WAIT_READ)
+    {
+        rv |= POLLIN;
+    }
+    if (events & G_WAIT_WRITE)
+    {
+        rv |= POLLOUT;
+    }
+    return rv;
+}
+#endif
+
+/*****************************************************************************/
+struct g_wait_set *
+g_wait_set_create(void)
+{
+#if defined(_WIN32)
+    return NULL;
+#else
+    struct g_wait_set *ws;
+
+    ws = g_new0(struct g_wait_set, 1);
+    if (ws == NULL)
+    {
+        return NULL;
+    }
+#if defined(HAVE_SYS_EPOLL_H)
+    ws->epfd = epoll_create1(EPOLL_CLOEXEC);
+    if (ws->epfd < 0)
+    {
+        LOG(LOG_LEVEL_ERROR, "g_wait_set_create: epoll_create1 failed: %s",
+            g_get_strerror());
+        g_free(ws);
+        return NULL;
+    }
+#endif
+    return ws;
+#endif
+}
+
+/*****************************************************************************/
+void
+g_wait_set_delete(struct g_wait_set *ws)
+{
+    if (ws == NULL)
+    {
+        return;
+    }
+#if defined(HAVE_SYS_EPOLL_H)
+    close(ws->epfd);
+#elif !defined(_WIN32)
+    g_free(ws->fds);
+    g_free(ws->data);
+#endif
+    g_free(ws);
+}
+
+/*****************************************************************************/
+int
+g_wait_set_add(struct g_wait_set *ws, tintptr obj, int events, void *data)
+{
+#if defined(HAVE_SYS_EPOLL_H)
+    return wait_set_epoll_ctl(ws, EPOLL_CTL_ADD, obj, events, data);
+#elif !defined(_WIN32)
+    struct pollfd *fds;
+    void **fd_data;
+    int alloc;
+
+    if (wait_set_poll_find(ws, obj) >= 0)
+    {
+        return 1;
+    }
+    if (ws->count >= ws->alloc)
+    {
+        alloc = MAX(16, ws->alloc * 2);
+        fds = (struct pollfd *) realloc(ws->fds, sizeof(*fds) * alloc);
+        if (fds == NULL)
+        {
+            return 1;
+        }
+        ws->fds = fds;
+        fd_data = (void **) realloc(ws->data, sizeof(*fd_data) * alloc);
+        if (fd_data == NULL)
+        {
+            return 1;
+        }
+        ws->data = fd_data;
+        ws->alloc = alloc;
+    }
+    ws->fds[ws->count].fd = WAIT_SET_FD(obj);
+    ws->fds[ws->count].events = wait_set_poll_events(events);
+    ws->fds[ws->count].revents = 0;
+    ws->data[ws->count] = data;
+    ws->count++;
+    return 0;
+#else
+    return 1;
+#endif
+}
+
+/*****************************************************************************/
+int
+g_wait_set_modify(struct g_wait_set *ws, tintptr obj, int events,
+                  void *data)
+{
+#if defined(HAVE_SYS_EPOLL_H)
+    return wait_set_epoll_ctl(ws, EPOLL_CTL_MOD, obj, events, data);
+#elif !defined(_WIN32)
+    int index;
+
+    index = wait_set_poll_find(ws, obj);
+    if (index < 0)
+    {
+        return 1;
+    }
+    ws->fds[index].events = wait_set_poll_events(events);
+    ws->data[index] = data;
+    return 0;
+#else
+    return 1;
+#endif
+}
+
+/*****************************************************************************/
+int
+g_wait_set_remove(struct g_wait_set *ws, tintptr obj)
+{
+#if defined(HAVE_SYS_EPOLL_H)
+    return wait_set_epoll_ctl(ws, EPOLL_CTL_DEL, obj, 0, NULL);
+#elif !defined(_WIN32)
+    int index;
+
+    index = wait_set_poll_find(ws, obj);
+    if (index < 0)
+    {
+        return 1;
+    }
+    ws->count--;
+    ws->fds[index] = ws->fds[ws->count];
+    ws->data[index] = ws->data[ws->count];
+    return 0;
+#else
+    return 1;
+#endif
+}
+
+/*****************************************************************************/
+int
+g_wait_set_wait(struct g_wait_set *ws, struct g_wait_set_event *events,
+                int max, int mstimeout)
+{
+#if defined(HAVE_SYS_EPOLL_H)
+    struct epoll_event evs[64];
+    int count;
+    int index;
+
+    count = epoll_wait(ws->epfd, evs, MIN(max, 64),
+                       mstimeout < 0 ? -1 : mstimeout);
+    if (count < 0)
+    {
+        return (errno == EINTR) ? 0 : -1;
+    }
+    for (index = 0; index < count; index++)
+    {
+        events[index].data = evs[index].data.ptr;
+        events[index].events = 0;
+        /* errors and hangups show up as readable so the reader sees them */
+        if (evs[index].events & (EPOLLIN | EPOLLHUP | EPOLLERR))
+        {
+            events[index].events |= G_WAIT_READ;
+        }
+        if (evs[index].events & EPOLLOUT)
+        {
+            events[index].events |= G_WAIT_WRITE;
+        }
+    }
+    return count;
+#elif !defined(_WIN32)
+    int rv;
+    int count;
+    int index;
+    short revents;
+
+    rv = poll(ws->fds, ws->count, mstimeout < 0 ? -1 : mstimeout);
+    if (rv < 0)
+    {
+        return (errno == EINTR) ? 0 : -1;
+    }
+    count = 0;
+    for (index = 0; (index < ws->count) && (count < max) && (rv > 0); index++)
+    {
+        revents = ws->fds[index].revents;
+        if (revents == 0)
+        {
+            continue;
+        }
+        rv--;
+        events[count].data = ws->data[index];
+        events[count].events = 0;
+        if (revents & (POLLIN | POLLHUP | POLLERR | POLLNVAL))
+        {
+            events[count].events |= G_WAIT_READ;
+        }
+        if (revents & POLLOUT)
+        {
+            events[count].events |= G_WAIT_WRITE;
+        }
+        count++;
+    }
+    return count;
+#else
+    return -1;
+#endif
+}
+
+/*****************************************************************************/
+tintptr
+g_wait_set_get_obj(struct g_wait_set *ws)
+{
+#if defined(HAVE_SYS_EPOLL_H)
+    /* an epoll fd polls readable while it has events */
+    return ws->epfd;
+#else
+    return -1;
+#endif
+}
+
+/*****************************************************************************/
+const char *
+g_wait_set_get_name(struct g_wait_set *ws)
+{
+#if defined(HAVE_SYS_EPOLL_H)
+    return "epoll";
+#elif !defined(_WIN32)
+    return "poll";
+#else
+    return "none";
+#endif
+}
+
 /*****************************************************************************/
 void
 g_random(char *data, int len)
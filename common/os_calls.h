@@ -46,6 +46,9 @@ struct exit_status
 #define g_tcp_select g_sck_select
 #define g_close_wait_obj g_delete_wait_obj
 
+/* most buffers g_sck_send_vec() sends in one call */
+#define G_SCK_SEND_VEC_MAX 16
+
 int      g_rm_temp_dir(void);
 int      g_mk_socket_path(const char *app_name);
 void     g_init(const char *app_name);
@@ -88,6 +91,17 @@ int      g_sck_listen(int sck);
 int      g_sck_accept(int sck);
 int      g_sck_recv(int sck, void *ptr, int len, int flags);
 int      g_sck_send(int sck, const void *ptr, int len, int flags);
+/**
+ * Sends several buffers with one call, like writev()
+ *
+ * @param sck Socket
+ * @param ptrs Buffers, in order
+ * @param lens Length of each buffer
+ * @param count Number of buffers, at most G_SCK_SEND_VEC_MAX are used
+ * @return Bytes sent, which can be fewer than asked for, or -1
+ */
+int      g_sck_send_vec(int sck, const void *const ptrs[], const int lens[],
+                        int count);
 int      g_sck_last_error_would_block(int sck);
 int      g_sck_socket_ok(int sck);
 int      g_sck_can_send(int sck, int millis);
@@ -133,6 +147,84 @@ int      g_is_wait_obj_set(tintptr obj);
 int      g_delete_wait_obj(tintptr obj);
 int      g_obj_wait(tintptr *read_objs, int rcount, tintptr *write_objs,
                     int wcount, int mstimeout);
+
+/* events for a wait set */
+#define G_WAIT_READ 1
+#define G_WAIT_WRITE 2
+
+/**
+ * A persistent set of wait objects and sockets
+ *
+ * Unlike g_obj_wait(), objects are added once rather than passed in on
+ * every wait, so a wait costs the same however many there are. This uses
+ * epoll where there is one, otherwise poll().
+ */
+struct g_wait_set;
+
+/** One ready object, as returned by g_wait_set_wait() */
+struct g_wait_set_event
+{
+    void *data; /* as passed to g_wait_set_add() */
+    int events; /* G_WAIT_READ and/or G_WAIT_WRITE */
+};
+
+/**
+ * Creates an empty wait set
+ * @return New set, or NULL on error
+ */
+struct g_wait_set *
+g_wait_set_create(void);
+void
+g_wait_set_delete(struct g_wait_set *ws);
+/**
+ * Adds a wait object or socket to a set
+ *
+ * @param ws Wait set
+ * @param obj Object from g_create_wait_obj(), or a socket
+ * @param events G_WAIT_READ and/or G_WAIT_WRITE, can be 0
+ * @param data Returned with events for obj
+ * @return 0 for success
+ */
+int
+g_wait_set_add(struct g_wait_set *ws, tintptr obj, int events, void *data);
+/**
+ * Changes the events and data for an object already in a set
+ */
+int
+g_wait_set_modify(struct g_wait_set *ws, tintptr obj, int events,
+                  void *data);
+/**
+ * Removes an object from a set. This must be done before it is closed.
+ */
+int
+g_wait_set_remove(struct g_wait_set *ws, tintptr obj);
+/**
+ * Waits for objects in a set to be ready
+ *
+ * @param ws Wait set
+ * @param events Array for the ready objects
+ * @param max Size of events
+ * @param mstimeout Time to wait in milliseconds, 0 doesn't wait, < 0
+ *                  waits forever
+ * @return Number of ready objects, 0 on timeout or signal, -1 on error
+ */
+int
+g_wait_set_wait(struct g_wait_set *ws, struct g_wait_set_event *events,
+                int max, int mstimeout);
+/**
+ * Wait object that is readable while anything in a set is ready, so a
+ * set can be waited on with g_obj_wait() alongside other objects
+ *
+ * @return the object, or -1 if the implementation has none, in which
+ *         case the caller has to wait on the members itself
+ */
+tintptr
+g_wait_set_get_obj(struct g_wait_set *ws);
+/**
+ * Name of the implementation a set uses, for logging
+ */
+const char *
+g_wait_set_get_name(struct g_wait_set *ws);
 void     g_random(char *data, int len);
 int      g_abs(int i);
 int      g_memcmp(const void *s1, const void *s2, int len);
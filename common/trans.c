@@ -32,6 +32,9 @@
 
 #define MAX_SBYTES 0
 
+/** Queued streams smaller than this are sent as one TLS record */
+#define TLS_BATCH_BYTES (16 * 1024)
+
 /** Time between polls of is_term when connecting */
 #define CONNECT_TERM_POLL_MS 3000
 /** Time we wait before another connect() attempt if one fails immediately */
@@ -121,6 +124,8 @@ trans_create(int mode, int in_size, int out_size)
 void
 trans_delete(struct trans *self)
 {
+    struct stream *temp_s;
+
     if (self == 0)
     {
         return;
@@ -135,6 +140,13 @@ trans_delete(struct trans *self)
     free_stream(self->in_s);
     free_stream(self->out_s);
 
+    while (self->wait_s != 0)
+    {
+        temp_s = self->wait_s;
+        self->wait_s = temp_s->next;
+        free_stream(temp_s);
+    }
+
     if (self->sck >= 0)
     {
         g_tcp_close(self->sck);
@@ -235,11 +247,120 @@ trans_get_wait_objs_rw(struct trans *self, tbus *robjs, int *rcount,
 }
 
 /*****************************************************************************/
-int
-trans_send_waiting(struct trans *self, int block)
+/* adds s, from p to end, to the send queue */
+static void
+trans_queue_add(struct trans *self, struct stream *s)
+{
+    int bytes;
+
+    bytes = (int) (s->end - s->p);
+    s->next = 0;
+    s->source = 0;
+    if (self->si != 0)
+    {
+        if ((self->si->cur_source != XRDP_SOURCE_NONE) &&
+                (self->si->cur_source != self->my_source))
+        {
+            self->si->source[self->si->cur_source] += bytes;
+            s->source = self->si->source + self->si->cur_source;
+        }
+    }
+    if (self->wait_tail == 0)
+    {
+        self->wait_s = s;
+    }
+    else
+    {
+        self->wait_tail->next = s;
+    }
+    self->wait_tail = s;
+    self->wait_count++;
+    self->wait_bytes += bytes;
+    self->wait_bytes_max = MAX(self->wait_bytes_max, self->wait_bytes);
+}
+
+/*****************************************************************************/
+/* drops sent bytes from the front of the send queue */
+static void
+trans_queue_remove(struct trans *self, int sent)
 {
     struct stream *temp_s;
     int bytes;
+
+    while ((sent > 0) && (self->wait_s != 0))
+    {
+        temp_s = self->wait_s;
+        bytes = MIN(sent, (int) (temp_s->end - temp_s->p));
+        temp_s->p += bytes;
+        if (temp_s->source != 0)
+        {
+            temp_s->source[0] -= bytes;
+        }
+        self->wait_bytes -= bytes;
+        sent -= bytes;
+        if (temp_s->p >= temp_s->end)
+        {
+            self->wait_s = temp_s->next;
+            if (self->wait_s == 0)
+            {
+                self->wait_tail = 0;
+            }
+            self->wait_count--;
+            free_stream(temp_s);
+        }
+    }
+}
+
+/*****************************************************************************/
+/* sends as much of the send queue as one call takes, returns like
+   trans_send */
+static int
+trans_queue_send(struct trans *self)
+{
+    struct stream *temp_s;
+    const void *ptrs[G_SCK_SEND_VEC_MAX];
+    int lens[G_SCK_SEND_VEC_MAX];
+    char batch[TLS_BATCH_BYTES];
+    int count;
+    int bytes;
+
+    temp_s = self->wait_s;
+    if (self->trans_send == trans_tcp_send)
+    {
+        /* one writev for the front of the queue */
+        count = 0;
+        while ((temp_s != 0) && (count < G_SCK_SEND_VEC_MAX))
+        {
+            ptrs[count] = temp_s->p;
+            lens[count] = (int) (temp_s->end - temp_s->p);
+            count++;
+            temp_s = temp_s->next;
+        }
+        return g_sck_send_vec(self->sck, ptrs, lens, count);
+    }
+    bytes = (int) (temp_s->end - temp_s->p);
+    if ((self->trans_send != trans_tls_send) || (temp_s->next == 0) ||
+            (bytes + (int) (temp_s->next->end - temp_s->next->p) >
+             TLS_BATCH_BYTES))
+    {
+        return self->trans_send(self, temp_s->p, bytes);
+    }
+    /* tls, gather small streams so they go in one record */
+    bytes = 0;
+    while ((temp_s != 0) &&
+            (bytes + (int) (temp_s->end - temp_s->p) <= TLS_BATCH_BYTES))
+    {
+        g_memcpy(batch + bytes, temp_s->p, temp_s->end - temp_s->p);
+        bytes += (int) (temp_s->end - temp_s->p);
+        temp_s = temp_s->next;
+    }
+    return self->trans_send(self, batch, bytes);
+}
+
+/*****************************************************************************/
+int
+trans_send_waiting(struct trans *self, int block)
+{
     int sent;
     int timeout;
     int cont;
@@ -250,23 +371,12 @@ trans_send_waiting(struct trans *self, int block)
     {
         if (self->wait_s != 0)
         {
-            temp_s = self->wait_s;
             if (g_tcp_can_send(self->sck, timeout))
             {
-                bytes = (int) (temp_s->end - temp_s->p);
-                sent = self->trans_send(self, temp_s->p, bytes);
+                sent = trans_queue_send(self);
                 if (sent > 0)
                 {
-                    temp_s->p += sent;
-                    if (temp_s->source != 0)
-                    {
-                        temp_s->source[0] -= sent;
-                    }
-                    if (temp_s->p >= temp_s->end)
-                    {
-                        self->wait_s = temp_s->next;
-                        free_stream(temp_s);
-                    }
+                    trans_queue_remove(self, sent);
                 }
                 else if (sent == 0)
                 {
@@ -592,15 +702,15 @@ trans_force_write(struct trans *self)
 }
 
 /*****************************************************************************/
-int
-trans_write_copy_s(struct trans *self, struct stream *out_s)
+/* sends what it can of out_s without blocking, *sent is set to how much
+   went, returns error */
+static int
+trans_write_now(struct trans *self, struct stream *out_s, int *sent)
 {
     int size;
-    int sent;
-    struct stream *wait_s;
-    struct stream *temp_s;
-    char *out_data;
+    int rv;
 
+    *sent = 0;
     if (self->status != TRANS_STATUS_UP)
     {
         return 1;
@@ -612,21 +722,18 @@ trans_write_copy_s(struct trans *self, struct stream *out_s)
         self->status = TRANS_STATUS_DOWN;
         return 1;
     }
-    out_data = out_s->data;
-    sent = 0;
     size = (int) (out_s->end - out_s->data);
-    if (self->wait_s == 0)
+    if ((self->wait_s == 0) && (size > 0))
     {
         /* if no left over, try to send this new data */
         if (g_tcp_can_send(self->sck, 0))
         {
-            sent = self->trans_send(self, out_s->data, size);
-            if (sent > 0)
+            rv = self->trans_send(self, out_s->data, size);
+            if (rv > 0)
             {
-                out_data += sent;
-                size -= sent;
+                *sent = rv;
             }
-            else if (sent == 0)
+            else if (rv == 0)
             {
                 return 1;
             }
@@ -639,37 +746,63 @@ trans_write_copy_s(struct trans *self, struct stream *out_s)
             }
         }
     }
-    if (size < 1)
-    {
-        return 0;
-    }
-    /* did not send right away, have to copy */
+    return 0;
+}
+
+/*****************************************************************************/
+/* queues a copy of out_s from offset on */
+static void
+trans_queue_copy(struct trans *self, struct stream *out_s, int offset)
+{
+    struct stream *wait_s;
+    int size;
+
+    size = (int) (out_s->end - out_s->data) - offset;
     make_stream(wait_s);
     init_stream(wait_s, size);
-    if (self->si != 0)
-    {
-        if ((self->si->cur_source != XRDP_SOURCE_NONE) &&
-                (self->si->cur_source != self->my_source))
-        {
-            self->si->source[self->si->cur_source] += size;
-            wait_s->source = self->si->source + self->si->cur_source;
-        }
-    }
-    out_uint8a(wait_s, out_data, size);
+    out_uint8a(wait_s, out_s->data + offset, size);
     s_mark_end(wait_s);
     wait_s->p = wait_s->data;
-    if (self->wait_s == 0)
+    trans_queue_add(self, wait_s);
+}
+
+/*****************************************************************************/
+int
+trans_write_copy_s(struct trans *self, struct stream *out_s)
+{
+    int sent;
+
+    if (trans_write_now(self, out_s, &sent) != 0)
+    {
+        return 1;
+    }
+    if (out_s->data + sent < out_s->end)
+    {
+        /* did not send right away, have to copy */
+        trans_queue_copy(self, out_s, sent);
+    }
+    return 0;
+}
+
+/*****************************************************************************/
+int
+trans_write_take_s(struct trans *self, struct stream *out_s)
+{
+    int sent;
+
+    if (trans_write_now(self, out_s, &sent) != 0)
     {
-        self->wait_s = wait_s;
+        free_stream(out_s);
+        return 1;
+    }
+    if (out_s->data + sent < out_s->end)
+    {
+        out_s->p = out_s->data + sent;
+        trans_queue_add(self, out_s);
     }
     else
     {
-        temp_s = self->wait_s;
-        while (temp_s->next != 0)
-        {
-            temp_s = temp_s->next;
-        }
-        temp_s->next = wait_s;
+        free_stream(out_s);
     }
     return 0;
 }
@@ -678,7 +811,38 @@ trans_write_copy_s(struct trans *self, struct stream *out_s)
 int
 trans_write_copy(struct trans *self)
 {
-    return trans_write_copy_s(self, self->out_s);
+    struct stream *out_s;
+    int sent;
+
+    out_s = self->out_s;
+    if (trans_write_now(self, out_s, &sent) != 0)
+    {
+        return 1;
+    }
+    if (out_s->data + sent >= out_s->end)
+    {
+        return 0;
+    }
+    if ((int) (out_s->end - out_s->data) - sent < out_s->size / 2)
+    {
+        /* only a little left, not worth keeping the whole buffer */
+        trans_queue_copy(self, out_s, sent);
+        return 0;
+    }
+    /* queue out_s as it is and give the transport a new one */
+    out_s->p = out_s->data + sent;
+    trans_queue_add(self, out_s);
+    make_stream(self->out_s);
+    init_stream(self->out_s, out_s->size);
+    return 0;
+}
+
+/*****************************************************************************/
+/* returns the number of bytes queued in wait_s and not yet sent */
+int
+trans_get_wait_bytes(struct trans *self)
+{
+    return self->wait_bytes;
 }
 
 /*****************************************************************************/
@@ -103,7 +103,11 @@ struct trans
     struct stream *out_s;
     char *listen_filename;
     tis_term is_term; /* used to test for exit */
-    struct stream *wait_s;
+    struct stream *wait_s; /* output not sent yet, oldest first */
+    struct stream *wait_tail; /* last stream in wait_s */
+    int wait_count; /* streams in wait_s */
+    int wait_bytes; /* bytes in wait_s */
+    int wait_bytes_max; /* most bytes ever in wait_s */
     int no_stream_init_on_data_in;
     int extra_flags; /* user defined */
     void *extra_data; /* user defined */
@@ -133,6 +137,15 @@ trans_get_wait_objs_rw(struct trans *self,
                        tbus *wobjs, int *wcount, int *timeout);
 int
 trans_check_wait_objs(struct trans *self);
+/**
+ * Sends what is queued in wait_s
+ *
+ * @param self Transport
+ * @param block If set, wait until the queue is empty
+ * @return 0 for success
+ */
+int
+trans_send_waiting(struct trans *self, int block);
 int
 trans_force_read_s(struct trans *self, struct stream *in_s, int size);
 int
@@ -145,6 +158,25 @@ int
 trans_write_copy(struct trans *self);
 int
 trans_write_copy_s(struct trans *self, struct stream *out_s);
+/**
+ * Sends a stream the caller gives up
+ *
+ * Like trans_write_copy_s(), but if out_s cannot all be sent right away
+ * it is queued as it is rather than copied. out_s must have been made
+ * with make_stream() and the caller must not touch it afterwards, even
+ * on error.
+ *
+ * @param self Transport
+ * @param out_s Stream to send, from data to end
+ * @return 0 for success
+ */
+int
+trans_write_take_s(struct trans *self, struct stream *out_s);
+/**
+ * Returns the number of bytes queued and not yet sent
+ */
+int
+trans_get_wait_bytes(struct trans *self);
 /**
  * Connect the transport to the specified destination
  *
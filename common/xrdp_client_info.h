@@ -213,6 +213,12 @@ struct xrdp_client_info
      * data */
     unsigned int session_physical_width; /* in mm */
     unsigned int session_physical_height; /* in mm */
+
+    /* number of threads used to encode each frame in codec mode */
+    int encoder_threads;
+
+    /* offer the client persistent bitmap caching */
+    int use_bitmap_cache_persist;
 };
 
 /* yyyymmdd of last incompatible change to xrdp_client_info */
@@ -1204,22 +1204,24 @@ libxrdp_reset(struct xrdp_session *session,
 int EXPORT_CC
 libxrdp_orders_send_raw_bitmap2(struct xrdp_session *session,
                                 int width, int height, int bpp, char *data,
-                                int cache_id, int cache_idx)
+                                int cache_id, int cache_idx,
+                                int key1, int key2)
 {
     return xrdp_orders_send_raw_bitmap2((struct xrdp_orders *)session->orders,
                                         width, height, bpp, data,
-                                        cache_id, cache_idx);
+                                        cache_id, cache_idx, key1, key2);
 }
 
 /*****************************************************************************/
 int EXPORT_CC
 libxrdp_orders_send_bitmap2(struct xrdp_session *session,
                             int width, int height, int bpp, char *data,
-                            int cache_id, int cache_idx, int hints)
+                            int cache_id, int cache_idx, int hints,
+                            int key1, int key2)
 {
     return xrdp_orders_send_bitmap2((struct xrdp_orders *)session->orders,
                                     width, height, bpp, data,
-                                    cache_id, cache_idx, hints);
+                                    cache_id, cache_idx, hints, key1, key2);
 }
 
 /*****************************************************************************/
@@ -1233,6 +1235,24 @@ libxrdp_orders_send_bitmap3(struct xrdp_session *session,
                                     cache_id, cache_idx, hints);
 }
 
+/*****************************************************************************/
+int EXPORT_CC
+libxrdp_get_persistent_keys(struct xrdp_session *session, int cache_id,
+                            const unsigned int **keys)
+{
+    struct xrdp_rdp *rdp;
+
+    rdp = (struct xrdp_rdp *) (session->rdp);
+    if ((cache_id < 0) || (cache_id >= XRDP_MAX_BITMAP_CACHE_ID) ||
+            (rdp->persist_keys[cache_id] == NULL))
+    {
+        *keys = NULL;
+        return 0;
+    }
+    *keys = rdp->persist_keys[cache_id];
+    return rdp->persist_key_count[cache_id];
+}
+
 /*****************************************************************************/
 int EXPORT_CC
 libxrdp_get_channel_count(const struct xrdp_session *session)
@@ -1620,6 +1640,51 @@ libxrdp_codec_jpeg_compress(struct xrdp_session *session,
                                     cx, cy, quality, out_data, io_len);
 }
 
+/*****************************************************************************/
+/* a jpeg handle is not thread safe, this creates one for a thread other
+   than the session's own */
+void *EXPORT_CC
+libxrdp_codec_jpeg_init(void)
+{
+    return xrdp_jpeg_init();
+}
+
+/*****************************************************************************/
+int EXPORT_CC
+libxrdp_codec_jpeg_deinit(void *jpeg_han)
+{
+    return xrdp_jpeg_deinit(jpeg_han);
+}
+
+/*****************************************************************************/
+/* same as libxrdp_codec_jpeg_compress but uses a handle from
+   libxrdp_codec_jpeg_init */
+int EXPORT_CC
+libxrdp_codec_jpeg_compress_han(void *jpeg_han,
+                                int format, char *inp_data,
+                                int width, int height,
+                                int stride, int x, int y,
+                                int cx, int cy, int quality,
+                                char *out_data, int *io_len)
+{
+    return xrdp_codec_jpeg_compress(jpeg_han, format, inp_data,
+                                    width, height, stride, x, y,
+                                    cx, cy, quality, out_data, io_len);
+}
+
+/*****************************************************************************/
+/* NSCodec is stateless so this can be called from any thread */
+int EXPORT_CC
+libxrdp_codec_nscodec_encode(const char *inp_data, int stride,
+                             int x, int y, int cx, int cy,
+                             int color_loss_level, int subsampling,
+                             char *out_data, int *io_len)
+{
+    return xrdp_nscodec_encode(inp_data, stride, x, y, cx, cy,
+                               color_loss_level, subsampling,
+                               out_data, io_len);
+}
+
 /*****************************************************************************/
 int EXPORT_CC
 libxrdp_fastpath_send_surface(struct xrdp_session *session,
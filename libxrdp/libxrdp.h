@@ -168,6 +168,11 @@ struct xrdp_rdp
     struct xrdp_client_info client_info;
     struct xrdp_mppc_enc *mppc_enc;
     void *rfx_enc;
+    /* from [MS-RDPBCGR] TS_BITMAPCACHE_PERSISTENT_LIST_PDU, key1 and key2
+       of each entry by cache index, for each cache */
+    unsigned int *persist_keys[XRDP_MAX_BITMAP_CACHE_ID];
+    int persist_key_count[XRDP_MAX_BITMAP_CACHE_ID];
+    int persist_key_total[XRDP_MAX_BITMAP_CACHE_ID];
 };
 
 /* state */
@@ -432,6 +437,8 @@ xrdp_rdp_incoming(struct xrdp_rdp *self);
 int
 xrdp_rdp_process_data(struct xrdp_rdp *self, struct stream *s);
 int
+xrdp_rdp_process_persistent_list(struct xrdp_rdp *self, struct stream *s);
+int
 xrdp_rdp_disconnect(struct xrdp_rdp *self);
 int
 xrdp_rdp_send_deactivate(struct xrdp_rdp *self);
@@ -519,11 +526,13 @@ xrdp_orders_send_font(struct xrdp_orders *self,
 int
 xrdp_orders_send_raw_bitmap2(struct xrdp_orders *self,
                              int width, int height, int bpp, char *data,
-                             int cache_id, int cache_idx);
+                             int cache_id, int cache_idx,
+                             int key1, int key2);
 int
 xrdp_orders_send_bitmap2(struct xrdp_orders *self,
                          int width, int height, int bpp, char *data,
-                         int cache_id, int cache_idx, int hints);
+                         int cache_id, int cache_idx, int hints,
+                         int key1, int key2);
 int
 xrdp_orders_send_bitmap3(struct xrdp_orders *self,
                          int width, int height, int bpp, char *data,
@@ -577,6 +586,15 @@ xrdp_jpeg_init(void);
 int
 xrdp_jpeg_deinit(void *handle);
 
+/* xrdp_nscodec.c */
+int
+xrdp_nscodec_rle_encode(const unsigned char *in, int in_bytes,
+                        unsigned char *out, int out_bytes);
+int
+xrdp_nscodec_encode(const char *inp_data, int stride, int x, int y,
+                    int cx, int cy, int color_loss_level, int subsampling,
+                    char *out_data, int *io_len);
+
 /* xrdp_channel.c */
 struct xrdp_channel *
 xrdp_channel_create(struct xrdp_sec *owner, struct xrdp_mcs *mcs_layer);
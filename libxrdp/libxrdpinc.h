@@ -199,15 +199,31 @@ libxrdp_reset(struct xrdp_session *session,
 int
 libxrdp_orders_send_raw_bitmap2(struct xrdp_session *session,
                                 int width, int height, int bpp, char *data,
-                                int cache_id, int cache_idx);
+                                int cache_id, int cache_idx,
+                                int key1, int key2);
 int
 libxrdp_orders_send_bitmap2(struct xrdp_session *session,
                             int width, int height, int bpp, char *data,
-                            int cache_id, int cache_idx, int hints);
+                            int cache_id, int cache_idx, int hints,
+                            int key1, int key2);
 int
 libxrdp_orders_send_bitmap3(struct xrdp_session *session,
                             int width, int height, int bpp, char *data,
                             int cache_id, int cache_idx, int hints);
+/**
+ * Returns the persistent bitmap cache keys the client sent for a cache
+ *
+ * The client has already loaded the bitmaps for these keys into the
+ * first entries of the cache.
+ *
+ * @param session Session
+ * @param cache_id Bitmap cache, 0 to XRDP_MAX_BITMAP_CACHE_ID - 1
+ * @param[out] keys key1 and key2 of each entry, in cache index order
+ * @return Number of entries, or 0 if there are none
+ */
+int
+libxrdp_get_persistent_keys(struct xrdp_session *session, int cache_id,
+                            const unsigned int **keys);
 /**
  * Returns the number of channels in the session
  *
@@ -295,6 +311,22 @@ libxrdp_codec_jpeg_compress(struct xrdp_session *session,
                             int stride, int x, int y,
                             int cx, int cy, int quality,
                             char *out_data, int *io_len);
+void *
+libxrdp_codec_jpeg_init(void);
+int
+libxrdp_codec_jpeg_deinit(void *jpeg_han);
+int
+libxrdp_codec_jpeg_compress_han(void *jpeg_han,
+                                int format, char *inp_data,
+                                int width, int height,
+                                int stride, int x, int y,
+                                int cx, int cy, int quality,
+                                char *out_data, int *io_len);
+int
+libxrdp_codec_nscodec_encode(const char *inp_data, int stride,
+                             int x, int y, int cx, int cy,
+                             int color_loss_level, int subsampling,
+                             char *out_data, int *io_len);
 int
 libxrdp_fastpath_send_surface(struct xrdp_session *session,
                               char *data_pad, int pad_bytes,
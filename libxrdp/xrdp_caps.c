@@ -280,12 +280,15 @@ xrdp_caps_process_bmpcache2(struct xrdp_rdp *self, struct stream *s,
     in_uint16_le(s, i); /* cache flags */
     self->client_info.bitmap_cache_persist_enable = i;
     in_uint8s(s, 2); /* number of caches in set, 3 */
+    /* the top bit of each entry count is the persistent flag */
     in_uint32_le(s, i);
+    i = i & 0x7fffffff;
     i = MIN(i, XRDP_MAX_BITMAP_CACHE_IDX);
     i = MAX(i, 0);
     self->client_info.cache1_entries = i;
     self->client_info.cache1_size = 256 * Bpp;
     in_uint32_le(s, i);
+    i = i & 0x7fffffff;
     i = MIN(i, XRDP_MAX_BITMAP_CACHE_IDX);
     i = MAX(i, 0);
     self->client_info.cache2_entries = i;
@@ -1135,6 +1138,22 @@ xrdp_caps_send_demand_active(struct xrdp_rdp *self)
     codec_caps_size_ptr[1] = codec_caps_size >> 8;
     codec_caps_count_ptr[0] = codec_caps_count;
 
+    if (self->client_info.use_bitmap_cache &&
+            self->client_info.use_bitmap_cache_persist)
+    {
+        /* Output bitmap cache host support capability set, without this
+           the client does not send its persistent key list */
+        caps_count++;
+        out_uint16_le(s, CAPSTYPE_BITMAPCACHE_HOSTSUPPORT);
+        out_uint16_le(s, CAPSTYPE_BITMAPCACHE_HOSTSUPPORT_LEN);
+        out_uint8(s, TS_BITMAPCACHE_REV2); /* cacheVersion */
+        out_uint8(s, 0); /* pad1 */
+        out_uint16_le(s, 0); /* pad2 */
+        LOG_DEVEL(LOG_LEVEL_TRACE, "xrdp_caps_send_demand_active: Server Capability "
+                  "CAPSTYPE_BITMAPCACHE_HOSTSUPPORT: "
+                  "cacheVersion = TS_BITMAPCACHE_REV2");
+    }
+
     /* Output color cache capability set */
     caps_count++;
     out_uint16_le(s, CAPSTYPE_COLORCACHE);
@@ -841,7 +841,8 @@ xrdp_channel_drdynvc_open(struct xrdp_channel *self, const char *name,
     cbChId = drdynvc_insert_uint_124(s, ChId); /* ChannelId */
     name_length = g_strlen(name);
     out_uint8a(s, name, name_length + 1); /* ChannelName */
-    chan_pri = 0;
+    /* WTS_CHANNEL_OPTION_DYNAMIC_PRI_* are the priority shifted left 1 */
+    chan_pri = (flags >> 1) & 3;
     /* cbId (low 2 bits), Pri (2 bits), Cmd (hi 4 bits) */
     cmd_ptr[0] = CMD_DVC_OPEN_CHANNEL | ((chan_pri << 2) & 0x0c) | cbChId;
     static_channel_id = self->drdynvc_channel_id;
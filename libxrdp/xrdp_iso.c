@@ -424,12 +424,14 @@ xrdp_iso_send_cc(struct xrdp_iso *self)
             /* [MS-RDPBCGR] RDP_NEG_RSP */
             out_uint8(s, RDP_NEG_RSP);                    /* type*/
             //TODO: hardcoded flags
-            out_uint8(s, EXTENDED_CLIENT_DATA_SUPPORTED); /* flags */
+            out_uint8(s, EXTENDED_CLIENT_DATA_SUPPORTED |
+                      DYNVC_GFX_PROTOCOL_SUPPORTED); /* flags */
             out_uint16_le(s, 8);                          /* length (must be 8) */
             out_uint32_le(s, self->selectedProtocol);     /* selectedProtocol */
             LOG_DEVEL(LOG_LEVEL_TRACE, "Adding structure [MS-RDPBCGR] RDP_NEG_RSP "
                       "flags 0x%02x, length 8, selectedProtocol 0x%8.8x",
-                      EXTENDED_CLIENT_DATA_SUPPORTED,
+                      EXTENDED_CLIENT_DATA_SUPPORTED |
+                      DYNVC_GFX_PROTOCOL_SUPPORTED,
                       self->selectedProtocol);
         }
     }
@@ -0,0 +1,365 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * NSCodec encoder [MS-RDPNSC]
+ */
+
+#if defined(HAVE_CONFIG_H)
+#include <config_ac.h>
+#endif
+
+#include "libxrdp.h"
+
+#if defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
+#define NSCODEC_HEADER_BYTES 20
+
+/*****************************************************************************/
+/* [MS-RDPNSC] 3.1.8.2.1 RLE
+   a run of two or more bytes is the value twice then the run length less
+   two in one byte, or 0xFF and the full run length in four bytes, the
+   last four bytes of the plane are always sent as they are
+   returns the bytes written to out, or -1 if that would be more than
+   out_bytes */
+int
+xrdp_nscodec_rle_encode(const unsigned char *in, int in_bytes,
+                        unsigned char *out, int out_bytes)
+{
+    int left;
+    int index;
+    int run;
+    int bytes;
+    unsigned char value;
+
+    if (in_bytes < 5)
+    {
+        return -1;
+    }
+    left = in_bytes - 4;
+    index = 0;
+    bytes = 0;
+    while (index < left)
+    {
+        value = in[index];
+        run = 1;
+        while ((index + run < left) && (in[index + run] == value))
+        {
+            run++;
+        }
+        if (run == 1)
+        {
+            if (bytes + 1 > out_bytes)
+            {
+                return -1;
+            }
+            out[bytes++] = value;
+        }
+        else if (run - 2 < 0xFF)
+        {
+            if (bytes + 3 > out_bytes)
+            {
+                return -1;
+            }
+            out[bytes++] = value;
+            out[bytes++] = value;
+            out[bytes++] = run - 2;
+        }
+        else
+        {
+            if (bytes + 7 > out_bytes)
+            {
+                return -1;
+            }
+            out[bytes++] = value;
+            out[bytes++] = value;
+            out[bytes++] = 0xFF;
+            out[bytes++] = run;
+            out[bytes++] = run >> 8;
+            out[bytes++] = run >> 16;
+            out[bytes++] = run >> 24;
+        }
+        index += run;
+    }
+    if (bytes + 4 > out_bytes)
+    {
+        return -1;
+    }
+    g_memcpy(out + bytes, in + left, 4);
+    return bytes + 4;
+}
+
+/*****************************************************************************/
+/* [MS-RDPNSC] 3.1.8.1.1 and 3.1.8.1.2, x8r8g8b8 to YCoCg with the
+   chroma reduced by shift bits */
+static void
+xrdp_nscodec_convert_line(const char *src, int count, int shift,
+                          unsigned char *y_line, char *co_line,
+                          char *cg_line)
+{
+    const unsigned char *s8;
+    int r;
+    int g;
+    int b;
+    int index;
+
+    index = 0;
+#if defined(__SSE2__)
+    {
+        __m128i mask;
+        __m128i zero;
+        __m128i sh;
+        __m128i p0;
+        __m128i p1;
+        __m128i r16;
+        __m128i g16;
+        __m128i b16;
+        __m128i y16;
+        __m128i co16;
+        __m128i cg16;
+
+        mask = _mm_set1_epi32(0xFF);
+        zero = _mm_setzero_si128();
+        sh = _mm_cvtsi32_si128(shift);
+        /* eight pixels at a time, channels in 16 bit lanes */
+        for (; index + 8 <= count; index += 8)
+        {
+            p0 = _mm_loadu_si128((const __m128i *) (src + index * 4));
+            p1 = _mm_loadu_si128((const __m128i *) (src + index * 4 + 16));
+            b16 = _mm_packs_epi32(_mm_and_si128(p0, mask),
+                                  _mm_and_si128(p1, mask));
+            g16 = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 8), mask),
+                                  _mm_and_si128(_mm_srli_epi32(p1, 8), mask));
+            r16 = _mm_packs_epi32(_mm_and_si128(_mm_srli_epi32(p0, 16), mask),
+                                  _mm_and_si128(_mm_srli_epi32(p1, 16), mask));
+            y16 = _mm_add_epi16(_mm_srli_epi16(r16, 2),
+                                _mm_srli_epi16(g16, 1));
+            y16 = _mm_add_epi16(y16, _mm_srli_epi16(b16, 2));
+            co16 = _mm_sra_epi16(_mm_sub_epi16(r16, b16), sh);
+            cg16 = _mm_sub_epi16(g16, _mm_srli_epi16(r16, 1));
+            cg16 = _mm_sra_epi16(_mm_sub_epi16(cg16, _mm_srli_epi16(b16, 1)),
+                                 sh);
+            _mm_storel_epi64((__m128i *) (y_line + index),
+                             _mm_packus_epi16(y16, zero));
+            _mm_storel_epi64((__m128i *) (co_line + index),
+                             _mm_packs_epi16(co16, zero));
+            _mm_storel_epi64((__m128i *) (cg_line + index),
+                             _mm_packs_epi16(cg16, zero));
+        }
+    }
+#endif
+    s8 = (const unsigned char *) src;
+    for (; index < count; index++)
+    {
+        b = s8[index * 4 + 0];
+        g = s8[index * 4 + 1];
+        r = s8[index * 4 + 2];
+        y_line[index] = (r >> 2) + (g >> 1) + (b >> 2);
+        co_line[index] = (r - b) >> shift;
+        cg_line[index] = (g - (r >> 1) - (b >> 1)) >> shift;
+    }
+}
+
+/*****************************************************************************/
+/* [MS-RDPNSC] 3.1.8.1.3, average each 2 by 2 block of a chroma plane */
+static void
+xrdp_nscodec_subsample(const char *in, int width, int height, char *out)
+{
+    const signed char *line0;
+    const signed char *line1;
+    int x;
+    int y;
+
+    for (y = 0; y < height; y += 2)
+    {
+        line0 = (const signed char *) (in + y * width);
+        line1 = line0 + width;
+        for (x = 0; x < width; x += 2)
+        {
+            *(out++) = (line0[x] + line0[x + 1] +
+                        line1[x] + line1[x + 1]) >> 2;
+        }
+    }
+}
+
+/*****************************************************************************/
+/* writes a plane RLE compressed if that is smaller, else raw
+   returns the plane byte count or -1 if it does not fit */
+static int
+xrdp_nscodec_out_plane(const char *plane, int plane_bytes,
+                       char *out, int out_bytes)
+{
+    int bytes;
+
+    bytes = xrdp_nscodec_rle_encode((const unsigned char *) plane,
+                                    plane_bytes, (unsigned char *) out,
+                                    MIN(out_bytes, plane_bytes - 1));
+    if (bytes > 0)
+    {
+        return bytes;
+    }
+    if (plane_bytes > out_bytes)
+    {
+        return -1;
+    }
+    g_memcpy(out, plane, plane_bytes);
+    return plane_bytes;
+}
+
+/*****************************************************************************/
+/* encodes the cx by cy area at x, y of a 32 bpp x8r8g8b8 image as a
+   NSCODEC_BITMAP_STREAM, color_loss_level is 1 to 7, subsampling non zero
+   for ChromaSubsamplingLevel 1, the alpha plane is not sent
+   on entry io_len is the size of out_data, on return the bytes used
+   returns 0 on success */
+int
+xrdp_nscodec_encode(const char *inp_data, int stride, int x, int y,
+                    int cx, int cy, int color_loss_level, int subsampling,
+                    char *out_data, int *io_len)
+{
+    struct stream ls;
+    struct stream *s;
+    const char *src;
+    char *planes;
+    char *y_plane;
+    char *co_plane;
+    char *cg_plane;
+    char *co_sub;
+    char *cg_sub;
+    char *line;
+    int plane_width;
+    int plane_height;
+    int chroma_bytes;
+    int y_bytes;
+    int plane_bytes[3];
+    int out_bytes;
+    int bytes;
+    int row;
+    int col;
+
+    if ((cx < 1) || (cy < 1) || (color_loss_level < 1) ||
+            (color_loss_level > 7) || (*io_len < NSCODEC_HEADER_BYTES))
+    {
+        return 1;
+    }
+    subsampling = subsampling ? 1 : 0;
+    if (subsampling)
+    {
+        /* luma width is padded to 8 and chroma height to 2 */
+        plane_width = (cx + 7) & ~7;
+        plane_height = (cy + 1) & ~1;
+        y_bytes = plane_width * cy;
+        chroma_bytes = (plane_width / 2) * (plane_height / 2);
+    }
+    else
+    {
+        plane_width = cx;
+        plane_height = cy;
+        y_bytes = cx * cy;
+        chroma_bytes = y_bytes;
+    }
+    planes = (char *) g_malloc(plane_width * plane_height * 3 +
+                               chroma_bytes * 2, 0);
+    if (planes == NULL)
+    {
+        return 1;
+    }
+    y_plane = planes;
+    co_plane = y_plane + plane_width * plane_height;
+    cg_plane = co_plane + plane_width * plane_height;
+    co_sub = cg_plane + plane_width * plane_height;
+    cg_sub = co_sub + chroma_bytes;
+
+    for (row = 0; row < cy; row++)
+    {
+        src = inp_data + (y + row) * stride + x * 4;
+        xrdp_nscodec_convert_line(src, cx, color_loss_level,
+                                  (unsigned char *) (y_plane +
+                                          row * plane_width),
+                                  co_plane + row * plane_width,
+                                  cg_plane + row * plane_width);
+        for (col = cx; col < plane_width; col++)
+        {
+            /* repeat the last pixel into the padding */
+            line = y_plane + row * plane_width;
+            line[col] = line[cx - 1];
+            line = co_plane + row * plane_width;
+            line[col] = line[cx - 1];
+            line = cg_plane + row * plane_width;
+            line[col] = line[cx - 1];
+        }
+    }
+    if (plane_height > cy)
+    {
+        g_memcpy(co_plane + cy * plane_width,
+                 co_plane + (cy - 1) * plane_width, plane_width);
+        g_memcpy(cg_plane + cy * plane_width,
+                 cg_plane + (cy - 1) * plane_width, plane_width);
+    }
+    if (subsampling)
+    {
+        xrdp_nscodec_subsample(co_plane, plane_width, plane_height, co_sub);
+        xrdp_nscodec_subsample(cg_plane, plane_width, plane_height, cg_sub);
+        co_plane = co_sub;
+        cg_plane = cg_sub;
+    }
+
+    out_bytes = NSCODEC_HEADER_BYTES;
+    bytes = xrdp_nscodec_out_plane(y_plane, y_bytes, out_data + out_bytes,
+                                   *io_len - out_bytes);
+    plane_bytes[0] = bytes;
+    out_bytes += bytes;
+    if (bytes >= 0)
+    {
+        bytes = xrdp_nscodec_out_plane(co_plane, chroma_bytes,
+                                       out_data + out_bytes,
+                                       *io_len - out_bytes);
+        plane_bytes[1] = bytes;
+        out_bytes += bytes;
+    }
+    if (bytes >= 0)
+    {
+        bytes = xrdp_nscodec_out_plane(cg_plane, chroma_bytes,
+                                       out_data + out_bytes,
+                                       *io_len - out_bytes);
+        plane_bytes[2] = bytes;
+        out_bytes += bytes;
+    }
+    g_free(planes);
+    if (bytes < 0)
+    {
+        LOG_DEVEL(LOG_LEVEL_DEBUG, "xrdp_nscodec_encode: out_data too "
+                  "small, %d bytes", *io_len);
+        return 1;
+    }
+
+    /* NSCODEC_BITMAP_STREAM header */
+    g_memset(&ls, 0, sizeof(ls));
+    s = &ls;
+    s->data = out_data;
+    s->p = s->data;
+    s->size = NSCODEC_HEADER_BYTES;
+    s->end = s->data + s->size;
+    out_uint32_le(s, plane_bytes[0]); /* LumaPlaneByteCount */
+    out_uint32_le(s, plane_bytes[1]); /* OrangeChromaPlaneByteCount */
+    out_uint32_le(s, plane_bytes[2]); /* GreenChromaPlaneByteCount */
+    out_uint32_le(s, 0); /* AlphaPlaneByteCount, all opaque */
+    out_uint8(s, color_loss_level);
+    out_uint8(s, subsampling); /* ChromaSubsamplingLevel */
+    out_uint16_le(s, 0); /* Reserved */
+    *io_len = out_bytes;
+    return 0;
+}
@@ -2657,11 +2657,13 @@ xrdp_orders_send_font(struct xrdp_orders *self,
 int
 xrdp_orders_send_raw_bitmap2(struct xrdp_orders *self,
                              int width, int height, int bpp, char *data,
-                             int cache_id, int cache_idx)
+                             int cache_id, int cache_idx,
+                             int key1, int key2)
 {
     int order_flags = 0;
     int len = 0;
     int bufsize = 0;
+    int key_bytes = 0;
     int Bpp = 0;
     int i = 0;
     int j = 0;
@@ -2692,25 +2694,40 @@ xrdp_orders_send_raw_bitmap2(struct xrdp_orders *self,
         e = 4 - e;
     }
 
+    if ((key1 | key2) != 0)
+    {
+        key_bytes = 8;
+    }
     Bpp = (bpp + 7) / 8;
     bufsize = (width + e) * height * Bpp;
-    while (bufsize + 14 > max_order_size)
+    while (bufsize + key_bytes + 14 > max_order_size)
     {
+        /* not all of it, so the client must not keep it */
+        key_bytes = 0;
         height--;
         bufsize = (width + e) * height * Bpp;
     }
-    if (xrdp_orders_check(self, bufsize + 14) != 0)
+    if (xrdp_orders_check(self, bufsize + key_bytes + 14) != 0)
     {
         return 1;
     }
     self->order_count++;
     order_flags = TS_STANDARD | TS_SECONDARY;
     out_uint8(self->out_s, order_flags);
-    len = (bufsize + 6) - 7; /* length after type minus 7 */
+    len = (bufsize + key_bytes + 6) - 7; /* length after type minus 7 */
     out_uint16_le(self->out_s, len);
     i = (((Bpp + 2) << 3) & 0x38) | (cache_id & 7);
+    if (key_bytes != 0)
+    {
+        i = i | (CBR2_PERSISTENT_KEY_PRESENT << 7);
+    }
     out_uint16_le(self->out_s, i); /* flags */
     out_uint8(self->out_s, TS_CACHE_BITMAP_UNCOMPRESSED_REV2); /* type */
+    if (key_bytes != 0)
+    {
+        out_uint32_le(self->out_s, key1);
+        out_uint32_le(self->out_s, key2);
+    }
     out_uint8(self->out_s, width + e);
     out_uint8(self->out_s, height);
     out_uint16_be(self->out_s, bufsize | 0x4000);
@@ -2783,11 +2800,13 @@ xrdp_orders_send_raw_bitmap2(struct xrdp_orders *self,
 int
 xrdp_orders_send_bitmap2(struct xrdp_orders *self,
                          int width, int height, int bpp, char *data,
-                         int cache_id, int cache_idx, int hints)
+                         int cache_id, int cache_idx, int hints,
+                         int key1, int key2)
 {
     int order_flags = 0;
     int len = 0;
     int bufsize = 0;
+    int key_bytes = 0;
     int Bpp = 0;
     int i = 0;
     int lines_sending = 0;
@@ -2843,22 +2862,36 @@ xrdp_orders_send_bitmap2(struct xrdp_orders *self,
     {
         height = lines_sending;
     }
+    else if ((key1 | key2) != 0)
+    {
+        /* only when it is all there, else the client must not keep it */
+        key_bytes = 8;
+    }
 
     bufsize = (int)(s->p - p);
     Bpp = (bpp + 7) / 8;
-    if (xrdp_orders_check(self, bufsize + 14) != 0)
+    if (xrdp_orders_check(self, bufsize + key_bytes + 14) != 0)
     {
         return 1;
     }
     self->order_count++;
     order_flags = TS_STANDARD | TS_SECONDARY;
     out_uint8(self->out_s, order_flags);
-    len = (bufsize + 6) - 7; /* length after type minus 7 */
+    len = (bufsize + key_bytes + 6) - 7; /* length after type minus 7 */
     out_uint16_le(self->out_s, len);
     i = (((Bpp + 2) << 3) & 0x38) | (cache_id & 7);
-    i = i | (0x08 << 7); /* CBR2_NO_BITMAP_COMPRESSION_HDR */
+    i = i | (CBR2_NO_BITMAP_COMPRESSION_HDR << 7);
+    if (key_bytes != 0)
+    {
+        i = i | (CBR2_PERSISTENT_KEY_PRESENT << 7);
+    }
     out_uint16_le(self->out_s, i); /* flags */
     out_uint8(self->out_s, TS_CACHE_BITMAP_COMPRESSED_REV2); /* type */
+    if (key_bytes != 0)
+    {
+        out_uint32_le(self->out_s, key1);
+        out_uint32_le(self->out_s, key2);
+    }
     out_uint8(self->out_s, width + e);
     out_uint8(self->out_s, height);
     out_uint16_be(self->out_s, bufsize | 0x4000);
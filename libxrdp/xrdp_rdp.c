@@ -72,6 +72,10 @@ xrdp_rdp_read_config(const char *xrdp_ini, struct xrdp_client_info *client_info)
         {
             client_info->use_bitmap_cache = g_text2bool(value);
         }
+        else if (g_strcasecmp(item, "bitmap_cache_persist") == 0)
+        {
+            client_info->use_bitmap_cache_persist = g_text2bool(value);
+        }
         else if (g_strcasecmp(item, "bitmap_compression") == 0)
         {
             client_info->use_bitmap_comp = g_text2bool(value);
@@ -129,6 +133,10 @@ xrdp_rdp_read_config(const char *xrdp_ini, struct xrdp_client_info *client_info)
         {
             client_info->max_bpp = g_atoi(value);
         }
+        else if (g_strcasecmp(item, "encoder_threads") == 0)
+        {
+            client_info->encoder_threads = g_atoi(value);
+        }
         else if (g_strcasecmp(item, "rfx_min_pixel") == 0)
         {
             client_info->rfx_min_pixel = g_atoi(value);
@@ -399,11 +407,17 @@ xrdp_rdp_create(struct xrdp_session *session, struct trans *trans)
 void
 xrdp_rdp_delete(struct xrdp_rdp *self)
 {
+    int index;
+
     if (self == 0)
     {
         return;
     }
 
+    for (index = 0; index < XRDP_MAX_BITMAP_CACHE_ID; index++)
+    {
+        g_free(self->persist_keys[index]);
+    }
     xrdp_sec_delete(self->sec_layer);
     mppc_enc_free(self->mppc_enc);
 #if defined(XRDP_NEUTRINORDP)
@@ -1401,6 +1415,103 @@ xrdp_rdp_process_frame_ack(struct xrdp_rdp *self, struct stream *s)
     return 0;
 }
 
+/*****************************************************************************/
+/* Process a [MS-RDPBCGR] TS_BITMAPCACHE_PERSISTENT_LIST_PDU message
+   the client has loaded the bitmaps these keys are for into its caches
+   from disk, in cache index order, the keys are kept for xrdp to seed
+   its bitmap cache with */
+int
+xrdp_rdp_process_persistent_list(struct xrdp_rdp *self, struct stream *s)
+{
+    int num_entries[5];
+    int total_entries[5];
+    int flags;
+    int index;
+    int jndex;
+    int count;
+    unsigned int key1;
+    unsigned int key2;
+
+    if (!s_check_rem_and_log(s, 24, "Parsing [MS-RDPBCGR] "
+                             "TS_BITMAPCACHE_PERSISTENT_LIST_PDU"))
+    {
+        return 1;
+    }
+    for (index = 0; index < 5; index++)
+    {
+        in_uint16_le(s, num_entries[index]);
+    }
+    for (index = 0; index < 5; index++)
+    {
+        in_uint16_le(s, total_entries[index]);
+    }
+    in_uint8(s, flags); /* bBitMask */
+    in_uint8s(s, 3); /* Pad2, Pad3 */
+    LOG_DEVEL(LOG_LEVEL_TRACE, "Received [MS-RDPBCGR] "
+              "TS_BITMAPCACHE_PERSISTENT_LIST_PDU "
+              "numEntries %d %d %d, totalEntries %d %d %d, bBitMask 0x%2.2x",
+              num_entries[0], num_entries[1], num_entries[2],
+              total_entries[0], total_entries[1], total_entries[2], flags);
+
+    if (!self->client_info.use_bitmap_cache_persist)
+    {
+        LOG_DEVEL(LOG_LEVEL_DEBUG, "xrdp_rdp_process_persistent_list: "
+                  "persistent bitmap cache is off, ignoring");
+        return 0;
+    }
+    if (flags & PERSIST_FIRST_PDU)
+    {
+        for (index = 0; index < XRDP_MAX_BITMAP_CACHE_ID; index++)
+        {
+            g_free(self->persist_keys[index]);
+            self->persist_keys[index] = NULL;
+            count = MIN(total_entries[index], XRDP_MAX_BITMAP_CACHE_IDX);
+            if (count > 0)
+            {
+                self->persist_keys[index] = g_new(unsigned int, count * 2);
+                if (self->persist_keys[index] == NULL)
+                {
+                    count = 0;
+                }
+            }
+            self->persist_key_count[index] = 0;
+            self->persist_key_total[index] = count;
+        }
+    }
+    for (index = 0; index < 5; index++)
+    {
+        if (!s_check_rem_and_log(s, num_entries[index] * 8,
+                                 "Parsing [MS-RDPBCGR] "
+                                 "TS_BITMAPCACHE_PERSISTENT_LIST_ENTRY"))
+        {
+            return 1;
+        }
+        for (jndex = 0; jndex < num_entries[index]; jndex++)
+        {
+            in_uint32_le(s, key1);
+            in_uint32_le(s, key2);
+            if (index >= XRDP_MAX_BITMAP_CACHE_ID)
+            {
+                continue;
+            }
+            count = self->persist_key_count[index];
+            if (count < self->persist_key_total[index])
+            {
+                self->persist_keys[index][count * 2] = key1;
+                self->persist_keys[index][count * 2 + 1] = key2;
+                self->persist_key_count[index] = count + 1;
+            }
+        }
+    }
+    if (flags & PERSIST_LAST_PDU)
+    {
+        LOG(LOG_LEVEL_INFO, "Client has %d %d %d persistent bitmap cache "
+            "entries", self->persist_key_count[0],
+            self->persist_key_count[1], self->persist_key_count[2]);
+    }
+    return 0;
+}
+
 /*****************************************************************************/
 /* Process a [MS-RDPBCGR] TS_SUPPRESS_OUTPUT_PDU message */
 static int
@@ -1536,6 +1647,9 @@ xrdp_rdp_process_data(struct xrdp_rdp *self, struct stream *s)
         case RDP_DATA_PDU_FONT2: /* 39(0x27) */
             xrdp_rdp_process_data_font(self, s);
             break;
+        case PDUTYPE2_BITMAPCACHE_PERSISTENT_LIST: /* 43(0x2b) */
+            xrdp_rdp_process_persistent_list(self, s);
+            break;
         case 56: /* PDUTYPE2_FRAME_ACKNOWLEDGE 0x38 */
             xrdp_rdp_process_frame_ack(self, s);
             break;
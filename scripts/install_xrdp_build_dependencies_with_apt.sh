@@ -77,7 +77,8 @@ in
             libssl-dev \
             libx11-dev \
             libxrandr-dev \
-            libxfixes-dev"
+            libxfixes-dev \
+            zlib1g-dev"
 
         case "$FEATURE_SET"
         in
@@ -124,7 +125,8 @@ in
             libxext-dev:i386 \
             libxfixes-dev:i386 \
             libxrandr-dev:i386 \
-            libxrender-dev:i386"
+            libxrender-dev:i386 \
+            zlib1g-dev:i386"
 
         dpkg --add-architecture i386
         dpkg --print-architecture
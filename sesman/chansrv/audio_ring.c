@@ -0,0 +1,165 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * lock free ring of audio records
+ *
+ * Each record is a 4 byte length followed by the record bytes, which may
+ * wrap. The writer owns 'head' and the reader owns 'tail'. Both only
+ * ever increase, and the other thread reads them with acquire
+ * semantics, so record bytes are visible before the index that covers
+ * them.
+ */
+
+#if defined(HAVE_CONFIG_H)
+#include <config_ac.h>
+#endif
+
+#include "arch.h"
+#include "defines.h"
+#include "os_calls.h"
+#include "audio_ring.h"
+
+struct audio_ring
+{
+    unsigned int head; /* next byte to write */
+    unsigned int tail; /* next byte to read */
+    unsigned int mask;
+    char *data;
+};
+
+/*****************************************************************************/
+static unsigned int
+load_acquire(const unsigned int *p)
+{
+    return __atomic_load_n(p, __ATOMIC_ACQUIRE);
+}
+
+/*****************************************************************************/
+static void
+store_release(unsigned int *p, unsigned int value)
+{
+    __atomic_store_n(p, value, __ATOMIC_RELEASE);
+}
+
+/*****************************************************************************/
+/* copies into the ring at position pos, wrapping */
+static void
+ring_put(struct audio_ring *r, unsigned int pos, const void *src, int bytes)
+{
+    unsigned int offset = pos & r->mask;
+    unsigned int first = MIN((unsigned int) bytes, r->mask + 1 - offset);
+
+    g_memcpy(r->data + offset, src, first);
+    g_memcpy(r->data, (const char *) src + first, bytes - first);
+}
+
+/*****************************************************************************/
+/* copies out of the ring from position pos, wrapping */
+static void
+ring_get(const struct audio_ring *r, unsigned int pos, void *dst, int bytes)
+{
+    unsigned int offset = pos & r->mask;
+    unsigned int first = MIN((unsigned int) bytes, r->mask + 1 - offset);
+
+    g_memcpy(dst, r->data + offset, first);
+    g_memcpy((char *) dst + first, r->data, bytes - first);
+}
+
+/*****************************************************************************/
+struct audio_ring *
+audio_ring_create(int bytes)
+{
+    struct audio_ring *r;
+    unsigned int size;
+
+    size = 64;
+    while (size < (unsigned int) bytes)
+    {
+        size <<= 1;
+    }
+    r = g_new0(struct audio_ring, 1);
+    if (r == NULL)
+    {
+        return NULL;
+    }
+    r->data = (char *) g_malloc(size, 0);
+    if (r->data == NULL)
+    {
+        g_free(r);
+        return NULL;
+    }
+    r->mask = size - 1;
+    return r;
+}
+
+/*****************************************************************************/
+void
+audio_ring_delete(struct audio_ring *r)
+{
+    if (r != NULL)
+    {
+        g_free(r->data);
+        g_free(r);
+    }
+}
+
+/*****************************************************************************/
+int
+audio_ring_write(struct audio_ring *r,
+                 const void *hdr, int hdr_bytes,
+                 const void *data, int data_bytes)
+{
+    unsigned int head;
+    unsigned int used;
+    int bytes;
+
+    bytes = hdr_bytes + data_bytes;
+    head = r->head;
+    used = head - load_acquire(&r->tail);
+    if (bytes < 0 || (unsigned int) bytes + 4 > r->mask + 1 - used)
+    {
+        return 1;
+    }
+    ring_put(r, head, &bytes, 4);
+    ring_put(r, head + 4, hdr, hdr_bytes);
+    ring_put(r, head + 4 + hdr_bytes, data, data_bytes);
+    store_release(&r->head, head + 4 + bytes);
+    return 0;
+}
+
+/*****************************************************************************/
+int
+audio_ring_read(struct audio_ring *r, void *buf, int buf_bytes)
+{
+    unsigned int tail;
+    int bytes;
+
+    tail = r->tail;
+    if (tail == load_acquire(&r->head))
+    {
+        return 0;
+    }
+    ring_get(r, tail, &bytes, 4);
+    if (bytes > buf_bytes)
+    {
+        store_release(&r->tail, tail + 4 + bytes);
+        return -1;
+    }
+    ring_get(r, tail + 4, buf, bytes);
+    store_release(&r->tail, tail + 4 + bytes);
+    return bytes;
+}
@@ -0,0 +1,57 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* lock free ring of audio records, between one writer thread and one
+   reader thread */
+
+#ifndef _AUDIO_RING_H
+#define _AUDIO_RING_H
+
+struct audio_ring;
+
+/**
+ * Creates a ring
+ *
+ * @param bytes Capacity, rounded up to a power of two
+ * @return ring, or NULL if out of memory
+ */
+struct audio_ring *audio_ring_create(int bytes);
+
+/**
+ * Frees a ring. Neither thread may be using it
+ */
+void audio_ring_delete(struct audio_ring *r);
+
+/**
+ * Adds a record, made of hdr followed by data. Writer thread only
+ *
+ * @return 0 on success, non-zero if there is no room
+ */
+int  audio_ring_write(struct audio_ring *r,
+                      const void *hdr, int hdr_bytes,
+                      const void *data, int data_bytes);
+
+/**
+ * Removes the oldest record. Reader thread only
+ *
+ * @param buf Buffer for the record
+ * @param buf_bytes Size of buf
+ * @return record size, 0 if the ring is empty, or -1 if buf is too small
+ *         (the record is dropped)
+ */
+int  audio_ring_read(struct audio_ring *r, void *buf, int buf_bytes);
+
+#endif
@@ -40,6 +40,7 @@
 #include "chansrv_config.h"
 #include "xrdp_sockets.h"
 #include "audin.h"
+#include "timeout.h"
 
 #include "ms-rdpbcgr.h"
 
@@ -49,6 +50,10 @@ static struct trans *g_lis_trans = 0;
 static struct trans *g_con_trans = 0;
 static struct trans *g_api_lis_trans = 0;
 static struct list *g_api_con_trans_list = 0; /* list of apps using api functions */
+/* sockets of g_api_con_trans_list, so a pass only checks ready ones */
+static struct g_wait_set *g_api_con_wait_set = NULL;
+#define MAX_API_WAIT_EVENTS 32
+static struct source_info g_con_source_info; /* pauses reads on g_con_trans */
 static struct chan_item g_chan_items[32];
 static int g_num_chan_items = 0;
 static int g_cliprdr_index = -1;
@@ -103,145 +108,9 @@ struct xrdp_api_data
 {
     int chan_flags;
     int chan_id;
+    int wait_events; /* what g_api_con_wait_set waits for */
 };
 
-struct timeout_obj
-{
-    tui32 mstime;
-    void *data;
-    void (*callback)(void *data);
-    struct timeout_obj *next;
-};
-
-static struct timeout_obj *g_timeout_head = 0;
-static struct timeout_obj *g_timeout_tail = 0;
-
-/*****************************************************************************/
-int
-add_timeout(int msoffset, void (*callback)(void *data), void *data)
-{
-    struct timeout_obj *tobj;
-    tui32 now;
-
-    LOG_DEVEL(LOG_LEVEL_DEBUG, "add_timeout:");
-    now = g_time3();
-    tobj = g_new0(struct timeout_obj, 1);
-    tobj->mstime = now + msoffset;
-    tobj->callback = callback;
-    tobj->data = data;
-    if (g_timeout_tail == 0)
-    {
-        g_timeout_head = tobj;
-        g_timeout_tail = tobj;
-    }
-    else
-    {
-        g_timeout_tail->next = tobj;
-        g_timeout_tail = tobj;
-    }
-    return 0;
-}
-
-/*****************************************************************************/
-static int
-get_timeout(int *timeout)
-{
-    struct timeout_obj *tobj;
-    tui32 now;
-    int ltimeout;
-
-    LOG_DEVEL(LOG_LEVEL_DEBUG, "get_timeout:");
-    ltimeout = *timeout;
-    if (ltimeout < 1)
-    {
-        ltimeout = 0;
-    }
-    tobj = g_timeout_head;
-    if (tobj != 0)
-    {
-        now = g_time3();
-        while (tobj != 0)
-        {
-            LOG_DEVEL(LOG_LEVEL_DEBUG, "  now %u tobj->mstime %u", now, tobj->mstime);
-            if (now < tobj->mstime)
-            {
-                ltimeout = tobj->mstime - now;
-            }
-            tobj = tobj->next;
-        }
-    }
-    if (ltimeout > 0)
-    {
-        LOG_DEVEL(LOG_LEVEL_DEBUG, "  ltimeout %d", ltimeout);
-        if (*timeout < 1)
-        {
-            *timeout = ltimeout;
-        }
-        else
-        {
-            if (*timeout > ltimeout)
-            {
-                *timeout = ltimeout;
-            }
-        }
-    }
-    return 0;
-}
-
-/*****************************************************************************/
-static int
-check_timeout(void)
-{
-    struct timeout_obj *tobj;
-    struct timeout_obj *last_tobj;
-    struct timeout_obj *temp_tobj;
-    int count;
-    tui32 now;
-    UNUSED_VAR(count);
-    LOG_DEVEL(LOG_LEVEL_DEBUG, "check_timeout:");
-    count = 0;
-    tobj = g_timeout_head;
-    if (tobj != 0)
-    {
-        last_tobj = 0;
-        while (tobj != 0)
-        {
-            count++;
-            now = g_time3();
-            if (now >= tobj->mstime)
-            {
-                tobj->callback(tobj->data);
-                if (last_tobj == 0)
-                {
-                    g_timeout_head = tobj->next;
-                    if (g_timeout_head == 0)
-                    {
-                        g_timeout_tail = 0;
-                    }
-                }
-                else
-                {
-                    last_tobj->next = tobj->next;
-                    if (g_timeout_tail == tobj)
-                    {
-                        g_timeout_tail = last_tobj;
-                    }
-                }
-                temp_tobj = tobj;
-                tobj = tobj->next;
-                g_free(temp_tobj);
-            }
-            else
-            {
-                last_tobj = tobj;
-                tobj = tobj->next;
-            }
-        }
-    }
-    LOG_DEVEL(LOG_LEVEL_DEBUG, "  count %d", count);
-    return 0;
-}
-
 /*****************************************************************************/
 int
 g_is_term(void)
@@ -306,6 +175,17 @@ send_channel_data(int chan_id, const char *data, int size)
     return 0;
 }
 
+/*****************************************************************************/
+/* stops or restarts reading channel data from xrdp, for a module that
+   has nowhere to put more. xrdp then stops reading from the client, so
+   keyboard and mouse input stop too, keep pauses short */
+void
+chansrv_pause_input(int pause)
+{
+    /* uses the trans back-pressure check, anything over 0 skips reads */
+    g_con_source_info.source[XRDP_SOURCE_CHANSRV] = pause ? 1 : 0;
+}
+
 /*****************************************************************************/
 /* returns error */
 int
@@ -1194,6 +1074,9 @@ my_trans_conn_in(struct trans *trans, struct trans *new_trans)
     g_con_trans = new_trans;
     g_con_trans->trans_data_in = my_trans_data_in;
     g_con_trans->header_size = 8;
+    g_memset(&g_con_source_info, 0, sizeof(g_con_source_info));
+    g_con_trans->si = &g_con_source_info;
+    g_con_trans->my_source = XRDP_SOURCE_CHANSRV;
     /* stop listening */
     trans_delete(g_lis_trans);
     g_lis_trans = 0;
@@ -1224,6 +1107,15 @@ my_api_trans_conn_in(struct trans *trans, struct trans *new_trans)
         LOG_DEVEL(LOG_LEVEL_ERROR, "my_api_trans_conn_in: error");
         return 1;
     }
+    if (g_wait_set_add(g_api_con_wait_set, new_trans->sck, G_WAIT_READ,
+                       new_trans) != 0)
+    {
+        LOG(LOG_LEVEL_ERROR, "my_api_trans_conn_in: can't wait on the "
+            "connection");
+        g_free(ad);
+        return 1;
+    }
+    ad->wait_events = G_WAIT_READ;
     new_trans->callback_data = ad;
     list_add_item(g_api_con_trans_list, (intptr_t) new_trans);
     return 0;
@@ -1265,6 +1157,15 @@ setup_api_listen(void)
     char port[256];
     int error = 0;
 
+    g_api_con_wait_set = g_wait_set_create();
+    if (g_api_con_wait_set == NULL)
+    {
+        LOG(LOG_LEVEL_ERROR, "setup_api_listen: can't create wait set");
+        return 1;
+    }
+    LOG(LOG_LEVEL_DEBUG, "setup_api_listen: waiting with %s",
+        g_wait_set_get_name(g_api_con_wait_set));
+
     g_api_lis_trans = trans_create(TRANS_MODE_UNIX, 8192 * 4, 8192 * 4);
     g_api_lis_trans->is_term = g_is_term;
     g_snprintf(port, 255, CHANSRV_API_STR, g_display_num);
@@ -1281,6 +1182,29 @@ setup_api_listen(void)
     return 0;
 }
 
+/*****************************************************************************/
+/* re-arms the wait set events for a connection, adding write events
+   while it has output queued */
+static void
+api_con_update_wait(struct trans *ltran)
+{
+    struct xrdp_api_data *ad;
+    int events;
+
+    ad = (struct xrdp_api_data *) (ltran->callback_data);
+    events = G_WAIT_READ;
+    if (ltran->wait_s != NULL)
+    {
+        events |= G_WAIT_WRITE;
+    }
+    if (events != ad->wait_events &&
+            g_wait_set_modify(g_api_con_wait_set, ltran->sck, events,
+                              ltran) == 0)
+    {
+        ad->wait_events = events;
+    }
+}
+
 /*****************************************************************************/
 static int
 api_con_trans_list_get_wait_objs_rw(intptr_t *robjs, int *rcount,
@@ -1288,8 +1212,32 @@ api_con_trans_list_get_wait_objs_rw(intptr_t *robjs, int *rcount,
                                     int *timeout)
 {
     int api_con_index;
+    tintptr obj;
     struct trans *ltran;
 
+    if (g_api_con_wait_set == NULL)
+    {
+        return 0;
+    }
+    for (api_con_index = g_api_con_trans_list->count - 1;
+            api_con_index >= 0;
+            api_con_index--)
+    {
+        ltran = (struct trans *)
+                list_get_item(g_api_con_trans_list, api_con_index);
+        if (ltran != NULL)
+        {
+            api_con_update_wait(ltran);
+        }
+    }
+    obj = g_wait_set_get_obj(g_api_con_wait_set);
+    if (obj != -1)
+    {
+        /* one object for all the connections */
+        robjs[*rcount] = obj;
+        (*rcount)++;
+        return 0;
+    }
     for (api_con_index = g_api_con_trans_list->count - 1;
             api_con_index >= 0;
             api_con_index--)
@@ -1305,44 +1253,57 @@ api_con_trans_list_get_wait_objs_rw(intptr_t *robjs, int *rcount,
     return 0;
 }
 
+/*****************************************************************************/
+static void
+api_con_delete(struct trans *ltran)
+{
+    g_wait_set_remove(g_api_con_wait_set, ltran->sck);
+    g_free(ltran->callback_data);
+    trans_delete(ltran);
+}
+
 /*****************************************************************************/
 static int
 api_con_trans_list_check_wait_objs(void)
 {
-    int api_con_index;
+    struct g_wait_set_event events[MAX_API_WAIT_EVENTS];
+    int count;
+    int index;
     int drdynvc_index;
     struct trans *ltran;
     struct xrdp_api_data *ad;
 
-    for (api_con_index = g_api_con_trans_list->count - 1;
-            api_con_index >= 0;
-            api_con_index--)
+    if (g_api_con_wait_set == NULL)
     {
-        ltran = (struct trans *)
-                list_get_item(g_api_con_trans_list, api_con_index);
-        if (ltran != NULL)
+        return 0;
+    }
+    /* only connections that are ready need looking at */
+    count = g_wait_set_wait(g_api_con_wait_set, events,
+                            MAX_API_WAIT_EVENTS, 0);
+    for (index = 0; index < count; index++)
+    {
+        ltran = (struct trans *) (events[index].data);
+        if (trans_check_wait_objs(ltran) != 0)
         {
-            if (trans_check_wait_objs(ltran) != 0)
+            /* disconnect */
+            list_remove_item(g_api_con_trans_list,
+                             list_index_of(g_api_con_trans_list,
+                                           (tintptr) ltran));
+            ad = (struct xrdp_api_data *) (ltran->callback_data);
+            if (ad->chan_flags != 0)
             {
-                /* disconnect */
-                list_remove_item(g_api_con_trans_list, api_con_index);
-                ad = (struct xrdp_api_data *) (ltran->callback_data);
-                if (ad->chan_flags != 0)
-                {
-                    chansrv_drdynvc_close(ad->chan_id);
-                }
-                for (drdynvc_index = 0;
-                        drdynvc_index < (int) ARRAYSIZE(g_drdynvcs);
-                        drdynvc_index++)
+                chansrv_drdynvc_close(ad->chan_id);
+            }
+            for (drdynvc_index = 0;
+                    drdynvc_index < (int) ARRAYSIZE(g_drdynvcs);
+                    drdynvc_index++)
+            {
+                if (g_drdynvcs[drdynvc_index].xrdp_api_trans == ltran)
                 {
-                    if (g_drdynvcs[drdynvc_index].xrdp_api_trans == ltran)
-                    {
-                        g_drdynvcs[drdynvc_index].xrdp_api_trans = NULL;
-                    }
+                    g_drdynvcs[drdynvc_index].xrdp_api_trans = NULL;
                 }
-                g_free(ad);
-                trans_delete(ltran);
             }
+            api_con_delete(ltran);
         }
     }
     return 0;
@@ -1364,8 +1325,7 @@ api_con_trans_list_remove_all(void)
         if (ltran != NULL)
         {
             list_remove_item(g_api_con_trans_list, api_con_index);
-            g_free(ltran->callback_data);
-            trans_delete(ltran);
+            api_con_delete(ltran);
         }
     }
     return 0;
@@ -1489,6 +1449,8 @@ channel_thread_loop(void *in_val)
     g_api_lis_trans = 0;
     api_con_trans_list_remove_all();
     list_delete(g_api_con_trans_list);
+    g_wait_set_delete(g_api_con_wait_set);
+    g_api_con_wait_set = NULL;
     LOG_DEVEL(LOG_LEVEL_INFO, "channel_thread_loop: thread stop");
     g_set_wait_obj(g_thread_done_event);
     return rv;
@@ -1566,6 +1528,7 @@ main_cleanup(void)
         tc_mutex_delete(g_exec_mutex);
         tc_sem_delete(g_exec_sem);
     }
+    timeout_deinit();
     log_end();
     config_free(g_cfg);
     g_deinit(); /* os_calls */
@@ -41,6 +41,11 @@
 #define DEFAULT_FUSE_MOUNT_NAME             "xrdp-client"
 #define DEFAULT_FILE_UMASK                  077
 #define DEFAULT_USE_NAUTILUS3_FLIST_FORMAT  0
+#define DEFAULT_FUSE_WRITE_BEHIND           0
+#define DEFAULT_AUDIO_TARGET_LATENCY        250
+#define MIN_AUDIO_TARGET_LATENCY            40
+#define MAX_AUDIO_TARGET_LATENCY            2000
+#define DEFAULT_AUDIO_PLAYBACK_DVC          1
 /**
  * Type used for passing a logging function about
  */
@@ -182,6 +187,26 @@ read_config_chansrv(log_func_t logmsg,
         {
             cfg->use_nautilus3_flist_format = g_text2bool(value);
         }
+        else if (g_strcasecmp(name, "FuseWriteBehind") == 0)
+        {
+            cfg->fuse_write_behind = g_text2bool(value);
+        }
+        else if (g_strcasecmp(name, "AudioTargetLatency") == 0)
+        {
+            cfg->audio_target_latency = g_atoi(value);
+            if (cfg->audio_target_latency < MIN_AUDIO_TARGET_LATENCY ||
+                    cfg->audio_target_latency > MAX_AUDIO_TARGET_LATENCY)
+            {
+                logmsg(LOG_LEVEL_WARNING, "AudioTargetLatency %s is out of "
+                       "range, using %d", value,
+                       DEFAULT_AUDIO_TARGET_LATENCY);
+                cfg->audio_target_latency = DEFAULT_AUDIO_TARGET_LATENCY;
+            }
+        }
+        else if (g_strcasecmp(name, "AudioPlaybackDvc") == 0)
+        {
+            cfg->audio_playback_dvc = g_text2bool(value);
+        }
     }
 
     return error;
@@ -213,6 +238,9 @@ new_config(void)
         cfg->fuse_mount_name = fuse_mount_name;
         cfg->file_umask = DEFAULT_FILE_UMASK;
         cfg->use_nautilus3_flist_format = DEFAULT_USE_NAUTILUS3_FLIST_FORMAT;
+        cfg->fuse_write_behind = DEFAULT_FUSE_WRITE_BEHIND;
+        cfg->audio_target_latency = DEFAULT_AUDIO_TARGET_LATENCY;
+        cfg->audio_playback_dvc = DEFAULT_AUDIO_PLAYBACK_DVC;
     }
 
     return cfg;
@@ -318,6 +346,12 @@ config_dump(struct config_chansrv *config)
     g_writeln("    FileMask:                  0%o", config->file_umask);
     g_writeln("    Nautilus 3 Flist Format:   %s",
               g_bool2text(config->use_nautilus3_flist_format));
+    g_writeln("    FuseWriteBehind:           %s",
+              g_bool2text(config->fuse_write_behind));
+    g_writeln("    AudioTargetLatency:        %d ms",
+              config->audio_target_latency);
+    g_writeln("    AudioPlaybackDvc:          %s",
+              g_bool2text(config->audio_playback_dvc));
 }
 
 /******************************************************************************/
@@ -38,6 +38,15 @@ struct config_chansrv
 
     /** Whether to use nautilus3-compatible file lists for the clipboard */
     int use_nautilus3_flist_format;
+
+    /** FuseWriteBehind from sesman.ini */
+    int fuse_write_behind;
+
+    /** AudioTargetLatency from sesman.ini, in ms */
+    int audio_target_latency;
+
+    /** AudioPlaybackDvc from sesman.ini */
+    int audio_playback_dvc;
 };
 
 
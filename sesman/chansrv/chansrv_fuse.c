@@ -252,6 +252,9 @@ struct state_create
 struct state_read
 {
     fuse_req_t        req;        /* Original FUSE request from lookup  */
+    /* For read ahead, req is NULL and these say where the data goes */
+    struct xfuse_handle *fh;      /* NULL once the handle is closed     */
+    int               block;      /* index into fh->ra->blocks          */
 };
 
 /*
@@ -261,6 +264,9 @@ struct state_write
 {
     fuse_req_t        req;        /* Original FUSE request from lookup  */
     fuse_ino_t        inum;       /* inum of file we're writing         */
+    /* For write behind, req is NULL and these say what was sent */
+    struct xfuse_handle *fh;      /* NULL once the handle is closed     */
+    size_t            length;     /* bytes in the IRP_MJ_WRITE          */
 };
 
 /*
@@ -307,9 +313,124 @@ struct xfuse_handle
      *       fields of this structure contain invalid values.
      */
     struct xfs_dir_handle *dir_handle;
+    fuse_ino_t inum;          /* inode of a redirected file           */
+    struct xfuse_ra *ra;      /* read ahead state, NULL until read    */
+    struct xfuse_wb *wb;      /* write behind state, NULL until write */
 };
 typedef struct xfuse_handle XFUSE_HANDLE;
 
+/*
+ * Read ahead for redirected files.
+ *
+ * Each IRP_MJ_READ is a round trip to the client, so reading a file one
+ * FUSE request at a time is limited by latency. Once a handle is being
+ * read sequentially, blocks ahead of the reader are requested several
+ * at a time and kept in a small cache that later reads are answered
+ * from. Writes and size changes drop the cache of every handle open
+ * on the file.
+ */
+#define XFUSE_RA_BLOCK_SIZE (128 * 1024)
+#define XFUSE_RA_MAX_BLOCKS 16  /* cache per handle, 2 MB             */
+#define XFUSE_RA_WINDOW 8       /* blocks kept in flight ahead        */
+#define XFUSE_RA_SEQ_READS 2    /* sequential reads before it starts  */
+
+enum xfuse_ra_block_state
+{
+    RA_BLOCK_FREE = 0,
+    RA_BLOCK_PENDING,           /* IRP_MJ_READ sent                   */
+    RA_BLOCK_VALID
+};
+
+struct xfuse_ra_block
+{
+    enum xfuse_ra_block_state state;
+    off_t off;                  /* multiple of XFUSE_RA_BLOCK_SIZE    */
+    size_t len;                 /* valid bytes, short at end of file  */
+    int discard;                /* file changed while pending         */
+    char *data;                 /* XFUSE_RA_BLOCK_SIZE bytes          */
+    struct state_read *fip;     /* while pending                      */
+};
+
+/* a FUSE read waiting for pending blocks */
+struct xfuse_ra_waiter
+{
+    fuse_req_t req;
+    off_t off;
+    size_t size;
+};
+
+struct xfuse_ra
+{
+    struct xfuse_ra_block blocks[XFUSE_RA_MAX_BLOCKS];
+    struct list *waiters;       /* of struct xfuse_ra_waiter          */
+    off_t next_off;             /* where a sequential read would be   */
+    int seq_reads;
+    off_t eof;                  /* from a short read, -1 if unknown   */
+};
+
+/*
+ * Write behind for redirected files, enabled by FuseWriteBehind.
+ *
+ * Writes are copied into chunks and answered straight away. Contiguous
+ * writes are coalesced into one IRP_MJ_WRITE of up to
+ * XFUSE_WB_CHUNK_SIZE, and a few of those are kept in flight. The last
+ * chunk is held back while the link is busy so it can grow. Chunks are
+ * allocated to fit what is in them and grow as writes are added, so
+ * scattered small writes don't each cost a whole chunk. A write that
+ * doesn't follow on from the previous one is not sent until everything
+ * before it has completed, so overlapping writes can't be reordered by
+ * the client.
+ *
+ * flush, fsync, release and reads on the handle wait for the data to
+ * reach the client. A failed write is reported by the next flush (and
+ * so by close()), and subsequent writes fail.
+ */
+#define XFUSE_WB_CHUNK_SIZE (1024 * 1024)
+#define XFUSE_WB_CHUNK_MIN (4 * 1024) /* allocation granularity   */
+#define XFUSE_WB_MAX_IN_FLIGHT 4
+#define XFUSE_WB_MAX_BYTES (8 * 1024 * 1024) /* before writes wait    */
+
+struct xfuse_wb_chunk
+{
+    off_t off;
+    size_t len;
+    size_t cap;                 /* bytes allocated at data            */
+    int barrier;                /* wait for the IRPs before it        */
+    char *data;
+};
+
+enum xfuse_wb_wait_type
+{
+    WB_WAIT_WRITE = 0,          /* reply once under XFUSE_WB_MAX_BYTES */
+    WB_WAIT_FLUSH,              /* the rest wait until nothing's left */
+    WB_WAIT_READ,
+    WB_WAIT_RELEASE
+};
+
+/* a FUSE request waiting for write behind */
+struct xfuse_wb_waiter
+{
+    enum xfuse_wb_wait_type type;
+    fuse_req_t req;
+    fuse_ino_t inum;
+    off_t off;
+    size_t size;
+    struct fuse_file_info fi;   /* for release                        */
+};
+
+struct xfuse_wb
+{
+    struct list *chunks;        /* of struct xfuse_wb_chunk, in order */
+    struct list *irps;          /* of struct state_write, in flight   */
+    struct list *waiters;       /* of struct xfuse_wb_waiter          */
+    size_t bytes;               /* buffered and in flight             */
+    off_t next_off;             /* where a contiguous write would be  */
+    int error;                  /* errno for the next flush           */
+    int busy;                   /* in xfuse_wb_progress()             */
+    int writes;                 /* FUSE writes taken                  */
+    int irps_sent;
+};
+
 /* used for file data request sent to client */
 struct req_list_item
 {
@@ -323,6 +444,7 @@ struct req_list_item
 extern struct config_chansrv *g_cfg; /* in chansrv.c */
 
 static struct list *g_req_list = 0;
+static struct list *g_ra_handles = 0;        /* handles with read ahead    */
 static struct xfs_fs *g_xfs;                 /* an inst of xrdp file system */
 static ino_t g_clipboard_inum;               /* inode of clipboard dir      */
 static char *g_mount_point = 0;              /* our FUSE mount point        */
@@ -386,10 +508,11 @@ static void xfuse_cb_create(fuse_req_t req, fuse_ino_t parent,
                             const char *name, mode_t mode,
                             struct fuse_file_info *fi);
 
-#if 0
+static void xfuse_cb_flush(fuse_req_t req, fuse_ino_t ino,
+                           struct fuse_file_info *fi);
+
 static void xfuse_cb_fsync(fuse_req_t req, fuse_ino_t ino, int datasync,
                            struct fuse_file_info *fi);
-#endif
 
 static void xfuse_cb_setattr(fuse_req_t req, fuse_ino_t ino, struct stat *attr,
                              int to_set, struct fuse_file_info *fi);
@@ -411,6 +534,9 @@ static void update_inode_file_attributes(const struct file_attr *fattr,
 static char *get_name_for_entry_in_parent(fuse_ino_t parent, const char *name);
 static unsigned int format_user_info(char *dest, unsigned int len,
                                      const char *format);
+static void xfuse_release_remote(fuse_req_t req, fuse_ino_t ino,
+                                 struct fuse_file_info *fi,
+                                 XFUSE_HANDLE *handle, tui32 device_id);
 
 /*****************************************************************************/
 int
@@ -419,6 +545,850 @@ load_fuse_config(void)
     return 0;
 }
 
+/*****************************************************************************/
+/* returns the block for block_off, or NULL. Blocks being discarded are
+   treated as missing */
+static struct xfuse_ra_block *
+xfuse_ra_find_block(struct xfuse_ra *ra, off_t block_off)
+{
+    struct xfuse_ra_block *block;
+    int index;
+
+    for (index = 0; index < XFUSE_RA_MAX_BLOCKS; index++)
+    {
+        block = ra->blocks + index;
+        if (block->state != RA_BLOCK_FREE && !block->discard &&
+                block->off == block_off)
+        {
+            return block;
+        }
+    }
+    return NULL;
+}
+
+/*****************************************************************************/
+/* returns 1 if every block of the range is cached or on its way */
+static int
+xfuse_ra_covered(struct xfuse_ra *ra, off_t off, size_t size)
+{
+    struct xfuse_ra_block *block;
+    off_t pos;
+    off_t block_off;
+
+    for (pos = off; pos < off + (off_t) size;
+            pos = block_off + XFUSE_RA_BLOCK_SIZE)
+    {
+        block_off = pos - pos % XFUSE_RA_BLOCK_SIZE;
+        block = xfuse_ra_find_block(ra, block_off);
+        if (block == NULL)
+        {
+            return 0;
+        }
+        if (block->state == RA_BLOCK_VALID &&
+                block->len < XFUSE_RA_BLOCK_SIZE)
+        {
+            /* end of file */
+            break;
+        }
+    }
+    return 1;
+}
+
+/*****************************************************************************/
+/* replies to a read from the cache, returns 0 if it could */
+static int
+xfuse_ra_reply(struct xfuse_ra *ra, fuse_req_t req, off_t off, size_t size)
+{
+    struct xfuse_ra_block *block;
+    off_t pos;
+    off_t end;
+    off_t block_off;
+    size_t part;
+    char *buf;
+
+    end = off + size;
+    for (pos = off; pos < end; pos = block_off + XFUSE_RA_BLOCK_SIZE)
+    {
+        block_off = pos - pos % XFUSE_RA_BLOCK_SIZE;
+        block = xfuse_ra_find_block(ra, block_off);
+        if (block == NULL || block->state != RA_BLOCK_VALID)
+        {
+            return 1;
+        }
+        if (block->len < XFUSE_RA_BLOCK_SIZE)
+        {
+            /* the file ends in this block */
+            if (end > block_off + (off_t) block->len)
+            {
+                end = block_off + block->len;
+            }
+            break;
+        }
+    }
+
+    if (end <= off)
+    {
+        fuse_reply_buf(req, 0, 0);
+        return 0;
+    }
+    block = xfuse_ra_find_block(ra, off - off % XFUSE_RA_BLOCK_SIZE);
+    if (end <= block->off + XFUSE_RA_BLOCK_SIZE)
+    {
+        /* all in one block, no need to copy */
+        fuse_reply_buf(req, block->data + (off - block->off), end - off);
+        return 0;
+    }
+    if ((buf = g_new(char, end - off)) == NULL)
+    {
+        return 1;
+    }
+    for (pos = off; pos < end; pos += part)
+    {
+        block = xfuse_ra_find_block(ra, pos - pos % XFUSE_RA_BLOCK_SIZE);
+        part = block->off + XFUSE_RA_BLOCK_SIZE - pos;
+        if (part > (size_t) (end - pos))
+        {
+            part = end - pos;
+        }
+        g_memcpy(buf + (pos - off), block->data + (pos - block->off), part);
+    }
+    fuse_reply_buf(req, buf, end - off);
+    free(buf);
+    return 0;
+}
+
+/*****************************************************************************/
+/* reads without the cache, the reply comes from
+   xfuse_devredir_cb_read_file() */
+static void
+xfuse_ra_read_direct(XFUSE_HANDLE *fh, fuse_req_t req, off_t off,
+                     size_t size)
+{
+    struct state_read *fusep;
+
+    if ((fusep = g_new0(struct state_read, 1)) == NULL)
+    {
+        LOG_DEVEL(LOG_LEVEL_ERROR, "system out of memory");
+        fuse_reply_err(req, ENOMEM);
+        return;
+    }
+    fusep->req = req;
+    devredir_file_read(fusep, fh->DeviceId, fh->FileId, size, off);
+}
+
+/*****************************************************************************/
+/* replies to the waiters that can be answered now. Those that need a
+   block which has gone are read the usual way */
+static void
+xfuse_ra_serve_waiters(XFUSE_HANDLE *fh)
+{
+    struct xfuse_ra *ra = fh->ra;
+    struct xfuse_ra_waiter *waiter;
+    int index;
+
+    index = 0;
+    while (index < ra->waiters->count)
+    {
+        waiter = (struct xfuse_ra_waiter *) list_get_item(ra->waiters, index);
+        if (xfuse_ra_reply(ra, waiter->req, waiter->off, waiter->size) == 0)
+        {
+            list_remove_item(ra->waiters, index);
+        }
+        else if (!xfuse_ra_covered(ra, waiter->off, waiter->size))
+        {
+            xfuse_ra_read_direct(fh, waiter->req, waiter->off, waiter->size);
+            list_remove_item(ra->waiters, index);
+        }
+        else
+        {
+            index++;
+        }
+    }
+}
+
+/*****************************************************************************/
+/* returns a free block, reusing the oldest one wholly before keep_from
+   if need be, or NULL */
+static struct xfuse_ra_block *
+xfuse_ra_get_free_block(struct xfuse_ra *ra, off_t keep_from)
+{
+    struct xfuse_ra_block *block;
+    struct xfuse_ra_block *victim;
+    int index;
+
+    victim = NULL;
+    for (index = 0; index < XFUSE_RA_MAX_BLOCKS; index++)
+    {
+        block = ra->blocks + index;
+        if (block->state == RA_BLOCK_FREE)
+        {
+            return block;
+        }
+        if (block->state == RA_BLOCK_VALID &&
+                block->off + XFUSE_RA_BLOCK_SIZE <= keep_from &&
+                (victim == NULL || block->off < victim->off))
+        {
+            victim = block;
+        }
+    }
+    if (victim != NULL)
+    {
+        victim->state = RA_BLOCK_FREE;
+    }
+    return victim;
+}
+
+/*****************************************************************************/
+/* asks the client for the blocks from off up to end that we don't have */
+static void
+xfuse_ra_fill(XFUSE_HANDLE *fh, off_t off, off_t end)
+{
+    struct xfuse_ra *ra = fh->ra;
+    struct xfuse_ra_block *block;
+    struct xfuse_ra_waiter *waiter;
+    struct state_read *fip;
+    off_t block_off;
+    off_t keep_from;
+    int index;
+
+    off -= off % XFUSE_RA_BLOCK_SIZE;
+    /* blocks a waiter needs stay */
+    keep_from = off;
+    for (index = 0; index < ra->waiters->count; index++)
+    {
+        waiter = (struct xfuse_ra_waiter *) list_get_item(ra->waiters, index);
+        if (waiter->off - waiter->off % XFUSE_RA_BLOCK_SIZE < keep_from)
+        {
+            keep_from = waiter->off - waiter->off % XFUSE_RA_BLOCK_SIZE;
+        }
+    }
+    for (block_off = off; block_off < end;
+            block_off += XFUSE_RA_BLOCK_SIZE)
+    {
+        if (ra->eof >= 0 && block_off >= ra->eof)
+        {
+            break;
+        }
+        if (xfuse_ra_find_block(ra, block_off) != NULL)
+        {
+            continue;
+        }
+        if ((block = xfuse_ra_get_free_block(ra, keep_from)) == NULL)
+        {
+            break;
+        }
+        if (block->data == NULL &&
+                (block->data = g_new(char, XFUSE_RA_BLOCK_SIZE)) == NULL)
+        {
+            break;
+        }
+        if ((fip = g_new0(struct state_read, 1)) == NULL)
+        {
+            break;
+        }
+        fip->fh = fh;
+        fip->block = block - ra->blocks;
+        block->state = RA_BLOCK_PENDING;
+        block->off = block_off;
+        block->len = 0;
+        block->discard = 0;
+        block->fip = fip;
+        devredir_file_read(fip, fh->DeviceId, fh->FileId,
+                           XFUSE_RA_BLOCK_SIZE, block_off);
+        if (block->state != RA_BLOCK_PENDING)
+        {
+            /* failed straight away, the link has gone */
+            break;
+        }
+    }
+}
+
+/*****************************************************************************/
+/* a read ahead IRP_MJ_READ has finished */
+static void
+xfuse_ra_block_done(struct state_read *fip, enum NTSTATUS IoStatus,
+                    const char *buf, size_t length)
+{
+    XFUSE_HANDLE *fh = fip->fh;
+    struct xfuse_ra *ra;
+    struct xfuse_ra_block *block;
+
+    if (fh == NULL || fh->ra == NULL)
+    {
+        /* the handle was closed */
+        return;
+    }
+    ra = fh->ra;
+    block = ra->blocks + fip->block;
+    block->fip = NULL;
+    if (block->discard || IoStatus != STATUS_SUCCESS ||
+            length > XFUSE_RA_BLOCK_SIZE)
+    {
+        LOG_DEVEL(LOG_LEVEL_DEBUG, "dropping read ahead at %lld, "
+                  "NTSTATUS %d discard %d", (long long) block->off,
+                  (int) IoStatus, block->discard);
+        block->state = RA_BLOCK_FREE;
+        block->discard = 0;
+    }
+    else
+    {
+        g_memcpy(block->data, buf, length);
+        block->len = length;
+        block->state = RA_BLOCK_VALID;
+        if (length < XFUSE_RA_BLOCK_SIZE)
+        {
+            ra->eof = block->off + length;
+        }
+    }
+    xfuse_ra_serve_waiters(fh);
+    if (block->state == RA_BLOCK_VALID && ra->seq_reads >= XFUSE_RA_SEQ_READS)
+    {
+        /* keep the pipeline full */
+        xfuse_ra_fill(fh, ra->next_off,
+                      ra->next_off + XFUSE_RA_WINDOW * XFUSE_RA_BLOCK_SIZE);
+    }
+}
+
+/*****************************************************************************/
+/* answers a read of a redirected file from the cache, or gets it on
+   its way. Returns non zero if the caller should read it directly */
+static int
+xfuse_ra_read(XFUSE_HANDLE *fh, fuse_req_t req, size_t size, off_t off)
+{
+    struct xfuse_ra *ra;
+    struct xfuse_ra_waiter *waiter;
+
+    if (size > XFUSE_RA_BLOCK_SIZE * 2)
+    {
+        return 1;
+    }
+    if (fh->ra == NULL)
+    {
+        if ((ra = g_new0(struct xfuse_ra, 1)) == NULL)
+        {
+            return 1;
+        }
+        if ((ra->waiters = list_create()) == NULL)
+        {
+            free(ra);
+            return 1;
+        }
+        ra->waiters->auto_free = 1;
+        ra->eof = -1;
+        fh->ra = ra;
+        list_add_item(g_ra_handles, (tbus) fh);
+    }
+    ra = fh->ra;
+    if (off == ra->next_off)
+    {
+        ra->seq_reads++;
+    }
+    else
+    {
+        ra->seq_reads = 0;
+    }
+    ra->next_off = off + size;
+
+    if (ra->seq_reads >= XFUSE_RA_SEQ_READS)
+    {
+        if (ra->seq_reads == XFUSE_RA_SEQ_READS)
+        {
+            LOG_DEVEL(LOG_LEVEL_DEBUG, "sequential reads of FileId %d, "
+                      "starting read ahead at %lld", fh->FileId,
+                      (long long) off);
+        }
+        xfuse_ra_fill(fh, off,
+                      off + size + XFUSE_RA_WINDOW * XFUSE_RA_BLOCK_SIZE);
+    }
+    if (xfuse_ra_reply(ra, req, off, size) == 0)
+    {
+        return 0;
+    }
+    if (!xfuse_ra_covered(ra, off, size))
+    {
+        return 1;
+    }
+    if ((waiter = g_new0(struct xfuse_ra_waiter, 1)) == NULL)
+    {
+        return 1;
+    }
+    waiter->req = req;
+    waiter->off = off;
+    waiter->size = size;
+    list_add_item(ra->waiters, (tbus) waiter);
+    return 0;
+}
+
+/*****************************************************************************/
+/* the file has changed, drop what every handle on it has cached */
+static void
+xfuse_ra_invalidate(fuse_ino_t inum)
+{
+    XFUSE_HANDLE *fh;
+    struct xfuse_ra_block *block;
+    int index;
+    int bindex;
+
+    for (index = 0; g_ra_handles != 0 && index < g_ra_handles->count;
+            index++)
+    {
+        fh = (XFUSE_HANDLE *) list_get_item(g_ra_handles, index);
+        if (fh->inum != inum)
+        {
+            continue;
+        }
+        for (bindex = 0; bindex < XFUSE_RA_MAX_BLOCKS; bindex++)
+        {
+            block = fh->ra->blocks + bindex;
+            if (block->state == RA_BLOCK_VALID)
+            {
+                block->state = RA_BLOCK_FREE;
+            }
+            else if (block->state == RA_BLOCK_PENDING)
+            {
+                /* freed when the data arrives */
+                block->discard = 1;
+            }
+        }
+        fh->ra->eof = -1;
+        fh->ra->seq_reads = 0;
+        /* anyone waiting reads it again */
+        xfuse_ra_serve_waiters(fh);
+    }
+}
+
+/*****************************************************************************/
+static void
+xfuse_ra_delete(XFUSE_HANDLE *fh)
+{
+    struct xfuse_ra *ra = fh->ra;
+    struct xfuse_ra_waiter *waiter;
+    int index;
+
+    if (ra == NULL)
+    {
+        return;
+    }
+    for (index = 0; index < XFUSE_RA_MAX_BLOCKS; index++)
+    {
+        if (ra->blocks[index].fip != NULL)
+        {
+            /* the IRP is still out, its data goes nowhere */
+            ra->blocks[index].fip->fh = NULL;
+        }
+        free(ra->blocks[index].data);
+    }
+    for (index = 0; index < ra->waiters->count; index++)
+    {
+        waiter = (struct xfuse_ra_waiter *) list_get_item(ra->waiters, index);
+        fuse_reply_err(waiter->req, EIO);
+    }
+    list_delete(ra->waiters);
+    if (g_ra_handles != 0 &&
+            (index = list_index_of(g_ra_handles, (tbus) fh)) >= 0)
+    {
+        list_remove_item(g_ra_handles, index);
+    }
+    free(ra);
+    fh->ra = NULL;
+}
+
+/*****************************************************************************/
+/* returns 1 if the handle has write behind data not yet written */
+static int
+xfuse_wb_pending(const XFUSE_HANDLE *fh)
+{
+    return fh->wb != NULL &&
+           (fh->wb->chunks->count > 0 || fh->wb->irps->count > 0);
+}
+
+/*****************************************************************************/
+/* returns 1 if something is waiting for all the data to go */
+static int
+xfuse_wb_flushing(struct xfuse_wb *wb)
+{
+    struct xfuse_wb_waiter *waiter;
+    int index;
+
+    for (index = 0; index < wb->waiters->count; index++)
+    {
+        waiter = (struct xfuse_wb_waiter *) list_get_item(wb->waiters, index);
+        if (waiter->type != WB_WAIT_WRITE)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/*****************************************************************************/
+static void
+xfuse_wb_free_chunk(struct xfuse_wb_chunk *chunk)
+{
+    free(chunk->data);
+    free(chunk);
+}
+
+/*****************************************************************************/
+/* sends the chunks that can go */
+static void
+xfuse_wb_send(XFUSE_HANDLE *fh)
+{
+    struct xfuse_wb *wb = fh->wb;
+    struct xfuse_wb_chunk *chunk;
+    struct state_write *fip;
+
+    while (wb->chunks->count > 0 && wb->irps->count < XFUSE_WB_MAX_IN_FLIGHT)
+    {
+        chunk = (struct xfuse_wb_chunk *) list_get_item(wb->chunks, 0);
+        if (chunk->barrier && wb->irps->count > 0)
+        {
+            break;
+        }
+        if (wb->chunks->count == 1 && chunk->len < XFUSE_WB_CHUNK_SIZE &&
+                wb->irps->count > 0 && !xfuse_wb_flushing(wb))
+        {
+            /* let it fill up while the link is busy */
+            break;
+        }
+        list_remove_item(wb->chunks, 0);
+        if ((fip = g_new0(struct state_write, 1)) == NULL)
+        {
+            LOG_DEVEL(LOG_LEVEL_ERROR, "system out of memory");
+            wb->bytes -= chunk->len;
+            wb->error = ENOMEM;
+            xfuse_wb_free_chunk(chunk);
+            continue;
+        }
+        fip->inum = fh->inum;
+        fip->fh = fh;
+        fip->length = chunk->len;
+        list_add_item(wb->irps, (tbus) fip);
+        wb->irps_sent++;
+
+        /* the data is copied, the chunk can go */
+        devredir_file_write(fip, fh->DeviceId, fh->FileId, chunk->data,
+                            chunk->len, chunk->off);
+        xfuse_wb_free_chunk(chunk);
+    }
+}
+
+/*****************************************************************************/
+/* sends what can be sent, then answers the waiters that can be answered.
+   The handle may be deleted by a waiting release */
+static void
+xfuse_wb_progress(XFUSE_HANDLE *fh)
+{
+    struct xfuse_wb *wb = fh->wb;
+    struct xfuse_wb_waiter *waiter;
+    struct xfuse_wb_waiter w;
+    int index;
+
+    if (wb->busy)
+    {
+        /* a write failed straight away, the caller carries on */
+        return;
+    }
+    wb->busy = 1;
+    xfuse_wb_send(fh);
+    wb->busy = 0;
+
+    index = 0;
+    while (index < wb->waiters->count)
+    {
+        waiter = (struct xfuse_wb_waiter *) list_get_item(wb->waiters, index);
+        if (waiter->type == WB_WAIT_WRITE)
+        {
+            if (wb->bytes > XFUSE_WB_MAX_BYTES && wb->error == 0)
+            {
+                index++;
+                continue;
+            }
+        }
+        else if (xfuse_wb_pending(fh))
+        {
+            index++;
+            continue;
+        }
+        /* removing the waiter frees it */
+        w = *waiter;
+        list_remove_item(wb->waiters, index);
+        switch (w.type)
+        {
+            case WB_WAIT_WRITE:
+                if (wb->error != 0)
+                {
+                    fuse_reply_err(w.req, wb->error);
+                }
+                else
+                {
+                    fuse_reply_write(w.req, w.size);
+                }
+                break;
+
+            case WB_WAIT_FLUSH:
+                fuse_reply_err(w.req, wb->error);
+                wb->error = 0;
+                break;
+
+            case WB_WAIT_READ:
+                if (xfuse_ra_read(fh, w.req, w.size, w.off) != 0)
+                {
+                    xfuse_ra_read_direct(fh, w.req, w.off, w.size);
+                }
+                break;
+
+            case WB_WAIT_RELEASE:
+                if (wb->error != 0)
+                {
+                    LOG(LOG_LEVEL_WARNING, "Data written to inode %ld "
+                        "was lost, errno %d", w.inum, wb->error);
+                }
+                xfuse_release_remote(w.req, w.inum, &w.fi, fh, fh->DeviceId);
+                /* fh has gone */
+                return;
+        }
+    }
+}
+
+/*****************************************************************************/
+/* an IRP_MJ_WRITE sent by xfuse_wb_send() has finished */
+static void
+xfuse_wb_write_done(struct state_write *fip, enum NTSTATUS IoStatus,
+                    size_t length)
+{
+    XFUSE_HANDLE *fh = fip->fh;
+    struct xfuse_wb *wb;
+    int index;
+
+    if (fh == NULL)
+    {
+        /* the handle was closed */
+        return;
+    }
+    wb = fh->wb;
+    if ((index = list_index_of(wb->irps, (tbus) fip)) >= 0)
+    {
+        list_remove_item(wb->irps, index);
+    }
+    wb->bytes -= fip->length;
+    if (IoStatus != STATUS_SUCCESS || length != fip->length)
+    {
+        LOG(LOG_LEVEL_ERROR, "Write behind to inode %ld failed, NTSTATUS "
+            "%d, %zu of %zu bytes written", fip->inum, (int) IoStatus,
+            length, fip->length);
+        if (wb->error == 0)
+        {
+            wb->error = EIO;
+        }
+    }
+    xfuse_wb_progress(fh);
+}
+
+/*****************************************************************************/
+/* makes a request wait for the write behind data, returns 0 if it waits,
+   non zero if it can go ahead now */
+static int
+xfuse_wb_wait(XFUSE_HANDLE *fh, enum xfuse_wb_wait_type type,
+              fuse_req_t req, fuse_ino_t inum, off_t off, size_t size,
+              const struct fuse_file_info *fi)
+{
+    struct xfuse_wb_waiter *waiter;
+
+    if (!xfuse_wb_pending(fh))
+    {
+        return 1;
+    }
+    if ((waiter = g_new0(struct xfuse_wb_waiter, 1)) == NULL)
+    {
+        LOG_DEVEL(LOG_LEVEL_ERROR, "system out of memory");
+        return 1;
+    }
+    waiter->type = type;
+    waiter->req = req;
+    waiter->inum = inum;
+    waiter->off = off;
+    waiter->size = size;
+    if (fi != NULL)
+    {
+        waiter->fi = *fi;
+    }
+    list_add_item(fh->wb->waiters, (tbus) waiter);
+    /* the last chunk can go now */
+    xfuse_wb_progress(fh);
+    return 0;
+}
+
+/*****************************************************************************/
+static struct xfuse_wb *
+xfuse_wb_create(void)
+{
+    struct xfuse_wb *wb;
+
+    if ((wb = g_new0(struct xfuse_wb, 1)) == NULL)
+    {
+        return NULL;
+    }
+    wb->chunks = list_create();
+    wb->irps = list_create();
+    wb->waiters = list_create();
+    if (wb->chunks == NULL || wb->irps == NULL || wb->waiters == NULL)
+    {
+        list_delete(wb->chunks);
+        list_delete(wb->irps);
+        list_delete(wb->waiters);
+        free(wb);
+        return NULL;
+    }
+    wb->waiters->auto_free = 1;
+    return wb;
+}
+
+/*****************************************************************************/
+/* takes a write to a redirected file, returns non zero if it should be
+   written the usual way */
+static int
+xfuse_wb_write(XFUSE_HANDLE *fh, fuse_req_t req, const char *buf,
+               size_t size, off_t off)
+{
+    struct xfuse_wb *wb;
+    struct xfuse_wb_chunk *chunk;
+    XFS_INODE *xinode;
+    int barrier;
+    size_t cap;
+    char *data;
+
+    if (!g_cfg->fuse_write_behind)
+    {
+        return 1;
+    }
+    if (fh->wb == NULL && (fh->wb = xfuse_wb_create()) == NULL)
+    {
+        return 1;
+    }
+    wb = fh->wb;
+    if (wb->error != 0)
+    {
+        fuse_reply_err(req, wb->error);
+        return 0;
+    }
+
+    barrier = (wb->bytes > 0 && off != wb->next_off);
+    chunk = NULL;
+    if (!barrier && wb->chunks->count > 0)
+    {
+        chunk = (struct xfuse_wb_chunk *)
+                list_get_item(wb->chunks, wb->chunks->count - 1);
+        if (chunk->len + size > chunk->cap &&
+                chunk->len + size > XFUSE_WB_CHUNK_SIZE)
+        {
+            chunk = NULL;
+        }
+        else if (chunk->len + size > chunk->cap)
+        {
+            /* grow it, doubling so appends copy each byte about once */
+            cap = chunk->cap * 2;
+            if (cap < chunk->len + size)
+            {
+                cap = chunk->len + size;
+            }
+            if (cap > XFUSE_WB_CHUNK_SIZE)
+            {
+                cap = XFUSE_WB_CHUNK_SIZE;
+            }
+            if ((data = (char *) realloc(chunk->data, cap)) == NULL)
+            {
+                fuse_reply_err(req, ENOMEM);
+                return 0;
+            }
+            chunk->data = data;
+            chunk->cap = cap;
+        }
+    }
+    if (chunk == NULL)
+    {
+        if ((chunk = g_new0(struct xfuse_wb_chunk, 1)) == NULL)
+        {
+            fuse_reply_err(req, ENOMEM);
+            return 0;
+        }
+        chunk->cap = (size + XFUSE_WB_CHUNK_MIN - 1) &
+                     ~((size_t) XFUSE_WB_CHUNK_MIN - 1);
+        if (chunk->cap == 0)
+        {
+            chunk->cap = XFUSE_WB_CHUNK_MIN;
+        }
+        if ((chunk->data = g_new(char, chunk->cap)) == NULL)
+        {
+            free(chunk);
+            fuse_reply_err(req, ENOMEM);
+            return 0;
+        }
+        chunk->off = off;
+        chunk->barrier = barrier;
+        list_add_item(wb->chunks, (tbus) chunk);
+    }
+    g_memcpy(chunk->data + chunk->len, buf, size);
+    chunk->len += size;
+    wb->bytes += size;
+    wb->next_off = off + size;
+    wb->writes++;
+
+    if ((xinode = xfs_get(g_xfs, fh->inum)) != NULL &&
+            (off_t) (off + size) > xinode->size)
+    {
+        xinode->size = off + size;
+    }
+
+    if (wb->bytes <= XFUSE_WB_MAX_BYTES ||
+            xfuse_wb_wait(fh, WB_WAIT_WRITE, req, fh->inum, off, size,
+                          NULL) != 0)
+    {
+        fuse_reply_write(req, size);
+        xfuse_wb_progress(fh);
+    }
+    return 0;
+}
+
+/*****************************************************************************/
+static void
+xfuse_wb_delete(XFUSE_HANDLE *fh)
+{
+    struct xfuse_wb *wb = fh->wb;
+    struct xfuse_wb_waiter *waiter;
+    int index;
+
+    if (wb == NULL)
+    {
+        return;
+    }
+    if (wb->writes > 0)
+    {
+        LOG(LOG_LEVEL_DEBUG, "Write behind for inode %ld coalesced %d "
+            "writes into %d IRPs", fh->inum, wb->writes, wb->irps_sent);
+    }
+    for (index = 0; index < wb->irps->count; index++)
+    {
+        /* the IRP is still out, nobody wants to know */
+        ((struct state_write *) list_get_item(wb->irps, index))->fh = NULL;
+    }
+    for (index = 0; index < wb->chunks->count; index++)
+    {
+        xfuse_wb_free_chunk((struct xfuse_wb_chunk *)
+                            list_get_item(wb->chunks, index));
+    }
+    for (index = 0; index < wb->waiters->count; index++)
+    {
+        waiter = (struct xfuse_wb_waiter *) list_get_item(wb->waiters, index);
+        fuse_reply_err(waiter->req, EIO);
+    }
+    list_delete(wb->chunks);
+    list_delete(wb->irps);
+    list_delete(wb->waiters);
+    free(wb);
+    fh->wb = NULL;
+}
+
 /*****************************************************************************/
 XFUSE_HANDLE *
 xfuse_handle_create()
@@ -439,6 +1409,8 @@ xfuse_handle_delete(XFUSE_HANDLE *self)
     {
         free(self->dir_handle);
     }
+    xfuse_ra_delete(self);
+    xfuse_wb_delete(self);
     free(self);
 }
 
@@ -595,7 +1567,8 @@ xfuse_init(void)
     g_xfuse_ops.read        = xfuse_cb_read;
     g_xfuse_ops.write       = xfuse_cb_write;
     g_xfuse_ops.create      = xfuse_cb_create;
-    //g_xfuse_ops.fsync     = xfuse_cb_fsync; /* LK_TODO delete this */
+    g_xfuse_ops.flush       = xfuse_cb_flush;
+    g_xfuse_ops.fsync       = xfuse_cb_fsync;
     g_xfuse_ops.getattr     = xfuse_cb_getattr;
     g_xfuse_ops.setattr     = xfuse_cb_setattr;
     g_xfuse_ops.opendir     = xfuse_cb_opendir;
@@ -650,6 +1623,12 @@ xfuse_deinit(void)
         g_req_list = 0;
     }
 
+    if (g_ra_handles != 0)
+    {
+        list_delete(g_ra_handles);
+        g_ra_handles = 0;
+    }
+
     xfuse_deinit_xrdp_fs();
 
     g_xfuse_inited = 0;
@@ -934,6 +1913,8 @@ static int xfuse_init_lib(struct fuse_args *args)
     g_req_list = list_create();
     g_req_list->auto_free = 1;
 
+    g_ra_handles = list_create();
+
     return 0;
 }
 
@@ -1370,6 +2351,7 @@ void xfuse_devredir_cb_create_file(struct state_create *fip,
                 else
                 {
                     struct fuse_entry_param  e;
+                    fh->inum = xinode->inum;
                     xfs_inode_to_fuse_entry_param(xinode, &e);
                     fuse_reply_create(fip->req, &e, &fip->fi);
                     xfs_increment_file_open_count(g_xfs, xinode->inum);
@@ -1422,6 +2404,7 @@ void xfuse_devredir_cb_open_file(struct state_open *fip,
             /* save file handle for later use */
             fh->DeviceId = DeviceId;
             fh->FileId = FileId;
+            fh->inum = fip->inum;
 
             fip->fi.fh = xfuse_handle_to_fuse_handle(fh);
 
@@ -1443,7 +2426,11 @@ void xfuse_devredir_cb_read_file(struct state_read *fip,
                                  enum NTSTATUS IoStatus,
                                  const char *buf, size_t length)
 {
-    if (IoStatus != STATUS_SUCCESS)
+    if (fip->req == NULL)
+    {
+        xfuse_ra_block_done(fip, IoStatus, buf, length);
+    }
+    else if (IoStatus != STATUS_SUCCESS)
     {
         LOG_DEVEL(LOG_LEVEL_ERROR, "Read NTSTATUS is %d", (int) IoStatus);
         fuse_reply_err(fip->req, EIO);
@@ -1463,7 +2450,11 @@ void xfuse_devredir_cb_write_file(
 {
     XFS_INODE   *xinode;
 
-    if (IoStatus != STATUS_SUCCESS)
+    if (fip->req == NULL)
+    {
+        xfuse_wb_write_done(fip, IoStatus, length);
+    }
+    else if (IoStatus != STATUS_SUCCESS)
     {
         LOG_DEVEL(LOG_LEVEL_ERROR, "Write NTSTATUS is %d", (int) IoStatus);
         fuse_reply_err(fip->req, EIO);
@@ -2244,37 +3235,52 @@ static void xfuse_cb_release(fuse_req_t req, fuse_ino_t ino, struct
         /* specified file is a local resource */
         fuse_reply_err(req, 0);
     }
+    else if (handle != NULL &&
+             xfuse_wb_wait(handle, WB_WAIT_RELEASE, req, ino, 0, 0, fi) == 0)
+    {
+        /* closed once the write behind data has gone */
+    }
     else
     {
         /* specified file resides on redirected share */
+        xfuse_release_remote(req, ino, fi, handle, xinode->device_id);
+    }
+}
 
-        struct state_close *fip = g_new0(struct state_close, 1);
-        if (fip == NULL)
-        {
-            LOG_DEVEL(LOG_LEVEL_ERROR, "system out of memory");
-            fuse_reply_err(req, ENOMEM);
-            return;
-        }
+/**
+ * Closes a file on a redirected share
+ *****************************************************************************/
 
-        fip->req = req;
-        fip->inum = ino;
-        fip->fi = *fi;
+static void xfuse_release_remote(fuse_req_t req, fuse_ino_t ino,
+                                 struct fuse_file_info *fi,
+                                 XFUSE_HANDLE *handle, tui32 device_id)
+{
+    struct state_close *fip = g_new0(struct state_close, 1);
+    if (fip == NULL)
+    {
+        LOG_DEVEL(LOG_LEVEL_ERROR, "system out of memory");
+        fuse_reply_err(req, ENOMEM);
+        return;
+    }
 
-        fi->fh = xfuse_handle_to_fuse_handle(NULL);
+    fip->req = req;
+    fip->inum = ino;
+    fip->fi = *fi;
 
-        /*
-         * If this call succeeds, further request processing happens in
-         * xfuse_devredir_cb_file_close()
-         */
-        if (devredir_file_close(fip, xinode->device_id, handle->FileId))
-        {
-            LOG_DEVEL(LOG_LEVEL_ERROR, "failed to send devredir_close_file() cmd");
-            fuse_reply_err(req, EREMOTEIO);
-            free(fip);
-        }
+    fi->fh = xfuse_handle_to_fuse_handle(NULL);
 
-        xfuse_handle_delete(handle);
+    /*
+     * If this call succeeds, further request processing happens in
+     * xfuse_devredir_cb_file_close()
+     */
+    if (devredir_file_close(fip, device_id, handle->FileId))
+    {
+        LOG_DEVEL(LOG_LEVEL_ERROR, "failed to send devredir_close_file() cmd");
+        fuse_reply_err(req, EREMOTEIO);
+        free(fip);
     }
+
+    xfuse_handle_delete(handle);
 }
 
 /**
@@ -2328,9 +3334,13 @@ static void xfuse_cb_read(fuse_req_t req, fuse_ino_t ino, size_t size,
                                         (int) off, (int) size);
         }
     }
-    else
+    else if (xfuse_wb_wait(fh, WB_WAIT_READ, req, ino, off, size, NULL) == 0)
     {
-        /* target file is on a remote device */
+        /* read once the write behind data has gone */
+    }
+    else if (xfuse_ra_read(fh, req, size, off) != 0)
+    {
+        /* target file is on a remote device, and not read ahead */
 
         fusep = g_new0(struct state_read, 1);
         if (fusep == NULL)
@@ -2380,6 +3390,13 @@ static void xfuse_cb_write(fuse_req_t req, fuse_ino_t ino, const char *buf,
     else
     {
         /* target file is on a remote device */
+        xfuse_ra_invalidate(ino);
+
+        if (xfuse_wb_write(fh, req, buf, size, off) == 0)
+        {
+            /* taken by write behind */
+            return;
+        }
 
         fusep = g_new0(struct state_write, 1);
         if (fusep == NULL)
@@ -2420,18 +3437,41 @@ static void xfuse_cb_create(fuse_req_t req, fuse_ino_t parent,
     xfuse_create_dir_or_file(req, parent, name, mode & ~S_IFDIR, fi);
 }
 
+/**
+ * Called on each close() of a file. Write behind errors are returned
+ * from here
+ *****************************************************************************/
+
+static void xfuse_cb_flush(fuse_req_t req, fuse_ino_t ino,
+                           struct fuse_file_info *fi)
+{
+    XFUSE_HANDLE *fh;
+
+    LOG_DEVEL(LOG_LEVEL_DEBUG, "entered: ino=%ld", ino);
+
+    if ((fh = xfuse_handle_from_fuse_handle(fi->fh)) == NULL ||
+            fh->wb == NULL)
+    {
+        fuse_reply_err(req, 0);
+    }
+    else if (xfuse_wb_wait(fh, WB_WAIT_FLUSH, req, ino, 0, 0, NULL) != 0)
+    {
+        fuse_reply_err(req, fh->wb->error);
+        fh->wb->error = 0;
+    }
+}
+
 /**
  *****************************************************************************/
 
-#if 0
 static void xfuse_cb_fsync(fuse_req_t req, fuse_ino_t ino, int datasync,
                            struct fuse_file_info *fi)
 {
-    LOG_DEVEL(LOG_LEVEL_DEBUG, "#################### entered: ino=%ld datasync=%d", ino, datasync);
-    LOG_DEVEL(LOG_LEVEL_DEBUG, "function not required");
-    fuse_reply_err(req, EINVAL);
+    LOG_DEVEL(LOG_LEVEL_DEBUG, "entered: ino=%ld datasync=%d", ino, datasync);
+
+    /* the client has the data once the write behind has gone */
+    xfuse_cb_flush(req, ino, fi);
 }
-#endif
 
 /**
  * Sets attributes for a directory entry.
@@ -2535,6 +3575,11 @@ static void xfuse_cb_setattr(fuse_req_t req, fuse_ino_t ino, struct stat *attr,
                 /* we want path minus 'root node of the share' */
                 cptr = filename_on_device(full_path);
 
+                if ((change_mask & TO_SET_SIZE) != 0)
+                {
+                    xfuse_ra_invalidate(ino);
+                }
+
                 /*
                  * If this call succeeds, further request processing happens
                  * in xfuse_devredir_cb_setattr()
@@ -176,8 +176,11 @@ x-special/gnome-copied-files
 #include "clipboard.h"
 #include "clipboard_file.h"
 #include "clipboard_common.h"
+#include "clipboard_stream.h"
 #include "xcommon.h"
 #include "chansrv_fuse.h"
+#include "timeout.h"
+#include "ms-rdpbcgr.h"
 #include "ms-rdpeclip.h"
 
 static char g_bmp_image_header[] =
@@ -229,6 +232,11 @@ static XSelectionRequestEvent g_saved_selection_req_event;
 /* xserver maximum request size in bytes */
 static int g_incr_max_req_size = 0;
 
+/* window for a large data response streaming to an INCR requestor,
+   it grows past twice the request size only for a slow requestor */
+static struct clip_stream *g_c2s_stream = 0;
+#define CLIPBOARD_STREAM_MAX_SIZE (64 * 1024 * 1024)
+
 /* server to client, pasting from linux app to mstsc */
 struct clip_s2c g_clip_s2c;
 /* client to server, pasting from mstsc to linux app */
@@ -473,11 +481,16 @@ clipboard_init(void)
     return rv;
 }
 
+/*****************************************************************************/
+static void
+ss_stop(void);
+
 /*****************************************************************************/
 int
 clipboard_deinit(void)
 {
     LOG_DEVEL(LOG_LEVEL_INFO, "clipboard_deinit:");
+    ss_stop();
     if (g_wnd != 0)
     {
         XDestroyWindow(g_display, g_wnd);
@@ -485,6 +498,7 @@ clipboard_deinit(void)
     }
 
     xfuse_deinit();
+    clipboard_file_deinit();
 
     g_free(g_clip_c2s.data);
     g_clip_c2s.data = 0;
@@ -1418,59 +1432,93 @@ clipboard_process_clip_caps(struct stream *s, int clip_msg_status,
 }
 
 /*****************************************************************************/
-static int
-ss_part(char *data, int data_bytes)
+static void
+ss_stop(void)
 {
-    int index;
-    char *text;
+    if (g_c2s_stream != 0)
+    {
+        LOG(LOG_LEVEL_DEBUG, "ss_stop: in %lld out %lld peak %d stalls %d",
+            g_c2s_stream->in_total, g_c2s_stream->out_total,
+            g_c2s_stream->peak, g_c2s_stream->stalls);
+        /* resumes input if it is paused */
+        clip_stream_delete(g_c2s_stream);
+        g_c2s_stream = 0;
+    }
+}
 
-    LOG_DEVEL(LOG_LEVEL_DEBUG, "ss_part: data_bytes %d read_bytes_done %d "
-              "incr_bytes_done %d", data_bytes,
-              g_clip_c2s.read_bytes_done,
-              g_clip_c2s.incr_bytes_done);
-    /* copy to buffer */
-    if (g_clip_c2s.type == g_utf8_atom)
+/*****************************************************************************/
+/* gives up on the requestor, the rest of the response is discarded */
+static void
+ss_abort(void)
+{
+    if (g_clip_c2s.incr_in_progress)
     {
-        /* todo unicode */
-        text = (char *)g_malloc(data_bytes, 0);
-        index = 0;
-        data_bytes /= 2;
-        while (index < data_bytes)
-        {
-            text[index] = data[index * 2];
-            index++;
-        }
-        text[index] = 0;
-        g_memcpy(g_clip_c2s.data + g_clip_c2s.read_bytes_done, text, data_bytes);
-        g_clip_c2s.read_bytes_done += data_bytes;
-        g_free(text);
+        XSelectInput(g_display, g_clip_c2s.window, NoEventMask);
+        g_clip_c2s.incr_in_progress = 0;
     }
-    else
+    ss_stop();
+}
+
+/*****************************************************************************/
+/* sends the next INCR chunk, or the empty one that ends the transfer */
+static void
+ss_send(void)
+{
+    char *data;
+    int data_bytes;
+
+    data_bytes = clip_stream_peek(g_c2s_stream, &data, g_incr_max_req_size);
+    if ((data_bytes < 1) && g_clip_c2s.doing_response_ss)
     {
-        g_memcpy(g_clip_c2s.data + g_clip_c2s.read_bytes_done, data, data_bytes);
-        g_clip_c2s.read_bytes_done += data_bytes;
+        /* nothing yet, ss_part sends when more comes in */
+        g_clip_c2s.incr_in_progress = 0;
+        return;
     }
-    if (g_clip_c2s.incr_in_progress)
+    LOG_DEVEL(LOG_LEVEL_DEBUG, "ss_send: data_bytes %d incr_bytes_done %d",
+              data_bytes, g_clip_c2s.incr_bytes_done);
+    XChangeProperty(g_display, g_clip_c2s.window,
+                    g_clip_c2s.property, g_clip_c2s.type, 8,
+                    PropModeReplace, (tui8 *)data, data_bytes);
+    clip_stream_consume(g_c2s_stream, data_bytes);
+    g_clip_c2s.incr_bytes_done += data_bytes;
+    g_clip_c2s.incr_in_progress = 1;
+    if (data_bytes < 1)
     {
-        LOG_DEVEL(LOG_LEVEL_DEBUG, "ss_part: incr_in_progress set");
+        LOG_DEVEL(LOG_LEVEL_DEBUG, "ss_send: INCR done");
+        g_clip_c2s.incr_in_progress = 0;
+        /* we no longer need property notify */
+        XSelectInput(g_display, g_clip_c2s.window, NoEventMask);
+        ss_stop();
+        return;
+    }
+    clip_stream_flow(g_c2s_stream);
+}
+
+/*****************************************************************************/
+static int
+ss_part(char *data, int data_bytes)
+{
+    LOG_DEVEL(LOG_LEVEL_DEBUG, "ss_part: data_bytes %d incr_bytes_done %d",
+              data_bytes, g_clip_c2s.incr_bytes_done);
+    if (g_c2s_stream == 0)
+    {
+        /* dropped, discard the rest of the response */
         return 0;
     }
-    if (g_clip_c2s.read_bytes_done <= g_clip_c2s.incr_bytes_done)
+    if (clip_stream_write(g_c2s_stream, data, data_bytes) != 0)
     {
-        LOG_DEVEL(LOG_LEVEL_DEBUG, "ss_part: read_bytes_done < incr_bytes_done");
+        LOG(LOG_LEVEL_ERROR, "ss_part: no room for %d bytes, dropping "
+            "the paste", data_bytes);
+        ss_abort();
         return 0;
     }
-    data = g_clip_c2s.data + g_clip_c2s.incr_bytes_done;
-    data_bytes = g_clip_c2s.read_bytes_done - g_clip_c2s.incr_bytes_done;
-    if (data_bytes > g_incr_max_req_size)
+    if (g_clip_c2s.incr_in_progress)
     {
-        data_bytes = g_incr_max_req_size;
+        /* the next PropertyDelete sends it */
+        clip_stream_flow(g_c2s_stream);
+        return 0;
     }
-    g_clip_c2s.incr_bytes_done += data_bytes;
-    XChangeProperty(g_display, g_clip_c2s.window,
-                    g_clip_c2s.property, g_clip_c2s.type, 8,
-                    PropModeReplace, (tui8 *)data, data_bytes);
-    g_clip_c2s.incr_in_progress = 1;
+    ss_send();
     return 0;
 }
 
@@ -1478,38 +1526,20 @@ ss_part(char *data, int data_bytes)
 static int
 ss_end(void)
 {
-    char *data;
-    int data_bytes;
-
     LOG_DEVEL(LOG_LEVEL_DEBUG, "ss_end:");
     g_clip_c2s.doing_response_ss = 0;
     g_clip_c2s.in_request = 0;
 
-    if (g_clip_c2s.incr_in_progress)
+    if ((g_c2s_stream != 0) && !g_clip_c2s.incr_in_progress)
     {
-        LOG_DEVEL(LOG_LEVEL_DEBUG, "ss_end: incr_in_progress set");
-        return 0;
+        ss_send();
     }
-    if (g_clip_c2s.read_bytes_done <= g_clip_c2s.incr_bytes_done)
-    {
-        LOG_DEVEL(LOG_LEVEL_DEBUG, "ss_end: read_bytes_done < incr_bytes_done");
-        return 0;
-    }
-    data = g_clip_c2s.data + g_clip_c2s.incr_bytes_done;
-    data_bytes = g_clip_c2s.read_bytes_done - g_clip_c2s.incr_bytes_done;
-    if (data_bytes > g_incr_max_req_size)
-    {
-        data_bytes = g_incr_max_req_size;
-    }
-    g_clip_c2s.incr_bytes_done += data_bytes;
-    XChangeProperty(g_display, g_clip_c2s.window,
-                    g_clip_c2s.property, g_clip_c2s.type, 8,
-                    PropModeReplace, (tui8 *)data, data_bytes);
-    g_clip_c2s.incr_in_progress = 1;
     return 0;
 }
 
 /*****************************************************************************/
+/* starts passing a large data response straight through to the requestor
+   in INCR chunks, only a window of it is ever held here */
 static int
 ss_start(char *data, int data_bytes, int total_bytes)
 {
@@ -1517,11 +1547,13 @@ ss_start(char *data, int data_bytes, int total_bytes)
     XSelectionRequestEvent *req;
     long val1[2];
     int incr_bytes;
+    int mode;
 
     LOG_DEVEL(LOG_LEVEL_DEBUG, "ss_start: data_bytes %d total_bytes %d",
               data_bytes, total_bytes);
     req = &g_saved_selection_req_event;
 
+    mode = CLIP_STREAM_RAW;
     incr_bytes = total_bytes;
     if (req->target == g_image_bmp_atom)
     {
@@ -1529,6 +1561,13 @@ ss_start(char *data, int data_bytes, int total_bytes)
     }
     else if (req->target == g_utf8_atom)
     {
+        mode = CLIP_STREAM_UTF8;
+        incr_bytes /= 2;
+    }
+    else if (req->target == XA_STRING)
+    {
+        /* ICCCM STRING is ISO-8859-1 */
+        mode = CLIP_STREAM_LATIN1;
         incr_bytes /= 2;
     }
     val1[0] = incr_bytes; /* a guess */
@@ -1540,9 +1579,22 @@ ss_start(char *data, int data_bytes, int total_bytes)
     g_clip_c2s.type = req->target;
     g_clip_c2s.property = req->property;
     g_clip_c2s.window = req->requestor;
+    /* not kept, a later paste asks the client again */
     g_free(g_clip_c2s.data);
-    g_clip_c2s.data = (char *)g_malloc(incr_bytes + 64, 0);
-    g_clip_c2s.total_bytes = incr_bytes;
+    g_clip_c2s.data = 0;
+    g_clip_c2s.total_bytes = 0;
+    g_clip_c2s.converted = 0;
+
+    ss_stop();
+    g_c2s_stream = clip_stream_create(g_incr_max_req_size * 2,
+                                      CLIPBOARD_STREAM_MAX_SIZE, mode,
+                                      chansrv_pause_input);
+    if (g_c2s_stream == 0)
+    {
+        LOG(LOG_LEVEL_ERROR, "ss_start: out of memory");
+        clipboard_refuse_selection(req);
+        return 0;
+    }
 
     XChangeProperty(g_display, req->requestor, req->property,
                     g_incr_atom, 32, PropModeReplace, (tui8 *)val1, 1);
@@ -1561,10 +1613,10 @@ ss_start(char *data, int data_bytes, int total_bytes)
 
     if (req->target == g_image_bmp_atom)
     {
-        g_memcpy(g_clip_c2s.data, g_bmp_image_header, 14);
-        g_clip_c2s.read_bytes_done = 14;
+        clip_stream_write(g_c2s_stream, g_bmp_image_header, 14);
     }
 
+    /* the first chunk goes when the requestor deletes the INCR property */
     g_clip_c2s.incr_in_progress = 1;
 
     ss_part(data, data_bytes);
@@ -1609,7 +1661,8 @@ clipboard_data_in(struct stream *s, int chan_id, int chan_flags, int length,
         return 0;
     }
 
-    if (g_clip_c2s.in_request)
+    /* file lists are converted whole, they go the usual way */
+    if (g_clip_c2s.in_request && (g_clip_c2s.xrdp_clip_type != XRDP_CB_FILE))
     {
         if (total_length > 32 * 1024)
         {
@@ -1749,6 +1802,7 @@ clipboard_event_selection_owner_notify(XEvent *xevent)
     }
 
     g_got_selection = 0;
+    clipboard_file_evict();
     if (lxevent->owner != 0) /* nil owner comes when selection */
     {
         /* window is closed */
@@ -1939,6 +1993,7 @@ clipboard_event_selection_notify(XEvent *xevent)
             g_clip_s2c.total_bytes = 0;
             g_free(g_clip_s2c.data);
             g_clip_s2c.data = 0;
+            g_clip_s2c.alloc_bytes = 0;
             //LOG_DEVEL_HEXDUMP(LOG_LEVEL_TRACE, "", data, sizeof(long));
             g_free(data);
             return 0;
@@ -2562,6 +2617,7 @@ clipboard_event_property_notify(XEvent *xevent)
     int format_in_bytes;
     int new_data_len;
     int data_bytes;
+    int alloc_bytes;
     char *cptr;
 
     LOG_DEVEL(LOG_LEVEL_DEBUG, "clipboard_event_property_notify: PropertyNotify .window %ld "
@@ -2569,10 +2625,18 @@ clipboard_event_property_notify(XEvent *xevent)
               xevent->xproperty.state, xevent->xproperty.atom,
               get_atom_text(xevent->xproperty.atom));
 
-    if (g_clip_c2s.incr_in_progress &&
+    if ((g_c2s_stream != 0) && g_clip_c2s.incr_in_progress &&
             (xevent->xproperty.window == g_clip_c2s.window) &&
             (xevent->xproperty.atom == g_clip_c2s.property) &&
             (xevent->xproperty.state == PropertyDelete))
+    {
+        /* streaming a data response, see ss_start */
+        ss_send();
+    }
+    else if (g_clip_c2s.incr_in_progress &&
+             (xevent->xproperty.window == g_clip_c2s.window) &&
+             (xevent->xproperty.atom == g_clip_c2s.property) &&
+             (xevent->xproperty.state == PropertyDelete))
     {
         LOG_DEVEL(LOG_LEVEL_DEBUG, "clipboard_event_property_notify: INCR PropertyDelete");
         /* this is used for when copying a large clipboard to the other app,
@@ -2675,13 +2739,26 @@ clipboard_event_property_notify(XEvent *xevent)
 
             format_in_bytes = FORMAT_TO_BYTES(actual_format_return);
             new_data_len = nitems_returned * format_in_bytes;
-            cptr = (char *) g_malloc(g_clip_s2c.total_bytes + new_data_len, 0);
-            g_memcpy(cptr, g_clip_s2c.data, g_clip_s2c.total_bytes);
-            g_free(g_clip_s2c.data);
+            /* grow by doubling, copying on every chunk is quadratic,
+               keep a byte for the nil the text path needs */
+            if (g_clip_s2c.total_bytes + new_data_len >=
+                    g_clip_s2c.alloc_bytes)
+            {
+                alloc_bytes = MAX(g_clip_s2c.alloc_bytes * 2,
+                                  g_clip_s2c.total_bytes + new_data_len + 1);
+                cptr = (char *) g_malloc(alloc_bytes, 0);
+                if (cptr != NULL)
+                {
+                    g_memcpy(cptr, g_clip_s2c.data, g_clip_s2c.total_bytes);
+                }
+                g_free(g_clip_s2c.data);
+                g_clip_s2c.data = cptr;
+                g_clip_s2c.alloc_bytes = alloc_bytes;
+            }
 
-            if (cptr == NULL)
+            if (g_clip_s2c.data == NULL)
             {
-                g_clip_s2c.data = 0;
+                g_clip_s2c.alloc_bytes = 0;
 
                 /* cannot add any more data */
                 if (data != 0)
@@ -2694,9 +2771,9 @@ clipboard_event_property_notify(XEvent *xevent)
             }
 
             LOG_DEVEL(LOG_LEVEL_DEBUG, "clipboard_event_property_notify: new_data_len %d", new_data_len);
-            g_clip_s2c.data = cptr;
             g_memcpy(g_clip_s2c.data + g_clip_s2c.total_bytes, data, new_data_len);
             g_clip_s2c.total_bytes += new_data_len;
+            g_clip_s2c.data[g_clip_s2c.total_bytes] = 0;
 
             if (data)
             {
@@ -44,6 +44,7 @@ struct clip_s2c /* server to client, pasting from linux app to mstsc */
 {
     int incr_in_progress;
     int total_bytes;
+    int alloc_bytes; /* size of data while an INCR comes in */
     char *data;
     Atom type; /* UTF8_STRING, image/bmp, ... */
     Atom property; /* XRDP_CLIP_PROPERTY_ATOM, _QT_SELECTION, ... */
@@ -38,6 +38,7 @@
 #include "chansrv.h"
 #include "clipboard.h"
 #include "clipboard_file.h"
+#include "clipboard_file_cache.h"
 #include "clipboard_common.h"
 #include "xcommon.h"
 #include "chansrv_fuse.h"
@@ -64,6 +65,10 @@ static struct list *g_files_list = 0;
 /* used when server is asking for file info from the client */
 static int g_file_request_sent_type = 0;
 
+/* files being copied to the client, and the stream for their chunks */
+static struct clipboard_file_cache *g_file_cache = 0;
+static struct stream *g_file_data_s = 0;
+
 /* number of seconds from 1 Jan. 1601 00:00 to 1 Jan 1970 00:00 UTC */
 #define CB_EPOCH_DIFF 11644473600LL
 
@@ -305,6 +310,7 @@ clipboard_send_data_response_for_file(const char *data, int data_size)
         g_files_list->auto_free = 1;
     }
     list_clear(g_files_list);
+    clipboard_file_evict();
     clipboard_get_files(data, data_size);
     cItems = g_files_list->count;
     bytes_after_header = cItems * 592 + 4;
@@ -441,7 +447,6 @@ clipboard_send_file_data(int streamId, int lindex,
     struct stream *s;
     int size;
     int rv;
-    int fd;
     char full_fn[256];
     struct cb_file_info *cfi;
 
@@ -461,53 +466,79 @@ clipboard_send_file_data(int streamId, int lindex,
     LOG_DEVEL(LOG_LEVEL_DEBUG, "clipboard_send_file_data: streamId %d lindex %d "
               "nPositionLow %d cbRequested %d", streamId, lindex,
               nPositionLow, cbRequested);
-    g_snprintf(full_fn, 255, "%s/%s", cfi->pathname, cfi->filename);
-    fd = g_file_open_ex(full_fn, 1, 0, 0, 0);
-    if (fd == -1)
+    if (g_file_cache == 0)
     {
-        LOG(LOG_LEVEL_ERROR, "clipboard_send_file_data: file open [%s] failed: %s",
-            full_fn, g_get_strerror());
-        clipboard_send_filecontents_response_fail(streamId);
-        return 1;
+        g_file_cache = clipboard_file_cache_create();
     }
-    if (g_file_seek(fd, nPositionLow) < 0)
+    if (g_file_data_s == 0)
+    {
+        make_stream(g_file_data_s);
+    }
+    if (g_file_cache == 0 || g_file_data_s == 0 || cbRequested < 0)
     {
-        LOG(LOG_LEVEL_ERROR, "clipboard_send_file_data: seek error in file [%s]: %s",
-            full_fn, g_get_strerror());
-        g_file_close(fd);
         clipboard_send_filecontents_response_fail(streamId);
         return 1;
     }
-    make_stream(s);
+    g_snprintf(full_fn, 255, "%s/%s", cfi->pathname, cfi->filename);
+    s = g_file_data_s;
     init_stream(s, cbRequested + 64);
-    size = g_file_read(fd, s->data + 12, cbRequested);
+    size = clipboard_file_cache_read(g_file_cache, streamId, lindex, full_fn,
+                                     nPositionLow, s->data + 12, cbRequested);
     if (size < 1)
     {
         LOG_DEVEL(LOG_LEVEL_ERROR, "clipboard_send_file_data: read error, want %d got %d",
                   cbRequested, size);
-        free_stream(s);
-        g_file_close(fd);
         clipboard_send_filecontents_response_fail(streamId);
-        return 1;
+        rv = 1;
+    }
+    else
+    {
+        out_uint16_le(s, CB_FILECONTENTS_RESPONSE); /* 9 */
+        out_uint16_le(s, CB_RESPONSE_OK); /* 1 status */
+        out_uint32_le(s, size + 4);
+        out_uint32_le(s, streamId);
+        s->p += size;
+        out_uint32_le(s, 0);
+        s_mark_end(s);
+        size = (int)(s->end - s->data);
+        rv = send_channel_data(g_cliprdr_chan_id, s->data, size);
     }
-    out_uint16_le(s, CB_FILECONTENTS_RESPONSE); /* 9 */
-    out_uint16_le(s, CB_RESPONSE_OK); /* 1 status */
-    out_uint32_le(s, size + 4);
-    out_uint32_le(s, streamId);
-    s->p += size;
-    out_uint32_le(s, 0);
-    s_mark_end(s);
-    size = (int)(s->end - s->data);
-    rv = send_channel_data(g_cliprdr_chan_id, s->data, size);
-    free_stream(s);
-    g_file_close(fd);
-
-    /* Log who transferred which file via clipboard for the purpose of audit */
-    LOG(LOG_LEVEL_INFO, "S2C: Transferred a file: filename=%s, uid=%d", full_fn, g_getuid());
 
+    if (cbRequested > CLIPBOARD_FILE_READ_AHEAD)
+    {
+        /* the client picks the size, don't keep a big one for the
+           session */
+        free_stream(g_file_data_s);
+        g_file_data_s = 0;
+    }
     return rv;
 }
 
+/*****************************************************************************/
+/* closes the files kept open for the client, the clipboard has changed */
+void
+clipboard_file_evict(void)
+{
+    if (g_file_cache != 0)
+    {
+        LOG(LOG_LEVEL_DEBUG, "clipboard_file_evict: %d requests, %d opens, "
+            "%d reads", g_file_cache->requests, g_file_cache->opens,
+            g_file_cache->reads);
+        clipboard_file_cache_clear(g_file_cache);
+    }
+}
+
+/*****************************************************************************/
+void
+clipboard_file_deinit(void)
+{
+    clipboard_file_evict();
+    clipboard_file_cache_delete(g_file_cache);
+    g_file_cache = 0;
+    free_stream(g_file_data_s);
+    g_file_data_s = 0;
+}
+
 /*****************************************************************************/
 /* ask the client to send the file size */
 int
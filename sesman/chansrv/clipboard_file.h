@@ -58,4 +58,14 @@ int
 clipboard_request_file_data(int stream_id, int lindex, int offset,
                             int request_bytes);
 
+/**
+ * Closes the files kept open for CB_FILECONTENTS_REQUESTs. Call on a
+ * clipboard change, a later request for one of them opens it again
+ */
+void
+clipboard_file_evict(void);
+
+void
+clipboard_file_deinit(void);
+
 #endif
@@ -0,0 +1,252 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * clipboard file contents cache
+ *
+ * Clients ask for a file in order, a chunk at a time, so each entry
+ * keeps its file open with a read-ahead buffer starting at the last
+ * request. A request inside the buffer is a copy, one past it keeps
+ * what is left and reads on from where the file already is, and
+ * anything else seeks. Requests bigger than the buffer skip it.
+ */
+
+#if defined(HAVE_CONFIG_H)
+#include <config_ac.h>
+#endif
+
+#include "arch.h"
+#include "defines.h"
+#include "os_calls.h"
+#include "log.h"
+#include "clipboard_file_cache.h"
+
+/*****************************************************************************/
+struct clipboard_file_cache *
+clipboard_file_cache_create(void)
+{
+    struct clipboard_file_cache *cache;
+    int index;
+
+    cache = g_new0(struct clipboard_file_cache, 1);
+    if (cache != NULL)
+    {
+        for (index = 0; index < CLIPBOARD_FILE_CACHE_ENTRIES; index++)
+        {
+            cache->entries[index].fd = -1;
+        }
+    }
+    return cache;
+}
+
+/*****************************************************************************/
+static void
+entry_close(struct clipboard_file_cache_entry *entry)
+{
+    if (entry->fd != -1)
+    {
+        g_file_close(entry->fd);
+        entry->fd = -1;
+    }
+    entry->buf_bytes = 0;
+}
+
+/*****************************************************************************/
+void
+clipboard_file_cache_delete(struct clipboard_file_cache *cache)
+{
+    int index;
+
+    if (cache == NULL)
+    {
+        return;
+    }
+    clipboard_file_cache_clear(cache);
+    for (index = 0; index < CLIPBOARD_FILE_CACHE_ENTRIES; index++)
+    {
+        g_free(cache->entries[index].buf);
+    }
+    g_free(cache);
+}
+
+/*****************************************************************************/
+void
+clipboard_file_cache_clear(struct clipboard_file_cache *cache)
+{
+    int index;
+
+    for (index = 0; index < CLIPBOARD_FILE_CACHE_ENTRIES; index++)
+    {
+        entry_close(cache->entries + index);
+    }
+}
+
+/*****************************************************************************/
+/* the entry for a stream, opening the file in the least recently used
+   entry if it isn't open */
+static struct clipboard_file_cache_entry *
+entry_get(struct clipboard_file_cache *cache, int stream_id, int lindex,
+          const char *filename)
+{
+    struct clipboard_file_cache_entry *entry;
+    struct clipboard_file_cache_entry *lru;
+    int index;
+
+    lru = cache->entries;
+    for (index = 0; index < CLIPBOARD_FILE_CACHE_ENTRIES; index++)
+    {
+        entry = cache->entries + index;
+        if (entry->fd != -1 && entry->stream_id == stream_id &&
+                entry->lindex == lindex)
+        {
+            return entry;
+        }
+        if (lru->fd != -1 &&
+                (entry->fd == -1 || entry->last_used < lru->last_used))
+        {
+            lru = entry;
+        }
+    }
+
+    entry = lru;
+    entry_close(entry);
+    if (entry->buf == NULL)
+    {
+        entry->buf = (char *)g_malloc(CLIPBOARD_FILE_READ_AHEAD, 0);
+        if (entry->buf == NULL)
+        {
+            return NULL;
+        }
+    }
+    entry->fd = g_file_open_ex(filename, 1, 0, 0, 0);
+    if (entry->fd == -1)
+    {
+        LOG(LOG_LEVEL_ERROR, "clipboard_file_cache: file open [%s] "
+            "failed: %s", filename, g_get_strerror());
+        return NULL;
+    }
+    entry->stream_id = stream_id;
+    entry->lindex = lindex;
+    entry->fd_offset = 0;
+    entry->buf_offset = 0;
+    entry->buf_bytes = 0;
+    cache->opens++;
+    /* Log who transferred which file via clipboard for the purpose of
+       audit, once a transfer rather than once a chunk */
+    LOG(LOG_LEVEL_INFO, "S2C: Transferred a file: filename=%s, uid=%d",
+        filename, g_getuid());
+    return entry;
+}
+
+/*****************************************************************************/
+/* reads until bytes or the end of the file, returns bytes read or -1 */
+static int
+entry_read(struct clipboard_file_cache *cache,
+           struct clipboard_file_cache_entry *entry,
+           int offset, char *data, int bytes)
+{
+    int rv;
+    int got;
+
+    if (entry->fd_offset != offset)
+    {
+        if (g_file_seek(entry->fd, offset) < 0)
+        {
+            LOG(LOG_LEVEL_ERROR, "clipboard_file_cache: seek error: %s",
+                g_get_strerror());
+            return -1;
+        }
+        entry->fd_offset = offset;
+    }
+    rv = 0;
+    while (rv < bytes)
+    {
+        got = g_file_read(entry->fd, data + rv, bytes - rv);
+        cache->reads++;
+        if (got < 0)
+        {
+            LOG(LOG_LEVEL_ERROR, "clipboard_file_cache: read error: %s",
+                g_get_strerror());
+            return -1;
+        }
+        if (got == 0)
+        {
+            break;
+        }
+        rv += got;
+        entry->fd_offset += got;
+    }
+    return rv;
+}
+
+/*****************************************************************************/
+int
+clipboard_file_cache_read(struct clipboard_file_cache *cache,
+                          int stream_id, int lindex, const char *filename,
+                          int offset, char *data, int bytes)
+{
+    struct clipboard_file_cache_entry *entry;
+    int keep;
+    int got;
+
+    cache->requests++;
+    entry = entry_get(cache, stream_id, lindex, filename);
+    if (entry == NULL)
+    {
+        return -1;
+    }
+    entry->last_used = ++cache->tick;
+
+    if (bytes >= CLIPBOARD_FILE_READ_AHEAD)
+    {
+        entry->buf_bytes = 0;
+        got = entry_read(cache, entry, offset, data, bytes);
+        if (got < 0)
+        {
+            entry_close(entry);
+        }
+        return got;
+    }
+
+    if (offset < entry->buf_offset ||
+            offset + bytes > entry->buf_offset + entry->buf_bytes)
+    {
+        keep = 0;
+        if (offset >= entry->buf_offset &&
+                offset < entry->buf_offset + entry->buf_bytes)
+        {
+            /* the start is buffered, the file is at the end of it */
+            keep = entry->buf_offset + entry->buf_bytes - offset;
+            g_memmove(entry->buf, entry->buf + (offset - entry->buf_offset),
+                      keep);
+        }
+        entry->buf_offset = offset;
+        entry->buf_bytes = keep;
+        got = entry_read(cache, entry, offset + keep, entry->buf + keep,
+                         CLIPBOARD_FILE_READ_AHEAD - keep);
+        if (got < 0)
+        {
+            entry_close(entry);
+            return -1;
+        }
+        entry->buf_bytes += got;
+    }
+
+    bytes = MIN(bytes, entry->buf_offset + entry->buf_bytes - offset);
+    bytes = MAX(bytes, 0);
+    g_memcpy(data, entry->buf + (offset - entry->buf_offset), bytes);
+    return bytes;
+}
@@ -0,0 +1,80 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* open files and read-ahead for CB_FILECONTENTS_REQUESTs, so a file
+   copied to the client is opened once rather than once a chunk */
+
+#ifndef _CLIPBOARD_FILE_CACHE_H
+#define _CLIPBOARD_FILE_CACHE_H
+
+/* files kept open at once */
+#define CLIPBOARD_FILE_CACHE_ENTRIES 4
+/* bytes read from a file at a time */
+#define CLIPBOARD_FILE_READ_AHEAD (256 * 1024)
+
+struct clipboard_file_cache_entry
+{
+    int stream_id;
+    int lindex;
+    int fd;         /* -1 if the entry is free */
+    int fd_offset;  /* file offset of fd */
+    char *buf;      /* read-ahead, CLIPBOARD_FILE_READ_AHEAD bytes */
+    int buf_offset; /* file offset of buf[0] */
+    int buf_bytes;
+    int last_used;
+};
+
+struct clipboard_file_cache
+{
+    struct clipboard_file_cache_entry entries[CLIPBOARD_FILE_CACHE_ENTRIES];
+    int tick;
+    /* counters */
+    int requests;
+    int opens;
+    int reads;
+};
+
+struct clipboard_file_cache *
+clipboard_file_cache_create(void);
+
+void
+clipboard_file_cache_delete(struct clipboard_file_cache *cache);
+
+/**
+ * Closes all the files, for a clipboard change
+ */
+void
+clipboard_file_cache_clear(struct clipboard_file_cache *cache);
+
+/**
+ * Reads part of a file for a stream, opening it if it isn't open for
+ * the stream already. The least recently used file is closed to make
+ * room
+ *
+ * @param stream_id streamId of the request
+ * @param lindex lindex of the request
+ * @param filename File to open if it isn't open
+ * @param offset File offset to read from
+ * @param data Where to put the bytes
+ * @param bytes Bytes wanted
+ * @return bytes read, 0 at the end of the file, -1 on error
+ */
+int
+clipboard_file_cache_read(struct clipboard_file_cache *cache,
+                          int stream_id, int lindex, const char *filename,
+                          int offset, char *data, int bytes);
+
+#endif
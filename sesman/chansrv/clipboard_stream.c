@@ -0,0 +1,322 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * clipboard transfer window
+ *
+ * The window is a linear buffer. Bytes are taken from the front and
+ * added at the back, and what is left is moved down to the start when
+ * a write would not fit after it. X takes whole INCR chunks, so this
+ * is rare and cheaper than handing out wrapped chunks.
+ *
+ * Pausing input stops chansrv reading from xrdp, and xrdp then stops
+ * reading from the client, so the pause is kept short. A requestor that
+ * can't keep up costs memory rather than input latency.
+ */
+
+#if defined(HAVE_CONFIG_H)
+#include <config_ac.h>
+#endif
+
+#include "arch.h"
+#include "defines.h"
+#include "os_calls.h"
+#include "log.h"
+#include "clipboard_stream.h"
+#include "timeout.h"
+#include "ms-rdpbcgr.h"
+
+#define REPLACEMENT_CHAR 0xfffd
+/* room to keep for a channel fragment before input is paused */
+#define FRAG_ROOM CLIP_STREAM_MAX_OUT(CHANNEL_CHUNK_LENGTH)
+
+/*****************************************************************************/
+struct clip_stream *
+clip_stream_create(int size, int max_size, int mode,
+                   void (*pause)(int pause))
+{
+    struct clip_stream *cs;
+
+    cs = g_new0(struct clip_stream, 1);
+    if (cs == NULL)
+    {
+        return NULL;
+    }
+    cs->data = (char *)g_malloc(size, 0);
+    if (cs->data == NULL)
+    {
+        g_free(cs);
+        return NULL;
+    }
+    cs->size = size;
+    cs->max_size = MAX(size, max_size);
+    cs->mode = mode;
+    cs->lead = -1;
+    cs->pause = pause;
+    return cs;
+}
+
+/*****************************************************************************/
+void
+clip_stream_delete(struct clip_stream *cs)
+{
+    if (cs != NULL)
+    {
+        cancel_timeout(cs->stall_timeout);
+        if (cs->paused && cs->pause != NULL)
+        {
+            cs->pause(0);
+        }
+        g_free(cs->data);
+        g_free(cs);
+    }
+}
+
+/*****************************************************************************/
+static void
+out_utf8(char **out, int cp)
+{
+    unsigned char *p;
+
+    p = (unsigned char *)*out;
+    if (cp < 0x80)
+    {
+        *p++ = cp;
+    }
+    else if (cp < 0x800)
+    {
+        *p++ = 0xc0 | (cp >> 6);
+        *p++ = 0x80 | (cp & 0x3f);
+    }
+    else if (cp < 0x10000)
+    {
+        *p++ = 0xe0 | (cp >> 12);
+        *p++ = 0x80 | ((cp >> 6) & 0x3f);
+        *p++ = 0x80 | (cp & 0x3f);
+    }
+    else
+    {
+        *p++ = 0xf0 | (cp >> 18);
+        *p++ = 0x80 | ((cp >> 12) & 0x3f);
+        *p++ = 0x80 | ((cp >> 6) & 0x3f);
+        *p++ = 0x80 | (cp & 0x3f);
+    }
+    *out = (char *)p;
+}
+
+/*****************************************************************************/
+static void
+out_char(struct clip_stream *cs, char **out, int cp)
+{
+    if (cs->mode == CLIP_STREAM_UTF8)
+    {
+        out_utf8(out, cp);
+    }
+    else
+    {
+        /* ISO-8859-1 is the first 256 code points */
+        **out = (cp < 0x100) ? cp : '?';
+        (*out)++;
+    }
+}
+
+/*****************************************************************************/
+/* converts UTF-16LE at out, returns the bytes written */
+static int
+utf16_convert(struct clip_stream *cs, const char *data, int bytes, char *out)
+{
+    const unsigned char *in;
+    char *start;
+    int index;
+    int unit;
+
+    in = (const unsigned char *)data;
+    start = out;
+    for (index = 0; index < bytes && !cs->done; index++)
+    {
+        if (cs->lead < 0)
+        {
+            cs->lead = in[index];
+            continue;
+        }
+        unit = cs->lead | (in[index] << 8);
+        cs->lead = -1;
+        if (cs->high != 0)
+        {
+            if (unit >= 0xdc00 && unit <= 0xdfff)
+            {
+                out_char(cs, &out, 0x10000 + ((cs->high - 0xd800) << 10) +
+                         (unit - 0xdc00));
+                cs->high = 0;
+                continue;
+            }
+            /* lone high surrogate */
+            out_char(cs, &out, REPLACEMENT_CHAR);
+            cs->high = 0;
+        }
+        if (unit >= 0xd800 && unit <= 0xdbff)
+        {
+            cs->high = unit;
+        }
+        else if (unit >= 0xdc00 && unit <= 0xdfff)
+        {
+            out_char(cs, &out, REPLACEMENT_CHAR);
+        }
+        else if (unit == 0)
+        {
+            cs->done = 1;
+        }
+        else
+        {
+            out_char(cs, &out, unit);
+        }
+    }
+    return (int)(out - start);
+}
+
+/*****************************************************************************/
+int
+clip_stream_write(struct clip_stream *cs, const char *data, int bytes)
+{
+    int need;
+    int added;
+
+    if (bytes < 1 || cs->done)
+    {
+        return 0;
+    }
+    need = bytes;
+    if (cs->mode != CLIP_STREAM_RAW)
+    {
+        need = CLIP_STREAM_MAX_OUT(bytes);
+    }
+    if (need > cs->size - cs->bytes)
+    {
+        return 1;
+    }
+    if (need > cs->size - (cs->head + cs->bytes))
+    {
+        g_memmove(cs->data, cs->data + cs->head, cs->bytes);
+        cs->head = 0;
+    }
+    if (cs->mode != CLIP_STREAM_RAW)
+    {
+        added = utf16_convert(cs, data, bytes,
+                              cs->data + cs->head + cs->bytes);
+    }
+    else
+    {
+        g_memcpy(cs->data + cs->head + cs->bytes, data, bytes);
+        added = bytes;
+    }
+    cs->bytes += added;
+    cs->peak = MAX(cs->peak, cs->bytes);
+    cs->in_total += bytes;
+    return 0;
+}
+
+/*****************************************************************************/
+int
+clip_stream_room(const struct clip_stream *cs)
+{
+    return cs->size - cs->bytes;
+}
+
+/*****************************************************************************/
+int
+clip_stream_peek(const struct clip_stream *cs, char **data, int max_bytes)
+{
+    *data = cs->data + cs->head;
+    return MIN(cs->bytes, max_bytes);
+}
+
+/*****************************************************************************/
+void
+clip_stream_consume(struct clip_stream *cs, int bytes)
+{
+    bytes = MIN(bytes, cs->bytes);
+    cs->head += bytes;
+    cs->bytes -= bytes;
+    cs->out_total += bytes;
+    if (cs->bytes == 0)
+    {
+        cs->head = 0;
+    }
+}
+
+/*****************************************************************************/
+/* input has been paused too long, grow the window and resume it */
+static void
+stall_timeout(void *data)
+{
+    struct clip_stream *cs;
+    char *new_data;
+    int new_size;
+
+    cs = (struct clip_stream *)data;
+    cs->stall_timeout = 0;
+    cs->stalls++;
+    new_size = MIN(cs->size * 2, cs->max_size);
+    if (new_size > cs->size)
+    {
+        new_data = (char *)g_malloc(new_size, 0);
+        if (new_data != NULL)
+        {
+            g_memcpy(new_data, cs->data + cs->head, cs->bytes);
+            g_free(cs->data);
+            cs->data = new_data;
+            cs->head = 0;
+            cs->size = new_size;
+        }
+    }
+    LOG(LOG_LEVEL_DEBUG, "clip_stream: requestor is slow, window now %d "
+        "bytes", cs->size);
+    /* resume even if it can't grow, a write that doesn't fit then fails */
+    cs->paused = 0;
+    if (cs->pause != NULL)
+    {
+        cs->pause(0);
+    }
+}
+
+/*****************************************************************************/
+void
+clip_stream_flow(struct clip_stream *cs)
+{
+    int full;
+
+    full = clip_stream_room(cs) < FRAG_ROOM;
+    if (full && !cs->paused && cs->stall_timeout == 0)
+    {
+        cs->paused = 1;
+        if (cs->pause != NULL)
+        {
+            cs->pause(1);
+        }
+        cs->stall_timeout = add_timeout(CLIP_STREAM_STALL_MS,
+                                        stall_timeout, cs);
+    }
+    else if (!full && cs->paused)
+    {
+        cancel_timeout(cs->stall_timeout);
+        cs->stall_timeout = 0;
+        cs->paused = 0;
+        if (cs->pause != NULL)
+        {
+            cs->pause(0);
+        }
+    }
+}
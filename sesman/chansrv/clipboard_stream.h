@@ -0,0 +1,119 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* window between cliprdr data response fragments and X INCR property
+   chunks, so a large paste to a requestor that keeps up never needs the
+   whole transfer in memory */
+
+#ifndef _CLIPBOARD_STREAM_H
+#define _CLIPBOARD_STREAM_H
+
+/* most bytes a write of this many input bytes can add to the window */
+#define CLIP_STREAM_MAX_OUT(_bytes) (((_bytes) / 2 + 2) * 3)
+
+/* ms input can stay paused on a full window before the window grows.
+   Input is the whole xrdp link, keyboard and mouse included */
+#define CLIP_STREAM_STALL_MS 50
+
+/* output of a window */
+#define CLIP_STREAM_RAW 0       /* input as is */
+#define CLIP_STREAM_UTF8 1      /* UTF-16LE input, UTF-8 output */
+#define CLIP_STREAM_LATIN1 2    /* UTF-16LE input, ISO-8859-1 output */
+
+struct clip_stream
+{
+    char *data;
+    int size;       /* window size */
+    int max_size;   /* most the window can grow to */
+    int head;       /* offset of the oldest byte */
+    int bytes;      /* bytes in the window */
+    int peak;       /* most bytes ever in the window */
+    int mode;       /* CLIP_STREAM_RAW, ... */
+    int lead;       /* low byte of a split UTF-16 unit, -1 if none */
+    int high;       /* high surrogate waiting for its pair, 0 if none */
+    int done;       /* NUL seen, the rest of the input is ignored */
+    int paused;     /* input is paused */
+    int stall_timeout; /* handle, 0 if none */
+    void (*pause)(int pause);
+    /* counters */
+    long long in_total;
+    long long out_total;
+    int stalls;
+};
+
+/**
+ * Creates a window
+ *
+ * @param size Window size in bytes
+ * @param max_size Most the window can grow to when input stalls
+ * @param mode CLIP_STREAM_RAW, or a UTF-16 conversion, which stops at
+ *             the first NUL
+ * @param pause Called to pause (1) or resume (0) input, see
+ *              clip_stream_flow()
+ * @return new window, or NULL on allocation failure
+ */
+struct clip_stream *
+clip_stream_create(int size, int max_size, int mode,
+                   void (*pause)(int pause));
+
+void
+clip_stream_delete(struct clip_stream *cs);
+
+/**
+ * Adds a fragment. UTF-16 units and surrogate pairs may be split
+ * across fragments
+ *
+ * @return 0 on success, 1 if the window has no room for the fragment,
+ *         in which case nothing is added
+ */
+int
+clip_stream_write(struct clip_stream *cs, const char *data, int bytes);
+
+/**
+ * Bytes that can be added before the window is full
+ */
+int
+clip_stream_room(const struct clip_stream *cs);
+
+/**
+ * Gets the oldest bytes in the window, without removing them
+ *
+ * @param data Set to the first byte
+ * @param max_bytes Most bytes wanted
+ * @return bytes available at data, at most max_bytes
+ */
+int
+clip_stream_peek(const struct clip_stream *cs, char **data, int max_bytes);
+
+/**
+ * Removes bytes from the front of the window, after a peek
+ */
+void
+clip_stream_consume(struct clip_stream *cs, int bytes);
+
+/**
+ * Pauses input while the window has no room for another channel
+ * fragment, and resumes it when there is. Call after writes and
+ * consumes.
+ *
+ * Input is not paused for more than CLIP_STREAM_STALL_MS at a time. If
+ * the window is still full after that, it doubles, up to max_size, and
+ * input resumes. Once it can't grow, writes fail when it is full
+ */
+void
+clip_stream_flow(struct clip_stream *cs);
+
+#endif
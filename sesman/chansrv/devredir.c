@@ -965,6 +965,7 @@ devredir_proc_device_iocompletion(struct stream *s)
     tui32      CompletionId;
     tui32      IoStatus32;
     tui32      Length;
+    tui32      FileId;
     enum COMPLETION_TYPE comp_type;
 
     if (!s_check_rem_and_log(s, 12, "Parsing [MS-RDPEFS] DR_DEVICE_IOCOMPLETION"))
@@ -1020,7 +1021,8 @@ devredir_proc_device_iocompletion(struct stream *s)
                     {
                         return -1;
                     }
-                    xstream_rd_u32_le(s, irp->FileId);
+                    xstream_rd_u32_le(s, FileId);
+                    devredir_irp_set_file_id(irp, FileId);
                     devredir_send_drive_dir_request(irp, DeviceId,
                                                     1, irp->pathname);
                 }
@@ -1031,7 +1033,8 @@ devredir_proc_device_iocompletion(struct stream *s)
                 {
                     return -1;
                 }
-                xstream_rd_u32_le(s, irp->FileId);
+                xstream_rd_u32_le(s, FileId);
+                devredir_irp_set_file_id(irp, FileId);
 
                 xfuse_devredir_cb_create_file(
                     (struct state_create *) irp->fuse_info,
@@ -1047,7 +1050,8 @@ devredir_proc_device_iocompletion(struct stream *s)
                 {
                     return -1;
                 }
-                xstream_rd_u32_le(s, irp->FileId);
+                xstream_rd_u32_le(s, FileId);
+                devredir_irp_set_file_id(irp, FileId);
 
                 xfuse_devredir_cb_open_file((struct state_open *) irp->fuse_info,
                                             IoStatus, DeviceId, irp->FileId);
@@ -1104,7 +1108,8 @@ devredir_proc_device_iocompletion(struct stream *s)
                 {
                     return -1;
                 }
-                xstream_rd_u32_le(s, irp->FileId);
+                xstream_rd_u32_le(s, FileId);
+                devredir_irp_set_file_id(irp, FileId);
                 devredir_proc_cid_rmdir_or_file(irp, IoStatus);
                 break;
 
@@ -1117,7 +1122,8 @@ devredir_proc_device_iocompletion(struct stream *s)
                 {
                     return -1;
                 }
-                xstream_rd_u32_le(s, irp->FileId);
+                xstream_rd_u32_le(s, FileId);
+                devredir_irp_set_file_id(irp, FileId);
                 devredir_proc_cid_rename_file(irp, IoStatus);
                 break;
 
@@ -1251,7 +1257,7 @@ devredir_get_dir_listing(struct state_dirscan *fusep, tui32 device_id,
         strcpy(irp->pathname, path);
         devredir_cvt_slash(irp->pathname);
 
-        irp->CompletionId = g_completion_id++;
+        devredir_irp_set_completion_id(irp, g_completion_id++);
         irp->completion_type = CID_CREATE_DIR_REQ;
         irp->DeviceId = device_id;
         irp->fuse_info = fusep;
@@ -1315,7 +1321,7 @@ devredir_lookup_entry(struct state_lookup *fusep, tui32 device_id,
          * Allocate an IRP to open the file, read the basic attributes,
          * read the standard attributes, and then close the file
          */
-        irp->CompletionId = g_completion_id++;
+        devredir_irp_set_completion_id(irp, g_completion_id++);
         irp->completion_type = CID_LOOKUP;
         irp->DeviceId = device_id;
         irp->gen.lookup.state = E_LOOKUP_GET_FH;
@@ -1373,7 +1379,7 @@ devredir_setattr_for_entry(struct state_setattr *fusep, tui32 device_id,
          * Allocate an IRP to open the file, update the attributes
          * and close the file.
          */
-        irp->CompletionId = g_completion_id++;
+        devredir_irp_set_completion_id(irp, g_completion_id++);
         irp->completion_type = CID_SETATTR;
         irp->DeviceId = device_id;
         irp->fuse_info = fusep;
@@ -1426,7 +1432,7 @@ devredir_file_create(struct state_create *fusep, tui32 device_id,
         devredir_cvt_slash(irp->pathname);
 
         irp->completion_type = CID_CREATE_REQ;
-        irp->CompletionId = g_completion_id++;
+        devredir_irp_set_completion_id(irp, g_completion_id++);
         irp->DeviceId = device_id;
         irp->fuse_info = fusep;
 
@@ -1479,7 +1485,7 @@ devredir_file_open(struct state_open *fusep, tui32 device_id,
         devredir_cvt_slash(irp->pathname);
 
         irp->completion_type = CID_OPEN_REQ;
-        irp->CompletionId = g_completion_id++;
+        devredir_irp_set_completion_id(irp, g_completion_id++);
         irp->DeviceId = device_id;
 
         irp->fuse_info = fusep;
@@ -1535,7 +1541,7 @@ int devredir_file_close(struct state_close *fusep, tui32 device_id,
         return -1;
     }
 
-    irp->CompletionId = g_completion_id++;
+    devredir_irp_set_completion_id(irp, g_completion_id++);
 #else
     if ((irp = devredir_irp_find_by_fileid(FileId)) == NULL)
     {
@@ -1575,7 +1581,7 @@ devredir_rmdir_or_file(struct state_remove *fusep, tui32 device_id,
         /* convert / to windows compatible \ */
         devredir_cvt_slash(irp->pathname);
 
-        irp->CompletionId = g_completion_id++;
+        devredir_irp_set_completion_id(irp, g_completion_id++);
         irp->completion_type = CID_RMDIR_OR_FILE;
         irp->DeviceId = device_id;
 
@@ -1634,9 +1640,9 @@ devredir_file_read(struct state_read *fusep, tui32 DeviceId, tui32 FileId,
     else
     {
         new_irp->DeviceId = DeviceId;
-        new_irp->FileId = FileId;
+        devredir_irp_set_file_id(new_irp, FileId);
         new_irp->completion_type = CID_READ;
-        new_irp->CompletionId = g_completion_id++;
+        devredir_irp_set_completion_id(new_irp, g_completion_id++);
         new_irp->fuse_info = fusep;
 
         devredir_insert_DeviceIoRequest(s,
@@ -1693,9 +1699,9 @@ devredir_file_write(struct state_write *fusep, tui32 DeviceId, tui32 FileId,
     else
     {
         new_irp->DeviceId = DeviceId;
-        new_irp->FileId = FileId;
+        devredir_irp_set_file_id(new_irp, FileId);
         new_irp->completion_type = CID_WRITE;
-        new_irp->CompletionId = g_completion_id++;
+        devredir_irp_set_completion_id(new_irp, g_completion_id++);
         new_irp->fuse_info = fusep;
         /* Offset needed after write to calculate new EOF */
         new_irp->gen.write.offset = Offset;
@@ -1760,7 +1766,7 @@ int devredir_file_rename(struct state_rename *fusep, tui32 device_id,
         devredir_cvt_slash(irp->gen.rename.new_name);
 
         irp->completion_type = CID_RENAME_FILE;
-        irp->CompletionId = g_completion_id++;
+        devredir_irp_set_completion_id(irp, g_completion_id++);
         irp->DeviceId = device_id;
 
         irp->fuse_info = fusep;
@@ -2138,6 +2144,7 @@ devredir_proc_cid_lookup(IRP *irp,
                          enum NTSTATUS IoStatus)
 {
     tui32 Length;
+    tui32 FileId;
 
     LOG_DEVEL(LOG_LEVEL_DEBUG, "entry state is %d", irp->gen.lookup.state);
     if (IoStatus != STATUS_SUCCESS)
@@ -2153,7 +2160,8 @@ devredir_proc_cid_lookup(IRP *irp,
         {
             case E_LOOKUP_GET_FH:
                 /* We've been sent the file ID */
-                xstream_rd_u32_le(s_in, irp->FileId);
+                xstream_rd_u32_le(s_in, FileId);
+                devredir_irp_set_file_id(irp, FileId);
                 issue_lookup(irp, FileBasicInformation);
                 irp->gen.lookup.state = E_LOOKUP_CHECK_BASIC;
                 break;
@@ -2316,6 +2324,7 @@ devredir_proc_cid_setattr(IRP *irp,
 #define TO_SET_BASIC_ATTRS (TO_SET_MODE | \
                             TO_SET_ATIME | TO_SET_MTIME)
     tui32 Length;
+    tui32 FileId;
 
     LOG_DEVEL(LOG_LEVEL_DEBUG, "entry state is %d", irp->gen.setattr.state);
     if (IoStatus != STATUS_SUCCESS)
@@ -2331,7 +2340,8 @@ devredir_proc_cid_setattr(IRP *irp,
         {
             case E_SETATTR_GET_FH:
                 /* We've been sent the file ID */
-                xstream_rd_u32_le(s_in, irp->FileId);
+                xstream_rd_u32_le(s_in, FileId);
+                devredir_irp_set_file_id(irp, FileId);
                 break;
 
             case E_SETATTR_CHECK_BASIC:
@@ -32,6 +32,231 @@
 #include "irp.h"
 
 IRP *g_irp_head = NULL;
+static IRP *g_irp_tail = NULL;
+
+/*
+ * IRPs are looked up by CompletionId for every I/O completion, and by
+ * FileId for every read and write, so as well as the list there are
+ * hash chains on both. The tables double when the IRPs outnumber the
+ * buckets by two to one.
+ *
+ * IRPs without a pathname are the common case, and come from slabs
+ * which are kept for reuse.
+ */
+#define IRP_HASH_MIN_BITS 6
+#define IRP_SLAB_COUNT 64
+
+struct irp_slab
+{
+    struct irp_slab *next;
+    IRP irps[IRP_SLAB_COUNT];
+};
+
+static IRP **g_cid_hash = NULL;
+static IRP **g_fid_hash = NULL;
+static unsigned int g_hash_bits = 0;
+static unsigned int g_irp_count = 0;
+static unsigned int g_irp_seq = 0;
+static IRP *g_irp_free_list = NULL;
+static struct irp_slab *g_irp_slabs = NULL;
+
+/*****************************************************************************/
+static unsigned int
+irp_hash(tui32 key)
+{
+    return (unsigned int) ((key * 2654435761U) >> (32 - g_hash_bits));
+}
+
+/*****************************************************************************/
+/* returns non zero if a was created before b, allowing for wrap */
+static int
+irp_older(const IRP *a, const IRP *b)
+{
+    return (int) (a->seq - b->seq) < 0;
+}
+
+/*****************************************************************************/
+static void
+irp_cid_link(IRP *irp)
+{
+    IRP **bucket = g_cid_hash + irp_hash(irp->CompletionId);
+
+    irp->cid_prev = NULL;
+    irp->cid_next = *bucket;
+    if (*bucket != NULL)
+    {
+        (*bucket)->cid_prev = irp;
+    }
+    *bucket = irp;
+}
+
+/*****************************************************************************/
+static void
+irp_cid_unlink(IRP *irp)
+{
+    if (irp->cid_prev != NULL)
+    {
+        irp->cid_prev->cid_next = irp->cid_next;
+    }
+    else
+    {
+        g_cid_hash[irp_hash(irp->CompletionId)] = irp->cid_next;
+    }
+    if (irp->cid_next != NULL)
+    {
+        irp->cid_next->cid_prev = irp->cid_prev;
+    }
+}
+
+/*****************************************************************************/
+static void
+irp_fid_link(IRP *irp)
+{
+    IRP **bucket = g_fid_hash + irp_hash(irp->FileId);
+
+    irp->fid_prev = NULL;
+    irp->fid_next = *bucket;
+    if (*bucket != NULL)
+    {
+        (*bucket)->fid_prev = irp;
+    }
+    *bucket = irp;
+}
+
+/*****************************************************************************/
+static void
+irp_fid_unlink(IRP *irp)
+{
+    if (irp->fid_prev != NULL)
+    {
+        irp->fid_prev->fid_next = irp->fid_next;
+    }
+    else
+    {
+        g_fid_hash[irp_hash(irp->FileId)] = irp->fid_next;
+    }
+    if (irp->fid_next != NULL)
+    {
+        irp->fid_next->fid_prev = irp->fid_prev;
+    }
+}
+
+/*****************************************************************************/
+/* makes sure there are enough buckets for one more IRP, returns 0 on
+   success */
+static int
+irp_hash_reserve(void)
+{
+    unsigned int bits;
+    IRP **cid_hash;
+    IRP **fid_hash;
+    IRP *irp;
+
+    if (g_hash_bits > 0 && g_irp_count + 1 <= (2U << g_hash_bits))
+    {
+        return 0;
+    }
+    bits = (g_hash_bits == 0) ? IRP_HASH_MIN_BITS : g_hash_bits + 1;
+    cid_hash = g_new0(IRP *, 1U << bits);
+    fid_hash = g_new0(IRP *, 1U << bits);
+    if (cid_hash == NULL || fid_hash == NULL)
+    {
+        g_free(cid_hash);
+        g_free(fid_hash);
+        /* the old tables still work, just with longer chains */
+        return (g_hash_bits == 0) ? -1 : 0;
+    }
+    g_free(g_cid_hash);
+    g_free(g_fid_hash);
+    g_cid_hash = cid_hash;
+    g_fid_hash = fid_hash;
+    g_hash_bits = bits;
+    for (irp = g_irp_head; irp != NULL; irp = irp->next)
+    {
+        irp_cid_link(irp);
+        irp_fid_link(irp);
+    }
+    LOG_DEVEL(LOG_LEVEL_DEBUG, "%u IRPs, now %u buckets", g_irp_count,
+              1U << bits);
+    return 0;
+}
+
+/*****************************************************************************/
+/* returns a zeroed IRP from the slabs, or NULL */
+static IRP *
+irp_slab_alloc(void)
+{
+    struct irp_slab *slab;
+    IRP *irp;
+    int index;
+
+    if (g_irp_free_list == NULL)
+    {
+        if ((slab = g_new(struct irp_slab, 1)) == NULL)
+        {
+            return NULL;
+        }
+        slab->next = g_irp_slabs;
+        g_irp_slabs = slab;
+        for (index = 0; index < IRP_SLAB_COUNT; index++)
+        {
+            slab->irps[index].next = g_irp_free_list;
+            g_irp_free_list = slab->irps + index;
+        }
+    }
+    irp = g_irp_free_list;
+    g_irp_free_list = irp->next;
+    g_memset(irp, 0, sizeof(IRP));
+    irp->from_slab = 1;
+    return irp;
+}
+
+/*****************************************************************************/
+static void
+irp_free(IRP *irp)
+{
+    if (irp->from_slab)
+    {
+        irp->prev = NULL;
+        irp->next = g_irp_free_list;
+        g_irp_free_list = irp;
+    }
+    else
+    {
+        g_free(irp);
+    }
+}
+
+/*****************************************************************************/
+/* appends a new IRP to the list and the hash chains, returns 0 on
+   success */
+static int
+irp_insert(IRP *irp)
+{
+    if (irp_hash_reserve() != 0)
+    {
+        return -1;
+    }
+
+    /* insert at end of linked list */
+    if (g_irp_tail == NULL)
+    {
+        /* list is empty, this is the first entry */
+        g_irp_head = irp;
+    }
+    else
+    {
+        g_irp_tail->next = irp;
+        irp->prev = g_irp_tail;
+    }
+    g_irp_tail = irp;
+
+    irp->seq = g_irp_seq++;
+    irp_cid_link(irp);
+    irp_fid_link(irp);
+    g_irp_count++;
+    return 0;
+}
 
 /**
  * Create a new IRP and append to linked list
@@ -42,28 +267,22 @@ IRP *g_irp_head = NULL;
 IRP *devredir_irp_new(void)
 {
     IRP *irp;
-    IRP *irp_last;
 
     LOG_DEVEL(LOG_LEVEL_DEBUG, "entered");
 
     /* create new IRP */
-    irp = g_new0(IRP, 1);
+    irp = irp_slab_alloc();
     if (irp == NULL)
     {
         LOG_DEVEL(LOG_LEVEL_ERROR, "system out of memory!");
         return NULL;
     }
 
-    /* insert at end of linked list */
-    if ((irp_last = devredir_irp_get_last()) == NULL)
-    {
-        /* list is empty, this is the first entry */
-        g_irp_head = irp;
-    }
-    else
+    if (irp_insert(irp) != 0)
     {
-        irp_last->next = irp;
-        irp->prev = irp_last;
+        LOG_DEVEL(LOG_LEVEL_ERROR, "system out of memory!");
+        irp_free(irp);
+        return NULL;
     }
 
     LOG_DEVEL(LOG_LEVEL_DEBUG, "new IRP=%p", irp);
@@ -104,7 +323,6 @@ IRP *devredir_irp_with_pathname_new(const char *pathname)
 IRP *devredir_irp_with_pathnamelen_new(unsigned int pathnamelen)
 {
     IRP *irp;
-    IRP *irp_last;
 
     LOG_DEVEL(LOG_LEVEL_DEBUG, "entered");
 
@@ -118,16 +336,11 @@ IRP *devredir_irp_with_pathnamelen_new(unsigned int pathnamelen)
 
     irp->pathname = (char *)irp + sizeof(IRP); /* Initialise pathname pointer */
 
-    /* insert at end of linked list */
-    if ((irp_last = devredir_irp_get_last()) == NULL)
+    if (irp_insert(irp) != 0)
     {
-        /* list is empty, this is the first entry */
-        g_irp_head = irp;
-    }
-    else
-    {
-        irp_last->next = irp;
-        irp->prev = irp_last;
+        LOG_DEVEL(LOG_LEVEL_ERROR, "system out of memory!");
+        g_free(irp);
+        return NULL;
     }
 
     LOG_DEVEL(LOG_LEVEL_DEBUG, "new IRP=%p", irp);
@@ -142,9 +355,7 @@ IRP *devredir_irp_with_pathnamelen_new(unsigned int pathnamelen)
 
 int devredir_irp_delete(IRP *irp)
 {
-    IRP *lirp = g_irp_head;
-
-    if ((irp == NULL) || (lirp == NULL))
+    if ((irp == NULL) || (g_irp_head == NULL))
     {
         return -1;
     }
@@ -152,98 +363,116 @@ int devredir_irp_delete(IRP *irp)
     LOG_DEVEL(LOG_LEVEL_DEBUG, "irp=%p completion_id=%d type=%d",
               irp, irp->CompletionId, irp->completion_type);
 
-    devredir_irp_dump(); // LK_TODO
-
-    while (lirp)
-    {
-        if (lirp == irp)
-        {
-            break;
-        }
-
-        lirp = lirp->next;
-    }
-
-    if (lirp == NULL)
+    if (irp->prev == NULL && irp != g_irp_head)
     {
         return -1;    /* did not find specified irp */
     }
 
-    if (lirp->prev == NULL)
+    if (irp->prev == NULL)
     {
         /* we are at head of linked list */
-        if (lirp->next == NULL)
-        {
-            /* only one element in list */
-            g_free(lirp);
-            g_irp_head = NULL;
-            devredir_irp_dump(); // LK_TODO
-            return 0;
-        }
-
-        lirp->next->prev = NULL;
-        g_irp_head = lirp->next;
-        g_free(lirp);
+        g_irp_head = irp->next;
+    }
+    else
+    {
+        irp->prev->next = irp->next;
     }
-    else if (lirp->next == NULL)
+
+    if (irp->next == NULL)
     {
         /* we are at tail of linked list */
-        lirp->prev->next = NULL;
-        g_free(lirp);
+        g_irp_tail = irp->prev;
     }
     else
     {
-        /* we are in between */
-        lirp->prev->next = lirp->next;
-        lirp->next->prev = lirp->prev;
-        g_free(lirp);
+        irp->next->prev = irp->prev;
     }
 
-    devredir_irp_dump(); // LK_TODO
+    irp_cid_unlink(irp);
+    irp_fid_unlink(irp);
+    g_irp_count--;
+    irp_free(irp);
 
     return 0;
 }
 
+/**
+ * Sets the CompletionId of an IRP
+ *****************************************************************************/
+
+void devredir_irp_set_completion_id(IRP *irp, tui32 completion_id)
+{
+    irp_cid_unlink(irp);
+    irp->CompletionId = completion_id;
+    irp_cid_link(irp);
+}
+
+/**
+ * Sets the FileId of an IRP
+ *****************************************************************************/
+
+void devredir_irp_set_file_id(IRP *irp, tui32 file_id)
+{
+    irp_fid_unlink(irp);
+    irp->FileId = file_id;
+    irp_fid_link(irp);
+}
+
 /**
  * Return IRP containing specified completion_id
+ *
+ * If more than one does, the oldest is returned
  *****************************************************************************/
 
 IRP *devredir_irp_find(tui32 completion_id)
 {
-    IRP *irp = g_irp_head;
+    IRP *irp;
+    IRP *found = NULL;
 
-    while (irp)
+    if (g_cid_hash != NULL)
     {
-        if (irp->CompletionId == completion_id)
+        for (irp = g_cid_hash[irp_hash(completion_id)]; irp != NULL;
+                irp = irp->cid_next)
         {
-            LOG_DEVEL(LOG_LEVEL_DEBUG, "returning irp=%p", irp);
-            return irp;
+            if (irp->CompletionId == completion_id &&
+                    (found == NULL || irp_older(irp, found)))
+            {
+                found = irp;
+            }
         }
-
-        irp = irp->next;
     }
 
-    LOG_DEVEL(LOG_LEVEL_DEBUG, "returning irp=NULL");
-    return NULL;
+    LOG_DEVEL(LOG_LEVEL_DEBUG, "returning irp=%p", found);
+    return found;
 }
 
+/**
+ * Return IRP containing specified FileId
+ *
+ * If more than one does, the oldest is returned. This is the one which
+ * opened the file
+ *****************************************************************************/
+
 IRP *devredir_irp_find_by_fileid(tui32 FileId)
 {
-    IRP *irp = g_irp_head;
+    IRP *irp;
+    IRP *found = NULL;
 
-    while (irp)
+    if (g_fid_hash != NULL)
     {
-        if (irp->FileId == FileId)
+        for (irp = g_fid_hash[irp_hash(FileId)]; irp != NULL;
+                irp = irp->fid_next)
         {
-            LOG_DEVEL(LOG_LEVEL_DEBUG, "returning irp=%p", irp);
-            return irp;
+            if (irp->FileId == FileId &&
+                    (found == NULL || irp_older(irp, found)))
+            {
+                found = irp;
+            }
         }
-
-        irp = irp->next;
     }
 
-    LOG_DEVEL(LOG_LEVEL_DEBUG, "returning irp=NULL");
-    return NULL;
+    LOG_DEVEL(LOG_LEVEL_DEBUG, "returning irp=%p", found);
+    return found;
 }
 
 /**
@@ -252,20 +481,8 @@ IRP *devredir_irp_find_by_fileid(tui32 FileId)
 
 IRP *devredir_irp_get_last(void)
 {
-    IRP *irp = g_irp_head;
-
-    while (irp)
-    {
-        if (irp->next == NULL)
-        {
-            break;
-        }
-
-        irp = irp->next;
-    }
-
-    LOG_DEVEL(LOG_LEVEL_DEBUG, "returning irp=%p", irp);
-    return irp;
+    LOG_DEVEL(LOG_LEVEL_DEBUG, "returning irp=%p", g_irp_tail);
+    return g_irp_tail;
 }
 
 void devredir_irp_dump(void)
@@ -74,7 +74,10 @@ struct irp_rename
     char           *new_name;     /* New name for file */
 };
 
-/* An I/O Resource Packet to track I/O calls */
+/* An I/O Resource Packet to track I/O calls
+ *
+ * CompletionId and FileId are indexed, so must be set with
+ * devredir_irp_set_completion_id() and devredir_irp_set_file_id() */
 
 typedef struct irp IRP;
 
@@ -98,6 +101,12 @@ struct irp
     void      *fuse_info;           /* Fuse info pointer for FUSE calls  */
     IRP       *next;                /* point to next IRP                 */
     IRP       *prev;                /* point to previous IRP             */
+    IRP       *cid_next;            /* CompletionId hash chain           */
+    IRP       *cid_prev;
+    IRP       *fid_next;            /* FileId hash chain                 */
+    IRP       *fid_prev;
+    unsigned int seq;               /* creation order                    */
+    int        from_slab;           /* allocated by devredir_irp_new()   */
     int        scard_index;         /* used to smart card to locate dev  */
 
     void     (*callback)(struct stream *s, IRP *irp, tui32 DeviceId,
@@ -114,6 +123,8 @@ IRP *devredir_irp_with_pathname_new(const char *pathname);
  * significantly */
 IRP *devredir_irp_with_pathnamelen_new(unsigned int pathnamelen);
 int   devredir_irp_delete(IRP *irp);
+void  devredir_irp_set_completion_id(IRP *irp, tui32 completion_id);
+void  devredir_irp_set_file_id(IRP *irp, tui32 file_id);
 IRP *devredir_irp_find(tui32 completion_id);
 IRP *devredir_irp_find_by_fileid(tui32 FileId);
 IRP *devredir_irp_get_last(void);
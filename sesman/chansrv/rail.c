@@ -37,6 +37,7 @@
 #include "chansrv.h"
 #include "rail.h"
 #include "xcommon.h"
+#include "timeout.h"
 #include "log.h"
 #include "os_calls.h"
 #include "string_calls.h"
@@ -69,7 +70,7 @@ static int g_rail_running = 1;
 static struct list *g_window_list = 0;
 
 static int g_got_focus = 0;
-static int g_focus_counter = 0;
+static int g_focus_timeout = 0; /* handle of my_timeout() */
 static Window g_focus_win = 0;
 
 static int g_xrr_event_base = 0; /* non zero means we got extension */
@@ -354,6 +355,8 @@ rail_deinit(void)
         g_window_list = 0;
         /* no longer window manager */
         XSelectInput(g_display, g_root_window, 0);
+        cancel_timeout(g_focus_timeout);
+        g_focus_timeout = 0;
         g_rail_up = 0;
     }
 
@@ -551,11 +554,8 @@ void
 my_timeout(void *data)
 {
     LOG_DEVEL(LOG_LEVEL_DEBUG, "my_timeout: g_got_focus %d", g_got_focus);
-    if (g_focus_counter == (int)(long)data)
-    {
-        LOG_DEVEL(LOG_LEVEL_DEBUG, "my_timeout: g_focus_counter %d", g_focus_counter);
-        rail_win_popdown();
-    }
+    g_focus_timeout = 0;
+    rail_win_popdown();
 }
 
 /*****************************************************************************/
@@ -580,7 +580,9 @@ rail_process_activate(struct stream *s, int size)
         return 0;
     }
 
-    g_focus_counter++;
+    /* a later activate overrides the popdown */
+    cancel_timeout(g_focus_timeout);
+    g_focus_timeout = 0;
     g_got_focus = enabled;
     LOG_DEVEL(LOG_LEVEL_DEBUG, "  window_id 0x%8.8x enabled %d", window_id, enabled);
 
@@ -621,7 +623,7 @@ rail_process_activate(struct stream *s, int size)
     {
         LOG_DEVEL(LOG_LEVEL_DEBUG, "  window attributes: override_redirect %d",
                   window_attributes.override_redirect);
-        add_timeout(200, my_timeout, (void *)(long)g_focus_counter);
+        g_focus_timeout = add_timeout(200, my_timeout, NULL);
     }
     return 0;
 }
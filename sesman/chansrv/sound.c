@@ -28,13 +28,16 @@
 #include <sys/un.h>
 
 #include "sound.h"
+#include "audio_ring.h"
+#include "sound_latency.h"
 #include "thread_calls.h"
 #include "defines.h"
 #include "fifo.h"
 #include "xrdp_constants.h"
 #include "xrdp_sockets.h"
 #include "chansrv_common.h"
-#include "list.h"
+#include "chansrv_config.h"
+#include "timeout.h"
 #include "audin.h"
 
 #if defined(XRDP_FDK_AAC)
@@ -60,6 +63,7 @@ static lame_global_flags *g_lame_encoder = 0;
 
 extern int g_rdpsnd_chan_id;    /* in chansrv.c */
 extern int g_display_num;       /* in chansrv.c */
+extern struct config_chansrv *g_cfg; /* in chansrv.c */
 
 /* audio out: sound_server -> xrdp -> NeutrinoRDP */
 static struct trans *g_audio_l_trans_out = 0; /* listener */
@@ -74,8 +78,6 @@ static int    g_cBlockNo = 0;
 static int    g_bytes_in_stream = 0;
 FIFO   g_in_fifo;
 int    g_bytes_in_fifo = 0;
-static int    g_time_diff = 0;
-static int    g_best_time_diff = 0;
 
 
 static struct stream *g_stream_inp = NULL;
@@ -86,9 +88,76 @@ static char g_buffer[MAX_BBUF_SIZE];
 static int g_buf_index = 0;
 static int g_sent_time[256];
 
-static int g_bbuf_size = 1024 * 8; /* may change later */
+static int g_chunk_bytes = 1024 * 8; /* size of the chunk in g_buffer */
 
-static struct list *g_ack_time_diff = 0;
+/* PCM from the audio source is 44100Hz, 2 channels, 16 bits */
+#define SOUND_PCM_BYTES_PER_SEC (44100 * 4)
+/* one AAC frame of 1024 samples */
+#define SOUND_FDK_AAC_CHUNK_BYTES 4096
+#define SOUND_MP3LAME_CHUNK_BYTES 11520
+
+/* picks chunk sizes from wave confirm times, see sound_latency.c */
+static struct sound_latency g_latency;
+static int g_drop_bytes = 0; /* incoming PCM still to drop */
+
+/*
+ * Audio output goes on the AUDIO_PLAYBACK_DVC dynamic channel when the
+ * client opens it, so it isn't queued with the other static channels.
+ * Until then, or if the client refuses it, the rdpsnd static channel is
+ * used. Microphone input always uses the static channel. The lossy
+ * variant needs a UDP transport, which xrdp doesn't have
+ */
+#define AUDIO_PLAYBACK_DVC_NAME "AUDIO_PLAYBACK_DVC"
+/* WTS_CHANNEL_OPTION_DYNAMIC | WTS_CHANNEL_OPTION_DYNAMIC_PRI_REAL */
+#define AUDIO_PLAYBACK_DVC_FLAGS (0x01 | 0x06)
+/* ms to wait for the client to open the channel */
+#define AUDIO_PLAYBACK_DVC_OPEN_TIMEOUT 5000
+
+enum sound_dvc_state
+{
+    SOUND_DVC_CLOSED = 0, /* using the static channel */
+    SOUND_DVC_OPENING,
+    SOUND_DVC_OPEN
+};
+
+static struct chansrv_drdynvc_procs g_dvc_procs;
+static int g_dvc_state = SOUND_DVC_CLOSED;
+static int g_dvc_chan_id = 0;
+static int g_dvc_open_timeout = 0;
+static struct stream *g_dvc_in_s = NULL;
+
+/*
+ * Audio out is encoded on its own thread, so encoder CPU time doesn't
+ * hold up the other channels and they don't delay audio. Full PCM
+ * chunks go to the encoder through g_pcm_ring, and encoded chunks come
+ * back through g_wave_ring to be sent from the channel thread.
+ */
+#define SOUND_RING_BYTES (256 * 1024)
+
+enum sound_codec
+{
+    SOUND_CODEC_PCM = 0,
+    SOUND_CODEC_FDK_AAC,
+    SOUND_CODEC_OPUS,
+    SOUND_CODEC_MP3LAME,
+    SOUND_CHUNK_CLOSE /* not audio, send SNDC_CLOSE */
+};
+
+struct sound_chunk
+{
+    int time; /* g_time3() when the PCM arrived, for g_sent_time */
+    int duration_ms; /* of the PCM */
+    int codec;
+    int format_index; /* wFormatNo */
+};
+
+static struct audio_ring *g_pcm_ring = NULL;
+static struct audio_ring *g_wave_ring = NULL;
+static tbus g_encoder_sem = 0; /* one count per g_pcm_ring record */
+static tbus g_encoder_done_sem = 0;
+static tintptr g_wave_event = 0; /* set when g_wave_ring has records */
+static int g_encoder_running = 0;
+static int g_encoder_stop = 0;
 
 struct xr_wave_format_ex
 {
@@ -259,6 +328,21 @@ static int sound_process_input_data(struct stream *s, int bytes);
 static int sound_sndsrvr_source_data_in(struct trans *trans);
 static int sound_start_source_listener(void);
 static int sound_start_sink_listener(void);
+static int sound_send_close(void);
+static int sound_process_output_pdu(int code, struct stream *s, int size);
+
+/*****************************************************************************/
+/* sends an audio output PDU to the client, on the dynamic channel if
+   it's open */
+static int
+sound_send_pdu(char *data, int bytes)
+{
+    if (g_dvc_state == SOUND_DVC_OPEN)
+    {
+        return chansrv_drdynvc_send_data(g_dvc_chan_id, data, bytes);
+    }
+    return send_channel_data(g_rdpsnd_chan_id, data, bytes);
+}
 
 /*****************************************************************************/
 static int
@@ -328,7 +412,7 @@ sound_send_server_output_formats(void)
     size_ptr[0] = bytes;
     size_ptr[1] = bytes >> 8;
     bytes = (int)(s->end - s->data);
-    send_channel_data(g_rdpsnd_chan_id, s->data, bytes);
+    sound_send_pdu(s->data, bytes);
     free_stream(s);
     return 0;
 }
@@ -357,7 +441,7 @@ sound_send_training(void)
     size_ptr[0] = bytes;
     size_ptr[1] = bytes >> 8;
     bytes = (int)(s->end - s->data);
-    send_channel_data(g_rdpsnd_chan_id, s->data, bytes);
+    sound_send_pdu(s->data, bytes);
     free_stream(s);
     return 0;
 }
@@ -626,10 +710,10 @@ sound_wave_compress_fdk_aac(char *data, int data_bytes, int *format_index)
     rv = data_bytes;
     cdata_bytes = data_bytes;
     cdata = (char *) g_malloc(cdata_bytes, 0);
-    if (data_bytes < g_bbuf_size)
+    if (data_bytes < SOUND_FDK_AAC_CHUNK_BYTES)
     {
-        g_memset(data + data_bytes, 0, g_bbuf_size - data_bytes);
-        data_bytes = g_bbuf_size;
+        g_memset(data + data_bytes, 0, SOUND_FDK_AAC_CHUNK_BYTES - data_bytes);
+        data_bytes = SOUND_FDK_AAC_CHUNK_BYTES;
     }
 
     in_buffer = data;
@@ -701,7 +785,9 @@ sound_wave_compress_opus(char *data, int data_bytes, int *format_index)
     int rv;
     int error;
     int data_bytes_org;
+    int index;
     opus_int16 *os16;
+    static const int frame_bytes[6] = { 480, 960, 1920, 3840, 7680, 11520 };
 
     if (g_client_does_opus == 0)
     {
@@ -735,10 +821,15 @@ sound_wave_compress_opus(char *data, int data_bytes, int *format_index)
        20  ms  3840
        40  ms  7680
        60  ms 11520 */
-    if (data_bytes < g_bbuf_size)
+    index = 0;
+    while (index < 5 && frame_bytes[index] < data_bytes)
+    {
+        index++;
+    }
+    if (data_bytes < frame_bytes[index])
     {
-        g_memset(data + data_bytes, 0, g_bbuf_size - data_bytes);
-        data_bytes = g_bbuf_size;
+        g_memset(data + data_bytes, 0, frame_bytes[index] - data_bytes);
+        data_bytes = frame_bytes[index];
     }
     cdata_bytes = opus_encode(g_opus_encoder, os16, data_bytes / 4,
                               cdata, cdata_bytes);
@@ -815,10 +906,10 @@ sound_wave_compress_mp3lame(char *data, int data_bytes, int *format_index)
     odata_bytes = data_bytes;
     cdata_bytes = data_bytes;
     cdata = (unsigned char *) g_malloc(cdata_bytes, 0);
-    if (data_bytes < g_bbuf_size)
+    if (data_bytes < SOUND_MP3LAME_CHUNK_BYTES)
     {
-        g_memset(data + data_bytes, 0, g_bbuf_size - data_bytes);
-        data_bytes = g_bbuf_size;
+        g_memset(data + data_bytes, 0, SOUND_MP3LAME_CHUNK_BYTES - data_bytes);
+        data_bytes = SOUND_MP3LAME_CHUNK_BYTES;
     }
     cdata_bytes = lame_encode_buffer_interleaved(g_lame_encoder,
                   (short int *) data,
@@ -854,50 +945,79 @@ sound_wave_compress_mp3lame(char *data, int data_bytes, int *format_index)
 #endif
 
 /*****************************************************************************/
+/* picks the codec for the next chunk */
 static int
-sound_wave_compress(char *data, int data_bytes, int *format_index)
+sound_wave_codec(void)
 {
     if (g_client_does_fdk_aac)
     {
-        g_bbuf_size = 4096;
-        return sound_wave_compress_fdk_aac(data, data_bytes, format_index);
+        return SOUND_CODEC_FDK_AAC;
     }
     else if (g_client_does_opus)
     {
-        g_bbuf_size = 11520;
-        return sound_wave_compress_opus(data, data_bytes, format_index);
+        return SOUND_CODEC_OPUS;
     }
     else if (g_client_does_mp3lame)
     {
-        g_bbuf_size = 11520;
-        return sound_wave_compress_mp3lame(data, data_bytes, format_index);
+        return SOUND_CODEC_MP3LAME;
+    }
+    return SOUND_CODEC_PCM;
+}
+
+/*****************************************************************************/
+/* size of the next chunk for a codec. Opus and PCM chunks are as long
+   as the latency controller asks for */
+static int
+sound_chunk_bytes(int codec)
+{
+    switch (codec)
+    {
+        case SOUND_CODEC_FDK_AAC:
+            return SOUND_FDK_AAC_CHUNK_BYTES;
+        case SOUND_CODEC_OPUS:
+            /* an Opus frame, the encoder runs at 48000Hz */
+            return g_latency.chunk_ms * 48 * 4;
+        case SOUND_CODEC_MP3LAME:
+            return SOUND_MP3LAME_CHUNK_BYTES;
+        default:
+            return (g_latency.chunk_ms * SOUND_PCM_BYTES_PER_SEC / 1000) & ~3;
+    }
+}
+
+/*****************************************************************************/
+static int
+sound_wave_compress(int codec, char *data, int data_bytes, int *format_index)
+{
+    switch (codec)
+    {
+        case SOUND_CODEC_FDK_AAC:
+            return sound_wave_compress_fdk_aac(data, data_bytes, format_index);
+        case SOUND_CODEC_OPUS:
+            return sound_wave_compress_opus(data, data_bytes, format_index);
+        case SOUND_CODEC_MP3LAME:
+            return sound_wave_compress_mp3lame(data, data_bytes,
+                                               format_index);
     }
     return data_bytes;
 }
 
 /*****************************************************************************/
-/* send wave message to client */
+/* send wave message to client, data is already compressed */
 static int
-sound_send_wave_data_chunk(char *data, int data_bytes)
+sound_send_wave_data_chunk(const struct sound_chunk *chunk,
+                           char *data, int data_bytes)
 {
     struct stream *s;
     int bytes;
     int time;
-    int format_index;
     char *size_ptr;
 
-    LOG_DEVEL(LOG_LEVEL_DEBUG, "sound_send_wave_data_chunk: data_bytes %d", data_bytes);
-
     if ((data_bytes < 4) || (data_bytes > 128 * 1024))
     {
         LOG_DEVEL(LOG_LEVEL_ERROR, "sound_send_wave_data_chunk: bad data_bytes %d", data_bytes);
         return 1;
     }
 
-    /* compress, if available */
-    format_index = g_current_client_format_index;
-    data_bytes = sound_wave_compress(data, data_bytes, &format_index);
-
     /* part one of 2 PDU wave info */
 
     LOG_DEVEL(LOG_LEVEL_DEBUG, "sound_send_wave_data_chunk: sending %d bytes", data_bytes);
@@ -907,12 +1027,13 @@ sound_send_wave_data_chunk(char *data, int data_bytes)
     out_uint16_le(s, SNDC_WAVE);
     size_ptr = s->p;
     out_uint16_le(s, 0); /* size, set later */
-    time = g_time3();
+    time = chunk->time;
     out_uint16_le(s, time);
-    out_uint16_le(s, format_index); /* wFormatNo */
+    out_uint16_le(s, chunk->format_index); /* wFormatNo */
     g_cBlockNo++;
     out_uint8(s, g_cBlockNo);
     g_sent_time[g_cBlockNo & 0xff] = time;
+    sound_latency_sent(&g_latency, g_time3(), chunk->duration_ms);
 
     LOG_DEVEL(LOG_LEVEL_DEBUG, "sound_send_wave_data_chunk: sending time %d, g_cBlockNo %d",
               time & 0xffff, g_cBlockNo & 0xff);
@@ -926,7 +1047,7 @@ sound_send_wave_data_chunk(char *data, int data_bytes)
     size_ptr[0] = bytes;
     size_ptr[1] = bytes >> 8;
     bytes = (int)(s->end - s->data);
-    send_channel_data(g_rdpsnd_chan_id, s->data, bytes);
+    sound_send_pdu(s->data, bytes);
 
     /* part two of 2 PDU wave info
        even is zero, we have to send this */
@@ -935,12 +1056,179 @@ sound_send_wave_data_chunk(char *data, int data_bytes)
     out_uint8a(s, data + 4, data_bytes - 4);
     s_mark_end(s);
     bytes = (int)(s->end - s->data);
-    send_channel_data(g_rdpsnd_chan_id, s->data, bytes);
+    sound_send_pdu(s->data, bytes);
 
     free_stream(s);
     return 0;
 }
 
+/*****************************************************************************/
+/* encoder thread, takes PCM chunks from g_pcm_ring and puts encoded ones
+   in g_wave_ring */
+static THREAD_RV THREAD_CC
+sound_encoder_thread(void *arg)
+{
+    struct sound_chunk chunk;
+    char buf[sizeof(struct sound_chunk) + MAX_BBUF_SIZE];
+    char *data;
+    int bytes;
+    int data_bytes;
+
+    for (;;)
+    {
+        tc_sem_dec(g_encoder_sem);
+        if (g_encoder_stop)
+        {
+            break;
+        }
+        bytes = audio_ring_read(g_pcm_ring, buf, sizeof(buf));
+        if (bytes < (int) sizeof(chunk))
+        {
+            continue;
+        }
+        g_memcpy(&chunk, buf, sizeof(chunk));
+        data = buf + sizeof(chunk);
+        data_bytes = bytes - (int) sizeof(chunk);
+        if (chunk.codec != SOUND_CHUNK_CLOSE)
+        {
+            data_bytes = sound_wave_compress(chunk.codec, data, data_bytes,
+                                             &chunk.format_index);
+        }
+        if (audio_ring_write(g_wave_ring, &chunk, sizeof(chunk),
+                             data, data_bytes) != 0)
+        {
+            LOG_DEVEL(LOG_LEVEL_ERROR, "sound_encoder_thread: dropped, no room");
+            continue;
+        }
+        g_set_wait_obj(g_wave_event);
+    }
+    tc_sem_inc(g_encoder_done_sem);
+    return 0;
+}
+
+/*****************************************************************************/
+static void
+sound_encoder_stop(void)
+{
+    if (g_encoder_running)
+    {
+        g_encoder_stop = 1;
+        tc_sem_inc(g_encoder_sem);
+        tc_sem_dec(g_encoder_done_sem);
+        g_encoder_running = 0;
+    }
+    audio_ring_delete(g_pcm_ring);
+    g_pcm_ring = NULL;
+    audio_ring_delete(g_wave_ring);
+    g_wave_ring = NULL;
+    if (g_encoder_sem != 0)
+    {
+        tc_sem_delete(g_encoder_sem);
+        g_encoder_sem = 0;
+    }
+    if (g_encoder_done_sem != 0)
+    {
+        tc_sem_delete(g_encoder_done_sem);
+        g_encoder_done_sem = 0;
+    }
+    if (g_wave_event != 0)
+    {
+        g_delete_wait_obj(g_wave_event);
+        g_wave_event = 0;
+    }
+}
+
+/*****************************************************************************/
+/* starts the encoder thread, audio is encoded inline if this fails */
+static void
+sound_encoder_start(void)
+{
+    char name[256];
+
+    sound_encoder_stop();
+    g_pcm_ring = audio_ring_create(SOUND_RING_BYTES);
+    g_wave_ring = audio_ring_create(SOUND_RING_BYTES);
+    g_encoder_sem = tc_sem_create(0);
+    g_encoder_done_sem = tc_sem_create(0);
+    g_snprintf(name, sizeof(name), "xrdp_chansrv_%8.8x_sound_wave",
+               g_getpid());
+    g_wave_event = g_create_wait_obj(name);
+    g_encoder_stop = 0;
+    if (g_pcm_ring == NULL || g_wave_ring == NULL ||
+            g_encoder_sem == 0 || g_encoder_done_sem == 0 ||
+            g_wave_event == 0 ||
+            tc_thread_create(sound_encoder_thread, 0) != 0)
+    {
+        LOG(LOG_LEVEL_WARNING, "sound_encoder_start: can't start the encoder "
+            "thread, audio will be encoded on the channel thread");
+        return;
+    }
+    g_encoder_running = 1;
+}
+
+/*****************************************************************************/
+/* sends what the encoder has finished, called on the channel thread */
+static int
+sound_send_encoded(void)
+{
+    struct sound_chunk chunk;
+    char buf[sizeof(struct sound_chunk) + MAX_BBUF_SIZE];
+    int bytes;
+
+    while ((bytes = audio_ring_read(g_wave_ring, buf, sizeof(buf))) != 0)
+    {
+        if (bytes < (int) sizeof(chunk))
+        {
+            continue;
+        }
+        g_memcpy(&chunk, buf, sizeof(chunk));
+        if (chunk.codec == SOUND_CHUNK_CLOSE)
+        {
+            sound_send_close();
+        }
+        else
+        {
+            sound_send_wave_data_chunk(&chunk, buf + sizeof(chunk),
+                                       bytes - (int) sizeof(chunk));
+        }
+    }
+    return 0;
+}
+
+/*****************************************************************************/
+/* hands a full PCM chunk, or a close, to the encoder
+   returns 2 if the chunk was dropped */
+static int
+sound_queue_chunk(int codec, char *data, int data_bytes)
+{
+    struct sound_chunk chunk;
+
+    chunk.time = g_time3();
+    chunk.duration_ms = (int) ((long long) data_bytes * 1000 /
+                               SOUND_PCM_BYTES_PER_SEC);
+    chunk.codec = codec;
+    chunk.format_index = g_current_client_format_index;
+
+    if (!g_encoder_running)
+    {
+        if (codec == SOUND_CHUNK_CLOSE)
+        {
+            return sound_send_close();
+        }
+        data_bytes = sound_wave_compress(codec, data, data_bytes,
+                                         &chunk.format_index);
+        return sound_send_wave_data_chunk(&chunk, data, data_bytes);
+    }
+
+    if (audio_ring_write(g_pcm_ring, &chunk, sizeof(chunk),
+                         data, data_bytes) != 0)
+    {
+        return 2;
+    }
+    tc_sem_inc(g_encoder_sem);
+    return 0;
+}
+
 /*****************************************************************************/
 /* send wave message to client, buffer first */
 static int
@@ -951,20 +1239,36 @@ sound_send_wave_data(char *data, int data_bytes)
     int data_index;
     int error;
     int res;
+    int codec;
+    int drop_ms;
 
     LOG_DEVEL(LOG_LEVEL_DEBUG, "sound_send_wave_data: sending %d bytes", data_bytes);
-    if (g_time_diff > g_best_time_diff + 250)
+    codec = sound_wave_codec();
+    if (g_drop_bytes == 0)
     {
-        data_bytes = data_bytes / 4;
-        data_bytes = data_bytes & ~3;
-        g_memset(data, 0, data_bytes);
-        g_time_diff = 0;
+        drop_ms = sound_latency_drop_ms(&g_latency);
+        if (drop_ms > 0)
+        {
+            LOG(LOG_LEVEL_DEBUG, "sound_send_wave_data: too much audio "
+                "queued at the client, dropping %d ms", drop_ms);
+            g_drop_bytes = (drop_ms * SOUND_PCM_BYTES_PER_SEC / 1000) & ~3;
+        }
     }
     data_index = 0;
+    if (g_drop_bytes > 0)
+    {
+        data_index = MIN(g_drop_bytes, data_bytes);
+        g_drop_bytes -= data_index;
+        data_bytes -= data_index;
+    }
     error = 0;
     while (data_bytes > 0)
     {
-        space_left = g_bbuf_size - g_buf_index;
+        if (g_buf_index == 0)
+        {
+            g_chunk_bytes = sound_chunk_bytes(codec);
+        }
+        space_left = g_chunk_bytes - g_buf_index;
         chunk_bytes = MIN(space_left, data_bytes);
         if (chunk_bytes < 1)
         {
@@ -974,10 +1278,10 @@ sound_send_wave_data(char *data, int data_bytes)
         }
         g_memcpy(g_buffer + g_buf_index, data + data_index, chunk_bytes);
         g_buf_index += chunk_bytes;
-        if (g_buf_index >= g_bbuf_size)
+        if (g_buf_index >= g_chunk_bytes)
         {
             g_buf_index = 0;
-            res = sound_send_wave_data_chunk(g_buffer, g_bbuf_size);
+            res = sound_queue_chunk(codec, g_buffer, g_chunk_bytes);
             if (res == 2)
             {
                 /* don't need to error on this */
@@ -1009,9 +1313,6 @@ sound_send_close(void)
 
     LOG_DEVEL(LOG_LEVEL_DEBUG, "sound_send_close:");
 
-    g_best_time_diff = 0;
-    g_buf_index = 0;
-
     /* send close msg */
     make_stream(s);
     init_stream(s, 8182);
@@ -1023,7 +1324,7 @@ sound_send_close(void)
     size_ptr[0] = bytes;
     size_ptr[1] = bytes >> 8;
     bytes = (int)(s->end - s->data);
-    send_channel_data(g_rdpsnd_chan_id, s->data, bytes);
+    sound_send_pdu(s->data, bytes);
     free_stream(s);
     return 0;
 }
@@ -1049,8 +1350,6 @@ sound_process_wave_confirm(struct stream *s, int size)
     int cConfirmedBlockNo;
     int time;
     int time_diff;
-    int index;
-    int acc;
 
     time = g_time3();
     in_uint16_le(s, wTimeStamp);
@@ -1061,25 +1360,7 @@ sound_process_wave_confirm(struct stream *s, int size)
         "cConfirmedBlockNo %d time diff %d",
         wTimeStamp, cConfirmedBlockNo, time_diff);
 
-    acc = 0;
-    list_add_item(g_ack_time_diff, time_diff);
-    if (g_ack_time_diff->count >= 50)
-    {
-        while (g_ack_time_diff->count > 50)
-        {
-            list_remove_item(g_ack_time_diff, 0);
-        }
-        for (index = 0; index < g_ack_time_diff->count; index++)
-        {
-            acc += list_get_item(g_ack_time_diff, index);
-        }
-        acc = acc / g_ack_time_diff->count;
-        if ((g_best_time_diff < 1) || (g_best_time_diff > acc))
-        {
-            g_best_time_diff = acc;
-        }
-    }
-    g_time_diff = acc;
+    sound_latency_confirm(&g_latency, time_diff);
     return 0;
 }
 
@@ -1095,7 +1376,11 @@ process_pcm_message(int id, int size, struct stream *s)
             return sound_send_wave_data(s->p, size);
             break;
         case 1:
-            return sound_send_close();
+            /* after any audio still being encoded */
+            sound_latency_reset(&g_latency);
+            g_drop_bytes = 0;
+            g_buf_index = 0;
+            return sound_queue_chunk(SOUND_CHUNK_CLOSE, NULL, 0);
             break;
         default:
             LOG_DEVEL(LOG_LEVEL_ERROR, "process_pcm_message: unknown id %d", id);
@@ -1225,6 +1510,186 @@ sound_sndsrvr_source_conn_in(struct trans *trans, struct trans *new_trans)
     return 0;
 }
 
+/*****************************************************************************/
+/* PDU from the client on the dynamic channel */
+static int
+sound_dvc_process_pdu(struct stream *s)
+{
+    int code;
+    int size;
+
+    if (!s_check_rem(s, 4))
+    {
+        LOG(LOG_LEVEL_ERROR, "sound_dvc_process_pdu: short PDU");
+        return 1;
+    }
+    in_uint8(s, code);
+    in_uint8s(s, 1);
+    in_uint16_le(s, size);
+    return sound_process_output_pdu(code, s, size);
+}
+
+/*****************************************************************************/
+static int
+sound_dvc_data_fragment(char *data, int bytes)
+{
+    int rv;
+
+    if (!s_check_rem(g_dvc_in_s, bytes))
+    {
+        LOG(LOG_LEVEL_ERROR, "sound_dvc_data_fragment: %d bytes is more "
+            "than the %d left", bytes, (int) (g_dvc_in_s->end - g_dvc_in_s->p));
+        free_stream(g_dvc_in_s);
+        g_dvc_in_s = NULL;
+        return 1;
+    }
+    out_uint8a(g_dvc_in_s, data, bytes);
+    if (g_dvc_in_s->p == g_dvc_in_s->end)
+    {
+        g_dvc_in_s->p = g_dvc_in_s->data;
+        rv = sound_dvc_process_pdu(g_dvc_in_s);
+        free_stream(g_dvc_in_s);
+        g_dvc_in_s = NULL;
+        return rv;
+    }
+    return 0;
+}
+
+/*****************************************************************************/
+static int
+sound_dvc_data_first(int chan_id, char *data, int bytes, int total_bytes)
+{
+    free_stream(g_dvc_in_s);
+    make_stream(g_dvc_in_s);
+    init_stream(g_dvc_in_s, total_bytes);
+    g_dvc_in_s->end = g_dvc_in_s->data + total_bytes;
+    return sound_dvc_data_fragment(data, bytes);
+}
+
+/*****************************************************************************/
+static int
+sound_dvc_data(int chan_id, char *data, int bytes)
+{
+    struct stream ls;
+
+    if (g_dvc_in_s == NULL)
+    {
+        g_memset(&ls, 0, sizeof(ls));
+        ls.data = data;
+        ls.p = ls.data;
+        ls.end = ls.p + bytes;
+        return sound_dvc_process_pdu(&ls);
+    }
+    return sound_dvc_data_fragment(data, bytes);
+}
+
+/*****************************************************************************/
+static int
+sound_dvc_open_response(int chan_id, int creation_status)
+{
+    if (g_dvc_state != SOUND_DVC_OPENING)
+    {
+        /* too late, we're using the static channel */
+        if (creation_status == 0)
+        {
+            chansrv_drdynvc_close(chan_id);
+        }
+        return 0;
+    }
+    cancel_timeout(g_dvc_open_timeout);
+    g_dvc_open_timeout = 0;
+    if (creation_status == 0)
+    {
+        LOG(LOG_LEVEL_INFO, "sound: audio output is on the "
+            AUDIO_PLAYBACK_DVC_NAME " dynamic channel");
+        g_dvc_state = SOUND_DVC_OPEN;
+    }
+    else
+    {
+        LOG(LOG_LEVEL_INFO, "sound: client can't open "
+            AUDIO_PLAYBACK_DVC_NAME " (0x%8.8x), audio output is on the "
+            "static channel", creation_status);
+        g_dvc_state = SOUND_DVC_CLOSED;
+    }
+    return sound_send_server_output_formats();
+}
+
+/*****************************************************************************/
+static int
+sound_dvc_close_response(int chan_id)
+{
+    free_stream(g_dvc_in_s);
+    g_dvc_in_s = NULL;
+    if (g_dvc_state == SOUND_DVC_OPEN)
+    {
+        /* the client closed it, carry on over the static channel */
+        LOG(LOG_LEVEL_INFO, "sound: client closed " AUDIO_PLAYBACK_DVC_NAME
+            ", audio output is on the static channel");
+        g_dvc_state = SOUND_DVC_CLOSED;
+        return sound_send_server_output_formats();
+    }
+    return 0;
+}
+
+/*****************************************************************************/
+static void
+sound_dvc_open_timeout(void *data)
+{
+    g_dvc_open_timeout = 0;
+    if (g_dvc_state == SOUND_DVC_OPENING)
+    {
+        LOG(LOG_LEVEL_WARNING, "sound: no reply opening "
+            AUDIO_PLAYBACK_DVC_NAME ", audio output is on the static "
+            "channel");
+        g_dvc_state = SOUND_DVC_CLOSED;
+        sound_send_server_output_formats();
+    }
+}
+
+/*****************************************************************************/
+/* starts the output side of the protocol, on the dynamic channel if we
+   can. The server formats are sent once we know which channel to use */
+static void
+sound_output_start(void)
+{
+    if (g_cfg->audio_playback_dvc)
+    {
+        g_memset(&g_dvc_procs, 0, sizeof(g_dvc_procs));
+        g_dvc_procs.open_response = sound_dvc_open_response;
+        g_dvc_procs.close_response = sound_dvc_close_response;
+        g_dvc_procs.data_first = sound_dvc_data_first;
+        g_dvc_procs.data = sound_dvc_data;
+        if (chansrv_drdynvc_open(AUDIO_PLAYBACK_DVC_NAME,
+                                 AUDIO_PLAYBACK_DVC_FLAGS,
+                                 &g_dvc_procs, &g_dvc_chan_id) == 0)
+        {
+            g_dvc_state = SOUND_DVC_OPENING;
+            g_dvc_open_timeout = add_timeout(AUDIO_PLAYBACK_DVC_OPEN_TIMEOUT,
+                                             sound_dvc_open_timeout, NULL);
+            return;
+        }
+        LOG(LOG_LEVEL_WARNING, "sound_output_start: can't open "
+            AUDIO_PLAYBACK_DVC_NAME);
+    }
+    g_dvc_state = SOUND_DVC_CLOSED;
+    sound_send_server_output_formats();
+}
+
+/*****************************************************************************/
+static void
+sound_output_stop(void)
+{
+    cancel_timeout(g_dvc_open_timeout);
+    g_dvc_open_timeout = 0;
+    if (g_dvc_state != SOUND_DVC_CLOSED)
+    {
+        g_dvc_state = SOUND_DVC_CLOSED;
+        chansrv_drdynvc_close(g_dvc_chan_id);
+    }
+    free_stream(g_dvc_in_s);
+    g_dvc_in_s = NULL;
+}
+
 /*****************************************************************************/
 int
 sound_init(void)
@@ -1234,7 +1699,7 @@ sound_init(void)
     g_stream_incoming_packet = NULL;
 
     /* init sound output */
-    sound_send_server_output_formats();
+    sound_output_start();
     sound_start_sink_listener();
 
     /* init sound input */
@@ -1244,6 +1709,8 @@ sound_init(void)
     /* save data from sound_server_source */
     fifo_init(&g_in_fifo, 100);
 
+    sound_encoder_start();
+
     g_client_does_fdk_aac = 0;
     g_client_fdk_aac_index = 0;
 
@@ -1253,11 +1720,9 @@ sound_init(void)
     g_client_does_mp3lame = 0;
     g_client_mp3lame_index = 0;
 
-    if (g_ack_time_diff == 0)
-    {
-        g_ack_time_diff = list_create();
-    }
-    list_clear(g_ack_time_diff);
+    sound_latency_init(&g_latency, g_cfg->audio_target_latency);
+    g_drop_bytes = 0;
+    g_buf_index = 0;
 
     return 0;
 }
@@ -1267,6 +1732,15 @@ int
 sound_deinit(void)
 {
     LOG_DEVEL(LOG_LEVEL_DEBUG, "sound_deinit:");
+    if (g_latency.confirms > 0)
+    {
+        LOG(LOG_LEVEL_INFO, "sound_deinit: %d blocks confirmed, round trip "
+            "%d ms, jitter %d ms, highest %d ms, %d ms chunks, "
+            "%d underruns, %d drops of %d ms in all",
+            g_latency.confirms, g_latency.srtt, g_latency.rttvar,
+            g_latency.max_rtt, g_latency.chunk_ms, g_latency.underruns,
+            g_latency.drops, g_latency.dropped_ms);
+    }
     if (g_audio_l_trans_out != 0)
     {
         trans_delete(g_audio_l_trans_out);
@@ -1291,6 +1765,10 @@ sound_deinit(void)
         g_audio_c_trans_in = 0;
     }
 
+    /* before the encoders are closed */
+    sound_encoder_stop();
+    sound_output_stop();
+
 #if defined(XRDP_MP3LAME)
     if (g_lame_encoder)
     {
@@ -1305,6 +1783,30 @@ sound_deinit(void)
     return 0;
 }
 
+/*****************************************************************************/
+/* audio output PDUs from the client, on either channel */
+static int
+sound_process_output_pdu(int code, struct stream *s, int size)
+{
+    switch (code)
+    {
+        case SNDC_WAVECONFIRM:
+            return sound_process_wave_confirm(s, size);
+
+        case SNDC_TRAINING:
+            return sound_process_training(s, size);
+
+        case SNDC_FORMATS:
+            return sound_process_output_formats(s, size);
+
+        default:
+            LOG_DEVEL(LOG_LEVEL_ERROR, "sound_process_output_pdu: unknown "
+                      "code %d size %d", code, size);
+            break;
+    }
+    return 0;
+}
+
 /*****************************************************************************/
 
 /* data in from client ( client -> xrdp -> chansrv ) */
@@ -1329,18 +1831,6 @@ sound_data_in(struct stream *s, int chan_id, int chan_flags, int length,
 
     switch (code)
     {
-        case SNDC_WAVECONFIRM:
-            sound_process_wave_confirm(g_stream_incoming_packet, size);
-            break;
-
-        case SNDC_TRAINING:
-            sound_process_training(g_stream_incoming_packet, size);
-            break;
-
-        case SNDC_FORMATS:
-            sound_process_output_formats(g_stream_incoming_packet, size);
-            break;
-
         case SNDC_REC_NEGOTIATE:
             sound_process_input_formats(g_stream_incoming_packet, size);
             break;
@@ -1351,7 +1841,7 @@ sound_data_in(struct stream *s, int chan_id, int chan_flags, int length,
             break;
 
         default:
-            LOG_DEVEL(LOG_LEVEL_ERROR, "sound_data_in: unknown code %d size %d", code, size);
+            sound_process_output_pdu(code, g_stream_incoming_packet, size);
             break;
     }
 
@@ -1396,6 +1886,12 @@ sound_get_wait_objs(tbus *objs, int *count, int *timeout)
         lcount++;
     }
 
+    if (g_wave_event != 0)
+    {
+        objs[lcount] = g_wave_event;
+        lcount++;
+    }
+
     *count = lcount;
     return 0;
 }
@@ -1404,6 +1900,13 @@ sound_get_wait_objs(tbus *objs, int *count, int *timeout)
 int
 sound_check_wait_objs(void)
 {
+    if (g_wave_event != 0 && g_is_wait_obj_set(g_wave_event))
+    {
+        /* reset first, so a chunk finished while sending isn't missed */
+        g_reset_wait_obj(g_wave_event);
+        sound_send_encoded();
+    }
+
     if (g_audio_l_trans_out != 0)
     {
         if (trans_check_wait_objs(g_audio_l_trans_out) != 0)
@@ -0,0 +1,212 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * audio out latency control
+ *
+ * srtt and rttvar are kept as in TCP (RFC 6298). The chunk duration is
+ * the smallest one that covers twice the jitter, so a late chunk still
+ * finds the previous one playing, but no more than half the target.
+ * It grows at once on jitter or an underrun and only shrinks after
+ * SHRINK_CONFIRMS quiet confirms. Queueing at the client is srtt less
+ * min_rtt, and anything over the target is dropped back to half the
+ * target.
+ */
+
+#if defined(HAVE_CONFIG_H)
+#include <config_ac.h>
+#endif
+
+#include "arch.h"
+#include "defines.h"
+#include "os_calls.h"
+#include "sound_latency.h"
+
+/* confirms before the estimates are used for drops */
+#define WARMUP_CONFIRMS 8
+/* confirms to wait after a drop, for srtt to settle */
+#define DROP_HOLDOFF 25
+/* confirms allowing a smaller chunk before it is used */
+#define SHRINK_CONFIRMS 50
+/* a gap longer than this is a new stream, not an underrun */
+#define IDLE_MS 1000
+
+/*****************************************************************************/
+/* largest chunk the target allows */
+static int
+chunk_cap(const struct sound_latency *sl)
+{
+    int cap;
+
+    cap = SOUND_LATENCY_MAX_CHUNK_MS;
+    while (cap > SOUND_LATENCY_MIN_CHUNK_MS && cap > sl->target_ms / 2)
+    {
+        cap -= SOUND_LATENCY_MIN_CHUNK_MS;
+    }
+    return cap;
+}
+
+/*****************************************************************************/
+static int
+chunk_up(const struct sound_latency *sl, int chunk_ms)
+{
+    return MIN(chunk_ms + SOUND_LATENCY_MIN_CHUNK_MS, chunk_cap(sl));
+}
+
+/*****************************************************************************/
+static int
+chunk_down(int chunk_ms)
+{
+    return MAX(chunk_ms - SOUND_LATENCY_MIN_CHUNK_MS,
+               SOUND_LATENCY_MIN_CHUNK_MS);
+}
+
+/*****************************************************************************/
+void
+sound_latency_init(struct sound_latency *sl, int target_ms)
+{
+    g_memset(sl, 0, sizeof(*sl));
+    sl->target_ms = target_ms;
+    sound_latency_reset(sl);
+}
+
+/*****************************************************************************/
+void
+sound_latency_reset(struct sound_latency *sl)
+{
+    sl->srtt = 0;
+    sl->rttvar = 0;
+    sl->min_rtt = 0;
+    sl->chunk_ms = chunk_cap(sl);
+    sl->stable = 0;
+    sl->holdoff = 0;
+    sl->play_end = 0;
+    sl->samples = 0;
+}
+
+/*****************************************************************************/
+void
+sound_latency_confirm(struct sound_latency *sl, int rtt_ms)
+{
+    int err;
+    int want;
+    int cap;
+
+    if (rtt_ms < 0)
+    {
+        return;
+    }
+    if (sl->samples == 0)
+    {
+        sl->srtt = rtt_ms;
+        sl->rttvar = rtt_ms / 2;
+        sl->min_rtt = rtt_ms;
+    }
+    else
+    {
+        err = rtt_ms - sl->srtt;
+        sl->srtt += err / 8;
+        if (err < 0)
+        {
+            err = -err;
+        }
+        sl->rttvar += (err - sl->rttvar) / 4;
+        sl->min_rtt = MIN(sl->min_rtt, sl->srtt);
+    }
+    sl->samples++;
+    sl->confirms++;
+    sl->max_rtt = MAX(sl->max_rtt, rtt_ms);
+    if (sl->holdoff > 0)
+    {
+        sl->holdoff--;
+    }
+
+    cap = chunk_cap(sl);
+    want = SOUND_LATENCY_MIN_CHUNK_MS;
+    while (want < cap && want < 2 * sl->rttvar)
+    {
+        want += SOUND_LATENCY_MIN_CHUNK_MS;
+    }
+    if (want > sl->chunk_ms)
+    {
+        sl->chunk_ms = want;
+        sl->stable = 0;
+    }
+    else if (want < sl->chunk_ms)
+    {
+        sl->stable++;
+        if (sl->stable >= SHRINK_CONFIRMS)
+        {
+            sl->chunk_ms = chunk_down(sl->chunk_ms);
+            sl->stable = 0;
+        }
+    }
+    else
+    {
+        sl->stable = 0;
+    }
+}
+
+/*****************************************************************************/
+void
+sound_latency_sent(struct sound_latency *sl, int now, int chunk_ms)
+{
+    int arrival;
+    int gap;
+
+    arrival = now + sl->min_rtt / 2;
+    gap = arrival - sl->play_end;
+    if (sl->play_end == 0 || gap > IDLE_MS)
+    {
+        /* first chunk of a stream, the client waits for a second one */
+        sl->play_end = arrival + 2 * chunk_ms;
+        return;
+    }
+    if (gap > 0)
+    {
+        sl->underruns++;
+        sl->chunk_ms = chunk_up(sl, sl->chunk_ms);
+        sl->stable = 0;
+        sl->play_end = arrival + chunk_ms;
+        return;
+    }
+    sl->play_end += chunk_ms;
+}
+
+/*****************************************************************************/
+int
+sound_latency_drop_ms(struct sound_latency *sl)
+{
+    int queued;
+    int rv;
+
+    if (sl->samples < WARMUP_CONFIRMS || sl->holdoff > 0)
+    {
+        return 0;
+    }
+    queued = sl->srtt - sl->min_rtt;
+    if (queued <= sl->target_ms)
+    {
+        return 0;
+    }
+    rv = queued - sl->target_ms / 2;
+    sl->drops++;
+    sl->dropped_ms += rv;
+    sl->holdoff = DROP_HOLDOFF;
+    /* forget the queue, srtt measures it again over the holdoff */
+    sl->srtt = sl->min_rtt;
+    return rv;
+}
@@ -0,0 +1,83 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* audio out latency control, driven by wave confirm round trip times
+   (the client confirms a block once it has played it, so the round
+   trip includes the audio queued at the client) */
+
+#ifndef _SOUND_LATENCY_H
+#define _SOUND_LATENCY_H
+
+/* chunk durations to choose from, in ms. These are all Opus frame
+   sizes */
+#define SOUND_LATENCY_MIN_CHUNK_MS 20
+#define SOUND_LATENCY_MAX_CHUNK_MS 60
+
+struct sound_latency
+{
+    int target_ms;  /* most audio to let queue at the client */
+    int srtt;       /* smoothed wave confirm time, ms */
+    int rttvar;     /* mean deviation of srtt, ms */
+    int min_rtt;    /* lowest srtt, the link without any queue */
+    int chunk_ms;   /* duration of the chunks to send */
+    int stable;     /* confirms in a row that allowed a smaller chunk */
+    int holdoff;    /* confirms to wait before the next drop */
+    int play_end;   /* time the client should run out of audio, 0 if idle */
+    int samples;    /* confirms since the last reset */
+    /* counters */
+    int confirms;
+    int underruns;
+    int drops;
+    int dropped_ms;
+    int max_rtt;
+};
+
+/**
+ * Starts a controller
+ *
+ * @param target_ms Most audio to let queue at the client
+ */
+void sound_latency_init(struct sound_latency *sl, int target_ms);
+
+/**
+ * Forgets the link estimates, for a new stream. Counters are kept
+ */
+void sound_latency_reset(struct sound_latency *sl);
+
+/**
+ * Adds a wave confirm round trip time
+ */
+void sound_latency_confirm(struct sound_latency *sl, int rtt_ms);
+
+/**
+ * Records a chunk sent to the client, counting an underrun if the
+ * client should have run out of audio before it arrives. The client is
+ * assumed to hold one chunk before it starts playing
+ *
+ * @param now g_time3() at send
+ * @param chunk_ms Duration of the chunk
+ */
+void sound_latency_sent(struct sound_latency *sl, int now, int chunk_ms);
+
+/**
+ * Asks how much incoming audio to drop, to catch up when more than the
+ * target is queued at the client
+ *
+ * @return ms of audio to drop, 0 for none
+ */
+int  sound_latency_drop_ms(struct sound_latency *sl);
+
+#endif
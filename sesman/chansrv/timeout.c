@@ -0,0 +1,308 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/*
+ * timeouts run from the chansrv main loop
+ *
+ * Timeouts live in slots, and a binary min-heap of slot numbers keeps
+ * the earliest at the top. Each slot knows where it is in the heap so
+ * a timeout can be cancelled in O(log n). A handle is the slot number
+ * and a generation count for the slot, so a stale handle can't cancel
+ * a later timeout which reuses the slot.
+ */
+
+#if defined(HAVE_CONFIG_H)
+#include <config_ac.h>
+#endif
+
+#include <stdlib.h>
+
+#include "arch.h"
+#include "log.h"
+#include "os_calls.h"
+#include "timeout.h"
+
+#define TIMEOUT_SLOT_BITS 16
+#define TIMEOUT_MAX_SLOTS (1 << TIMEOUT_SLOT_BITS)
+#define TIMEOUT_MAX_GENERATION 0x7fff
+
+struct timeout_obj
+{
+    tui32 mstime;
+    void *data;
+    void (*callback)(void *data);
+    int generation;             /* 1 to TIMEOUT_MAX_GENERATION */
+    int heap_index;             /* -1 if the slot is free */
+    int next_free;
+};
+
+static struct timeout_obj *g_slots = NULL;
+static int g_slot_count = 0;
+static int g_free_slot = -1;
+static int *g_heap = NULL;      /* of slot numbers */
+static int g_heap_count = 0;
+
+/*****************************************************************************/
+/* returns non zero if time a is before time b, allowing for wrap */
+static int
+timeout_before(tui32 a, tui32 b)
+{
+    return (int) (a - b) < 0;
+}
+
+/*****************************************************************************/
+static void
+heap_set(int index, int slot)
+{
+    g_heap[index] = slot;
+    g_slots[slot].heap_index = index;
+}
+
+/*****************************************************************************/
+static void
+heap_up(int index)
+{
+    int slot;
+    int parent;
+
+    slot = g_heap[index];
+    while (index > 0)
+    {
+        parent = (index - 1) / 2;
+        if (!timeout_before(g_slots[slot].mstime,
+                            g_slots[g_heap[parent]].mstime))
+        {
+            break;
+        }
+        heap_set(index, g_heap[parent]);
+        index = parent;
+    }
+    heap_set(index, slot);
+}
+
+/*****************************************************************************/
+static void
+heap_down(int index)
+{
+    int slot;
+    int child;
+
+    slot = g_heap[index];
+    for (;;)
+    {
+        child = index * 2 + 1;
+        if (child >= g_heap_count)
+        {
+            break;
+        }
+        if (child + 1 < g_heap_count &&
+                timeout_before(g_slots[g_heap[child + 1]].mstime,
+                               g_slots[g_heap[child]].mstime))
+        {
+            child++;
+        }
+        if (!timeout_before(g_slots[g_heap[child]].mstime,
+                            g_slots[slot].mstime))
+        {
+            break;
+        }
+        heap_set(index, g_heap[child]);
+        index = child;
+    }
+    heap_set(index, slot);
+}
+
+/*****************************************************************************/
+/* takes a slot out of the heap and frees it */
+static void
+timeout_remove(int slot)
+{
+    struct timeout_obj *tobj = g_slots + slot;
+    int index;
+    int moved;
+
+    index = tobj->heap_index;
+    g_heap_count--;
+    if (index < g_heap_count)
+    {
+        /* fill the hole with the last one, which may need to go either
+           way */
+        moved = g_heap[g_heap_count];
+        heap_set(index, moved);
+        heap_down(index);
+        heap_up(g_slots[moved].heap_index);
+    }
+
+    tobj->heap_index = -1;
+    tobj->callback = NULL;
+    tobj->data = NULL;
+    tobj->generation++;
+    if (tobj->generation > TIMEOUT_MAX_GENERATION)
+    {
+        tobj->generation = 1;
+    }
+    tobj->next_free = g_free_slot;
+    g_free_slot = slot;
+}
+
+/*****************************************************************************/
+/* returns 0 if there are now free slots */
+static int
+timeout_grow(void)
+{
+    struct timeout_obj *slots;
+    int *heap;
+    int count;
+    int index;
+
+    count = (g_slot_count == 0) ? 16 : g_slot_count * 2;
+    if (count > TIMEOUT_MAX_SLOTS)
+    {
+        return 1;
+    }
+    heap = (int *) realloc(g_heap, count * sizeof(g_heap[0]));
+    if (heap == NULL)
+    {
+        return 1;
+    }
+    g_heap = heap;
+    slots = (struct timeout_obj *) realloc(g_slots,
+                                           count * sizeof(g_slots[0]));
+    if (slots == NULL)
+    {
+        return 1;
+    }
+    g_slots = slots;
+    for (index = count - 1; index >= g_slot_count; index--)
+    {
+        g_memset(g_slots + index, 0, sizeof(g_slots[0]));
+        g_slots[index].generation = 1;
+        g_slots[index].heap_index = -1;
+        g_slots[index].next_free = g_free_slot;
+        g_free_slot = index;
+    }
+    g_slot_count = count;
+    return 0;
+}
+
+/*****************************************************************************/
+int
+add_timeout(int msoffset, void (*callback)(void *data), void *data)
+{
+    struct timeout_obj *tobj;
+    int slot;
+
+    LOG_DEVEL(LOG_LEVEL_DEBUG, "add_timeout: msoffset %d", msoffset);
+    if (g_free_slot < 0 && timeout_grow() != 0)
+    {
+        LOG(LOG_LEVEL_ERROR, "add_timeout: can't allocate timeout");
+        return 0;
+    }
+    slot = g_free_slot;
+    tobj = g_slots + slot;
+    g_free_slot = tobj->next_free;
+
+    tobj->mstime = g_time3() + msoffset;
+    tobj->callback = callback;
+    tobj->data = data;
+    g_heap[g_heap_count] = slot;
+    g_heap_count++;
+    heap_up(g_heap_count - 1);
+    return (tobj->generation << TIMEOUT_SLOT_BITS) | slot;
+}
+
+/*****************************************************************************/
+void
+cancel_timeout(int handle)
+{
+    int slot;
+
+    slot = handle & (TIMEOUT_MAX_SLOTS - 1);
+    if (handle <= 0 || slot >= g_slot_count ||
+            g_slots[slot].generation != (handle >> TIMEOUT_SLOT_BITS) ||
+            g_slots[slot].heap_index < 0)
+    {
+        /* already gone */
+        return;
+    }
+    timeout_remove(slot);
+}
+
+/*****************************************************************************/
+int
+get_timeout(int *timeout)
+{
+    int ltimeout;
+
+    if (g_heap_count == 0)
+    {
+        return 0;
+    }
+    ltimeout = (int) (g_slots[g_heap[0]].mstime - g_time3());
+    if (ltimeout < 1)
+    {
+        /* due now, but a wait of less than 1 ms is forever */
+        ltimeout = 1;
+    }
+    LOG_DEVEL(LOG_LEVEL_DEBUG, "get_timeout: ltimeout %d", ltimeout);
+    if (*timeout < 1 || *timeout > ltimeout)
+    {
+        *timeout = ltimeout;
+    }
+    return 0;
+}
+
+/*****************************************************************************/
+int
+check_timeout(void)
+{
+    struct timeout_obj *tobj;
+    void (*callback)(void *data);
+    void *data;
+    tui32 now;
+    int count;
+
+    now = g_time3();
+    /* timeouts added by the callbacks wait for the next call */
+    count = g_heap_count;
+    while (count > 0 && g_heap_count > 0)
+    {
+        tobj = g_slots + g_heap[0];
+        if (timeout_before(now, tobj->mstime))
+        {
+            break;
+        }
+        callback = tobj->callback;
+        data = tobj->data;
+        timeout_remove(g_heap[0]);
+        callback(data);
+        count--;
+    }
+    return 0;
+}
+
+/*****************************************************************************/
+void
+timeout_deinit(void)
+{
+    free(g_slots);
+    free(g_heap);
+    g_slots = NULL;
+    g_heap = NULL;
+    g_slot_count = 0;
+    g_free_slot = -1;
+    g_heap_count = 0;
+}
@@ -0,0 +1,53 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/* timeouts run from the chansrv main loop */
+
+#ifndef _TIMEOUT_H
+#define _TIMEOUT_H
+
+/**
+ * Arranges for callback(data) to be called msoffset ms from now
+ *
+ * @return handle for cancel_timeout(), or 0 on error
+ */
+int  add_timeout(int msoffset, void (*callback)(void *data), void *data);
+
+/**
+ * Stops a timeout from firing
+ *
+ * Handles of timeouts which have fired or been cancelled, and 0, are
+ * ignored
+ */
+void cancel_timeout(int handle);
+
+/**
+ * Lowers *timeout (ms, < 1 for none) so a wait ends when the next
+ * timeout is due
+ */
+int  get_timeout(int *timeout);
+
+/**
+ * Calls the callbacks of the timeouts which are due
+ */
+int  check_timeout(void);
+
+/**
+ * Drops all timeouts and frees their memory
+ */
+void timeout_deinit(void);
+
+#endif
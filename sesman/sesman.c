@@ -52,6 +52,9 @@
  */
 #define MAX_SHORT_LIVED_CONNECTIONS 16
 
+/* Most ready objects handled each time round the main loop */
+#define MAX_WAIT_EVENTS 32
+
 /**
  * Define the mode of operation of the program
  */
@@ -86,6 +89,11 @@ static struct lock_uds *g_list_trans_lock;
 static struct list *g_con_list = NULL;
 static int g_pid;
 
+/* Everything the main loop waits on. Connections and the listener are
+ * added when they are created and removed when they are deleted */
+static struct g_wait_set *g_con_wait_set = NULL;
+static int g_list_trans_waiting = 0; /* g_list_trans is in g_con_wait_set */
+
 /*****************************************************************************/
 /**
  * @brief looks for a case-insensitive match of a string in a list
@@ -149,6 +157,10 @@ delete_connection(struct sesman_con *sc)
 {
     if (sc != NULL)
     {
+        if (g_con_wait_set != NULL && sc->wait_events != 0)
+        {
+            g_wait_set_remove(g_con_wait_set, sc->t->sck);
+        }
         trans_delete(sc->t);
         if (sc->auth_info != NULL)
         {
@@ -307,6 +319,10 @@ sesman_close_all(unsigned int flags)
 
     LOG_DEVEL(LOG_LEVEL_TRACE, "sesman_close_all:");
 
+    /* In a child the wait set is shared with the parent, so it must be
+     * dropped before anything is removed from it */
+    g_wait_set_delete(g_con_wait_set);
+    g_con_wait_set = NULL;
 
     sesman_delete_listening_transport();
     for (index = 0; index < g_con_list->count; index++)
@@ -362,8 +378,16 @@ sesman_listen_conn_in(struct trans *self, struct trans *new_self)
             "new connection");
         delete_connection(sc);
     }
+    else if (g_wait_set_add(g_con_wait_set, new_self->sck,
+                            G_WAIT_READ, sc) != 0)
+    {
+        LOG(LOG_LEVEL_ERROR, "sesman_data_in: Can't wait on "
+            "new connection");
+        delete_connection(sc);
+    }
     else
     {
+        sc->wait_events = G_WAIT_READ;
         new_self->callback_data = (void *)sc;
         new_self->trans_data_in = sesman_data_in;
         list_add_item(g_con_list, (intptr_t) sc);
@@ -420,6 +444,10 @@ sesman_delete_listening_transport(void)
 {
     if (g_getpid() == g_pid)
     {
+        if (g_con_wait_set != NULL && g_list_trans_waiting)
+        {
+            g_wait_set_remove(g_con_wait_set, g_list_trans->sck);
+        }
         trans_delete(g_list_trans);
     }
     else
@@ -427,6 +455,7 @@ sesman_delete_listening_transport(void)
         trans_delete_from_child(g_list_trans);
     }
     g_list_trans = NULL;
+    g_list_trans_waiting = 0;
 
     unlock_uds(g_list_trans_lock);
     g_list_trans_lock = NULL;
@@ -464,8 +493,16 @@ sesman_create_listening_transport(const struct config_sesman *cfg)
             LOG(LOG_LEVEL_ERROR, "%s: Can't set permissions on '%s' [%s]",
                 __func__, cfg->listen_port, g_get_strerror());
         }
+        else if (g_con_wait_set != NULL &&
+                 (rv = g_wait_set_add(g_con_wait_set, g_list_trans->sck,
+                                      G_WAIT_READ, &g_list_trans)) != 0)
+        {
+            LOG(LOG_LEVEL_ERROR, "%s: Can't wait on '%s'",
+                __func__, cfg->listen_port);
+        }
         else
         {
+            g_list_trans_waiting = (g_con_wait_set != NULL);
             g_list_trans->trans_conn_in = sesman_listen_conn_in;
         }
         g_umask_hex(entry_umask);
@@ -479,6 +516,31 @@ sesman_create_listening_transport(const struct config_sesman *cfg)
     return rv;
 }
 
+/******************************************************************************/
+/**
+ *
+ * @brief Re-arms a connection's wait set events, adding write events
+ * while it has output queued
+ *
+ */
+static void
+update_connection_wait(struct sesman_con *sc)
+{
+    int events;
+
+    events = G_WAIT_READ;
+    if (sc->t->wait_s != NULL)
+    {
+        /* output is queued, wake up when it can go */
+        events |= G_WAIT_WRITE;
+    }
+    if (events != sc->wait_events &&
+            g_wait_set_modify(g_con_wait_set, sc->t->sck, events, sc) == 0)
+    {
+        sc->wait_events = events;
+    }
+}
+
 /******************************************************************************/
 /**
  *
@@ -489,12 +551,10 @@ static int
 sesman_main_loop(void)
 {
     int error;
-    int robjs_count;
-    int wobjs_count;
-    int timeout;
+    int count;
     int index;
-    intptr_t robjs[32];
-    intptr_t wobjs[32];
+    int list_ready;
+    struct g_wait_set_event events[MAX_WAIT_EVENTS];
     struct sesman_con *scon;
 
     g_con_list = list_create();
@@ -503,10 +563,29 @@ sesman_main_loop(void)
         LOG(LOG_LEVEL_ERROR, "sesman_main_loop: list_create failed");
         return 1;
     }
+    g_con_wait_set = g_wait_set_create();
+    if (g_con_wait_set == NULL ||
+            g_wait_set_add(g_con_wait_set, g_term_event, G_WAIT_READ,
+                           NULL) != 0 ||
+            g_wait_set_add(g_con_wait_set, g_sigchld_event, G_WAIT_READ,
+                           NULL) != 0 ||
+            g_wait_set_add(g_con_wait_set, g_reload_event, G_WAIT_READ,
+                           NULL) != 0)
+    {
+        LOG(LOG_LEVEL_ERROR, "sesman_main_loop: can't create wait set");
+        g_wait_set_delete(g_con_wait_set);
+        g_con_wait_set = NULL;
+        list_delete(g_con_list);
+        return 1;
+    }
+    LOG(LOG_LEVEL_DEBUG, "sesman_main_loop: waiting with %s",
+        g_wait_set_get_name(g_con_wait_set));
     if (sesman_create_listening_transport(g_cfg) != 0)
     {
         LOG(LOG_LEVEL_ERROR,
             "sesman_main_loop: sesman_create_listening_transport failed");
+        g_wait_set_delete(g_con_wait_set);
+        g_con_wait_set = NULL;
         list_delete(g_con_list);
         return 1;
     }
@@ -515,52 +594,28 @@ sesman_main_loop(void)
     error = 0;
     while (!error)
     {
-        timeout = -1;
-        robjs_count = 0;
-        robjs[robjs_count++] = g_term_event;
-        robjs[robjs_count++] = g_sigchld_event;
-        robjs[robjs_count++] = g_reload_event;
-        wobjs_count = 0;
-        for (index = 0; index < g_con_list->count; index++)
+        count = g_wait_set_wait(g_con_wait_set, events, MAX_WAIT_EVENTS, -1);
+        if (count < 0)
         {
-            scon = (struct sesman_con *)list_get_item(g_con_list, index);
-            if (scon != NULL)
-            {
-                error = trans_get_wait_objs_rw(scon->t,
-                                               robjs, &robjs_count,
-                                               wobjs, &wobjs_count, &timeout);
-                if (error != 0)
-                {
-                    LOG(LOG_LEVEL_ERROR, "sesman_main_loop: "
-                        "trans_get_wait_objs_rw failed");
-                    break;
-                }
-            }
-        }
-        if (error != 0)
-        {
-            break;
+            /* should not get here */
+            LOG(LOG_LEVEL_WARNING, "sesman_main_loop: "
+                "Unexpected error from g_wait_set_wait()");
+            g_sleep(100);
         }
-        if (g_list_trans != NULL)
+
+        /* only connections that are ready need looking at */
+        list_ready = 0;
+        for (index = 0; index < count; index++)
         {
-            /* g_list_trans might be NULL on a reconfigure if sesman
-             * is unable to listen again */
-            error = trans_get_wait_objs_rw(g_list_trans, robjs, &robjs_count,
-                                           wobjs, &wobjs_count, &timeout);
-            if (error != 0)
+            if (events[index].data == &g_list_trans)
             {
-                LOG(LOG_LEVEL_ERROR, "sesman_main_loop: "
-                    "trans_get_wait_objs_rw failed");
-                break;
+                list_ready = 1;
+            }
+            else if (events[index].data != NULL)
+            {
+                scon = (struct sesman_con *)events[index].data;
+                scon->wait_ready = 1;
             }
-        }
-
-        if (g_obj_wait(robjs, robjs_count, wobjs, wobjs_count, timeout) != 0)
-        {
-            /* should not get here */
-            LOG(LOG_LEVEL_WARNING, "sesman_main_loop: "
-                "Unexpected error from g_obj_wait()");
-            g_sleep(100);
         }
 
         if (g_is_wait_obj_set(g_term_event)) /* term */
@@ -587,13 +642,17 @@ sesman_main_loop(void)
         {
             int remove_con = 0;
             scon = (struct sesman_con *)list_get_item(g_con_list, index);
-            if (trans_check_wait_objs(scon->t) != 0)
+            if (scon->wait_ready)
             {
-                LOG(LOG_LEVEL_ERROR, "sesman_main_loop: "
-                    "trans_check_wait_objs failed, removing trans");
-                remove_con = 1;
+                scon->wait_ready = 0;
+                if (trans_check_wait_objs(scon->t) != 0)
+                {
+                    LOG(LOG_LEVEL_ERROR, "sesman_main_loop: "
+                        "trans_check_wait_objs failed, removing trans");
+                    remove_con = 1;
+                }
             }
-            else if (scon->close_requested)
+            if (scon->close_requested)
             {
                 remove_con = 1;
             }
@@ -605,11 +664,12 @@ sesman_main_loop(void)
             }
             else
             {
+                update_connection_wait(scon);
                 ++index;
             }
         }
 
-        if (g_list_trans != NULL)
+        if (list_ready && g_list_trans != NULL)
         {
             error = trans_check_wait_objs(g_list_trans);
             if (error != 0)
@@ -898,6 +958,7 @@ main(int argc, char **argv)
             g_deinit();
             g_exit(0);
         }
+        log_after_fork();
 
     }
 
@@ -40,6 +40,8 @@ struct sesman_con
     int    uid; /* User */
     char *username; /* Username from UID (at time of logon) */
     char  *ip_addr; /* Connecting IP address */
+    int    wait_events; /* What the main loop waits for on t */
+    int    wait_ready; /* Set by the main loop when t is ready */
 };
 
 /* Globals */
@@ -47,6 +47,7 @@
 #include "log.h"
 #include "os_calls.h"
 #include "sesman.h"
+#include "session_index.h"
 #include "string_calls.h"
 #include "xauth.h"
 #include "xrdp_sockets.h"
@@ -100,6 +101,7 @@ session_get_bydata(const struct session_parameters *sp)
     char policy_str[64];
     struct session_chain *tmp;
     int policy = g_cfg->sess.policy;
+    int by_uid;
 
     if ((policy & SESMAN_CFG_SESS_POLICY_DEFAULT) != 0)
     {
@@ -125,7 +127,12 @@ session_get_bydata(const struct session_parameters *sp)
         return NULL;
     }
 
-    for (tmp = g_sessions ; tmp != 0 ; tmp = tmp->next)
+    /* With the 'U' policy only the user's own sessions can match */
+    by_uid = (policy & SESMAN_CFG_SESS_POLICY_U) != 0;
+    tmp = by_uid ? session_index_get(SESSION_KEY_UID, sp->uid) : g_sessions;
+
+    for ( ; tmp != 0 ;
+            tmp = by_uid ? session_index_next(tmp, SESSION_KEY_UID) : tmp->next)
     {
         struct session_item *item = tmp->item;
 
@@ -327,24 +334,7 @@ x_server_running(int display)
 static int
 session_is_display_in_chain(int display)
 {
-    struct session_chain *chain;
-    struct session_item *item;
-
-    chain = g_sessions;
-
-    while (chain != 0)
-    {
-        item = chain->item;
-
-        if (item->display == display)
-        {
-            return 1;
-        }
-
-        chain = chain->next;
-    }
-
-    return 0;
+    return session_index_get(SESSION_KEY_DISPLAY, display) != 0;
 }
 
 /******************************************************************************/
@@ -515,6 +505,13 @@ session_start(struct auth_info *auth_info,
         return E_SCP_SCREATE_MAX_REACHED;
     }
 
+    if (session_index_reserve() != 0)
+    {
+        LOG(LOG_LEVEL_ERROR, "Out of memory error: cannot index new session "
+            "- user %s", username);
+        return E_SCP_SCREATE_NO_MEMORY;
+    }
+
     temp = (struct session_chain *)g_malloc(sizeof(struct session_chain), 0);
 
     if (temp == 0)
@@ -1011,7 +1008,13 @@ session_start(struct auth_info *auth_info,
         temp->item->status = SESMAN_SESSION_STATUS_ACTIVE;
 
         temp->next = g_sessions;
+        temp->prev = 0;
+        if (g_sessions != 0)
+        {
+            g_sessions->prev = temp;
+        }
         g_sessions = temp;
+        session_index_add(temp);
         g_session_count++;
 
         return E_SCP_SCREATE_OK;
@@ -1077,75 +1080,51 @@ enum session_kill_status
 session_kill(int pid)
 {
     struct session_chain *tmp;
-    struct session_chain *prev;
+    char username[256];
 
-    tmp = g_sessions;
-    prev = 0;
+    tmp = session_index_get(SESSION_KEY_PID, pid);
 
-    while (tmp != 0)
+    if (tmp == 0)
     {
-        if (tmp->item == 0)
-        {
-            LOG(LOG_LEVEL_ERROR, "session descriptor for "
-                "pid %d is null!", pid);
-
-            if (prev == 0)
-            {
-                /* prev does no exist, so it's the first element - so we set
-                   g_sessions */
-                g_sessions = tmp->next;
-            }
-            else
-            {
-                prev->next = tmp->next;
-            }
-
-            return SESMAN_SESSION_KILL_NULLITEM;
-        }
-
-        if (tmp->item->pid == pid)
-        {
-            char username[256];
-            username_from_uid(tmp->item->uid, username, sizeof(username));
-
-            /* deleting the session */
-            if (tmp->item->auth_info != NULL)
-            {
-                LOG(LOG_LEVEL_INFO,
-                    "Calling auth_end for pid %d from pid %d",
-                    pid, g_getpid());
-                auth_end(tmp->item->auth_info);
-                tmp->item->auth_info = NULL;
-            }
-            LOG(LOG_LEVEL_INFO,
-                "++ terminated session: UID %d (%s), display :%d.0, "
-                "session_pid %d, ip %s",
-                tmp->item->uid, username, tmp->item->display,
-                tmp->item->pid, tmp->item->start_ip_addr);
-            g_free(tmp->item);
-
-            if (prev == 0)
-            {
-                /* prev does no exist, so it's the first element - so we set
-                   g_sessions */
-                g_sessions = tmp->next;
-            }
-            else
-            {
-                prev->next = tmp->next;
-            }
+        return SESMAN_SESSION_KILL_NOTFOUND;
+    }
 
-            g_free(tmp);
-            g_session_count--;
-            return SESMAN_SESSION_KILL_OK;
-        }
+    username_from_uid(tmp->item->uid, username, sizeof(username));
 
-        /* go on */
-        prev = tmp;
-        tmp = tmp->next;
+    /* deleting the session */
+    if (tmp->item->auth_info != NULL)
+    {
+        LOG(LOG_LEVEL_INFO,
+            "Calling auth_end for pid %d from pid %d",
+            pid, g_getpid());
+        auth_end(tmp->item->auth_info);
+        tmp->item->auth_info = NULL;
+    }
+    LOG(LOG_LEVEL_INFO,
+        "++ terminated session: UID %d (%s), display :%d.0, "
+        "session_pid %d, ip %s",
+        tmp->item->uid, username, tmp->item->display,
+        tmp->item->pid, tmp->item->start_ip_addr);
+
+    session_index_remove(tmp);
+    if (tmp->prev == 0)
+    {
+        /* it's the first element - so we set g_sessions */
+        g_sessions = tmp->next;
+    }
+    else
+    {
+        tmp->prev->next = tmp->next;
+    }
+    if (tmp->next != 0)
+    {
+        tmp->next->prev = tmp->prev;
     }
 
-    return SESMAN_SESSION_KILL_NOTFOUND;
+    g_free(tmp->item);
+    g_free(tmp);
+    g_session_count--;
+    return SESMAN_SESSION_KILL_OK;
 }
 
 /******************************************************************************/
@@ -1187,29 +1166,16 @@ session_get_bypid(int pid)
         return 0;
     }
 
-    tmp = g_sessions;
+    tmp = session_index_get(SESSION_KEY_PID, pid);
 
-    while (tmp != 0)
+    if (tmp == 0)
     {
-        if (tmp->item == 0)
-        {
-            LOG(LOG_LEVEL_ERROR, "session descriptor for pid %d is null!", pid);
-            g_free(dummy);
-            return 0;
-        }
-
-        if (tmp->item->pid == pid)
-        {
-            g_memcpy(dummy, tmp->item, sizeof(struct session_item));
-            return dummy;
-        }
-
-        /* go on */
-        tmp = tmp->next;
+        g_free(dummy);
+        return 0;
     }
 
-    g_free(dummy);
-    return 0;
+    g_memcpy(dummy, tmp->item, sizeof(struct session_item));
+    return dummy;
 }
 
 /******************************************************************************/
@@ -1223,25 +1189,22 @@ session_get_byuid(int uid, unsigned int *cnt, unsigned char flags)
 
     count = 0;
 
-    tmp = g_sessions;
+    tmp = session_index_get(SESSION_KEY_UID, uid);
 
     LOG(LOG_LEVEL_DEBUG, "searching for session by UID: %d", uid);
     while (tmp != 0)
     {
-        if (uid == tmp->item->uid)
-        {
-            LOG(LOG_LEVEL_DEBUG, "session_get_byuser: status=%d, flags=%d, "
-                "result=%d", (tmp->item->status), flags,
-                ((tmp->item->status) & flags));
+        LOG(LOG_LEVEL_DEBUG, "session_get_byuser: status=%d, flags=%d, "
+            "result=%d", (tmp->item->status), flags,
+            ((tmp->item->status) & flags));
 
-            if ((tmp->item->status) & flags)
-            {
-                count++;
-            }
+        if ((tmp->item->status) & flags)
+        {
+            count++;
         }
 
         /* go on */
-        tmp = tmp->next;
+        tmp = session_index_next(tmp, SESSION_KEY_UID);
     }
 
     if (count == 0)
@@ -1259,38 +1222,35 @@ session_get_byuid(int uid, unsigned int *cnt, unsigned char flags)
         return 0;
     }
 
-    tmp = g_sessions;
+    tmp = session_index_get(SESSION_KEY_UID, uid);
     index = 0;
 
     while (tmp != 0 && index < count)
     {
-        if (uid == tmp->item->uid)
+        if ((tmp->item->status) & flags)
         {
-            if ((tmp->item->status) & flags)
+            (sess[index]).sid = tmp->item->pid;
+            (sess[index]).display = tmp->item->display;
+            (sess[index]).type = tmp->item->type;
+            (sess[index]).height = tmp->item->height;
+            (sess[index]).width = tmp->item->width;
+            (sess[index]).bpp = tmp->item->bpp;
+            (sess[index]).start_time = tmp->item->start_time;
+            (sess[index]).uid = tmp->item->uid;
+            (sess[index]).start_ip_addr = g_strdup(tmp->item->start_ip_addr);
+
+            /* Check for string allocation failures */
+            if ((sess[index]).start_ip_addr == NULL)
             {
-                (sess[index]).sid = tmp->item->pid;
-                (sess[index]).display = tmp->item->display;
-                (sess[index]).type = tmp->item->type;
-                (sess[index]).height = tmp->item->height;
-                (sess[index]).width = tmp->item->width;
-                (sess[index]).bpp = tmp->item->bpp;
-                (sess[index]).start_time = tmp->item->start_time;
-                (sess[index]).uid = tmp->item->uid;
-                (sess[index]).start_ip_addr = g_strdup(tmp->item->start_ip_addr);
-
-                /* Check for string allocation failures */
-                if ((sess[index]).start_ip_addr == NULL)
-                {
-                    free_session_info_list(sess, *cnt);
-                    (*cnt) = 0;
-                    return 0;
-                }
-                index++;
+                free_session_info_list(sess, *cnt);
+                (*cnt) = 0;
+                return 0;
             }
+            index++;
         }
 
         /* go on */
-        tmp = tmp->next;
+        tmp = session_index_next(tmp, SESSION_KEY_UID);
     }
 
     (*cnt) = count;
@@ -73,10 +73,25 @@ struct session_item
     struct guid guid;
 };
 
+/**
+ * Keys a session can be found by, see session_index.h
+ */
+enum session_key
+{
+    SESSION_KEY_UID = 0,
+    SESSION_KEY_PID,
+    SESSION_KEY_DISPLAY,
+    SESSION_KEY_COUNT
+};
+
 struct session_chain
 {
     struct session_chain *next;
+    struct session_chain *prev;
     struct session_item *item;
+    /* Hash chains for each key */
+    struct session_chain *hash_next[SESSION_KEY_COUNT];
+    struct session_chain *hash_prev[SESSION_KEY_COUNT];
 };
 
 
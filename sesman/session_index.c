@@ -0,0 +1,248 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ *
+ * @file session_index.c
+ * @brief Hash indexes of the session chain by UID, PID and display
+ *
+ * Each session is on one hash chain per key, linked through the chain
+ * element. All the tables have the same number of buckets, which
+ * doubles when sessions outnumber the buckets by two to one.
+ *
+ */
+
+#if defined(HAVE_CONFIG_H)
+#include "config_ac.h"
+#endif
+
+#include "arch.h"
+#include "session_index.h"
+
+#include "log.h"
+#include "os_calls.h"
+
+#define SESSION_HASH_MIN_BITS 5
+
+static struct session_chain **g_tables[SESSION_KEY_COUNT];
+static unsigned int g_hash_bits;
+static unsigned int g_session_count;
+
+/******************************************************************************/
+static int
+key_value(const struct session_chain *sc, enum session_key k)
+{
+    switch (k)
+    {
+        case SESSION_KEY_UID:
+            return sc->item->uid;
+        case SESSION_KEY_PID:
+            return sc->item->pid;
+        default:
+            return sc->item->display;
+    }
+}
+
+/******************************************************************************/
+static unsigned int
+hash_key(int key, unsigned int bits)
+{
+    return ((unsigned int) key * 2654435761U) >> (32 - bits);
+}
+
+/******************************************************************************/
+static void
+hash_link(enum session_key k, struct session_chain *sc)
+{
+    struct session_chain **bucket;
+
+    bucket = g_tables[k] + hash_key(key_value(sc, k), g_hash_bits);
+    sc->hash_prev[k] = NULL;
+    sc->hash_next[k] = *bucket;
+    if (*bucket != NULL)
+    {
+        (*bucket)->hash_prev[k] = sc;
+    }
+    *bucket = sc;
+}
+
+/******************************************************************************/
+static void
+hash_unlink(enum session_key k, struct session_chain *sc)
+{
+    if (sc->hash_prev[k] != NULL)
+    {
+        sc->hash_prev[k]->hash_next[k] = sc->hash_next[k];
+    }
+    else
+    {
+        g_tables[k][hash_key(key_value(sc, k), g_hash_bits)] =
+            sc->hash_next[k];
+    }
+    if (sc->hash_next[k] != NULL)
+    {
+        sc->hash_next[k]->hash_prev[k] = sc->hash_prev[k];
+    }
+}
+
+/******************************************************************************/
+/* moves every session to a table of 1 << bits buckets, keeping the order
+   of each hash chain */
+static void
+hash_move(enum session_key k, struct session_chain **table,
+          struct session_chain **tails, unsigned int bits)
+{
+    struct session_chain *sc;
+    struct session_chain *next;
+    unsigned int index;
+    unsigned int b;
+
+    g_memset(tails, 0, sizeof(tails[0]) << bits);
+    for (index = 0; g_tables[k] != NULL && index < (1U << g_hash_bits);
+            index++)
+    {
+        for (sc = g_tables[k][index]; sc != NULL; sc = next)
+        {
+            next = sc->hash_next[k];
+            b = hash_key(key_value(sc, k), bits);
+            sc->hash_next[k] = NULL;
+            sc->hash_prev[k] = tails[b];
+            if (tails[b] != NULL)
+            {
+                tails[b]->hash_next[k] = sc;
+            }
+            else
+            {
+                table[b] = sc;
+            }
+            tails[b] = sc;
+        }
+    }
+    g_free(g_tables[k]);
+    g_tables[k] = table;
+}
+
+/******************************************************************************/
+int
+session_index_reserve(void)
+{
+    struct session_chain **tables[SESSION_KEY_COUNT];
+    struct session_chain **tails;
+    unsigned int bits;
+    int k;
+    int ok;
+
+    if (g_hash_bits > 0 && g_session_count + 1 <= (2U << g_hash_bits))
+    {
+        return 0;
+    }
+
+    bits = (g_hash_bits == 0) ? SESSION_HASH_MIN_BITS : g_hash_bits + 1;
+    tails = g_new(struct session_chain *, 1U << bits);
+    ok = (tails != NULL);
+    for (k = 0; k < SESSION_KEY_COUNT; k++)
+    {
+        tables[k] = g_new0(struct session_chain *, 1U << bits);
+        ok = ok && (tables[k] != NULL);
+    }
+
+    if (!ok)
+    {
+        g_free(tails);
+        for (k = 0; k < SESSION_KEY_COUNT; k++)
+        {
+            g_free(tables[k]);
+        }
+        /* the old tables still work, just with longer chains */
+        return (g_hash_bits == 0) ? 1 : 0;
+    }
+
+    for (k = 0; k < SESSION_KEY_COUNT; k++)
+    {
+        hash_move((enum session_key) k, tables[k], tails, bits);
+    }
+    g_free(tails);
+    g_hash_bits = bits;
+    LOG_DEVEL(LOG_LEVEL_DEBUG, "%u sessions, now %u buckets",
+              g_session_count, 1U << bits);
+    return 0;
+}
+
+/******************************************************************************/
+void
+session_index_add(struct session_chain *sc)
+{
+    int k;
+
+    if (g_hash_bits == 0 && session_index_reserve() != 0)
+    {
+        LOG(LOG_LEVEL_ERROR, "%s: out of memory", __func__);
+        return;
+    }
+    for (k = 0; k < SESSION_KEY_COUNT; k++)
+    {
+        hash_link((enum session_key) k, sc);
+    }
+    g_session_count++;
+}
+
+/******************************************************************************/
+void
+session_index_remove(struct session_chain *sc)
+{
+    int k;
+
+    if (g_hash_bits == 0)
+    {
+        return;
+    }
+    for (k = 0; k < SESSION_KEY_COUNT; k++)
+    {
+        hash_unlink((enum session_key) k, sc);
+    }
+    g_session_count--;
+}
+
+/******************************************************************************/
+/* returns sc, or the first session after it on its hash chain, with the
+   key */
+static struct session_chain *
+hash_find(struct session_chain *sc, enum session_key k, int key)
+{
+    while (sc != NULL && key_value(sc, k) != key)
+    {
+        sc = sc->hash_next[k];
+    }
+    return sc;
+}
+
+/******************************************************************************/
+struct session_chain *
+session_index_get(enum session_key k, int key)
+{
+    if (g_hash_bits == 0)
+    {
+        return NULL;
+    }
+    return hash_find(g_tables[k][hash_key(key, g_hash_bits)], k, key);
+}
+
+/******************************************************************************/
+struct session_chain *
+session_index_next(const struct session_chain *sc, enum session_key k)
+{
+    return hash_find(sc->hash_next[k], k, key_value(sc, k));
+}
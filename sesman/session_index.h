@@ -0,0 +1,83 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ */
+
+/**
+ *
+ * @file session_index.h
+ * @brief Hash indexes of the session chain by UID, PID and display
+ *
+ */
+
+#ifndef SESSION_INDEX_H
+#define SESSION_INDEX_H
+
+#include "session.h"
+
+/**
+ *
+ * @brief makes sure a session can be added to the indexes
+ * @return 0 on success, non-zero if out of memory
+ *
+ * Call this before starting a session, so that session_index_add()
+ * can't fail once it's running
+ *
+ */
+int
+session_index_reserve(void);
+
+/**
+ *
+ * @brief adds a session to the indexes
+ * @param sc Chain element, with the item's uid, pid and display set
+ *
+ * Sessions with the same key are returned newest first
+ *
+ */
+void
+session_index_add(struct session_chain *sc);
+
+/**
+ *
+ * @brief removes a session from the indexes
+ * @param sc Chain element previously passed to session_index_add()
+ *
+ */
+void
+session_index_remove(struct session_chain *sc);
+
+/**
+ *
+ * @brief finds the newest session with a key
+ * @param k Key to search on
+ * @param key Value of the key
+ * @return Chain element, or NULL if there is none
+ *
+ */
+struct session_chain *
+session_index_get(enum session_key k, int key);
+
+/**
+ *
+ * @brief finds the next older session with the same key
+ * @param sc Result of session_index_get() or session_index_next()
+ * @param k Key used for sc
+ * @return Chain element, or NULL if there is none
+ *
+ */
+struct session_chain *
+session_index_next(const struct session_chain *sc, enum session_key k);
+
+#endif
@@ -0,0 +1,168 @@
+#if defined(HAVE_CONFIG_H)
+#include "config_ac.h"
+#endif
+
+#include "arch.h"
+#include "os_calls.h"
+#include "thread_calls.h"
+#include "audio_ring.h"
+
+#include "test_chansrv.h"
+
+#define RECORD_COUNT 100000
+
+static struct audio_ring *g_ring;
+
+static void
+setup(void)
+{
+    g_ring = audio_ring_create(1024);
+    ck_assert_ptr_nonnull(g_ring);
+}
+
+static void
+teardown(void)
+{
+    audio_ring_delete(g_ring);
+    g_ring = NULL;
+}
+
+START_TEST(test_audio_ring__records)
+{
+    char buf[64];
+    int hdr = 42;
+
+    ck_assert_int_eq(audio_ring_read(g_ring, buf, sizeof(buf)), 0);
+    ck_assert_int_eq(audio_ring_write(g_ring, &hdr, 4, "abc", 3), 0);
+    ck_assert_int_eq(audio_ring_write(g_ring, NULL, 0, "defgh", 5), 0);
+
+    ck_assert_int_eq(audio_ring_read(g_ring, buf, sizeof(buf)), 7);
+    ck_assert_int_eq(*(int *) buf, 42);
+    ck_assert_int_eq(g_memcmp(buf + 4, "abc", 3), 0);
+    ck_assert_int_eq(audio_ring_read(g_ring, buf, sizeof(buf)), 5);
+    ck_assert_int_eq(g_memcmp(buf, "defgh", 5), 0);
+    ck_assert_int_eq(audio_ring_read(g_ring, buf, sizeof(buf)), 0);
+}
+END_TEST
+
+START_TEST(test_audio_ring__full)
+{
+    char data[300];
+    char buf[300];
+    int count;
+
+    g_memset(data, 'x', sizeof(data));
+    for (count = 0; audio_ring_write(g_ring, NULL, 0, data, 300) == 0;
+            count++)
+    {
+    }
+    /* 1024 bytes hold three 304 byte records */
+    ck_assert_int_eq(count, 3);
+
+    /* reading one makes room for one */
+    ck_assert_int_eq(audio_ring_read(g_ring, buf, sizeof(buf)), 300);
+    ck_assert_int_eq(audio_ring_write(g_ring, NULL, 0, data, 300), 0);
+    ck_assert_int_ne(audio_ring_write(g_ring, NULL, 0, data, 300), 0);
+}
+END_TEST
+
+START_TEST(test_audio_ring__wrap)
+{
+    char data[100];
+    char buf[100];
+    int index;
+    int j;
+
+    /* records of 4 + 100 bytes don't divide the ring, so they wrap */
+    for (index = 0; index < 50; index++)
+    {
+        g_memset(data, index, sizeof(data));
+        ck_assert_int_eq(audio_ring_write(g_ring, NULL, 0, data, 100), 0);
+        ck_assert_int_eq(audio_ring_read(g_ring, buf, sizeof(buf)), 100);
+        for (j = 0; j < 100; j++)
+        {
+            ck_assert_int_eq(buf[j], index);
+        }
+    }
+}
+END_TEST
+
+START_TEST(test_audio_ring__small_buffer)
+{
+    char buf[8];
+
+    ck_assert_int_eq(audio_ring_write(g_ring, NULL, 0, "0123456789", 10), 0);
+    ck_assert_int_eq(audio_ring_write(g_ring, NULL, 0, "ab", 2), 0);
+
+    /* the long record is dropped, the next is still there */
+    ck_assert_int_eq(audio_ring_read(g_ring, buf, sizeof(buf)), -1);
+    ck_assert_int_eq(audio_ring_read(g_ring, buf, sizeof(buf)), 2);
+    ck_assert_int_eq(g_memcmp(buf, "ab", 2), 0);
+}
+END_TEST
+
+/* writes numbered records of varying length as fast as it can */
+static THREAD_RV THREAD_CC
+writer(void *arg)
+{
+    char data[64];
+    int seq;
+    int len;
+
+    for (seq = 0; seq < RECORD_COUNT; seq++)
+    {
+        len = seq % 60;
+        g_memset(data, seq & 0xff, len);
+        while (audio_ring_write(g_ring, &seq, 4, data, len) != 0)
+        {
+            g_sleep(0);
+        }
+    }
+    return 0;
+}
+
+START_TEST(test_audio_ring__threads)
+{
+    char buf[64];
+    int seq;
+    int bytes;
+    int j;
+
+    ck_assert_int_eq(tc_thread_create(writer, NULL), 0);
+    for (seq = 0; seq < RECORD_COUNT; seq++)
+    {
+        while ((bytes = audio_ring_read(g_ring, buf, sizeof(buf))) == 0)
+        {
+            g_sleep(0);
+        }
+        ck_assert_int_eq(bytes, 4 + seq % 60);
+        ck_assert_int_eq(*(int *) buf, seq);
+        for (j = 4; j < bytes; j++)
+        {
+            ck_assert_int_eq((unsigned char) buf[j], seq & 0xff);
+        }
+    }
+}
+END_TEST
+
+/******************************************************************************/
+Suite *
+make_suite_test_audio_ring(void)
+{
+    Suite *s;
+    TCase *tc;
+
+    s = suite_create("AudioRing");
+
+    tc = tcase_create("audio_ring");
+    tcase_add_checked_fixture(tc, setup, teardown);
+    tcase_set_timeout(tc, 60);
+    suite_add_tcase(s, tc);
+    tcase_add_test(tc, test_audio_ring__records);
+    tcase_add_test(tc, test_audio_ring__full);
+    tcase_add_test(tc, test_audio_ring__wrap);
+    tcase_add_test(tc, test_audio_ring__small_buffer);
+    tcase_add_test(tc, test_audio_ring__threads);
+
+    return s;
+}
@@ -0,0 +1,13 @@
+#ifndef TEST_CHANSRV_H
+#define TEST_CHANSRV_H
+
+#include <check.h>
+
+Suite *make_suite_test_audio_ring(void);
+Suite *make_suite_test_clipboard_file_cache(void);
+Suite *make_suite_test_clipboard_stream(void);
+Suite *make_suite_test_irp(void);
+Suite *make_suite_test_sound_latency(void);
+Suite *make_suite_test_timeout(void);
+
+#endif /* TEST_CHANSRV_H */
@@ -0,0 +1,191 @@
+#if defined(HAVE_CONFIG_H)
+#include "config_ac.h"
+#endif
+
+#include "arch.h"
+#include "os_calls.h"
+#include "string_calls.h"
+#include "log.h"
+#include "clipboard_file_cache.h"
+
+#include "test_chansrv.h"
+
+/* not a multiple of the read-ahead, so the last chunk is short */
+#define FILE_BYTES (8 * 1024 * 1024 + 1000)
+#define CHUNK_BYTES (64 * 1024)
+
+static char g_file[256];
+static struct clipboard_file_cache *g_cache;
+
+/* byte at a file offset */
+static char
+file_byte(int offset)
+{
+    return (char)((offset * 7) ^ (offset >> 11));
+}
+
+static void
+make_file(int bytes)
+{
+    char *buf;
+    int fd;
+    int offset;
+    int index;
+
+    fd = g_file_open_ex(g_file, 0, 1, 1, 1);
+    ck_assert_int_ne(fd, -1);
+    buf = (char *)g_malloc(CHUNK_BYTES, 0);
+    for (offset = 0; offset < bytes; offset += CHUNK_BYTES)
+    {
+        for (index = 0; index < CHUNK_BYTES; index++)
+        {
+            buf[index] = file_byte(offset + index);
+        }
+        g_file_write(fd, buf, MIN(CHUNK_BYTES, bytes - offset));
+    }
+    g_free(buf);
+    g_file_close(fd);
+}
+
+static void
+check_bytes(const char *data, int offset, int bytes)
+{
+    int index;
+
+    for (index = 0; index < bytes; index++)
+    {
+        if (data[index] != file_byte(offset + index))
+        {
+            ck_abort_msg("bad byte at offset %d", offset + index);
+        }
+    }
+}
+
+static void
+setup(void)
+{
+    g_snprintf(g_file, sizeof(g_file), "/tmp/test_clipboard_file_%d",
+               g_getpid());
+    make_file(FILE_BYTES);
+    g_cache = clipboard_file_cache_create();
+    ck_assert_ptr_nonnull(g_cache);
+}
+
+static void
+teardown(void)
+{
+    clipboard_file_cache_delete(g_cache);
+    g_file_delete(g_file);
+}
+
+START_TEST(test_clipboard_file_cache__sequential)
+{
+    char *data;
+    int offset;
+    int got;
+
+    data = (char *)g_malloc(CHUNK_BYTES, 0);
+    offset = 0;
+    while ((got = clipboard_file_cache_read(g_cache, 1, 0, g_file, offset,
+                                            data, CHUNK_BYTES)) > 0)
+    {
+        check_bytes(data, offset, got);
+        offset += got;
+    }
+    g_free(data);
+
+    ck_assert_int_eq(got, 0);
+    ck_assert_int_eq(offset, FILE_BYTES);
+    ck_assert_int_eq(g_cache->opens, 1);
+    /* one read a buffer, the short last one, and two that see the end */
+    ck_assert_int_le(g_cache->reads,
+                     FILE_BYTES / CLIPBOARD_FILE_READ_AHEAD + 3);
+}
+END_TEST
+
+START_TEST(test_clipboard_file_cache__random)
+{
+    static const int offsets[] =
+    {
+        /* inside, straddling, before and past the read-ahead */
+        1000, 5000, CLIPBOARD_FILE_READ_AHEAD - 100, 0,
+        3 * CLIPBOARD_FILE_READ_AHEAD + 17, FILE_BYTES - 10, FILE_BYTES
+    };
+    char data[4096];
+    char *big;
+    int index;
+    int got;
+
+    for (index = 0; index < (int)(sizeof(offsets) / sizeof(offsets[0]));
+            index++)
+    {
+        got = clipboard_file_cache_read(g_cache, 1, 0, g_file,
+                                        offsets[index], data, sizeof(data));
+        ck_assert_int_eq(got, MIN((int)sizeof(data),
+                                  FILE_BYTES - offsets[index]));
+        check_bytes(data, offsets[index], got);
+    }
+
+    /* bigger than the read-ahead goes straight to the file */
+    big = (char *)g_malloc(CLIPBOARD_FILE_READ_AHEAD * 2, 0);
+    got = clipboard_file_cache_read(g_cache, 1, 0, g_file, 12345, big,
+                                    CLIPBOARD_FILE_READ_AHEAD * 2);
+    ck_assert_int_eq(got, CLIPBOARD_FILE_READ_AHEAD * 2);
+    check_bytes(big, 12345, got);
+    g_free(big);
+
+    ck_assert_int_eq(g_cache->opens, 1);
+}
+END_TEST
+
+START_TEST(test_clipboard_file_cache__evict)
+{
+    char data[16];
+    int stream_id;
+
+    /* one more stream than entries closes the least recently used */
+    for (stream_id = 0; stream_id <= CLIPBOARD_FILE_CACHE_ENTRIES;
+            stream_id++)
+    {
+        clipboard_file_cache_read(g_cache, stream_id, 0, g_file, 0, data,
+                                  sizeof(data));
+    }
+    ck_assert_int_eq(g_cache->opens, CLIPBOARD_FILE_CACHE_ENTRIES + 1);
+    clipboard_file_cache_read(g_cache, CLIPBOARD_FILE_CACHE_ENTRIES, 0,
+                              g_file, 16, data, sizeof(data));
+    ck_assert_int_eq(g_cache->opens, CLIPBOARD_FILE_CACHE_ENTRIES + 1);
+    clipboard_file_cache_read(g_cache, 0, 0, g_file, 16, data,
+                              sizeof(data));
+    ck_assert_int_eq(g_cache->opens, CLIPBOARD_FILE_CACHE_ENTRIES + 2);
+
+    /* a clipboard change closes everything */
+    clipboard_file_cache_clear(g_cache);
+    clipboard_file_cache_read(g_cache, 0, 0, g_file, 32, data,
+                              sizeof(data));
+    ck_assert_int_eq(g_cache->opens, CLIPBOARD_FILE_CACHE_ENTRIES + 3);
+    check_bytes(data, 32, sizeof(data));
+
+    /* a missing file is an error */
+    ck_assert_int_eq(clipboard_file_cache_read(g_cache, 9, 0,
+                     "/nonexistent/file", 0, data, sizeof(data)), -1);
+}
+END_TEST
+
+/******************************************************************************/
+Suite *
+make_suite_test_clipboard_file_cache(void)
+{
+    Suite *s;
+    TCase *tc;
+
+    s = suite_create("ClipboardFileCache");
+
+    tc = tcase_create("clipboard_file_cache");
+    tcase_add_checked_fixture(tc, setup, teardown);
+    suite_add_tcase(s, tc);
+    tcase_add_test(tc, test_clipboard_file_cache__sequential);
+    tcase_add_test(tc, test_clipboard_file_cache__random);
+    tcase_add_test(tc, test_clipboard_file_cache__evict);
+
+    return s;
+}
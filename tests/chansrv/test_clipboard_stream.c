@@ -0,0 +1,309 @@
+#if defined(HAVE_CONFIG_H)
+#include "config_ac.h"
+#endif
+
+#include <sys/resource.h>
+
+#include "arch.h"
+#include "os_calls.h"
+#include "clipboard_stream.h"
+#include "timeout.h"
+
+#include "test_chansrv.h"
+
+#define WINDOW_SIZE (512 * 1024)
+#define INCR_CHUNK (256 * 1024)
+#define FRAG_BYTES 1592
+
+static struct clip_stream *g_cs;
+static int g_paused;
+static int g_pauses;
+
+static void
+setup(void)
+{
+    g_cs = NULL;
+    g_paused = 0;
+    g_pauses = 0;
+}
+
+static void
+teardown(void)
+{
+    clip_stream_delete(g_cs);
+    timeout_deinit();
+}
+
+static void
+record_pause(int pause)
+{
+    g_paused = pause;
+    g_pauses += pause;
+}
+
+/* takes everything in the window, appending it to out */
+static int
+drain(struct clip_stream *cs, char *out, int out_bytes)
+{
+    char *data;
+    int bytes;
+
+    while ((bytes = clip_stream_peek(cs, &data, INCR_CHUNK)) > 0)
+    {
+        ck_assert_int_le(out_bytes + bytes, 64);
+        g_memcpy(out + out_bytes, data, bytes);
+        out_bytes += bytes;
+        clip_stream_consume(cs, bytes);
+    }
+    return out_bytes;
+}
+
+START_TEST(test_clipboard_stream__utf16_split)
+{
+    /* "a", U+00E9, U+20AC, U+1F600, "b", NUL, "c" */
+    static const unsigned char in[] =
+    {
+        'a', 0, 0xe9, 0, 0xac, 0x20, 0x3d, 0xd8, 0x00, 0xde, 'b', 0, 0, 0,
+        'c', 0
+    };
+    static const unsigned char want[] =
+    {
+        'a', 0xc3, 0xa9, 0xe2, 0x82, 0xac, 0xf0, 0x9f, 0x98, 0x80, 'b'
+    };
+    char out[64];
+    int out_bytes;
+    int index;
+
+    g_cs = clip_stream_create(64, 64, CLIP_STREAM_UTF8, NULL);
+    ck_assert_ptr_nonnull(g_cs);
+
+    /* one byte at a time splits every unit and the surrogate pair */
+    out_bytes = 0;
+    for (index = 0; index < (int)sizeof(in); index++)
+    {
+        ck_assert_int_eq(clip_stream_write(g_cs, (const char *)in + index,
+                                           1), 0);
+        out_bytes = drain(g_cs, out, out_bytes);
+    }
+    ck_assert_int_eq(out_bytes, sizeof(want));
+    ck_assert_int_eq(g_memcmp(out, want, sizeof(want)), 0);
+    ck_assert_int_eq(g_cs->done, 1);
+}
+END_TEST
+
+START_TEST(test_clipboard_stream__bad_surrogates)
+{
+    /* lone low surrogate, lone high surrogate followed by "x" */
+    static const unsigned char in[] = { 0x00, 0xdc, 0x00, 0xd8, 'x', 0 };
+    static const unsigned char want[] =
+    {
+        0xef, 0xbf, 0xbd, 0xef, 0xbf, 0xbd, 'x'
+    };
+    char out[64];
+    int out_bytes;
+
+    g_cs = clip_stream_create(64, 64, CLIP_STREAM_UTF8, NULL);
+    ck_assert_int_eq(clip_stream_write(g_cs, (const char *)in, sizeof(in)), 0);
+    out_bytes = drain(g_cs, out, 0);
+    ck_assert_int_eq(out_bytes, sizeof(want));
+    ck_assert_int_eq(g_memcmp(out, want, sizeof(want)), 0);
+}
+END_TEST
+
+START_TEST(test_clipboard_stream__latin1)
+{
+    /* "a", U+00E9, U+20AC, U+1F600, lone low surrogate, "b" */
+    static const unsigned char in[] =
+    {
+        'a', 0, 0xe9, 0, 0xac, 0x20, 0x3d, 0xd8, 0x00, 0xde, 0x00, 0xdc,
+        'b', 0
+    };
+    static const unsigned char want[] = { 'a', 0xe9, '?', '?', '?', 'b' };
+    char out[64];
+    int out_bytes;
+
+    g_cs = clip_stream_create(64, 64, CLIP_STREAM_LATIN1, NULL);
+    ck_assert_int_eq(clip_stream_write(g_cs, (const char *)in, sizeof(in)), 0);
+    out_bytes = drain(g_cs, out, 0);
+    ck_assert_int_eq(out_bytes, sizeof(want));
+    ck_assert_int_eq(g_memcmp(out, want, sizeof(want)), 0);
+}
+END_TEST
+
+START_TEST(test_clipboard_stream__raw_full)
+{
+    char in[40];
+    char *data;
+    int bytes;
+
+    g_memset(in, 'z', sizeof(in));
+    g_cs = clip_stream_create(64, 64, CLIP_STREAM_RAW, NULL);
+    ck_assert_int_eq(clip_stream_write(g_cs, in, 40), 0);
+    ck_assert_int_eq(clip_stream_room(g_cs), 24);
+
+    /* a write that does not fit adds nothing */
+    ck_assert_int_eq(clip_stream_write(g_cs, in, 30), 1);
+    ck_assert_int_eq(g_cs->bytes, 40);
+
+    /* after a consume it fits, moved down to the start */
+    bytes = clip_stream_peek(g_cs, &data, 20);
+    ck_assert_int_eq(bytes, 20);
+    clip_stream_consume(g_cs, bytes);
+    ck_assert_int_eq(clip_stream_write(g_cs, in, 30), 0);
+    ck_assert_int_eq(g_cs->head, 0);
+    ck_assert_int_eq(g_cs->bytes, 50);
+    ck_assert_int_eq(g_cs->peak, 50);
+}
+END_TEST
+
+/* input pauses on a full window, resumes when X takes some, and a
+   stall grows the window until it can't */
+START_TEST(test_clipboard_stream__flow)
+{
+    char in[4000];
+    char *data;
+    int index;
+
+    for (index = 0; index < (int)sizeof(in); index++)
+    {
+        in[index] = (char)index;
+    }
+    g_cs = clip_stream_create(4096, 8192, CLIP_STREAM_RAW, record_pause);
+    ck_assert_ptr_nonnull(g_cs);
+
+    /* no room for a channel fragment pauses, room again resumes */
+    ck_assert_int_eq(clip_stream_write(g_cs, in, 2000), 0);
+    clip_stream_flow(g_cs);
+    ck_assert_int_eq(g_paused, 1);
+    clip_stream_flow(g_cs);
+    ck_assert_int_eq(g_pauses, 1);
+    clip_stream_consume(g_cs, 1000);
+    clip_stream_flow(g_cs);
+    ck_assert_int_eq(g_paused, 0);
+    ck_assert_int_eq(g_cs->stall_timeout, 0);
+
+    /* a stall doubles the window, keeping what is in it */
+    ck_assert_int_eq(clip_stream_write(g_cs, in, 1000), 0);
+    clip_stream_flow(g_cs);
+    ck_assert_int_eq(g_paused, 1);
+    g_sleep(CLIP_STREAM_STALL_MS + 20);
+    check_timeout();
+    ck_assert_int_eq(g_paused, 0);
+    ck_assert_int_eq(g_cs->stalls, 1);
+    ck_assert_int_eq(g_cs->size, 8192);
+    ck_assert_int_eq(clip_stream_peek(g_cs, &data, 4096), 2000);
+    ck_assert_int_eq(g_memcmp(data, in + 1000, 1000), 0);
+    ck_assert_int_eq(g_memcmp(data + 1000, in, 1000), 0);
+    clip_stream_flow(g_cs);
+    ck_assert_int_eq(g_paused, 0);
+
+    /* at max_size a stall resumes without growing, then writes fail */
+    ck_assert_int_eq(clip_stream_write(g_cs, in, 4000), 0);
+    clip_stream_flow(g_cs);
+    ck_assert_int_eq(g_pauses, 3);
+    g_sleep(CLIP_STREAM_STALL_MS + 20);
+    check_timeout();
+    ck_assert_int_eq(g_paused, 0);
+    ck_assert_int_eq(g_cs->stalls, 2);
+    ck_assert_int_eq(g_cs->size, 8192);
+    ck_assert_int_eq(clip_stream_write(g_cs, in, 3000), 1);
+
+    /* deleting a paused window resumes input */
+    clip_stream_flow(g_cs);
+    ck_assert_int_eq(g_paused, 1);
+    clip_stream_delete(g_cs);
+    g_cs = NULL;
+    ck_assert_int_eq(g_paused, 0);
+}
+END_TEST
+
+/* a 100 MB paste through the window, pausing input while it is full
+   the way chansrv does, must not grow the process */
+START_TEST(test_clipboard_stream__100mb_bounded)
+{
+    struct rusage before;
+    struct rusage after;
+    char frag[FRAG_BYTES];
+    char *data;
+    long long total;
+    long long sent;
+    unsigned int sum_in;
+    unsigned int sum_out;
+    int bytes;
+    int index;
+    int unit;
+
+    total = 100 * 1024 * 1024;
+    getrusage(RUSAGE_SELF, &before);
+    g_cs = clip_stream_create(WINDOW_SIZE, WINDOW_SIZE, CLIP_STREAM_UTF8,
+                              NULL);
+    ck_assert_ptr_nonnull(g_cs);
+
+    sent = 0;
+    unit = 0;
+    sum_in = 0;
+    sum_out = 0;
+    while (sent < total)
+    {
+        /* printable ASCII, one UTF-8 byte per unit */
+        for (index = 0; index < FRAG_BYTES; index += 2)
+        {
+            frag[index] = 0x20 + unit % 95;
+            frag[index + 1] = 0;
+            sum_in = sum_in * 31 + (unsigned char)frag[index];
+            unit++;
+        }
+        ck_assert_int_eq(clip_stream_write(g_cs, frag, FRAG_BYTES), 0);
+        sent += FRAG_BYTES;
+        /* input pauses here, X takes a chunk */
+        while (clip_stream_room(g_cs) < CLIP_STREAM_MAX_OUT(FRAG_BYTES))
+        {
+            bytes = clip_stream_peek(g_cs, &data, INCR_CHUNK);
+            for (index = 0; index < bytes; index++)
+            {
+                sum_out = sum_out * 31 + (unsigned char)data[index];
+            }
+            clip_stream_consume(g_cs, bytes);
+        }
+    }
+    while ((bytes = clip_stream_peek(g_cs, &data, INCR_CHUNK)) > 0)
+    {
+        for (index = 0; index < bytes; index++)
+        {
+            sum_out = sum_out * 31 + (unsigned char)data[index];
+        }
+        clip_stream_consume(g_cs, bytes);
+    }
+    getrusage(RUSAGE_SELF, &after);
+
+    ck_assert(g_cs->in_total == sent);
+    ck_assert(g_cs->out_total == sent / 2);
+    ck_assert_uint_eq(sum_out, sum_in);
+    ck_assert_int_le(g_cs->peak, WINDOW_SIZE);
+    /* ru_maxrss is in kB */
+    ck_assert_int_lt(after.ru_maxrss - before.ru_maxrss, 16 * 1024);
+}
+END_TEST
+
+/******************************************************************************/
+Suite *
+make_suite_test_clipboard_stream(void)
+{
+    Suite *s;
+    TCase *tc;
+
+    s = suite_create("ClipboardStream");
+
+    tc = tcase_create("clipboard_stream");
+    tcase_add_checked_fixture(tc, setup, teardown);
+    tcase_set_timeout(tc, 60);
+    suite_add_tcase(s, tc);
+    tcase_add_test(tc, test_clipboard_stream__utf16_split);
+    tcase_add_test(tc, test_clipboard_stream__bad_surrogates);
+    tcase_add_test(tc, test_clipboard_stream__latin1);
+    tcase_add_test(tc, test_clipboard_stream__raw_full);
+    tcase_add_test(tc, test_clipboard_stream__flow);
+    tcase_add_test(tc, test_clipboard_stream__100mb_bounded);
+
+    return s;
+}
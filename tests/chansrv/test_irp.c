@@ -0,0 +1,174 @@
+#if defined(HAVE_CONFIG_H)
+#include "config_ac.h"
+#endif
+
+#include "arch.h"
+#include "os_calls.h"
+#include "parse.h"
+#include "string_calls.h"
+#include "irp.h"
+
+#include "test_chansrv.h"
+
+#define IRP_COUNT 5000
+
+static IRP *g_irps[IRP_COUNT];
+
+/* IRPs are created in pairs sharing a FileId, as when a file is open
+   and I/O is outstanding on it. Odd ones carry a pathname */
+static void
+create_irps(void)
+{
+    char pathname[64];
+    int index;
+
+    for (index = 0; index < IRP_COUNT; index++)
+    {
+        if (index % 2 == 0)
+        {
+            g_irps[index] = devredir_irp_new();
+        }
+        else
+        {
+            g_snprintf(pathname, sizeof(pathname), "/dir/file%d", index);
+            g_irps[index] = devredir_irp_with_pathname_new(pathname);
+        }
+        ck_assert_ptr_nonnull(g_irps[index]);
+        devredir_irp_set_completion_id(g_irps[index], index + 1);
+        devredir_irp_set_file_id(g_irps[index], 1000 + index / 2);
+    }
+}
+
+static void
+teardown(void)
+{
+    int index;
+
+    for (index = 0; index < IRP_COUNT; index++)
+    {
+        if (g_irps[index] != NULL)
+        {
+            ck_assert_int_eq(devredir_irp_delete(g_irps[index]), 0);
+            g_irps[index] = NULL;
+        }
+    }
+    ck_assert_ptr_null(devredir_irp_get_last());
+}
+
+START_TEST(test_irp__find)
+{
+    int index;
+
+    create_irps();
+    ck_assert_ptr_eq(devredir_irp_get_last(), g_irps[IRP_COUNT - 1]);
+    for (index = 0; index < IRP_COUNT; index++)
+    {
+        ck_assert_ptr_eq(devredir_irp_find(index + 1), g_irps[index]);
+        /* the older of the pair opened the file */
+        ck_assert_ptr_eq(devredir_irp_find_by_fileid(1000 + index / 2),
+                         g_irps[index - index % 2]);
+    }
+    ck_assert_ptr_null(devredir_irp_find(0));
+    ck_assert_ptr_null(devredir_irp_find(IRP_COUNT + 1));
+    ck_assert_ptr_null(devredir_irp_find_by_fileid(999));
+    ck_assert_str_eq(g_irps[1]->pathname, "/dir/file1");
+}
+END_TEST
+
+START_TEST(test_irp__delete)
+{
+    int index;
+
+    create_irps();
+    /* delete every third, out of order */
+    for (index = IRP_COUNT - 1; index >= 0; index--)
+    {
+        if (index % 3 == 0)
+        {
+            ck_assert_int_eq(devredir_irp_delete(g_irps[index]), 0);
+            g_irps[index] = NULL;
+        }
+    }
+    for (index = 0; index < IRP_COUNT; index++)
+    {
+        ck_assert_ptr_eq(devredir_irp_find(index + 1), g_irps[index]);
+        if (g_irps[index - index % 2] != NULL)
+        {
+            ck_assert_ptr_eq(devredir_irp_find_by_fileid(1000 + index / 2),
+                             g_irps[index - index % 2]);
+        }
+        else
+        {
+            /* only the newer one is left */
+            ck_assert_ptr_eq(devredir_irp_find_by_fileid(1000 + index / 2),
+                             g_irps[index - index % 2 + 1]);
+        }
+    }
+    ck_assert_ptr_eq(devredir_irp_get_last(), g_irps[IRP_COUNT - 1]);
+}
+END_TEST
+
+START_TEST(test_irp__set_ids)
+{
+    IRP *irp;
+
+    create_irps();
+    irp = g_irps[10];
+    devredir_irp_set_completion_id(irp, 0x80000000);
+    ck_assert_ptr_null(devredir_irp_find(11));
+    ck_assert_ptr_eq(devredir_irp_find(0x80000000), irp);
+
+    /* takes over a FileId, but is newer than the IRP that has it */
+    devredir_irp_set_file_id(irp, 1000);
+    ck_assert_ptr_eq(devredir_irp_find_by_fileid(1000), g_irps[0]);
+    ck_assert_ptr_eq(devredir_irp_find_by_fileid(1005), g_irps[11]);
+    ck_assert_int_eq(devredir_irp_delete(g_irps[0]), 0);
+    g_irps[0] = NULL;
+    ck_assert_ptr_eq(devredir_irp_find_by_fileid(1000), g_irps[1]);
+}
+END_TEST
+
+START_TEST(test_irp__reuse)
+{
+    IRP *irp;
+    IRP *irp2;
+
+    irp = devredir_irp_new();
+    ck_assert_ptr_nonnull(irp);
+    irp->DeviceId = 7;
+    devredir_irp_set_completion_id(irp, 42);
+    ck_assert_int_eq(devredir_irp_delete(irp), 0);
+    /* not in the list any more */
+    ck_assert_int_eq(devredir_irp_delete(irp), -1);
+    ck_assert_ptr_null(devredir_irp_find(42));
+
+    /* recycled IRPs start out clean */
+    irp2 = devredir_irp_new();
+    ck_assert_ptr_nonnull(irp2);
+    ck_assert_int_eq(irp2->DeviceId, 0);
+    ck_assert_int_eq(irp2->CompletionId, 0);
+    ck_assert_ptr_null(irp2->pathname);
+    ck_assert_ptr_eq(devredir_irp_find(0), irp2);
+    ck_assert_int_eq(devredir_irp_delete(irp2), 0);
+}
+END_TEST
+
+/******************************************************************************/
+Suite *
+make_suite_test_irp(void)
+{
+    Suite *s;
+    TCase *tc;
+
+    s = suite_create("Irp");
+
+    tc = tcase_create("irp");
+    tcase_add_checked_fixture(tc, NULL, teardown);
+    suite_add_tcase(s, tc);
+    tcase_add_test(tc, test_irp__find);
+    tcase_add_test(tc, test_irp__delete);
+    tcase_add_test(tc, test_irp__set_ids);
+    tcase_add_test(tc, test_irp__reuse);
+
+    return s;
+}
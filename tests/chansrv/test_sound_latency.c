@@ -0,0 +1,160 @@
+#if defined(HAVE_CONFIG_H)
+#include "config_ac.h"
+#endif
+
+#include "arch.h"
+#include "os_calls.h"
+#include "sound_latency.h"
+
+#include "test_chansrv.h"
+
+static struct sound_latency g_sl;
+
+static void
+setup(void)
+{
+    sound_latency_init(&g_sl, 250);
+}
+
+START_TEST(test_sound_latency__steady_link_shrinks_chunks)
+{
+    int i;
+
+    ck_assert_int_eq(g_sl.chunk_ms, SOUND_LATENCY_MAX_CHUNK_MS);
+    for (i = 0; i < 200; i++)
+    {
+        sound_latency_confirm(&g_sl, 100);
+    }
+    ck_assert_int_eq(g_sl.srtt, 100);
+    ck_assert_int_eq(g_sl.min_rtt, 100);
+    ck_assert_int_eq(g_sl.chunk_ms, SOUND_LATENCY_MIN_CHUNK_MS);
+    ck_assert_int_eq(sound_latency_drop_ms(&g_sl), 0);
+    ck_assert_int_eq(g_sl.confirms, 200);
+}
+END_TEST
+
+START_TEST(test_sound_latency__jitter_grows_chunks)
+{
+    int i;
+
+    for (i = 0; i < 200; i++)
+    {
+        sound_latency_confirm(&g_sl, 100);
+    }
+    ck_assert_int_eq(g_sl.chunk_ms, SOUND_LATENCY_MIN_CHUNK_MS);
+    for (i = 0; i < 20; i++)
+    {
+        sound_latency_confirm(&g_sl, (i & 1) ? 40 : 160);
+    }
+    ck_assert_int_gt(g_sl.rttvar, 30);
+    ck_assert_int_eq(g_sl.chunk_ms, SOUND_LATENCY_MAX_CHUNK_MS);
+    ck_assert_int_eq(g_sl.max_rtt, 160);
+}
+END_TEST
+
+START_TEST(test_sound_latency__target_caps_chunks)
+{
+    int i;
+
+    sound_latency_init(&g_sl, 60);
+    ck_assert_int_eq(g_sl.chunk_ms, SOUND_LATENCY_MIN_CHUNK_MS);
+    for (i = 0; i < 20; i++)
+    {
+        sound_latency_confirm(&g_sl, (i & 1) ? 40 : 160);
+    }
+    ck_assert_int_eq(g_sl.chunk_ms, SOUND_LATENCY_MIN_CHUNK_MS);
+}
+END_TEST
+
+START_TEST(test_sound_latency__drop_when_queued)
+{
+    int i;
+    int drop_ms;
+
+    for (i = 0; i < 10; i++)
+    {
+        sound_latency_confirm(&g_sl, 100);
+    }
+    ck_assert_int_eq(sound_latency_drop_ms(&g_sl), 0);
+
+    /* the client's queue grows to 400ms */
+    for (i = 0; i < 100; i++)
+    {
+        sound_latency_confirm(&g_sl, 500);
+    }
+    drop_ms = sound_latency_drop_ms(&g_sl);
+    ck_assert_int_gt(drop_ms, 250 / 2);
+    ck_assert_int_le(drop_ms, 400 - 250 / 2);
+    ck_assert_int_eq(g_sl.drops, 1);
+    ck_assert_int_eq(g_sl.dropped_ms, drop_ms);
+
+    /* not again until srtt has settled */
+    sound_latency_confirm(&g_sl, 500);
+    ck_assert_int_eq(sound_latency_drop_ms(&g_sl), 0);
+}
+END_TEST
+
+START_TEST(test_sound_latency__underrun)
+{
+    sound_latency_confirm(&g_sl, 20);
+    g_sl.chunk_ms = SOUND_LATENCY_MIN_CHUNK_MS;
+
+    /* on time, the client holds one chunk before playing */
+    sound_latency_sent(&g_sl, 1000, 20);
+    sound_latency_sent(&g_sl, 1020, 20);
+    sound_latency_sent(&g_sl, 1050, 20);
+    ck_assert_int_eq(g_sl.underruns, 0);
+
+    /* the client has played everything before this arrives */
+    sound_latency_sent(&g_sl, 1100, 20);
+    ck_assert_int_eq(g_sl.underruns, 1);
+    ck_assert_int_gt(g_sl.chunk_ms, SOUND_LATENCY_MIN_CHUNK_MS);
+
+    /* a pause is a new stream, not an underrun */
+    sound_latency_sent(&g_sl, 5000, 20);
+    ck_assert_int_eq(g_sl.underruns, 1);
+}
+END_TEST
+
+START_TEST(test_sound_latency__reset)
+{
+    int i;
+
+    for (i = 0; i < 10; i++)
+    {
+        sound_latency_confirm(&g_sl, 100);
+    }
+    sound_latency_sent(&g_sl, 1000, 20);
+    sound_latency_reset(&g_sl);
+    ck_assert_int_eq(g_sl.srtt, 0);
+    ck_assert_int_eq(g_sl.play_end, 0);
+    ck_assert_int_eq(g_sl.samples, 0);
+    ck_assert_int_eq(g_sl.confirms, 10);
+
+    /* negative times are from stale block numbers */
+    sound_latency_confirm(&g_sl, -5);
+    ck_assert_int_eq(g_sl.samples, 0);
+}
+END_TEST
+
+/******************************************************************************/
+Suite *
+make_suite_test_sound_latency(void)
+{
+    Suite *s;
+    TCase *tc;
+
+    s = suite_create("SoundLatency");
+
+    tc = tcase_create("sound_latency");
+    tcase_add_checked_fixture(tc, setup, NULL);
+    suite_add_tcase(s, tc);
+    tcase_add_test(tc, test_sound_latency__steady_link_shrinks_chunks);
+    tcase_add_test(tc, test_sound_latency__jitter_grows_chunks);
+    tcase_add_test(tc, test_sound_latency__target_caps_chunks);
+    tcase_add_test(tc, test_sound_latency__drop_when_queued);
+    tcase_add_test(tc, test_sound_latency__underrun);
+    tcase_add_test(tc, test_sound_latency__reset);
+
+    return s;
+}
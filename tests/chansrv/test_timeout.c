@@ -0,0 +1,157 @@
+#if defined(HAVE_CONFIG_H)
+#include "config_ac.h"
+#endif
+
+#include "arch.h"
+#include "os_calls.h"
+#include "timeout.h"
+
+#include "test_chansrv.h"
+
+#define MAX_FIRED 1000
+
+static int g_fired[MAX_FIRED];
+static int g_fired_count;
+
+static void
+record(void *data)
+{
+    ck_assert_int_lt(g_fired_count, MAX_FIRED);
+    g_fired[g_fired_count] = (int) (tintptr) data;
+    g_fired_count++;
+}
+
+static void
+setup(void)
+{
+    g_fired_count = 0;
+}
+
+static void
+teardown(void)
+{
+    timeout_deinit();
+}
+
+START_TEST(test_timeout__order)
+{
+    ck_assert_int_ne(add_timeout(30, record, (void *) 3), 0);
+    ck_assert_int_ne(add_timeout(10, record, (void *) 1), 0);
+    ck_assert_int_ne(add_timeout(20, record, (void *) 2), 0);
+    ck_assert_int_ne(add_timeout(1000, record, (void *) 4), 0);
+
+    /* nothing is due yet */
+    check_timeout();
+    ck_assert_int_eq(g_fired_count, 0);
+
+    g_sleep(50);
+    check_timeout();
+    ck_assert_int_eq(g_fired_count, 3);
+    ck_assert_int_eq(g_fired[0], 1);
+    ck_assert_int_eq(g_fired[1], 2);
+    ck_assert_int_eq(g_fired[2], 3);
+}
+END_TEST
+
+START_TEST(test_timeout__cancel)
+{
+    int handles[200];
+    int index;
+
+    /* out of order, cancelling every other one */
+    for (index = 0; index < 200; index++)
+    {
+        handles[index] = add_timeout((index * 7) % 20, record,
+                                     (void *) (tintptr) index);
+        ck_assert_int_ne(handles[index], 0);
+    }
+    for (index = 0; index < 200; index += 2)
+    {
+        cancel_timeout(handles[index]);
+    }
+    g_sleep(30);
+    check_timeout();
+    ck_assert_int_eq(g_fired_count, 100);
+    for (index = 0; index < g_fired_count; index++)
+    {
+        ck_assert_int_eq(g_fired[index] % 2, 1);
+    }
+}
+END_TEST
+
+/* a handle which has fired mustn't cancel a timeout reusing its slot */
+START_TEST(test_timeout__stale_handle)
+{
+    int handle;
+    int handle2;
+
+    handle = add_timeout(0, record, (void *) 1);
+    check_timeout();
+    ck_assert_int_eq(g_fired_count, 1);
+
+    handle2 = add_timeout(0, record, (void *) 2);
+    ck_assert_int_ne(handle2, handle);
+    cancel_timeout(handle);
+    cancel_timeout(handle);
+    cancel_timeout(0);
+    check_timeout();
+    ck_assert_int_eq(g_fired_count, 2);
+    ck_assert_int_eq(g_fired[1], 2);
+}
+END_TEST
+
+START_TEST(test_timeout__get_timeout)
+{
+    int handle;
+    int timeout;
+
+    /* nothing pending leaves the wait alone */
+    timeout = 0;
+    get_timeout(&timeout);
+    ck_assert_int_eq(timeout, 0);
+
+    /* the earliest timeout limits the wait */
+    add_timeout(5000, record, NULL);
+    handle = add_timeout(1000, record, NULL);
+    timeout = 0;
+    get_timeout(&timeout);
+    ck_assert_int_gt(timeout, 0);
+    ck_assert_int_le(timeout, 1000);
+
+    timeout = 50;
+    get_timeout(&timeout);
+    ck_assert_int_eq(timeout, 50);
+
+    cancel_timeout(handle);
+    timeout = 0;
+    get_timeout(&timeout);
+    ck_assert_int_gt(timeout, 1000);
+    ck_assert_int_le(timeout, 5000);
+
+    /* one already due still gives a finite wait */
+    add_timeout(0, record, NULL);
+    timeout = 0;
+    get_timeout(&timeout);
+    ck_assert_int_eq(timeout, 1);
+}
+END_TEST
+
+/******************************************************************************/
+Suite *
+make_suite_test_timeout(void)
+{
+    Suite *s;
+    TCase *tc;
+
+    s = suite_create("Timeout");
+
+    tc = tcase_create("timeout");
+    tcase_add_checked_fixture(tc, setup, teardown);
+    suite_add_tcase(s, tc);
+    tcase_add_test(tc, test_timeout__order);
+    tcase_add_test(tc, test_timeout__cancel);
+    tcase_add_test(tc, test_timeout__stale_handle);
+    tcase_add_test(tc, test_timeout__get_timeout);
+
+    return s;
+}
@@ -12,5 +12,8 @@ Suite *make_suite_test_os_calls(void);
 Suite *make_suite_test_ssl_calls(void);
 Suite *make_suite_test_base64(void);
 Suite *make_suite_test_guid(void);
+Suite *make_suite_test_hash_calls(void);
+Suite *make_suite_test_trans(void);
+Suite *make_suite_test_log(void);
 
 #endif /* TEST_COMMON_H */
@@ -50,6 +50,9 @@ int main (void)
     srunner_add_suite(sr, make_suite_test_ssl_calls());
     srunner_add_suite(sr, make_suite_test_base64());
     srunner_add_suite(sr, make_suite_test_guid());
+    srunner_add_suite(sr, make_suite_test_hash_calls());
+    srunner_add_suite(sr, make_suite_test_trans());
+    srunner_add_suite(sr, make_suite_test_log());
     //   srunner_add_suite(sr, make_list_suite());
 
     srunner_set_tap(sr, "-");
@@ -0,0 +1,104 @@
+#if defined(HAVE_CONFIG_H)
+#include "config_ac.h"
+#endif
+
+#include "os_calls.h"
+#include "hash_calls.h"
+
+#include "test_common.h"
+
+/* a 64x64 32bpp tile, the largest bitmap the cache holds */
+#define TILE_BYTES (64 * 64 * 4)
+
+/* bit at a time CRC32C to check the others against */
+static unsigned int
+crc32c_ref(unsigned int crc, const void *data, int bytes)
+{
+    const unsigned char *p = (const unsigned char *)data;
+    int bit;
+
+    crc = ~crc;
+    while (bytes-- > 0)
+    {
+        crc ^= *p++;
+        for (bit = 0; bit < 8; bit++)
+        {
+            crc = (crc & 1) ? (crc >> 1) ^ 0x82F63B78 : crc >> 1;
+        }
+    }
+    return ~crc;
+}
+
+START_TEST(test_crc32c_check_value)
+{
+    const char *text = "123456789";
+
+    /* the standard check value for CRC-32C */
+    ck_assert_uint_eq(g_hash_crc32c(0, text, 9), 0xE3069283);
+    ck_assert_uint_eq(g_hash_crc32c_sw(0, text, 9), 0xE3069283);
+    ck_assert_uint_eq(g_hash_crc32c(0, text, 0), 0);
+}
+END_TEST
+
+START_TEST(test_crc32c_all_match_reference)
+{
+    char data[300];
+    int offset;
+    int bytes;
+    unsigned int expected;
+    int index;
+
+    for (index = 0; index < (int)sizeof(data); index++)
+    {
+        data[index] = (char)(index * 7 + 3);
+    }
+    /* all lengths and alignments, so the unaligned head and the tail
+     * are covered */
+    for (offset = 0; offset < 8; offset++)
+    {
+        for (bytes = 0; bytes < 280; bytes++)
+        {
+            expected = crc32c_ref(0, data + offset, bytes);
+            ck_assert_uint_eq(g_hash_crc32c_sw(0, data + offset, bytes),
+                              expected);
+            ck_assert_uint_eq(g_hash_crc32c(0, data + offset, bytes),
+                              expected);
+        }
+    }
+}
+END_TEST
+
+START_TEST(test_crc32c_continues)
+{
+    char data[TILE_BYTES];
+    unsigned int crc;
+    int index;
+
+    g_random(data, sizeof(data));
+    crc = 0;
+    for (index = 0; index < 64; index++)
+    {
+        crc = g_hash_crc32c(crc, data + index * 64 * 4, 64 * 4);
+    }
+    ck_assert_uint_eq(crc, g_hash_crc32c(0, data, sizeof(data)));
+    ck_assert_uint_eq(crc, crc32c_ref(0, data, sizeof(data)));
+}
+END_TEST
+
+/******************************************************************************/
+Suite *
+make_suite_test_hash_calls(void)
+{
+    Suite *s;
+    TCase *tc_hash_calls;
+
+    s = suite_create("Hash-Calls");
+
+    tc_hash_calls = tcase_create("hash_calls");
+    suite_add_tcase(s, tc_hash_calls);
+    tcase_add_test(tc_hash_calls, test_crc32c_check_value);
+    tcase_add_test(tc_hash_calls, test_crc32c_all_match_reference);
+    tcase_add_test(tc_hash_calls, test_crc32c_continues);
+
+    return s;
+}
@@ -0,0 +1,267 @@
+#if defined(HAVE_CONFIG_H)
+#include "config_ac.h"
+#endif
+
+#include <stdio.h>
+#include <string.h>
+#include <unistd.h>
+
+#include "log.h"
+#include "os_calls.h"
+#include "string_calls.h"
+
+#include "test_common.h"
+
+static char g_log_file[256];
+
+static void
+setup(void)
+{
+    g_snprintf(g_log_file, sizeof(g_log_file), "/tmp/test_log_%d.log",
+               g_getpid());
+    g_file_delete(g_log_file);
+    /* the test program logs to the console, that stops for each test */
+    log_end();
+}
+
+static void
+teardown(void)
+{
+    struct log_config *lc;
+
+    log_end();
+    g_file_delete(g_log_file);
+    lc = log_config_init_for_console(LOG_LEVEL_INFO, NULL);
+    log_start_from_param(lc);
+    log_config_free(lc);
+}
+
+static void
+start_async_log(int buffer_kb)
+{
+    struct log_config *lc;
+
+    lc = log_config_init_for_console(LOG_LEVEL_INFO, NULL);
+    ck_assert_ptr_nonnull(lc);
+    lc->enable_console = 0;
+    lc->log_file = g_strdup(g_log_file);
+    lc->log_level = LOG_LEVEL_INFO;
+    lc->enable_async = 1;
+    lc->async_buffer_kb = buffer_kb;
+    ck_assert_int_eq(log_start_from_param(lc), LOG_STARTUP_OK);
+    log_config_free(lc);
+}
+
+/* counts "message <n>" lines, which must be in order, and dropped
+ * notices */
+static void
+read_log(int *messages, int *notices)
+{
+    FILE *fp;
+    char line[512];
+    const char *p;
+    int last;
+    int n;
+
+    *messages = 0;
+    *notices = 0;
+    last = -1;
+    fp = fopen(g_log_file, "r");
+    ck_assert_ptr_nonnull(fp);
+    while (fgets(line, sizeof(line), fp) != NULL)
+    {
+        if ((p = strstr(line, "message ")) != NULL)
+        {
+            n = atoi(p + 8);
+            ck_assert_int_gt(n, last);
+            last = n;
+            (*messages)++;
+        }
+        else if (strstr(line, "log messages dropped") != NULL)
+        {
+            (*notices)++;
+        }
+    }
+    fclose(fp);
+}
+
+START_TEST(test_log_async__writes_everything)
+{
+    int index;
+    int messages;
+    int notices;
+
+    start_async_log(1024);
+    for (index = 0; index < 1000; index++)
+    {
+        LOG(LOG_LEVEL_INFO, "message %d", index);
+    }
+    /* below the level, not queued */
+    LOG(LOG_LEVEL_DEBUG, "message %d", index);
+    ck_assert_int_eq(log_get_async_dropped(), 0);
+    /* waits for the writer */
+    log_end();
+
+    read_log(&messages, &notices);
+    ck_assert_int_eq(messages, 1000);
+    ck_assert_int_eq(notices, 0);
+}
+END_TEST
+
+START_TEST(test_log_async__drops_when_full)
+{
+    char filler[200];
+    int index;
+    int messages;
+    int notices;
+    unsigned int dropped;
+
+    g_memset(filler, 'x', sizeof(filler) - 1);
+    filler[sizeof(filler) - 1] = '\0';
+    start_async_log(64);
+    for (index = 0; index < 20000; index++)
+    {
+        LOG(LOG_LEVEL_INFO, "message %d %s", index, filler);
+    }
+    dropped = log_get_async_dropped();
+    log_end();
+
+    read_log(&messages, &notices);
+    /* nothing lost without being counted, and the count is logged */
+    ck_assert_int_eq(messages + dropped, 20000);
+    if (dropped > 0)
+    {
+        ck_assert_int_gt(notices, 0);
+    }
+}
+END_TEST
+
+START_TEST(test_log_async__forked_child)
+{
+    struct exit_status st;
+    int pid;
+    int index;
+    int messages;
+    int notices;
+
+    start_async_log(1024);
+    pid = g_fork();
+    ck_assert_int_ne(pid, -1);
+    if (pid == 0)
+    {
+        /* exit status 1 to 3 says which check failed */
+        if (log_is_async())
+        {
+            _exit(1);
+        }
+        log_after_fork();
+        if (!log_is_async())
+        {
+            _exit(2);
+        }
+        for (index = 0; index < 1000; index++)
+        {
+            LOG(LOG_LEVEL_INFO, "message %d", index);
+        }
+        if (log_get_async_dropped() != 0)
+        {
+            _exit(3);
+        }
+        /* waits for the child's writer */
+        log_end();
+        _exit(0);
+    }
+    st = g_waitpid_status(pid);
+    ck_assert_int_eq(st.signal_no, 0);
+    ck_assert_int_eq(st.exit_code, 0);
+    ck_assert(log_is_async());
+    log_end();
+
+    read_log(&messages, &notices);
+    ck_assert_int_eq(messages, 1000);
+    ck_assert_int_eq(notices, 0);
+}
+END_TEST
+
+#ifdef LOG_PER_LOGGER_LEVEL
+static void
+log_from_elsewhere(void)
+{
+    LOG(LOG_LEVEL_DEBUG, "message 1");
+}
+
+/* file logging at INFO, with this function at another level */
+static void
+start_logger_log(enum logLevels logger_level)
+{
+    struct log_config *lc;
+    struct log_logger_level *logger;
+
+    lc = log_config_init_for_console(LOG_LEVEL_INFO, NULL);
+    ck_assert_ptr_nonnull(lc);
+    lc->enable_console = 0;
+    lc->log_file = g_strdup(g_log_file);
+    lc->log_level = LOG_LEVEL_INFO;
+    logger = g_new0(struct log_logger_level, 1);
+    logger->log_level = logger_level;
+    logger->logger_type = LOG_TYPE_FUNCTION;
+    g_strcpy(logger->logger_name, "test_log__per_logger_level_fn");
+    list_add_item(lc->per_logger_level, (tbus) logger);
+    ck_assert_int_eq(log_start_from_param(lc), LOG_STARTUP_OK);
+    log_config_free(lc);
+}
+
+static void
+test_log__per_logger_level_fn(int n)
+{
+    LOG(LOG_LEVEL_DEBUG, "message %d", n);
+    LOG(LOG_LEVEL_INFO, "message %d", n + 1);
+}
+
+START_TEST(test_log__per_logger_level)
+{
+    int messages;
+    int notices;
+
+    start_logger_log(LOG_LEVEL_DEBUG);
+    /* twice, the second time from the call site cache */
+    log_from_elsewhere();
+    test_log__per_logger_level_fn(2);
+    log_from_elsewhere();
+    test_log__per_logger_level_fn(4);
+    log_end();
+    read_log(&messages, &notices);
+    ck_assert_int_eq(messages, 4);
+
+    /* the cache must not outlive the levels it came from */
+    g_file_delete(g_log_file);
+    start_logger_log(LOG_LEVEL_WARNING);
+    test_log__per_logger_level_fn(2);
+    log_end();
+    read_log(&messages, &notices);
+    ck_assert_int_eq(messages, 0);
+}
+END_TEST
+#endif
+
+/******************************************************************************/
+Suite *
+make_suite_test_log(void)
+{
+    Suite *s;
+    TCase *tc_log;
+
+    s = suite_create("Log");
+
+    tc_log = tcase_create("log_async");
+    tcase_add_checked_fixture(tc_log, setup, teardown);
+    suite_add_tcase(s, tc_log);
+    tcase_add_test(tc_log, test_log_async__writes_everything);
+    tcase_add_test(tc_log, test_log_async__drops_when_full);
+    tcase_add_test(tc_log, test_log_async__forked_child);
+#ifdef LOG_PER_LOGGER_LEVEL
+    tcase_add_test(tc_log, test_log__per_logger_level);
+#endif
+
+    return s;
+}
@@ -145,6 +145,110 @@ START_TEST(test_g_file_get_size__5GiB)
 END_TEST
 #endif
 
+/******************************************************************************/
+START_TEST(test_g_wait_set__ready)
+{
+    struct g_wait_set *ws;
+    struct g_wait_set_event events[4];
+    tintptr obj1;
+    tintptr obj2;
+    int data1;
+    int data2;
+
+    ws = g_wait_set_create();
+    ck_assert_ptr_nonnull(ws);
+    obj1 = g_create_wait_obj("wait_set_1");
+    obj2 = g_create_wait_obj("wait_set_2");
+    ck_assert_int_eq(g_wait_set_add(ws, obj1, G_WAIT_READ, &data1), 0);
+    ck_assert_int_eq(g_wait_set_add(ws, obj2, G_WAIT_READ, &data2), 0);
+
+    ck_assert_int_eq(g_wait_set_wait(ws, events, 4, 1), 0);
+    g_set_wait_obj(obj2);
+    ck_assert_int_eq(g_wait_set_wait(ws, events, 4, 1000), 1);
+    ck_assert_ptr_eq(events[0].data, &data2);
+    ck_assert_int_eq(events[0].events, G_WAIT_READ);
+
+    /* not waited for while it has no events */
+    ck_assert_int_eq(g_wait_set_modify(ws, obj2, 0, &data2), 0);
+    ck_assert_int_eq(g_wait_set_wait(ws, events, 4, 1), 0);
+    ck_assert_int_eq(g_wait_set_modify(ws, obj2, G_WAIT_READ, &data1), 0);
+    ck_assert_int_eq(g_wait_set_wait(ws, events, 4, 1), 1);
+    ck_assert_ptr_eq(events[0].data, &data1);
+
+    ck_assert_int_eq(g_wait_set_remove(ws, obj2), 0);
+    ck_assert_int_eq(g_wait_set_wait(ws, events, 4, 1), 0);
+    g_set_wait_obj(obj1);
+    ck_assert_int_eq(g_wait_set_wait(ws, events, 4, 1000), 1);
+    ck_assert_ptr_eq(events[0].data, &data1);
+
+    g_wait_set_delete(ws);
+    g_delete_wait_obj(obj1);
+    g_delete_wait_obj(obj2);
+}
+END_TEST
+
+/******************************************************************************/
+START_TEST(test_g_wait_set__write)
+{
+    struct g_wait_set *ws;
+    struct g_wait_set_event events[4];
+    int sck[2];
+
+    ck_assert_int_eq(g_sck_local_socketpair(sck), 0);
+    ws = g_wait_set_create();
+    ck_assert_ptr_nonnull(ws);
+    ck_assert_int_eq(g_wait_set_add(ws, sck[0], G_WAIT_READ, NULL), 0);
+    ck_assert_int_eq(g_wait_set_wait(ws, events, 4, 1), 0);
+    ck_assert_int_eq(g_wait_set_modify(ws, sck[0],
+                                       G_WAIT_READ | G_WAIT_WRITE, sck), 0);
+    ck_assert_int_eq(g_wait_set_wait(ws, events, 4, 1000), 1);
+    ck_assert_ptr_eq(events[0].data, sck);
+    ck_assert_int_eq(events[0].events, G_WAIT_WRITE);
+    /* the peer going away wakes up a reader */
+    ck_assert_int_eq(g_wait_set_modify(ws, sck[0], G_WAIT_READ, sck), 0);
+    g_sck_close(sck[1]);
+    ck_assert_int_eq(g_wait_set_wait(ws, events, 4, 1000), 1);
+    ck_assert_int_eq(events[0].events & G_WAIT_READ, G_WAIT_READ);
+    g_wait_set_delete(ws);
+    g_sck_close(sck[0]);
+}
+END_TEST
+
+/******************************************************************************/
+START_TEST(test_g_wait_set__obj)
+{
+    struct g_wait_set *ws;
+    struct g_wait_set_event events[4];
+    tintptr obj;
+    tintptr set_obj;
+
+    ws = g_wait_set_create();
+    ck_assert_ptr_nonnull(ws);
+    obj = g_create_wait_obj("wait_set_obj");
+    ck_assert_int_eq(g_wait_set_add(ws, obj, G_WAIT_READ, &obj), 0);
+
+    /* 0 doesn't wait */
+    ck_assert_int_eq(g_wait_set_wait(ws, events, 4, 0), 0);
+
+    /* the set's own object follows its members */
+    set_obj = g_wait_set_get_obj(ws);
+    if (set_obj != -1)
+    {
+        ck_assert_int_eq(g_is_wait_obj_set(set_obj), 0);
+        g_set_wait_obj(obj);
+        ck_assert_int_eq(g_obj_wait(&set_obj, 1, NULL, 0, 1000), 0);
+        ck_assert_int_ne(g_is_wait_obj_set(set_obj), 0);
+        ck_assert_int_eq(g_wait_set_wait(ws, events, 4, 0), 1);
+        ck_assert_ptr_eq(events[0].data, &obj);
+        g_reset_wait_obj(obj);
+        ck_assert_int_eq(g_is_wait_obj_set(set_obj), 0);
+    }
+
+    g_wait_set_delete(ws);
+    g_delete_wait_obj(obj);
+}
+END_TEST
+
 /******************************************************************************/
 Suite *
 make_suite_test_os_calls(void)
@@ -164,5 +268,11 @@ make_suite_test_os_calls(void)
     tcase_add_test(tc_os_calls, test_g_file_get_size__5GiB);
 #endif
 
+    tc_os_calls = tcase_create("oscalls-wait-set");
+    suite_add_tcase(s, tc_os_calls);
+    tcase_add_test(tc_os_calls, test_g_wait_set__ready);
+    tcase_add_test(tc_os_calls, test_g_wait_set__write);
+    tcase_add_test(tc_os_calls, test_g_wait_set__obj);
+
     return s;
 }
@@ -0,0 +1,201 @@
+#if defined(HAVE_CONFIG_H)
+#include "config_ac.h"
+#endif
+
+#include "os_calls.h"
+#include "trans.h"
+
+#include "test_common.h"
+
+#define MSG_BYTES 1000
+
+static struct trans *g_t;
+static int g_peer;
+
+/* a trans on one end of a socket pair, nobody reading the other end */
+static void
+setup(void)
+{
+    int sck[2];
+
+    ck_assert_int_eq(g_sck_local_socketpair(sck), 0);
+    g_t = trans_create(TRANS_MODE_UNIX, 8192, 8192);
+    ck_assert_ptr_nonnull(g_t);
+    g_t->sck = sck[0];
+    g_t->type1 = TRANS_TYPE_CLIENT;
+    g_t->status = TRANS_STATUS_UP;
+    g_sck_set_non_blocking(sck[0]);
+    g_peer = sck[1];
+    g_sck_set_non_blocking(g_peer);
+}
+
+static void
+teardown(void)
+{
+    trans_delete(g_t);
+    g_sck_close(g_peer);
+}
+
+/* message n is MSG_BYTES of n + offset */
+static void
+fill_msg(struct stream *s, int n)
+{
+    int index;
+
+    for (index = 0; index < MSG_BYTES; index++)
+    {
+        out_uint8(s, (n + index) & 0xff);
+    }
+    s_mark_end(s);
+}
+
+/* reads everything the trans sends and checks it is messages 0 to count
+   in order */
+static void
+check_received(int count)
+{
+    char buf[4096];
+    int total;
+    int got;
+    int index;
+
+    total = 0;
+    while (total < count * MSG_BYTES)
+    {
+        ck_assert_int_eq(trans_send_waiting(g_t, 0), 0);
+        got = g_sck_recv(g_peer, buf, sizeof(buf), 0);
+        if (got < 0)
+        {
+            ck_assert(g_sck_last_error_would_block(g_peer));
+            continue;
+        }
+        for (index = 0; index < got; index++)
+        {
+            ck_assert_int_eq((unsigned char) buf[index],
+                             ((total / MSG_BYTES) + (total % MSG_BYTES)) &
+                             0xff);
+            total++;
+        }
+    }
+    ck_assert_int_eq(trans_get_wait_bytes(g_t), 0);
+    ck_assert_ptr_null(g_t->wait_s);
+    ck_assert_int_eq(g_t->wait_count, 0);
+}
+
+/* sends messages until some are queued, returns how many were sent */
+static int
+fill_queue(int (*send_msg)(int n))
+{
+    int count;
+
+    count = 0;
+    while (g_t->wait_count < 20)
+    {
+        ck_assert_int_eq(send_msg(count), 0);
+        count++;
+    }
+    return count;
+}
+
+static int
+send_copy(int n)
+{
+    struct stream *s;
+    int rv;
+
+    make_stream(s);
+    init_stream(s, MSG_BYTES);
+    fill_msg(s, n);
+    rv = trans_write_copy_s(g_t, s);
+    free_stream(s);
+    return rv;
+}
+
+static int
+send_take(int n)
+{
+    struct stream *s;
+
+    make_stream(s);
+    init_stream(s, MSG_BYTES);
+    fill_msg(s, n);
+    return trans_write_take_s(g_t, s);
+}
+
+static int
+send_out_s(int n)
+{
+    struct stream *s;
+
+    s = trans_get_out_s(g_t, MSG_BYTES);
+    fill_msg(s, n);
+    return trans_write_copy(g_t);
+}
+
+START_TEST(test_trans_queue_copy)
+{
+    int count;
+
+    count = fill_queue(send_copy);
+    ck_assert_int_gt(trans_get_wait_bytes(g_t), 0);
+    ck_assert_int_le(trans_get_wait_bytes(g_t), g_t->wait_bytes_max);
+    check_received(count);
+}
+END_TEST
+
+START_TEST(test_trans_queue_take)
+{
+    int count;
+
+    count = fill_queue(send_take);
+    check_received(count);
+}
+END_TEST
+
+START_TEST(test_trans_queue_out_s)
+{
+    int count;
+
+    count = fill_queue(send_out_s);
+    /* out_s was queued as it was, the trans has a new one to fill */
+    ck_assert_ptr_ne(g_t->wait_tail, g_t->out_s);
+    ck_assert_int_eq(send_out_s(count), 0);
+    count++;
+    check_received(count);
+}
+END_TEST
+
+START_TEST(test_trans_queue_bytes)
+{
+    struct stream *s;
+    int queued;
+
+    fill_queue(send_copy);
+    queued = 0;
+    for (s = g_t->wait_s; s != 0; s = s->next)
+    {
+        queued += (int) (s->end - s->p);
+    }
+    ck_assert_int_eq(trans_get_wait_bytes(g_t), queued);
+}
+END_TEST
+
+/******************************************************************************/
+Suite *
+make_suite_test_trans(void)
+{
+    Suite *s;
+    TCase *tc_trans;
+
+    s = suite_create("Trans");
+
+    tc_trans = tcase_create("trans_send_queue");
+    tcase_add_checked_fixture(tc_trans, setup, teardown);
+    suite_add_tcase(s, tc_trans);
+    tcase_add_test(tc_trans, test_trans_queue_copy);
+    tcase_add_test(tc_trans, test_trans_queue_take);
+    tcase_add_test(tc_trans, test_trans_queue_out_s);
+    tcase_add_test(tc_trans, test_trans_queue_bytes);
+
+    return s;
+}
@@ -14,6 +14,8 @@ int main (void)
 
     sr = srunner_create(make_suite_test_xrdp_sec_process_mcs_data_monitors());
     srunner_add_suite(sr, make_suite_test_monitor_processing());
+    srunner_add_suite(sr, make_suite_test_xrdp_nscodec());
+    srunner_add_suite(sr, make_suite_test_xrdp_rdp_persistent_list());
 
     srunner_set_tap(sr, "-");
 
@@ -0,0 +1,403 @@
+#if defined(HAVE_CONFIG_H)
+#include "config_ac.h"
+#endif
+
+#include "libxrdp.h"
+#include "os_calls.h"
+
+#include "test_libxrdp.h"
+
+/* [MS-RDPNSC] 3.1.8.2.1 RLE, as a client decodes it */
+static void
+rle_decode(const unsigned char *in, unsigned char *out, int out_bytes)
+{
+    int left;
+    int len;
+    unsigned char value;
+
+    left = out_bytes;
+    while (left > 4)
+    {
+        value = *(in++);
+        if (left == 5)
+        {
+            *(out++) = value;
+            left--;
+        }
+        else if (value == *in)
+        {
+            in++;
+            if (*in < 0xFF)
+            {
+                len = *in + 2;
+                in++;
+            }
+            else
+            {
+                in++;
+                len = in[0] | (in[1] << 8) | (in[2] << 16) | (in[3] << 24);
+                in += 4;
+            }
+            ck_assert_int_le(len, left);
+            memset(out, value, len);
+            out += len;
+            left -= len;
+        }
+        else
+        {
+            *(out++) = value;
+            left--;
+        }
+    }
+    memcpy(out, in, 4);
+}
+
+/* a plane is RLE compressed if it is smaller than the original */
+static void
+read_plane(const unsigned char *in, int plane_bytes, unsigned char *out,
+           int org_bytes)
+{
+    if (plane_bytes < org_bytes)
+    {
+        rle_decode(in, out, org_bytes);
+    }
+    else
+    {
+        ck_assert_int_eq(plane_bytes, org_bytes);
+        memcpy(out, in, org_bytes);
+    }
+}
+
+/* decodes a NSCODEC_BITMAP_STREAM to x8r8g8b8 */
+static void
+nscodec_decode(const char *data, int data_bytes, int width, int height,
+               unsigned int *pixels)
+{
+    struct stream ls;
+    struct stream *s;
+    unsigned char *planes[3];
+    const unsigned char *y_line;
+    const unsigned char *co_line;
+    const unsigned char *cg_line;
+    int plane_bytes[4];
+    int org_bytes[3];
+    int color_loss_level;
+    int subsampling;
+    int plane_width;
+    int index;
+    int x;
+    int y;
+    int yv;
+    int co;
+    int cg;
+    int r;
+    int g;
+    int b;
+
+    g_memset(&ls, 0, sizeof(ls));
+    s = &ls;
+    s->data = (char *) data;
+    s->p = s->data;
+    s->end = s->data + data_bytes;
+    s->size = data_bytes;
+    in_uint32_le(s, plane_bytes[0]);
+    in_uint32_le(s, plane_bytes[1]);
+    in_uint32_le(s, plane_bytes[2]);
+    in_uint32_le(s, plane_bytes[3]);
+    in_uint8(s, color_loss_level);
+    in_uint8(s, subsampling);
+    in_uint8s(s, 2);
+    ck_assert_int_eq(plane_bytes[3], 0);
+    ck_assert_int_eq(20 + plane_bytes[0] + plane_bytes[1] + plane_bytes[2],
+                     data_bytes);
+
+    plane_width = subsampling ? (width + 7) & ~7 : width;
+    org_bytes[0] = plane_width * height;
+    org_bytes[1] = subsampling ?
+                   (plane_width / 2) * (((height + 1) & ~1) / 2) :
+                   width * height;
+    org_bytes[2] = org_bytes[1];
+    for (index = 0; index < 3; index++)
+    {
+        planes[index] = (unsigned char *) g_malloc(org_bytes[index], 0);
+        read_plane((const unsigned char *) s->p, plane_bytes[index],
+                   planes[index], org_bytes[index]);
+        in_uint8s(s, plane_bytes[index]);
+    }
+
+    for (y = 0; y < height; y++)
+    {
+        y_line = planes[0] + y * plane_width;
+        if (subsampling)
+        {
+            co_line = planes[1] + (y / 2) * (plane_width / 2);
+            cg_line = planes[2] + (y / 2) * (plane_width / 2);
+        }
+        else
+        {
+            co_line = planes[1] + y * width;
+            cg_line = planes[2] + y * width;
+        }
+        for (x = 0; x < width; x++)
+        {
+            index = subsampling ? x / 2 : x;
+            yv = y_line[x];
+            co = (signed char) (co_line[index] << (color_loss_level - 1));
+            cg = (signed char) (cg_line[index] << (color_loss_level - 1));
+            r = MAX(MIN(yv + co - cg, 255), 0);
+            g = MAX(MIN(yv + cg, 255), 0);
+            b = MAX(MIN(yv - co - cg, 255), 0);
+            pixels[y * width + x] = (r << 16) | (g << 8) | b;
+        }
+    }
+    for (index = 0; index < 3; index++)
+    {
+        g_free(planes[index]);
+    }
+}
+
+/* the largest difference in any colour channel */
+static int
+max_channel_diff(const unsigned int *p1, const unsigned int *p2, int count)
+{
+    int index;
+    int shift;
+    int diff;
+    int rv;
+
+    rv = 0;
+    for (index = 0; index < count; index++)
+    {
+        for (shift = 0; shift < 24; shift += 8)
+        {
+            diff = (int) ((p1[index] >> shift) & 0xFF) -
+                   (int) ((p2[index] >> shift) & 0xFF);
+            rv = MAX(rv, diff < 0 ? -diff : diff);
+        }
+    }
+    return rv;
+}
+
+/******************************************************************************/
+START_TEST(test_nscodec_rle__runs_and_literals)
+{
+    const unsigned char in[] =
+    {
+        1, 2, 2, 3, 3, 3, 3, 4, 5, 6, 7, 8
+    };
+    const unsigned char expected[] =
+    {
+        1, 2, 2, 0, 3, 3, 2, 4, 5, 6, 7, 8
+    };
+    unsigned char out[64];
+    int bytes;
+
+    bytes = xrdp_nscodec_rle_encode(in, sizeof(in), out, sizeof(out));
+    ck_assert_int_eq(bytes, sizeof(expected));
+    ck_assert_int_eq(memcmp(out, expected, sizeof(expected)), 0);
+}
+END_TEST
+
+/******************************************************************************/
+START_TEST(test_nscodec_rle__long_run)
+{
+    unsigned char in[1004];
+    unsigned char out[64];
+    unsigned char check[1004];
+    int bytes;
+
+    memset(in, 0x55, 1000);
+    in[1000] = 1;
+    in[1001] = 2;
+    in[1002] = 3;
+    in[1003] = 4;
+    bytes = xrdp_nscodec_rle_encode(in, sizeof(in), out, sizeof(out));
+    ck_assert_int_eq(bytes, 11);
+    ck_assert_int_eq(out[0], 0x55);
+    ck_assert_int_eq(out[1], 0x55);
+    ck_assert_int_eq(out[2], 0xFF);
+    ck_assert_int_eq(out[3] | (out[4] << 8) | (out[5] << 16) | (out[6] << 24),
+                     1000);
+    rle_decode(out, check, sizeof(check));
+    ck_assert_int_eq(memcmp(in, check, sizeof(in)), 0);
+}
+END_TEST
+
+/******************************************************************************/
+START_TEST(test_nscodec_rle__no_gain_fails)
+{
+    const unsigned char in[] =
+    {
+        1, 2, 3, 4, 5, 6, 7, 8, 9, 10
+    };
+    unsigned char out[64];
+
+    /* the caller sends the plane raw if it is not made smaller */
+    ck_assert_int_eq(xrdp_nscodec_rle_encode(in, sizeof(in), out,
+                     sizeof(in) - 1), -1);
+    ck_assert_int_eq(xrdp_nscodec_rle_encode(in, 4, out, sizeof(out)), -1);
+}
+END_TEST
+
+/******************************************************************************/
+START_TEST(test_nscodec_encode__color_conversion)
+{
+    unsigned int pixels[37 * 5];
+    unsigned char out[4096];
+    unsigned char planes[3][37 * 5];
+    const unsigned char *p;
+    int out_bytes;
+    int plane_bytes;
+    int index;
+    int r;
+    int g;
+    int b;
+
+    /* odd width so both the 8 pixel and the single pixel paths are used */
+    for (index = 0; index < 37 * 5; index++)
+    {
+        pixels[index] = (unsigned int) (index * 2654435761u);
+    }
+    out_bytes = sizeof(out);
+    ck_assert_int_eq(xrdp_nscodec_encode((const char *) pixels, 37 * 4,
+                                         0, 0, 37, 5, 2, 0,
+                                         (char *) out, &out_bytes), 0);
+    ck_assert_int_eq(out[16], 2);
+    ck_assert_int_eq(out[17], 0);
+    p = out + 20;
+    for (index = 0; index < 3; index++)
+    {
+        plane_bytes = out[index * 4] | (out[index * 4 + 1] << 8);
+        read_plane(p, plane_bytes, planes[index], 37 * 5);
+        p += plane_bytes;
+    }
+    ck_assert_int_eq(p - out, out_bytes);
+    for (index = 0; index < 37 * 5; index++)
+    {
+        r = (pixels[index] >> 16) & 0xFF;
+        g = (pixels[index] >> 8) & 0xFF;
+        b = pixels[index] & 0xFF;
+        ck_assert_int_eq(planes[0][index], (r >> 2) + (g >> 1) + (b >> 2));
+        ck_assert_int_eq((signed char) planes[1][index], (r - b) >> 2);
+        ck_assert_int_eq((signed char) planes[2][index],
+                         (g - (r >> 1) - (b >> 1)) >> 2);
+    }
+}
+END_TEST
+
+/******************************************************************************/
+START_TEST(test_nscodec_encode__round_trip)
+{
+    unsigned int image[64 * 40];
+    unsigned int area[21 * 13];
+    unsigned int decoded[21 * 13];
+    char out[4096];
+    int out_bytes;
+    int x;
+    int y;
+
+    for (y = 0; y < 40; y++)
+    {
+        for (x = 0; x < 64; x++)
+        {
+            image[y * 64 + x] = ((x * 4) << 16) | ((y * 6) << 8) | 0x80;
+        }
+    }
+    for (y = 0; y < 13; y++)
+    {
+        for (x = 0; x < 21; x++)
+        {
+            area[y * 21 + x] = image[(y + 7) * 64 + x + 5];
+        }
+    }
+
+    out_bytes = sizeof(out);
+    ck_assert_int_eq(xrdp_nscodec_encode((const char *) image, 64 * 4,
+                                         5, 7, 21, 13, 1, 0,
+                                         out, &out_bytes), 0);
+    nscodec_decode(out, out_bytes, 21, 13, decoded);
+    ck_assert_int_le(max_channel_diff(area, decoded, 21 * 13), 2);
+
+    /* odd size with subsampling uses the padded planes */
+    out_bytes = sizeof(out);
+    ck_assert_int_eq(xrdp_nscodec_encode((const char *) image, 64 * 4,
+                                         5, 7, 21, 13, 3, 1,
+                                         out, &out_bytes), 0);
+    ck_assert_int_eq(out[17], 1);
+    nscodec_decode(out, out_bytes, 21, 13, decoded);
+    ck_assert_int_le(max_channel_diff(area, decoded, 21 * 13), 16);
+}
+END_TEST
+
+/******************************************************************************/
+START_TEST(test_nscodec_encode__solid_is_small)
+{
+    unsigned int image[64 * 64];
+    unsigned int decoded[64 * 64];
+    char out[1024];
+    int out_bytes;
+    int index;
+
+    for (index = 0; index < 64 * 64; index++)
+    {
+        image[index] = 0x00336699;
+    }
+    out_bytes = sizeof(out);
+    ck_assert_int_eq(xrdp_nscodec_encode((const char *) image, 64 * 4,
+                                         0, 0, 64, 64, 3, 1,
+                                         out, &out_bytes), 0);
+    ck_assert_int_lt(out_bytes, 64);
+    nscodec_decode(out, out_bytes, 64, 64, decoded);
+    ck_assert_int_le(max_channel_diff(image, decoded, 64 * 64), 8);
+}
+END_TEST
+
+/******************************************************************************/
+START_TEST(test_nscodec_encode__bad_args)
+{
+    unsigned int image[16 * 16];
+    char out[64];
+    int out_bytes;
+
+    g_memset(image, 0, sizeof(image));
+    image[0] = 0x00FF0000;
+    out_bytes = sizeof(out);
+    ck_assert_int_ne(xrdp_nscodec_encode((const char *) image, 16 * 4,
+                                         0, 0, 16, 16, 0, 0,
+                                         out, &out_bytes), 0);
+    ck_assert_int_ne(xrdp_nscodec_encode((const char *) image, 16 * 4,
+                                         0, 0, 0, 16, 1, 0,
+                                         out, &out_bytes), 0);
+    /* does not fit */
+    out_bytes = 24;
+    ck_assert_int_ne(xrdp_nscodec_encode((const char *) image, 16 * 4,
+                                         0, 0, 16, 16, 1, 0,
+                                         out, &out_bytes), 0);
+}
+END_TEST
+
+/******************************************************************************/
+Suite *
+make_suite_test_xrdp_nscodec(void)
+{
+    Suite *s;
+    TCase *tc_rle;
+    TCase *tc_encode;
+
+    s = suite_create("test_xrdp_nscodec");
+
+    tc_rle = tcase_create("xrdp_nscodec_rle_encode");
+    tcase_add_test(tc_rle, test_nscodec_rle__runs_and_literals);
+    tcase_add_test(tc_rle, test_nscodec_rle__long_run);
+    tcase_add_test(tc_rle, test_nscodec_rle__no_gain_fails);
+    suite_add_tcase(s, tc_rle);
+
+    tc_encode = tcase_create("xrdp_nscodec_encode");
+    tcase_add_test(tc_encode, test_nscodec_encode__color_conversion);
+    tcase_add_test(tc_encode, test_nscodec_encode__round_trip);
+    tcase_add_test(tc_encode, test_nscodec_encode__solid_is_small);
+    tcase_add_test(tc_encode, test_nscodec_encode__bad_args);
+    suite_add_tcase(s, tc_encode);
+
+    return s;
+}
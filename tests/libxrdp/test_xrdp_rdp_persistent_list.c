@@ -0,0 +1,184 @@
+#if defined(HAVE_CONFIG_H)
+#include "config_ac.h"
+#endif
+
+#include "libxrdp.h"
+#include "os_calls.h"
+
+#include "test_libxrdp.h"
+
+static struct xrdp_rdp *rdp_layer;
+static struct xrdp_session *session;
+
+/******************************************************************************/
+static void
+setup(void)
+{
+    rdp_layer = (struct xrdp_rdp *)g_malloc(sizeof(struct xrdp_rdp), 1);
+    session = (struct xrdp_session *)g_malloc(sizeof(struct xrdp_session), 1);
+    session->rdp = rdp_layer;
+    session->client_info = &(rdp_layer->client_info);
+    session->client_info->use_bitmap_cache_persist = 1;
+}
+
+/******************************************************************************/
+static void
+teardown(void)
+{
+    int index;
+
+    for (index = 0; index < XRDP_MAX_BITMAP_CACHE_ID; index++)
+    {
+        g_free(rdp_layer->persist_keys[index]);
+    }
+    g_free(session);
+    g_free(rdp_layer);
+}
+
+/******************************************************************************/
+/* a TS_BITMAPCACHE_PERSISTENT_LIST_PDU, num and total have 5 entries, the
+   keys for cache n are (n << 16) + first + i and ~that */
+static void
+make_list(struct stream *s, const int *num, const int *total,
+          const int *first, int flags)
+{
+    int index;
+    int jndex;
+    unsigned int key;
+
+    init_stream(s, 8192);
+    for (index = 0; index < 5; index++)
+    {
+        out_uint16_le(s, num[index]);
+    }
+    for (index = 0; index < 5; index++)
+    {
+        out_uint16_le(s, total[index]);
+    }
+    out_uint8(s, flags);
+    out_uint8s(s, 3);
+    for (index = 0; index < 5; index++)
+    {
+        for (jndex = 0; jndex < num[index]; jndex++)
+        {
+            key = (index << 16) + first[index] + jndex;
+            out_uint32_le(s, key);
+            out_uint32_le(s, ~key);
+        }
+    }
+    s_mark_end(s);
+    s->p = s->data;
+}
+
+START_TEST(test_persistent_list__two_pdus)
+{
+    struct stream *s;
+    const unsigned int *keys;
+    const int total[5] = { 3, 5, 0, 0, 0 };
+    const int num1[5] = { 3, 2, 0, 0, 0 };
+    const int first1[5] = { 0, 0, 0, 0, 0 };
+    const int num2[5] = { 0, 3, 0, 0, 0 };
+    const int first2[5] = { 0, 2, 0, 0, 0 };
+    int count;
+    int index;
+
+    make_stream(s);
+    make_list(s, num1, total, first1, PERSIST_FIRST_PDU);
+    ck_assert_int_eq(xrdp_rdp_process_persistent_list(rdp_layer, s), 0);
+    make_list(s, num2, total, first2, PERSIST_LAST_PDU);
+    ck_assert_int_eq(xrdp_rdp_process_persistent_list(rdp_layer, s), 0);
+    free_stream(s);
+
+    count = libxrdp_get_persistent_keys(session, 0, &keys);
+    ck_assert_int_eq(count, 3);
+    for (index = 0; index < count; index++)
+    {
+        ck_assert_uint_eq(keys[index * 2], index);
+        ck_assert_uint_eq(keys[index * 2 + 1], ~(unsigned int)index);
+    }
+    /* the second PDU carries on from where the first stopped */
+    count = libxrdp_get_persistent_keys(session, 1, &keys);
+    ck_assert_int_eq(count, 5);
+    for (index = 0; index < count; index++)
+    {
+        ck_assert_uint_eq(keys[index * 2], (1 << 16) + index);
+    }
+    count = libxrdp_get_persistent_keys(session, 2, &keys);
+    ck_assert_int_eq(count, 0);
+    ck_assert_ptr_null(keys);
+}
+END_TEST
+
+START_TEST(test_persistent_list__more_than_total_and_cache_4)
+{
+    struct stream *s;
+    const unsigned int *keys;
+    const int total[5] = { 2, 0, 0, 0, 1 };
+    const int num[5] = { 4, 0, 0, 0, 1 };
+    const int first[5] = { 0, 0, 0, 0, 0 };
+
+    make_stream(s);
+    make_list(s, num, total, first, PERSIST_FIRST_PDU | PERSIST_LAST_PDU);
+    ck_assert_int_eq(xrdp_rdp_process_persistent_list(rdp_layer, s), 0);
+    /* all the keys were read */
+    ck_assert_int_eq(s_check_rem(s, 1), 0);
+    free_stream(s);
+
+    ck_assert_int_eq(libxrdp_get_persistent_keys(session, 0, &keys), 2);
+    ck_assert_int_eq(libxrdp_get_persistent_keys(session, 3, &keys), 0);
+}
+END_TEST
+
+START_TEST(test_persistent_list__short_pdu__fail)
+{
+    struct stream *s;
+    const int total[5] = { 4, 0, 0, 0, 0 };
+    const int num[5] = { 4, 0, 0, 0, 0 };
+    const int first[5] = { 0, 0, 0, 0, 0 };
+
+    make_stream(s);
+    make_list(s, num, total, first, PERSIST_FIRST_PDU | PERSIST_LAST_PDU);
+    s->end -= 8;
+    ck_assert_int_ne(xrdp_rdp_process_persistent_list(rdp_layer, s), 0);
+    free_stream(s);
+}
+END_TEST
+
+START_TEST(test_persistent_list__disabled__ignored)
+{
+    struct stream *s;
+    const unsigned int *keys;
+    const int total[5] = { 2, 0, 0, 0, 0 };
+    const int num[5] = { 2, 0, 0, 0, 0 };
+    const int first[5] = { 0, 0, 0, 0, 0 };
+
+    session->client_info->use_bitmap_cache_persist = 0;
+    make_stream(s);
+    make_list(s, num, total, first, PERSIST_FIRST_PDU | PERSIST_LAST_PDU);
+    ck_assert_int_eq(xrdp_rdp_process_persistent_list(rdp_layer, s), 0);
+    free_stream(s);
+
+    ck_assert_int_eq(libxrdp_get_persistent_keys(session, 0, &keys), 0);
+}
+END_TEST
+
+/******************************************************************************/
+Suite *
+make_suite_test_xrdp_rdp_persistent_list(void)
+{
+    Suite *s;
+    TCase *tc_persistent_list;
+
+    s = suite_create("PersistentList");
+
+    tc_persistent_list = tcase_create("xrdp_rdp_process_persistent_list");
+    tcase_add_checked_fixture(tc_persistent_list, setup, teardown);
+    suite_add_tcase(s, tc_persistent_list);
+    tcase_add_test(tc_persistent_list, test_persistent_list__two_pdus);
+    tcase_add_test(tc_persistent_list,
+                   test_persistent_list__more_than_total_and_cache_4);
+    tcase_add_test(tc_persistent_list, test_persistent_list__short_pdu__fail);
+    tcase_add_test(tc_persistent_list, test_persistent_list__disabled__ignored);
+
+    return s;
+}
@@ -0,0 +1,8 @@
+#ifndef TEST_SESMAN_H
+#define TEST_SESMAN_H
+
+#include <check.h>
+
+Suite *make_suite_test_session_index(void);
+
+#endif /* TEST_SESMAN_H */
@@ -0,0 +1,190 @@
+#if defined(HAVE_CONFIG_H)
+#include "config_ac.h"
+#endif
+
+#include "arch.h"
+#include "os_calls.h"
+#include "session_index.h"
+
+#include "test_sesman.h"
+
+#define SESSION_COUNT 1000
+#define USER_COUNT 50
+
+static struct session_chain g_chains[SESSION_COUNT];
+static struct session_item g_items[SESSION_COUNT];
+
+/* Sessions are spread over USER_COUNT users, as on a busy server */
+static void
+setup(void)
+{
+    int index;
+
+    for (index = 0; index < SESSION_COUNT; index++)
+    {
+        g_memset(&g_chains[index], 0, sizeof(g_chains[index]));
+        g_memset(&g_items[index], 0, sizeof(g_items[index]));
+        g_items[index].uid = 1000 + index % USER_COUNT;
+        g_items[index].pid = 20000 + index;
+        g_items[index].display = 10 + index;
+        g_chains[index].item = &g_items[index];
+        ck_assert_int_eq(session_index_reserve(), 0);
+        session_index_add(&g_chains[index]);
+    }
+}
+
+static void
+teardown(void)
+{
+    int index;
+
+    for (index = 0; index < SESSION_COUNT; index++)
+    {
+        if (g_chains[index].item != NULL)
+        {
+            session_index_remove(&g_chains[index]);
+            g_chains[index].item = NULL;
+        }
+    }
+}
+
+/* Counts sessions for a user, checking they come newest first */
+static int
+count_user_sessions(int uid)
+{
+    struct session_chain *sc;
+    struct session_chain *last = NULL;
+    int count = 0;
+
+    for (sc = session_index_get(SESSION_KEY_UID, uid); sc != NULL;
+            sc = session_index_next(sc, SESSION_KEY_UID))
+    {
+        ck_assert_int_eq(sc->item->uid, uid);
+        if (last != NULL)
+        {
+            ck_assert(sc < last);
+        }
+        last = sc;
+        count++;
+    }
+    return count;
+}
+
+START_TEST(test_session_index__find)
+{
+    int index;
+
+    for (index = 0; index < SESSION_COUNT; index++)
+    {
+        ck_assert_ptr_eq(session_index_get(SESSION_KEY_PID, 20000 + index),
+                         &g_chains[index]);
+        ck_assert_ptr_eq(session_index_get(SESSION_KEY_DISPLAY, 10 + index),
+                         &g_chains[index]);
+    }
+    ck_assert_ptr_null(session_index_get(SESSION_KEY_PID, 19999));
+    ck_assert_ptr_null(session_index_get(SESSION_KEY_DISPLAY,
+                                         10 + SESSION_COUNT));
+    ck_assert_ptr_null(session_index_get(SESSION_KEY_UID, 999));
+}
+END_TEST
+
+START_TEST(test_session_index__by_uid)
+{
+    int uid;
+
+    /* Order is kept through all the table growth in setup() */
+    for (uid = 1000; uid < 1000 + USER_COUNT; uid++)
+    {
+        ck_assert_int_eq(count_user_sessions(uid),
+                         SESSION_COUNT / USER_COUNT);
+    }
+}
+END_TEST
+
+START_TEST(test_session_index__remove)
+{
+    int index;
+
+    for (index = 0; index < SESSION_COUNT; index += 2)
+    {
+        session_index_remove(&g_chains[index]);
+        g_chains[index].item = NULL;
+    }
+
+    for (index = 0; index < SESSION_COUNT; index++)
+    {
+        if (index % 2 == 0)
+        {
+            ck_assert_ptr_null(session_index_get(SESSION_KEY_PID,
+                                                 20000 + index));
+        }
+        else
+        {
+            ck_assert_ptr_eq(session_index_get(SESSION_KEY_DISPLAY,
+                                               10 + index),
+                             &g_chains[index]);
+        }
+    }
+    /* USER_COUNT is even, so users alternate between keeping all their
+     * sessions and losing them */
+    ck_assert_int_eq(count_user_sessions(1000), 0);
+    ck_assert_int_eq(count_user_sessions(1001), SESSION_COUNT / USER_COUNT);
+}
+END_TEST
+
+/* Lookups by PID and by user find what walking the whole chain finds,
+ * as sesman used to */
+START_TEST(test_session_index__matches_chain)
+{
+    struct session_chain *sc;
+    int index;
+    int count;
+
+    for (index = 0; index < SESSION_COUNT - 1; index++)
+    {
+        g_chains[index + 1].next = &g_chains[index];
+    }
+
+    for (index = 0; index < SESSION_COUNT; index++)
+    {
+        for (sc = &g_chains[SESSION_COUNT - 1]; sc != NULL; sc = sc->next)
+        {
+            if (sc->item->pid == 20000 + index)
+            {
+                break;
+            }
+        }
+        ck_assert_ptr_eq(session_index_get(SESSION_KEY_PID, 20000 + index),
+                         sc);
+    }
+    for (index = 0; index < USER_COUNT; index++)
+    {
+        count = 0;
+        for (sc = &g_chains[SESSION_COUNT - 1]; sc != NULL; sc = sc->next)
+        {
+            count += (sc->item->uid == 1000 + index);
+        }
+        ck_assert_int_eq(count_user_sessions(1000 + index), count);
+    }
+}
+END_TEST
+
+/******************************************************************************/
+Suite *
+make_suite_test_session_index(void)
+{
+    Suite *s;
+    TCase *tc;
+
+    s = suite_create("SessionIndex");
+
+    tc = tcase_create("session_index");
+    tcase_add_checked_fixture(tc, setup, teardown);
+    suite_add_tcase(s, tc);
+    tcase_add_test(tc, test_session_index__find);
+    tcase_add_test(tc, test_session_index__by_uid);
+    tcase_add_test(tc, test_session_index__remove);
+    tcase_add_test(tc, test_session_index__matches_chain);
+
+    return s;
+}
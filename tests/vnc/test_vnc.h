@@ -0,0 +1,9 @@
+#ifndef TEST_VNC_H
+#define TEST_VNC_H
+
+#include <check.h>
+
+Suite *make_suite_test_vnc_decode(void);
+Suite *make_suite_test_vnc_dirty(void);
+
+#endif /* TEST_VNC_H */
@@ -0,0 +1,552 @@
+#if defined(HAVE_CONFIG_H)
+#include "config_ac.h"
+#endif
+
+#include <zlib.h>
+
+#include "arch.h"
+#include "defines.h"
+#include "os_calls.h"
+#include "parse.h"
+#include "vnc_decode.h"
+
+#include "test_vnc.h"
+
+#define MAX_WIRE_BYTES (8 * 1024 * 1024)
+
+/* what the server has sent */
+struct wire
+{
+    struct stream *s;
+    int pos;
+};
+
+static struct wire g_wire;
+static struct vnc_decoder *g_d;
+/* the server's zlib streams, ZRLE and the four Tight ones */
+static z_stream g_zrle_zs;
+static z_stream g_tight_zs[4];
+
+static int
+wire_read(void *handle, struct stream *s, int bytes)
+{
+    struct wire *w = (struct wire *)handle;
+    int sent;
+
+    sent = (int) (w->s->end - w->s->data);
+    if (bytes > sent - w->pos)
+    {
+        return 1;
+    }
+    init_stream(s, bytes);
+    g_memcpy(s->data, w->s->data + w->pos, bytes);
+    s->end = s->data + bytes;
+    w->pos += bytes;
+    return 0;
+}
+
+static void
+setup_bpp(int bpp)
+{
+    int index;
+
+    make_stream(g_wire.s);
+    init_stream(g_wire.s, MAX_WIRE_BYTES);
+    g_wire.pos = 0;
+    g_d = vnc_decoder_create(bpp);
+    ck_assert_ptr_nonnull(g_d);
+    g_memset(&g_zrle_zs, 0, sizeof(g_zrle_zs));
+    ck_assert_int_eq(deflateInit(&g_zrle_zs, 6), Z_OK);
+    for (index = 0; index < 4; index++)
+    {
+        g_memset(&g_tight_zs[index], 0, sizeof(g_tight_zs[index]));
+        ck_assert_int_eq(deflateInit(&g_tight_zs[index], 6), Z_OK);
+    }
+}
+
+static void
+setup(void)
+{
+    setup_bpp(32);
+}
+
+static void
+teardown(void)
+{
+    int index;
+
+    vnc_decoder_delete(g_d);
+    free_stream(g_wire.s);
+    deflateEnd(&g_zrle_zs);
+    for (index = 0; index < 4; index++)
+    {
+        deflateEnd(&g_tight_zs[index]);
+    }
+}
+
+/* compresses what's in payload onto the end of out, returns the bytes */
+static int
+deflate_payload(z_stream *zs, struct stream *payload, char *out, int size)
+{
+    zs->next_in = (Bytef *) payload->data;
+    zs->avail_in = (int) (payload->end - payload->data);
+    zs->next_out = (Bytef *) out;
+    zs->avail_out = size;
+    ck_assert_int_eq(deflate(zs, Z_SYNC_FLUSH), Z_OK);
+    ck_assert_int_eq(zs->avail_in, 0);
+    return size - zs->avail_out;
+}
+
+/* a ZRLE CPIXEL of a 32 bpp pixel */
+static void
+out_cpixel32(struct stream *s, tui32 pixel)
+{
+    out_uint8(s, pixel);
+    out_uint8(s, pixel >> 8);
+    out_uint8(s, pixel >> 16);
+}
+
+/* a Tight TPIXEL of a 32 bpp pixel */
+static void
+out_tpixel32(struct stream *s, tui32 pixel)
+{
+    out_uint8(s, pixel >> 16);
+    out_uint8(s, pixel >> 8);
+    out_uint8(s, pixel);
+}
+
+static void
+out_run_length(struct stream *s, int run)
+{
+    run--;
+    while (run >= 255)
+    {
+        out_uint8(s, 255);
+        run -= 255;
+    }
+    out_uint8(s, run);
+}
+
+static void
+out_compact_length(struct stream *s, int length)
+{
+    out_uint8(s, (length & 0x7f) | ((length > 0x7f) ? 0x80 : 0));
+    if (length > 0x7f)
+    {
+        out_uint8(s, ((length >> 7) & 0x7f) | ((length > 0x3fff) ? 0x80 : 0));
+        if (length > 0x3fff)
+        {
+            out_uint8(s, length >> 14);
+        }
+    }
+}
+
+/* sends a ZRLE rectangle body made of payload */
+static void
+send_zrle(struct stream *payload)
+{
+    char *out;
+    int bytes;
+
+    s_mark_end(payload);
+    out = (char *) g_malloc(MAX_WIRE_BYTES, 0);
+    bytes = deflate_payload(&g_zrle_zs, payload, out, MAX_WIRE_BYTES);
+    out_uint32_be(g_wire.s, bytes);
+    out_uint8a(g_wire.s, out, bytes);
+    s_mark_end(g_wire.s);
+    g_free(out);
+}
+
+/* sends Tight data, compressed if there's enough of it */
+static void
+send_tight_data(int stream_id, struct stream *payload)
+{
+    char *out;
+    int bytes;
+
+    s_mark_end(payload);
+    if (payload->end - payload->data < 12)
+    {
+        out_uint8a(g_wire.s, payload->data,
+                   (int) (payload->end - payload->data));
+    }
+    else
+    {
+        out = (char *) g_malloc(MAX_WIRE_BYTES, 0);
+        bytes = deflate_payload(&g_tight_zs[stream_id], payload, out,
+                                MAX_WIRE_BYTES);
+        out_compact_length(g_wire.s, bytes);
+        out_uint8a(g_wire.s, out, bytes);
+        g_free(out);
+    }
+    s_mark_end(g_wire.s);
+}
+
+static void
+check_pixels32(const char *data, const tui32 *expected, int count)
+{
+    const tui32 *pixels = (const tui32 *) data;
+    int index;
+
+    for (index = 0; index < count; index++)
+    {
+        ck_assert_msg(pixels[index] == expected[index],
+                      "pixel %d is %8.8x, expected %8.8x", index,
+                      pixels[index], expected[index]);
+    }
+}
+
+/* an 80x70 rectangle has four tiles, each encoded differently */
+START_TEST(test_zrle__subencodings)
+{
+    tui32 image[80 * 70];
+    struct stream *pl;
+    char *data;
+    int x;
+    int y;
+    int k;
+    int run;
+
+    for (y = 0; y < 70; y++)
+    {
+        for (x = 0; x < 80; x++)
+        {
+            if (y < 64 && x < 64)
+            {
+                image[y * 80 + x] = (x * 3 << 16) | (y * 3 << 8) | (x + y);
+            }
+            else if (y < 64)
+            {
+                image[y * 80 + x] = 0x123456;
+            }
+            else if (x < 64)
+            {
+                image[y * 80 + x] = 0x010101 * ((x + y) % 4);
+            }
+            else
+            {
+                image[y * 80 + x] = 0xff0000 + y;
+            }
+        }
+    }
+
+    make_stream(pl);
+    init_stream(pl, 1024 * 1024);
+    /* raw */
+    out_uint8(pl, 0);
+    for (y = 0; y < 64; y++)
+    {
+        for (x = 0; x < 64; x++)
+        {
+            out_cpixel32(pl, image[y * 80 + x]);
+        }
+    }
+    /* solid */
+    out_uint8(pl, 1);
+    out_cpixel32(pl, 0x123456);
+    /* packed palette, 2 bits a pixel */
+    out_uint8(pl, 4);
+    for (k = 0; k < 4; k++)
+    {
+        out_cpixel32(pl, 0x010101 * k);
+    }
+    for (y = 64; y < 70; y++)
+    {
+        for (x = 0; x < 64; x += 4)
+        {
+            out_uint8(pl, (((x + y) % 4) << 6) | (((x + y + 1) % 4) << 4) |
+                      (((x + y + 2) % 4) << 2) | ((x + y + 3) % 4));
+        }
+    }
+    /* plain RLE, a run a row */
+    out_uint8(pl, 128);
+    for (y = 64; y < 70; y++)
+    {
+        out_cpixel32(pl, 0xff0000 + y);
+        out_run_length(pl, 16);
+    }
+    send_zrle(pl);
+
+    ck_assert_int_eq(vnc_decode_zrle(g_d, wire_read, &g_wire, 80, 70, &data),
+                     0);
+    check_pixels32(data, image, 80 * 70);
+
+    /* the same stream carries on into the next rectangle. Palette RLE with
+       runs over 255 */
+    for (k = 0; k < 64 * 64; k++)
+    {
+        image[k] = (k < 1000) ? 0x00ff00 : (k < 1001) ? 0x0000ff : 0xffffff;
+    }
+    init_stream(pl, 1024 * 1024);
+    out_uint8(pl, 128 + 3);
+    out_cpixel32(pl, 0x00ff00);
+    out_cpixel32(pl, 0x0000ff);
+    out_cpixel32(pl, 0xffffff);
+    out_uint8(pl, 128 | 0);
+    out_run_length(pl, 1000);
+    out_uint8(pl, 1);
+    run = 64 * 64 - 1001;
+    out_uint8(pl, 128 | 2);
+    out_run_length(pl, run);
+    send_zrle(pl);
+    free_stream(pl);
+
+    ck_assert_int_eq(vnc_decode_zrle(g_d, wire_read, &g_wire, 64, 64, &data),
+                     0);
+    check_pixels32(data, image, 64 * 64);
+    ck_assert_int_eq(vnc_decoder_get_stats(g_d)->zrle_rects, 2);
+}
+END_TEST
+
+START_TEST(test_zrle__bad_data)
+{
+    struct stream *pl;
+    char *data;
+
+    make_stream(pl);
+    init_stream(pl, 1024);
+    /* unused subencoding */
+    out_uint8(pl, 17);
+    send_zrle(pl);
+    ck_assert_int_ne(vnc_decode_zrle(g_d, wire_read, &g_wire, 8, 8, &data), 0);
+
+    /* a run past the end of the tile */
+    init_stream(pl, 1024);
+    out_uint8(pl, 128);
+    out_cpixel32(pl, 0);
+    out_run_length(pl, 65);
+    send_zrle(pl);
+    ck_assert_int_ne(vnc_decode_zrle(g_d, wire_read, &g_wire, 8, 8, &data), 0);
+
+    /* a tile short of pixels */
+    init_stream(pl, 1024);
+    out_uint8(pl, 0);
+    out_cpixel32(pl, 0);
+    send_zrle(pl);
+    ck_assert_int_ne(vnc_decode_zrle(g_d, wire_read, &g_wire, 8, 8, &data), 0);
+    free_stream(pl);
+}
+END_TEST
+
+START_TEST(test_tight__fill_and_copy)
+{
+    tui32 image[20 * 10];
+    struct stream *pl;
+    char *data;
+    int k;
+
+    /* fill */
+    out_uint8(g_wire.s, 0x80);
+    out_tpixel32(g_wire.s, 0x102030);
+    s_mark_end(g_wire.s);
+    ck_assert_int_eq(vnc_decode_tight(g_d, wire_read, &g_wire, 20, 10, &data),
+                     0);
+    for (k = 0; k < 20 * 10; k++)
+    {
+        image[k] = 0x102030;
+    }
+    check_pixels32(data, image, 20 * 10);
+
+    /* 9 bytes, too little to compress */
+    make_stream(pl);
+    init_stream(pl, 1024 * 1024);
+    for (k = 0; k < 3; k++)
+    {
+        image[k] = 0x010203 * (k + 1);
+        out_tpixel32(pl, image[k]);
+    }
+    out_uint8(g_wire.s, 0x00);
+    send_tight_data(0, pl);
+    ck_assert_int_eq(vnc_decode_tight(g_d, wire_read, &g_wire, 3, 1, &data),
+                     0);
+    check_pixels32(data, image, 3);
+
+    /* compressed on stream 1, twice, then after a reset */
+    for (k = 0; k < 3; k++)
+    {
+        int index;
+
+        if (k == 2)
+        {
+            deflateReset(&g_tight_zs[1]);
+        }
+        init_stream(pl, 1024 * 1024);
+        for (index = 0; index < 20 * 10; index++)
+        {
+            image[index] = (index * 0x10101 + k) & 0xffffff;
+            out_tpixel32(pl, image[index]);
+        }
+        out_uint8(g_wire.s, (1 << 4) | ((k == 2) ? 0x02 : 0));
+        send_tight_data(1, pl);
+        ck_assert_int_eq(vnc_decode_tight(g_d, wire_read, &g_wire, 20, 10,
+                                          &data), 0);
+        check_pixels32(data, image, 20 * 10);
+    }
+    free_stream(pl);
+}
+END_TEST
+
+START_TEST(test_tight__palette)
+{
+    tui32 image[20 * 10];
+    struct stream *pl;
+    char *data;
+    int bits;
+    int x;
+    int y;
+
+    make_stream(pl);
+
+    /* two colours are a bitmap */
+    init_stream(pl, 1024 * 1024);
+    for (y = 0; y < 10; y++)
+    {
+        bits = 0;
+        for (x = 0; x < 20; x++)
+        {
+            image[y * 20 + x] = ((x + y) % 3 == 0) ? 0xabcdef : 0x000000;
+            bits = (bits << 1) | ((x + y) % 3 == 0);
+            if (x % 8 == 7)
+            {
+                out_uint8(pl, bits);
+                bits = 0;
+            }
+        }
+        out_uint8(pl, bits << 4);
+    }
+    out_uint8(g_wire.s, (0x04 | 2) << 4);
+    out_uint8(g_wire.s, 1); /* palette filter */
+    out_uint8(g_wire.s, 1);
+    out_tpixel32(g_wire.s, 0x000000);
+    out_tpixel32(g_wire.s, 0xabcdef);
+    send_tight_data(2, pl);
+    ck_assert_int_eq(vnc_decode_tight(g_d, wire_read, &g_wire, 20, 10, &data),
+                     0);
+    check_pixels32(data, image, 20 * 10);
+
+    /* more colours are a byte each */
+    init_stream(pl, 1024 * 1024);
+    for (y = 0; y < 10; y++)
+    {
+        for (x = 0; x < 20; x++)
+        {
+            image[y * 20 + x] = 0x111111 * ((x * y) % 5);
+            out_uint8(pl, (x * y) % 5);
+        }
+    }
+    out_uint8(g_wire.s, (0x04 | 2) << 4);
+    out_uint8(g_wire.s, 1);
+    out_uint8(g_wire.s, 4);
+    for (x = 0; x < 5; x++)
+    {
+        out_tpixel32(g_wire.s, 0x111111 * x);
+    }
+    send_tight_data(2, pl);
+    ck_assert_int_eq(vnc_decode_tight(g_d, wire_read, &g_wire, 20, 10, &data),
+                     0);
+    check_pixels32(data, image, 20 * 10);
+    free_stream(pl);
+}
+END_TEST
+
+START_TEST(test_tight__gradient)
+{
+    tui32 image[20 * 10];
+    struct stream *pl;
+    char *data;
+    int comp[3];
+    int est;
+    int c;
+    int x;
+    int y;
+
+#define COMP(px, py, pc) \
+    (((px) < 0 || (py) < 0) ? 0 : \
+     (int) ((image[(py) * 20 + (px)] >> (16 - 8 * (pc))) & 0xff))
+
+    for (y = 0; y < 10; y++)
+    {
+        for (x = 0; x < 20; x++)
+        {
+            image[y * 20 + x] = ((x * 13) << 16) | ((y * 25) << 8) |
+                                ((x * y * 7) & 0xff);
+        }
+    }
+    make_stream(pl);
+    init_stream(pl, 1024 * 1024);
+    for (y = 0; y < 10; y++)
+    {
+        for (x = 0; x < 20; x++)
+        {
+            for (c = 0; c < 3; c++)
+            {
+                est = COMP(x, y - 1, c) + COMP(x - 1, y, c) -
+                      COMP(x - 1, y - 1, c);
+                est = (est < 0) ? 0 : (est > 255) ? 255 : est;
+                comp[c] = (COMP(x, y, c) - est) & 0xff;
+            }
+            out_uint8(pl, comp[0]);
+            out_uint8(pl, comp[1]);
+            out_uint8(pl, comp[2]);
+        }
+    }
+#undef COMP
+    out_uint8(g_wire.s, (0x04 | 3) << 4);
+    out_uint8(g_wire.s, 2); /* gradient filter */
+    send_tight_data(3, pl);
+    free_stream(pl);
+    ck_assert_int_eq(vnc_decode_tight(g_d, wire_read, &g_wire, 20, 10, &data),
+                     0);
+    check_pixels32(data, image, 20 * 10);
+}
+END_TEST
+
+/* 16 bpp CPIXELs are whole pixels */
+START_TEST(test_zrle__16bpp)
+{
+    tui16 image[10 * 10];
+    tui16 pixel;
+    struct stream *pl;
+    char *data;
+    int k;
+
+    teardown();
+    setup_bpp(16);
+    make_stream(pl);
+    init_stream(pl, 1024);
+    out_uint8(pl, 0);
+    for (k = 0; k < 10 * 10; k++)
+    {
+        image[k] = k * 655;
+        pixel = image[k];
+        out_uint8a(pl, (char *) &pixel, 2);
+    }
+    send_zrle(pl);
+    free_stream(pl);
+    ck_assert_int_eq(vnc_decode_zrle(g_d, wire_read, &g_wire, 10, 10, &data),
+                     0);
+    ck_assert_int_eq(g_memcmp(data, image, sizeof(image)), 0);
+}
+END_TEST
+
+/******************************************************************************/
+Suite *
+make_suite_test_vnc_decode(void)
+{
+    Suite *s;
+    TCase *tc;
+
+    s = suite_create("VncDecode");
+
+    tc = tcase_create("vnc_decode");
+    tcase_add_checked_fixture(tc, setup, teardown);
+    suite_add_tcase(s, tc);
+    tcase_add_test(tc, test_zrle__subencodings);
+    tcase_add_test(tc, test_zrle__bad_data);
+    tcase_add_test(tc, test_zrle__16bpp);
+    tcase_add_test(tc, test_tight__fill_and_copy);
+    tcase_add_test(tc, test_tight__palette);
+    tcase_add_test(tc, test_tight__gradient);
+
+    return s;
+}
@@ -0,0 +1,137 @@
+#if defined(HAVE_CONFIG_H)
+#include "config_ac.h"
+#endif
+
+#include "vnc_dirty.h"
+
+#include "test_vnc.h"
+
+static struct vnc_dirty g_dirty;
+
+/******************************************************************************/
+static void
+setup(void)
+{
+    vnc_dirty_clear(&g_dirty);
+}
+
+/******************************************************************************/
+/* Is x, y, cx, cy inside a rectangle in the list? */
+static int
+is_covered(int x, int y, int cx, int cy)
+{
+    const struct vnc_dirty_rect *r;
+    int i;
+
+    for (i = 0; i < g_dirty.count; i++)
+    {
+        r = g_dirty.rects + i;
+        if (x >= r->x && y >= r->y &&
+                x + cx <= r->x + r->cx && y + cy <= r->y + r->cy)
+        {
+            return 1;
+        }
+    }
+    return 0;
+}
+
+/******************************************************************************/
+START_TEST(test_dirty__empty_rects_ignored)
+{
+    vnc_dirty_add(&g_dirty, 10, 10, 0, 20);
+    vnc_dirty_add(&g_dirty, 10, 10, 20, 0);
+    ck_assert_int_eq(g_dirty.count, 0);
+}
+END_TEST
+
+/******************************************************************************/
+START_TEST(test_dirty__strips_merge)
+{
+    int y;
+
+    /* Servers send a changed area as a column of tiles or strips */
+    for (y = 0; y < 720; y += 16)
+    {
+        vnc_dirty_add(&g_dirty, 0, y, 1280, 16);
+    }
+    ck_assert_int_eq(g_dirty.count, 1);
+    ck_assert_int_eq(g_dirty.rects[0].x, 0);
+    ck_assert_int_eq(g_dirty.rects[0].y, 0);
+    ck_assert_int_eq(g_dirty.rects[0].cx, 1280);
+    ck_assert_int_eq(g_dirty.rects[0].cy, 720);
+}
+END_TEST
+
+/******************************************************************************/
+START_TEST(test_dirty__distant_rects_kept)
+{
+    vnc_dirty_add(&g_dirty, 0, 0, 100, 100);
+    vnc_dirty_add(&g_dirty, 1000, 600, 100, 100);
+    ck_assert_int_eq(g_dirty.count, 2);
+    ck_assert(is_covered(0, 0, 100, 100));
+    ck_assert(is_covered(1000, 600, 100, 100));
+}
+END_TEST
+
+/******************************************************************************/
+START_TEST(test_dirty__overlap_merges)
+{
+    vnc_dirty_add(&g_dirty, 100, 100, 200, 200);
+    vnc_dirty_add(&g_dirty, 110, 110, 200, 200);
+    ck_assert_int_eq(g_dirty.count, 1);
+    ck_assert(is_covered(100, 100, 210, 210));
+}
+END_TEST
+
+/******************************************************************************/
+START_TEST(test_dirty__gap_filled)
+{
+    vnc_dirty_add(&g_dirty, 0, 0, 100, 100);
+    vnc_dirty_add(&g_dirty, 300, 0, 100, 100);
+    ck_assert_int_eq(g_dirty.count, 2);
+
+    /* Joins both, which then merge into one */
+    vnc_dirty_add(&g_dirty, 100, 0, 200, 100);
+    ck_assert_int_eq(g_dirty.count, 1);
+    ck_assert(is_covered(0, 0, 400, 100));
+}
+END_TEST
+
+/******************************************************************************/
+START_TEST(test_dirty__full_list)
+{
+    int i;
+
+    for (i = 0; i < VNC_DIRTY_MAX_RECTS * 2; i++)
+    {
+        vnc_dirty_add(&g_dirty, (i % 8) * 200, (i / 8) * 200, 10, 10);
+        ck_assert_int_le(g_dirty.count, VNC_DIRTY_MAX_RECTS);
+    }
+    for (i = 0; i < VNC_DIRTY_MAX_RECTS * 2; i++)
+    {
+        ck_assert(is_covered((i % 8) * 200, (i / 8) * 200, 10, 10));
+    }
+}
+END_TEST
+
+/******************************************************************************/
+Suite *
+make_suite_test_vnc_dirty(void)
+{
+    Suite *s;
+    TCase *tc;
+
+    s = suite_create("VncDirty");
+
+    tc = tcase_create("vnc_dirty");
+    tcase_add_checked_fixture(tc, setup, NULL);
+    suite_add_tcase(s, tc);
+    tcase_add_test(tc, test_dirty__empty_rects_ignored);
+    tcase_add_test(tc, test_dirty__strips_merge);
+    tcase_add_test(tc, test_dirty__distant_rects_kept);
+    tcase_add_test(tc, test_dirty__overlap_merges);
+    tcase_add_test(tc, test_dirty__gap_filled);
+    tcase_add_test(tc, test_dirty__full_list);
+
+    return s;
+}
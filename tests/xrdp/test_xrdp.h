@@ -5,5 +5,7 @@
 
 Suite *make_suite_test_bitmap_load(void);
 Suite *make_suite_egfx_base_functions(void);
+Suite *make_suite_test_xrdp_cache_index(void);
+Suite *make_suite_test_xrdp_chan_sched(void);
 
 #endif /* TEST_XRDP_H */
@@ -0,0 +1,178 @@
+#if defined(HAVE_CONFIG_H)
+#include "config_ac.h"
+#endif
+
+#include "xrdp.h"
+
+#include "test_xrdp.h"
+
+/* a key like the cache makes, random low half, size in the high half */
+static tui64
+make_key(unsigned int crc)
+{
+    return ((tui64) (64 | (64 << 12) | (32 << 24)) << 32) | crc;
+}
+
+/* small xorshift so the runs are the same every time */
+static unsigned int
+next_random(unsigned int *state)
+{
+    unsigned int x = *state;
+
+    x ^= x << 13;
+    x ^= x >> 17;
+    x ^= x << 5;
+    *state = x;
+    return x;
+}
+
+START_TEST(test_cache_index__add_and_find)
+{
+    struct xrdp_cache_index *index;
+    int i;
+
+    index = xrdp_cache_index_create(100);
+    ck_assert_ptr_nonnull(index);
+    ck_assert_int_eq(xrdp_cache_index_find(index, make_key(5)), -1);
+    /* unused entries are handed out in order */
+    for (i = 0; i < 100; i++)
+    {
+        ck_assert_int_eq(xrdp_cache_index_add(index, make_key(i * 7919)), i);
+    }
+    for (i = 0; i < 100; i++)
+    {
+        ck_assert_int_eq(xrdp_cache_index_find(index, make_key(i * 7919)), i);
+    }
+    ck_assert_int_eq(xrdp_cache_index_find(index, make_key(1)), -1);
+    xrdp_cache_index_delete(index);
+}
+END_TEST
+
+START_TEST(test_cache_index__evicts_least_recently_used)
+{
+    struct xrdp_cache_index *index;
+    int i;
+
+    index = xrdp_cache_index_create(4);
+    for (i = 0; i < 4; i++)
+    {
+        xrdp_cache_index_add(index, make_key(i));
+    }
+    xrdp_cache_index_touch(index, 0);
+    /* 1 is now the oldest */
+    ck_assert_int_eq(xrdp_cache_index_add(index, make_key(10)), 1);
+    ck_assert_int_eq(xrdp_cache_index_find(index, make_key(1)), -1);
+    ck_assert_int_eq(xrdp_cache_index_find(index, make_key(10)), 1);
+    ck_assert_int_eq(xrdp_cache_index_find(index, make_key(0)), 0);
+    ck_assert_int_eq(xrdp_cache_index_add(index, make_key(11)), 2);
+    ck_assert_int_eq(xrdp_cache_index_add(index, make_key(12)), 3);
+    ck_assert_int_eq(xrdp_cache_index_add(index, make_key(13)), 0);
+    xrdp_cache_index_delete(index);
+}
+END_TEST
+
+START_TEST(test_cache_index__set)
+{
+    struct xrdp_cache_index *index;
+
+    index = xrdp_cache_index_create(4);
+    ck_assert_int_eq(xrdp_cache_index_set(index, 2, make_key(20)), 0);
+    ck_assert_int_eq(xrdp_cache_index_find(index, make_key(20)), 2);
+    /* a key can only be in once */
+    ck_assert_int_ne(xrdp_cache_index_set(index, 3, make_key(20)), 0);
+    ck_assert_int_ne(xrdp_cache_index_set(index, 4, make_key(21)), 0);
+    /* set entries are the most recently used */
+    ck_assert_int_eq(xrdp_cache_index_add(index, make_key(1)), 0);
+    ck_assert_int_eq(xrdp_cache_index_add(index, make_key(2)), 1);
+    ck_assert_int_eq(xrdp_cache_index_add(index, make_key(3)), 3);
+    ck_assert_int_eq(xrdp_cache_index_add(index, make_key(4)), 2);
+    ck_assert_int_eq(xrdp_cache_index_find(index, make_key(20)), -1);
+    xrdp_cache_index_delete(index);
+}
+END_TEST
+
+START_TEST(test_cache_index__bad_entries)
+{
+    ck_assert_ptr_null(xrdp_cache_index_create(0));
+    ck_assert_ptr_null(xrdp_cache_index_create(XRDP_MAX_BITMAP_CACHE_IDX + 1));
+}
+END_TEST
+
+/* random adds, finds and touches checked against a brute force model, with
+   few enough keys that probe runs overlap and get shifted back */
+START_TEST(test_cache_index__matches_model)
+{
+    struct xrdp_cache_index *index;
+    tui64 model_key[64];
+    int model_stamp[64];
+    int model_used[64];
+    unsigned int state;
+    tui64 key;
+    int stamp;
+    int op;
+    int i;
+    int found;
+    int oldest;
+
+    index = xrdp_cache_index_create(64);
+    for (i = 0; i < 64; i++)
+    {
+        model_used[i] = 0;
+        model_stamp[i] = i - 64;
+    }
+    stamp = 0;
+    state = 12345;
+    for (op = 0; op < 200000; op++)
+    {
+        key = make_key(next_random(&state) % 150);
+        found = -1;
+        for (i = 0; i < 64; i++)
+        {
+            if (model_used[i] && (model_key[i] == key))
+            {
+                found = i;
+            }
+        }
+        ck_assert_int_eq(xrdp_cache_index_find(index, key), found);
+        if (found >= 0)
+        {
+            xrdp_cache_index_touch(index, found);
+            model_stamp[found] = ++stamp;
+            continue;
+        }
+        oldest = 0;
+        for (i = 1; i < 64; i++)
+        {
+            if (model_stamp[i] < model_stamp[oldest])
+            {
+                oldest = i;
+            }
+        }
+        ck_assert_int_eq(xrdp_cache_index_add(index, key), oldest);
+        model_key[oldest] = key;
+        model_used[oldest] = 1;
+        model_stamp[oldest] = ++stamp;
+    }
+    xrdp_cache_index_delete(index);
+}
+END_TEST
+
+/******************************************************************************/
+Suite *
+make_suite_test_xrdp_cache_index(void)
+{
+    Suite *s;
+    TCase *tc;
+
+    s = suite_create("CacheIndex");
+
+    tc = tcase_create("xrdp_cache_index");
+    suite_add_tcase(s, tc);
+    tcase_add_test(tc, test_cache_index__add_and_find);
+    tcase_add_test(tc, test_cache_index__evicts_least_recently_used);
+    tcase_add_test(tc, test_cache_index__set);
+    tcase_add_test(tc, test_cache_index__bad_entries);
+    tcase_add_test(tc, test_cache_index__matches_model);
+
+    return s;
+}
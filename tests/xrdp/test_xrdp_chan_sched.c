@@ -0,0 +1,261 @@
+#if defined(HAVE_CONFIG_H)
+#include "config_ac.h"
+#endif
+
+#include "xrdp.h"
+#include "trans.h"
+
+#include "test_xrdp.h"
+
+#define MAX_SENT 1000
+#define FRAG_BYTES 1600
+
+#define CHAN_SND 0
+#define CHAN_RAIL 1
+#define CHAN_CLIP 2
+#define CHAN_DR 3
+
+/* what the fake client link has seen */
+struct fake_link
+{
+    int backlog;
+    int backlog_per_send; /* added to backlog by each fragment sent */
+    int count;
+    int chan_ids[MAX_SENT];
+    int first_bytes[MAX_SENT];
+};
+
+static struct fake_link g_link;
+static struct source_info g_si;
+static struct xrdp_chan_sched *g_sched;
+
+static int
+fake_send(void *handle, int chan_id, char *data, int bytes, int total_bytes,
+          int flags)
+{
+    struct fake_link *link = (struct fake_link *)handle;
+
+    ck_assert_int_lt(link->count, MAX_SENT);
+    link->chan_ids[link->count] = chan_id;
+    link->first_bytes[link->count] = (unsigned char) data[0];
+    link->count++;
+    link->backlog += link->backlog_per_send;
+    return 0;
+}
+
+static int
+fake_get_backlog(void *handle)
+{
+    return ((struct fake_link *)handle)->backlog;
+}
+
+static void
+setup(void)
+{
+    g_memset(&g_link, 0, sizeof(g_link));
+    g_memset(&g_si, 0, sizeof(g_si));
+    g_sched = xrdp_chan_sched_create(&g_si, &g_link, fake_send,
+                                     fake_get_backlog);
+    ck_assert_ptr_nonnull(g_sched);
+    xrdp_chan_sched_add_channel(g_sched, CHAN_SND, "rdpsnd");
+    xrdp_chan_sched_add_channel(g_sched, CHAN_RAIL, "rail");
+    xrdp_chan_sched_add_channel(g_sched, CHAN_CLIP, "cliprdr");
+    xrdp_chan_sched_add_channel(g_sched, CHAN_DR, "rdpdr");
+}
+
+static void
+teardown(void)
+{
+    xrdp_chan_sched_delete(g_sched);
+    /* nothing left charged to chansrv */
+    ck_assert_int_eq(g_si.source[XRDP_SOURCE_CHANSRV], 0);
+}
+
+/* queues a fragment whose first byte is seq */
+static void
+queue(int chan_id, int seq)
+{
+    char data[FRAG_BYTES];
+
+    g_memset(data, 0, sizeof(data));
+    data[0] = (char) seq;
+    ck_assert_int_eq(xrdp_chan_sched_queue(g_sched, chan_id, 0, FRAG_BYTES,
+                                           data, FRAG_BYTES), 0);
+}
+
+START_TEST(test_chan_sched__classes)
+{
+    const struct xrdp_chan_sched_stats *stats;
+
+    stats = xrdp_chan_sched_get_stats(g_sched, CHAN_SND);
+    ck_assert_int_eq(stats->chan_class, XRDP_CHAN_CLASS_AUDIO);
+    ck_assert_str_eq(stats->name, "rdpsnd");
+    stats = xrdp_chan_sched_get_stats(g_sched, CHAN_RAIL);
+    ck_assert_int_eq(stats->chan_class, XRDP_CHAN_CLASS_INTERACTIVE);
+    stats = xrdp_chan_sched_get_stats(g_sched, CHAN_CLIP);
+    ck_assert_int_eq(stats->chan_class, XRDP_CHAN_CLASS_BULK);
+    stats = xrdp_chan_sched_get_stats(g_sched, CHAN_DR);
+    ck_assert_int_eq(stats->chan_class, XRDP_CHAN_CLASS_BULK);
+    ck_assert_ptr_null(xrdp_chan_sched_get_stats(g_sched, -1));
+    ck_assert_ptr_null(xrdp_chan_sched_get_stats(g_sched,
+                       XRDP_CHAN_SCHED_MAX_CHANNELS));
+}
+END_TEST
+
+/* with the link backed up only audio gets through, the rest follows in
+   order as the backlog drains */
+START_TEST(test_chan_sched__backlog)
+{
+    const struct xrdp_chan_sched_stats *stats;
+    int index;
+
+    g_link.backlog = 1024 * 1024;
+    for (index = 0; index < 10; index++)
+    {
+        queue(CHAN_DR, index);
+        queue(CHAN_RAIL, index);
+    }
+    queue(CHAN_SND, 0);
+    ck_assert_int_eq(xrdp_chan_sched_send(g_sched), 0);
+    ck_assert_int_eq(g_link.count, 1);
+    ck_assert_int_eq(g_link.chan_ids[0], CHAN_SND);
+
+    stats = xrdp_chan_sched_get_stats(g_sched, CHAN_DR);
+    ck_assert_int_eq(stats->queued_bytes, 10 * FRAG_BYTES);
+    ck_assert_int_eq(stats->queued_bytes_max, 10 * FRAG_BYTES);
+    ck_assert_int_eq(stats->sent_bytes, 0);
+
+    /* room for interactive but not bulk */
+    g_link.backlog = 64 * 1024;
+    ck_assert_int_eq(xrdp_chan_sched_send(g_sched), 0);
+    ck_assert_int_eq(g_link.count, 11);
+    for (index = 1; index < 11; index++)
+    {
+        ck_assert_int_eq(g_link.chan_ids[index], CHAN_RAIL);
+        ck_assert_int_eq(g_link.first_bytes[index], index - 1);
+    }
+
+    g_link.backlog = 0;
+    ck_assert_int_eq(xrdp_chan_sched_send(g_sched), 0);
+    ck_assert_int_eq(g_link.count, 21);
+    for (index = 11; index < 21; index++)
+    {
+        ck_assert_int_eq(g_link.chan_ids[index], CHAN_DR);
+        ck_assert_int_eq(g_link.first_bytes[index], index - 11);
+    }
+    ck_assert_int_eq(stats->queued_bytes, 0);
+    ck_assert_int_eq(stats->sent_bytes, 10 * FRAG_BYTES);
+    ck_assert_int_eq(stats->fragments, 10);
+}
+END_TEST
+
+/* when all classes have room they share the link by weight */
+START_TEST(test_chan_sched__weights)
+{
+    int index;
+    int snd;
+    int rail;
+    int bulk;
+
+    for (index = 0; index < 100; index++)
+    {
+        queue(CHAN_SND, index);
+        queue(CHAN_RAIL, index);
+        queue(CHAN_CLIP, index);
+    }
+    ck_assert_int_eq(xrdp_chan_sched_send(g_sched), 0);
+    ck_assert_int_eq(g_link.count, 300);
+    /* the first 70 fragments, ten rounds, are 4:2:1 */
+    snd = 0;
+    rail = 0;
+    bulk = 0;
+    for (index = 0; index < 70; index++)
+    {
+        switch (g_link.chan_ids[index])
+        {
+            case CHAN_SND:
+                snd++;
+                break;
+            case CHAN_RAIL:
+                rail++;
+                break;
+            default:
+                bulk++;
+                break;
+        }
+    }
+    ck_assert_int_eq(snd, 40);
+    ck_assert_int_eq(rail, 20);
+    ck_assert_int_eq(bulk, 10);
+}
+END_TEST
+
+/* bulk stops once the link backlog reaches its limit part way through */
+START_TEST(test_chan_sched__backlog_grows)
+{
+    int index;
+
+    g_link.backlog_per_send = FRAG_BYTES;
+    for (index = 0; index < 100; index++)
+    {
+        queue(CHAN_CLIP, index);
+    }
+    ck_assert_int_eq(xrdp_chan_sched_send(g_sched), 0);
+    ck_assert_int_gt(g_link.count, 0);
+    ck_assert_int_lt(g_link.count, 100);
+    /* the link drains, the rest goes */
+    g_link.backlog = 0;
+    g_link.backlog_per_send = 0;
+    ck_assert_int_eq(xrdp_chan_sched_send(g_sched), 0);
+    ck_assert_int_eq(g_link.count, 100);
+    for (index = 0; index < 100; index++)
+    {
+        ck_assert_int_eq(g_link.first_bytes[index], index);
+    }
+}
+END_TEST
+
+/* past the read ahead chansrv owes the link, so isn't read */
+START_TEST(test_chan_sched__charge)
+{
+    int index;
+
+    g_link.backlog = 1024 * 1024;
+    for (index = 0; index < 500; index++)
+    {
+        queue(CHAN_CLIP, index);
+    }
+    ck_assert_int_eq(g_si.source[XRDP_SOURCE_CHANSRV], 0);
+    for (index = 0; index < 500; index++)
+    {
+        queue(CHAN_CLIP, index);
+    }
+    ck_assert_int_gt(g_si.source[XRDP_SOURCE_CHANSRV], 0);
+
+    g_link.backlog = 0;
+    ck_assert_int_eq(xrdp_chan_sched_send(g_sched), 0);
+    ck_assert_int_eq(g_si.source[XRDP_SOURCE_CHANSRV], 0);
+    ck_assert_int_eq(g_link.count, 1000);
+}
+END_TEST
+
+/******************************************************************************/
+Suite *
+make_suite_test_xrdp_chan_sched(void)
+{
+    Suite *s;
+    TCase *tc;
+
+    s = suite_create("ChanSched");
+
+    tc = tcase_create("xrdp_chan_sched");
+    tcase_add_checked_fixture(tc, setup, teardown);
+    suite_add_tcase(s, tc);
+    tcase_add_test(tc, test_chan_sched__classes);
+    tcase_add_test(tc, test_chan_sched__backlog);
+    tcase_add_test(tc, test_chan_sched__weights);
+    tcase_add_test(tc, test_chan_sched__backlog_grows);
+    tcase_add_test(tc, test_chan_sched__charge);
+
+    return s;
+}
@@ -56,6 +56,21 @@ START_TEST(test_xrdp_egfx_send_create_surface__happy_path)
 }
 END_TEST
 
+START_TEST(test_xrdp_egfx_caps_avc420)
+{
+    ck_assert_int_eq(xrdp_egfx_caps_avc420(XR_RDPGFX_CAPVERSION_8, 0), 0);
+    ck_assert_int_eq(xrdp_egfx_caps_avc420(XR_RDPGFX_CAPVERSION_81, 0), 0);
+    ck_assert_int_ne(xrdp_egfx_caps_avc420(
+                         XR_RDPGFX_CAPVERSION_81,
+                         XR_RDPGFX_CAPS_FLAG_AVC420_ENABLED), 0);
+    ck_assert_int_ne(xrdp_egfx_caps_avc420(XR_RDPGFX_CAPVERSION_10, 0), 0);
+    ck_assert_int_ne(xrdp_egfx_caps_avc420(XR_RDPGFX_CAPVERSION_107, 0), 0);
+    ck_assert_int_eq(xrdp_egfx_caps_avc420(
+                         XR_RDPGFX_CAPVERSION_104,
+                         XR_RDPGFX_CAPS_FLAG_AVC_DISABLED), 0);
+}
+END_TEST
+
 /******************************************************************************/
 Suite *
 make_suite_egfx_base_functions(void)
@@ -68,6 +83,7 @@ make_suite_egfx_base_functions(void)
     tc_process_monitors = tcase_create("xrdp_egfx_base_functions");
     tcase_add_test(tc_process_monitors,
                    test_xrdp_egfx_send_create_surface__happy_path);
+    tcase_add_test(tc_process_monitors, test_xrdp_egfx_caps_avc420);
 
     suite_add_tcase(s, tc_process_monitors);
 
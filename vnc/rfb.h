@@ -32,6 +32,8 @@ enum c2s
     RFB_C2S_KEY_EVENT = 4,
     RFB_C2S_POINTER_EVENT = 5,
     RFB_C2S_CLIENT_CUT_TEXT = 6,
+    RFB_C2S_ENABLE_CONTINUOUS_UPDATES = 150,
+    RFB_C2S_FENCE = 248
 };
 
 /* Server to client messages */
@@ -40,7 +42,9 @@ enum s2c
     RFB_S2C_FRAMEBUFFER_UPDATE = 0,
     RFB_S2C_SET_COLOUR_MAP_ENTRIES = 1,
     RFB_S2C_BELL = 2,
-    RFB_S2C_SERVER_CUT_TEXT = 3
+    RFB_S2C_SERVER_CUT_TEXT = 3,
+    RFB_S2C_END_OF_CONTINUOUS_UPDATES = 150,
+    RFB_S2C_FENCE = 248
 };
 
 /* Encodings and pseudo-encodings
@@ -54,9 +58,22 @@ typedef uint32_t encoding_type;
 
 #define RFB_ENC_RAW                   (encoding_type)0
 #define RFB_ENC_COPY_RECT             (encoding_type)1
+#define RFB_ENC_TIGHT                 (encoding_type)7
+#define RFB_ENC_ZRLE                  (encoding_type)16
+#define RFB_ENC_QUALITY_LEVEL_0       (encoding_type)-32
+#define RFB_ENC_QUALITY_LEVEL_9       (encoding_type)-23
 #define RFB_ENC_CURSOR                (encoding_type)-239
 #define RFB_ENC_DESKTOP_SIZE          (encoding_type)-223
 #define RFB_ENC_EXTENDED_DESKTOP_SIZE (encoding_type)-308
+#define RFB_ENC_FENCE                 (encoding_type)-312
+#define RFB_ENC_CONTINUOUS_UPDATES    (encoding_type)-313
+
+/* Fence flags */
+#define RFB_FENCE_BLOCK_BEFORE 0x00000001
+#define RFB_FENCE_BLOCK_AFTER  0x00000002
+#define RFB_FENCE_SYNC_NEXT    0x00000004
+#define RFB_FENCE_REQUEST      0x80000000
+#define RFB_FENCE_MAX_PAYLOAD  64
 
 /**
  * Returns an error string for an ExtendedDesktopSize status code
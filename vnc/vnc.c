@@ -32,6 +32,7 @@
 
 #include "vnc.h"
 #include "vnc_clip.h"
+#include "vnc_decode.h"
 #include "rfb.h"
 #include "log.h"
 #include "trans.h"
@@ -46,9 +47,15 @@
 /* Used by enabled_encodings_mask */
 enum
 {
-    MSK_EXTENDED_DESKTOP_SIZE = (1 << 0)
+    MSK_EXTENDED_DESKTOP_SIZE = (1 << 0),
+    MSK_ZRLE = (1 << 1),
+    MSK_TIGHT = (1 << 2),
+    MSK_CONTINUOUS_UPDATES = (1 << 3)
 };
 
+/* Tight JPEG quality we ask for, 0 to 9 */
+#define VNC_TIGHT_QUALITY 7
+
 /******************************************************************************/
 int
 lib_send_copy(struct vnc *v, struct stream *s)
@@ -868,6 +875,21 @@ skip_trans_bytes(struct trans *trans, unsigned int bytes)
     return error;
 }
 
+/**************************************************************************//**
+ * Reads exactly the specified number of bytes for the decoders
+ *
+ * @param handle Transport to read
+ * @param s Stream to read into
+ * @param bytes Bytes to read
+ * @return != 0 for error
+ */
+static int
+read_for_decoder(void *handle, struct stream *s, int bytes)
+{
+    init_stream(s, bytes);
+    return trans_force_read_s((struct trans *)handle, s, bytes);
+}
+
 /**************************************************************************//**
  * Reads an encoding from the input stream and discards it
  *
@@ -905,6 +927,27 @@ skip_encoding(struct vnc *v, int x, int y, int cx, int cy,
         }
         break;
 
+        case RFB_ENC_ZRLE:
+        case RFB_ENC_TIGHT:
+        {
+            char *pixels;
+
+            /* Decoded anyway, to keep the zlib streams in step */
+            LOG(LOG_LEVEL_DEBUG, "Skipping %s encoding",
+                (encoding == RFB_ENC_ZRLE) ? "RFB_ENC_ZRLE" : "RFB_ENC_TIGHT");
+            if (encoding == RFB_ENC_ZRLE)
+            {
+                error = vnc_decode_zrle(v->decoder, read_for_decoder,
+                                        v->trans, cx, cy, &pixels);
+            }
+            else
+            {
+                error = vnc_decode_tight(v->decoder, read_for_decoder,
+                                         v->trans, cx, cy, &pixels);
+            }
+        }
+        break;
+
         case RFB_ENC_CURSOR:
         {
             int j = cx * cy * get_bytes_per_pixel(v->server_bpp);
@@ -1035,6 +1078,90 @@ find_matching_extended_rect(struct vnc *v,
     return error;
 }
 
+/**************************************************************************//**
+ * Sends an EnableContinuousUpdates message for the whole framebuffer
+ *
+ * @param v VNC object
+ * @param enable Non-zero to start updates, zero to stop them
+ * @return != 0 for error
+ *
+ * The server answers a request to stop with EndOfContinuousUpdates
+ */
+static int
+send_enable_continuous_updates(struct vnc *v, int enable)
+{
+    int error;
+    struct stream *s;
+
+    make_stream(s);
+    init_stream(s, 8192);
+    out_uint8(s, RFB_C2S_ENABLE_CONTINUOUS_UPDATES);
+    out_uint8(s, enable ? 1 : 0);
+    out_uint16_be(s, 0);
+    out_uint16_be(s, 0);
+    out_uint16_be(s, v->server_width);
+    out_uint16_be(s, v->server_height);
+    s_mark_end(s);
+    error = lib_send_copy(v, s);
+    free_stream(s);
+
+    if (error == 0)
+    {
+        v->cu_enabled = enable;
+    }
+
+    return error;
+}
+
+/**************************************************************************//**
+ * Starts continuous updates if the server has them and nothing else
+ * is going on
+ *
+ * @param v VNC object
+ * @return != 0 for error
+ */
+static int
+start_continuous_updates(struct vnc *v)
+{
+    int error = 0;
+
+    if (v->cu_supported && !v->cu_enabled && !v->cu_resize_pending &&
+            v->resize_status == VRS_DONE && v->suppress_output == 0)
+    {
+        LOG(LOG_LEVEL_DEBUG, "VNC enabling continuous updates");
+        error = send_enable_continuous_updates(v, 1);
+    }
+
+    return error;
+}
+
+/**************************************************************************//**
+ * Asks the server for changes to the whole framebuffer
+ *
+ * @param v VNC object
+ * @return != 0 for error
+ */
+static int
+send_incremental_update_request(struct vnc *v)
+{
+    int error;
+    struct stream *s;
+
+    make_stream(s);
+    init_stream(s, 8192);
+    out_uint8(s, RFB_C2S_FRAMEBUFFER_UPDATE_REQUEST);
+    out_uint8(s, 1); /* incremental == 1 : Changes only */
+    out_uint16_be(s, 0);
+    out_uint16_be(s, 0);
+    out_uint16_be(s, v->server_width);
+    out_uint16_be(s, v->server_height);
+    s_mark_end(s);
+    error = lib_send_copy(v, s);
+    free_stream(s);
+
+    return error;
+}
+
 /**************************************************************************//**
  * Sends a FramebufferUpdateRequest for the resize status state machine
  *
@@ -1106,6 +1233,10 @@ send_update_request_for_resize_status(struct vnc *v)
                 out_uint16_be(s, v->server_height);
                 s_mark_end(s);
                 error = lib_send_copy(v, s);
+                if (error == 0)
+                {
+                    error = start_continuous_updates(v);
+                }
             }
             break;
     }
@@ -1275,6 +1406,165 @@ lib_framebuffer_waiting_for_resize_confirm(struct vnc *v)
     return error;
 }
 
+/**************************************************************************//**
+ * Makes sure the framebuffer copy matches the server geometry
+ *
+ * @param v VNC object
+ * @return != 0 for error
+ *
+ * A new framebuffer is blank. Servers send the whole screen after a
+ * resize, so nothing stale from it gets painted.
+ */
+static int
+fb_check_size(struct vnc *v)
+{
+    int size;
+
+    if (v->fb == NULL ||
+            v->fb_width != v->server_width ||
+            v->fb_height != v->server_height)
+    {
+        g_free(v->fb);
+        size = v->server_width * v->server_height *
+               get_bytes_per_pixel(v->server_bpp);
+        v->fb = (char *)g_malloc(size, 1);
+        if (v->fb == NULL)
+        {
+            LOG(LOG_LEVEL_ERROR, "VNC can't allocate a %dx%d framebuffer",
+                v->server_width, v->server_height);
+            v->fb_width = 0;
+            v->fb_height = 0;
+            return 1;
+        }
+        v->fb_width = v->server_width;
+        v->fb_height = v->server_height;
+        vnc_dirty_clear(&v->dirty);
+    }
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * Copies decoded pixels into the framebuffer and marks them dirty
+ *
+ * @param v VNC object
+ * @param x, y, cx, cy Rectangle from the server
+ * @param data cx * cy pixels
+ * @return != 0 for error
+ */
+static int
+fb_put_rect(struct vnc *v, int x, int y, int cx, int cy, const char *data)
+{
+    int Bpp;
+    int row;
+    int width;
+    int height;
+
+    if (fb_check_size(v) != 0)
+    {
+        return 1;
+    }
+
+    Bpp = get_bytes_per_pixel(v->server_bpp);
+    width = MIN(cx, v->fb_width - x);
+    height = MIN(cy, v->fb_height - y);
+    if (width <= 0 || height <= 0)
+    {
+        return 0;
+    }
+
+    for (row = 0; row < height; row++)
+    {
+        g_memcpy(v->fb + ((y + row) * v->fb_width + x) * Bpp,
+                 data + row * cx * Bpp, width * Bpp);
+    }
+    vnc_dirty_add(&v->dirty, x, y, width, height);
+    v->stat_rects++;
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * Applies a CopyRect to the framebuffer
+ *
+ * @param v VNC object
+ * @param x, y, cx, cy Destination rectangle
+ * @param srcx, srcy Source position
+ * @return != 0 for error
+ */
+static int
+fb_copy_rect(struct vnc *v, int x, int y, int cx, int cy,
+             int srcx, int srcy)
+{
+    int Bpp;
+    int row;
+    int width;
+    int height;
+    int stride;
+    char *dst;
+    const char *src;
+
+    if (fb_check_size(v) != 0)
+    {
+        return 1;
+    }
+
+    Bpp = get_bytes_per_pixel(v->server_bpp);
+    width = MIN(cx, v->fb_width - MAX(x, srcx));
+    height = MIN(cy, v->fb_height - MAX(y, srcy));
+    if (width <= 0 || height <= 0)
+    {
+        return 0;
+    }
+
+    stride = v->fb_width * Bpp;
+    dst = v->fb + y * stride + x * Bpp;
+    src = v->fb + srcy * stride + srcx * Bpp;
+    if (y > srcy)
+    {
+        /* Overlapping move down the screen, go bottom up */
+        for (row = height - 1; row >= 0; row--)
+        {
+            g_memmove(dst + row * stride, src + row * stride, width * Bpp);
+        }
+    }
+    else
+    {
+        for (row = 0; row < height; row++)
+        {
+            g_memmove(dst + row * stride, src + row * stride, width * Bpp);
+        }
+    }
+
+    return 0;
+}
+
+/**************************************************************************//**
+ * Paints the dirty areas of the framebuffer
+ *
+ * @param v VNC object
+ * @return != 0 for error
+ */
+static int
+fb_flush(struct vnc *v)
+{
+    const struct vnc_dirty_rect *r;
+    int error = 0;
+    int i;
+
+    for (i = 0; i < v->dirty.count && error == 0; i++)
+    {
+        r = v->dirty.rects + i;
+        error = v->server_paint_rect(v, r->x, r->y, r->cx, r->cy,
+                                     v->fb, v->fb_width, v->fb_height,
+                                     r->x, r->y);
+        v->stat_paints++;
+    }
+    vnc_dirty_clear(&v->dirty);
+
+    return error;
+}
+
 /******************************************************************************/
 int
 lib_framebuffer_update(struct vnc *v)
@@ -1301,11 +1591,17 @@ lib_framebuffer_update(struct vnc *v)
     int b;
     int error;
     int need_size;
+    int start_ms;
+    int width;
+    int height;
     struct stream *s;
     struct stream *pixel_s;
     struct vnc_screen_layout layout = { 0 };
 
     num_recs = 0;
+    start_ms = g_time3();
+    width = v->server_width;
+    height = v->server_height;
 
     make_stream(pixel_s);
 
@@ -1320,6 +1616,13 @@ lib_framebuffer_update(struct vnc *v)
         error = v->server_begin_update(v);
     }
 
+    /* Without continuous updates, ask for the next update now so the
+     * server can send it while we process this one */
+    if (error == 0 && !v->cu_enabled && v->suppress_output == 0)
+    {
+        error = send_incremental_update_request(v);
+    }
+
     for (i = 0; i < num_recs; i++)
     {
         if (error != 0)
@@ -1346,7 +1649,25 @@ lib_framebuffer_update(struct vnc *v)
 
                 if (error == 0)
                 {
-                    error = v->server_paint_rect(v, x, y, cx, cy, pixel_s->data, cx, cy, 0, 0);
+                    error = fb_put_rect(v, x, y, cx, cy, pixel_s->data);
+                }
+            }
+            else if (encoding == RFB_ENC_ZRLE || encoding == RFB_ENC_TIGHT)
+            {
+                if (encoding == RFB_ENC_ZRLE)
+                {
+                    error = vnc_decode_zrle(v->decoder, read_for_decoder,
+                                            v->trans, cx, cy, &d1);
+                }
+                else
+                {
+                    error = vnc_decode_tight(v->decoder, read_for_decoder,
+                                             v->trans, cx, cy, &d1);
+                }
+
+                if (error == 0)
+                {
+                    error = fb_put_rect(v, x, y, cx, cy, d1);
                 }
             }
             else if (encoding == RFB_ENC_COPY_RECT)
@@ -1358,8 +1679,19 @@ lib_framebuffer_update(struct vnc *v)
                 {
                     in_uint16_be(s, srcx);
                     in_uint16_be(s, srcy);
+                    /* The source may be waiting to be painted */
+                    error = fb_flush(v);
+                }
+
+                if (error == 0)
+                {
                     error = v->server_screen_blt(v, x, y, cx, cy, srcx, srcy);
                 }
+
+                if (error == 0)
+                {
+                    error = fb_copy_rect(v, x, y, cx, cy, srcx, srcy);
+                }
             }
             else if (encoding == RFB_ENC_CURSOR)
             {
@@ -1411,7 +1743,11 @@ lib_framebuffer_update(struct vnc *v)
                 /* Server end has resized */
                 v->server_width = cx;
                 v->server_height = cy;
-                error = resize_client(v, 1, cx, cy);
+                error = fb_flush(v);
+                if (error == 0)
+                {
+                    error = resize_client(v, 1, cx, cy);
+                }
             }
             else if (encoding == RFB_ENC_EXTENDED_DESKTOP_SIZE)
             {
@@ -1423,7 +1759,11 @@ lib_framebuffer_update(struct vnc *v)
                 {
                     v->server_width = layout.total_width;
                     v->server_height = layout.total_height;
-                    error = resize_client_from_layout(v, 1, &layout);
+                    error = fb_flush(v);
+                    if (error == 0)
+                    {
+                        error = resize_client_from_layout(v, 1, &layout);
+                    }
                 }
                 g_free(layout.s);
             }
@@ -1438,25 +1778,36 @@ lib_framebuffer_update(struct vnc *v)
 
     if (error == 0)
     {
-        error = v->server_end_update(v);
+        error = fb_flush(v);
     }
 
     if (error == 0)
     {
-        if (v->suppress_output == 0)
+        error = v->server_end_update(v);
+    }
+
+    /* The request we've already sent is for the old geometry */
+    if (error == 0 && v->suppress_output == 0 &&
+            (v->server_width != width || v->server_height != height))
+    {
+        if (v->cu_enabled)
         {
-            init_stream(s, 8192);
-            out_uint8(s, RFB_C2S_FRAMEBUFFER_UPDATE_REQUEST);
-            out_uint8(s, 1); /* incremental == 1 : Changes only */
-            out_uint16_be(s, 0);
-            out_uint16_be(s, 0);
-            out_uint16_be(s, v->server_width);
-            out_uint16_be(s, v->server_height);
-            s_mark_end(s);
-            error = lib_send_copy(v, s);
+            error = send_enable_continuous_updates(v, 1);
+        }
+        else
+        {
+            error = send_incremental_update_request(v);
         }
     }
 
+    if (error == 0)
+    {
+        start_ms = g_time3() - start_ms;
+        v->stat_updates++;
+        v->stat_update_ms += start_ms;
+        v->stat_max_update_ms = MAX(v->stat_max_update_ms, start_ms);
+    }
+
     free_stream(s);
     free_stream(pixel_s);
     return error;
@@ -1528,6 +1879,105 @@ lib_bell_trigger(struct vnc *v)
     return error;
 }
 
+/**************************************************************************//**
+ * Handles an EndOfContinuousUpdates message
+ *
+ * The server sends one when it sees we support continuous updates, and
+ * again whenever we stop them.
+ *
+ * @param v VNC object
+ * @return != 0 for error
+ */
+static int
+lib_end_of_continuous_updates(struct vnc *v)
+{
+    int error;
+
+    if (!v->cu_supported)
+    {
+        LOG(LOG_LEVEL_INFO, "VNC server supports continuous updates");
+        v->cu_supported = 1;
+    }
+    v->cu_enabled = 0;
+
+    if (v->cu_resize_pending)
+    {
+        /* Updates have stopped, so the resize can start */
+        v->cu_resize_pending = 0;
+        v->resize_status = VRS_WAITING_FOR_FIRST_UPDATE;
+        error = send_update_request_for_resize_status(v);
+    }
+    else
+    {
+        error = start_continuous_updates(v);
+    }
+
+    return error;
+}
+
+/**************************************************************************//**
+ * Handles a ServerFence message
+ *
+ * Messages are processed in order, so the flags asking us to block are
+ * met by replying straight away.
+ *
+ * @param v VNC object
+ * @return != 0 for error
+ */
+static int
+lib_fence(struct vnc *v)
+{
+    char payload[RFB_FENCE_MAX_PAYLOAD];
+    unsigned int flags;
+    int length;
+    int error;
+    struct stream *s;
+
+    make_stream(s);
+    init_stream(s, 8192);
+    error = trans_force_read_s(v->trans, s, 8);
+
+    if (error == 0)
+    {
+        in_uint8s(s, 3);
+        in_uint32_be(s, flags);
+        in_uint8(s, length);
+        if (length > RFB_FENCE_MAX_PAYLOAD)
+        {
+            LOG(LOG_LEVEL_ERROR, "VNC fence payload of %d bytes is too long",
+                length);
+            error = 1;
+        }
+    }
+
+    if (error == 0 && length > 0)
+    {
+        init_stream(s, 8192);
+        error = trans_force_read_s(v->trans, s, length);
+        if (error == 0)
+        {
+            in_uint8a(s, payload, length);
+        }
+    }
+
+    if (error == 0 && (flags & RFB_FENCE_REQUEST) != 0)
+    {
+        flags &= RFB_FENCE_BLOCK_BEFORE | RFB_FENCE_BLOCK_AFTER |
+                 RFB_FENCE_SYNC_NEXT;
+        init_stream(s, 8192);
+        out_uint8(s, RFB_C2S_FENCE);
+        out_uint8s(s, 3);
+        out_uint32_be(s, flags);
+        out_uint8(s, length);
+        out_uint8a(s, payload, length);
+        s_mark_end(s);
+        error = lib_send_copy(v, s);
+    }
+
+    free_stream(s);
+    return error;
+}
+
 /******************************************************************************/
 int
 lib_mod_signal(struct vnc *v)
@@ -1539,7 +1989,7 @@ lib_mod_signal(struct vnc *v)
 static int
 lib_mod_process_message(struct vnc *v, struct stream *s)
 {
-    char type;
+    int type;
     int error;
     char text[256];
 
@@ -1577,6 +2027,14 @@ lib_mod_process_message(struct vnc *v, struct stream *s)
             LOG(LOG_LEVEL_DEBUG, "VNC got clip data");
             error = vnc_clip_process_rfb_data(v);
         }
+        else if (type == RFB_S2C_END_OF_CONTINUOUS_UPDATES)
+        {
+            error = lib_end_of_continuous_updates(v);
+        }
+        else if (type == RFB_S2C_FENCE)
+        {
+            error = lib_fence(v);
+        }
         else
         {
             g_sprintf(text, "VNC unknown in lib_mod_process_message %d", type);
@@ -1632,6 +2090,53 @@ lib_data_in(struct trans *trans)
     return 0;
 }
 
+/**************************************************************************//**
+ * Decides whether the VNC server is on this machine
+ *
+ * @param v VNC object
+ * @return non-zero if it is
+ */
+static int
+server_is_local(struct vnc *v)
+{
+    return g_strcmp(v->ip, "127.0.0.1") == 0 ||
+           g_strcmp(v->ip, "::1") == 0 ||
+           g_strcasecmp(v->ip, "localhost") == 0;
+}
+
+/**************************************************************************//**
+ * Adds the ZRLE and Tight encodings to a SetEncodings list
+ *
+ * @param v VNC object
+ * @param e Encodings list
+ * @param [in,out] n Encodings in the list
+ */
+static void
+add_compressed_encodings(struct vnc *v, encoding_type *e, unsigned int *n)
+{
+    if (v->enabled_encodings_mask & MSK_TIGHT)
+    {
+        e[(*n)++] = RFB_ENC_TIGHT;
+        /* Without a quality level the server won't send JPEG */
+        if (v->server_bpp > 8 && vnc_decoder_jpeg_supported())
+        {
+            e[(*n)++] = RFB_ENC_QUALITY_LEVEL_0 + VNC_TIGHT_QUALITY;
+        }
+    }
+    else
+    {
+        LOG(LOG_LEVEL_INFO, "VNC User disabled TIGHT");
+    }
+    if (v->enabled_encodings_mask & MSK_ZRLE)
+    {
+        e[(*n)++] = RFB_ENC_ZRLE;
+    }
+    else
+    {
+        LOG(LOG_LEVEL_INFO, "VNC User disabled ZRLE");
+    }
+}
+
 /******************************************************************************/
 /*
   return error
@@ -1961,10 +2466,28 @@ lib_mod_connect(struct vnc *v)
 
     if (error == 0)
     {
-        encoding_type e[10];
+        vnc_decoder_delete(v->decoder);
+        v->decoder = vnc_decoder_create(v->server_bpp);
+        if (v->decoder == NULL)
+        {
+            v->server_msg(v, "VNC error: vnc_decoder_create() failed", 0);
+            error = 1;
+        }
+    }
+
+    if (error == 0)
+    {
+        encoding_type e[16];
         unsigned int n = 0;
         unsigned int i;
 
+        /* Compressed encodings first, the server uses the first it knows.
+         * Raw is quicker for a server on this machine */
+        if (!server_is_local(v))
+        {
+            add_compressed_encodings(v, e, &n);
+        }
+
         /* These encodings are always supported */
         e[n++] = RFB_ENC_RAW;
         e[n++] = RFB_ENC_COPY_RECT;
@@ -1979,6 +2502,20 @@ lib_mod_connect(struct vnc *v)
             LOG(LOG_LEVEL_INFO,
                 "VNC User disabled EXTENDED_DESKTOP_SIZE");
         }
+        if (v->enabled_encodings_mask & MSK_CONTINUOUS_UPDATES)
+        {
+            /* Servers only allow continuous updates with fences */
+            e[n++] = RFB_ENC_FENCE;
+            e[n++] = RFB_ENC_CONTINUOUS_UPDATES;
+        }
+        else
+        {
+            LOG(LOG_LEVEL_INFO, "VNC User disabled CONTINUOUS_UPDATES");
+        }
+        if (server_is_local(v))
+        {
+            add_compressed_encodings(v, e, &n);
+        }
 
         init_stream(s, 8192);
         out_uint8(s, RFB_C2S_SET_ENCODINGS);
@@ -1995,6 +2532,10 @@ lib_mod_connect(struct vnc *v)
     if (error == 0)
     {
         v->resize_status = VRS_WAITING_FOR_FIRST_UPDATE;
+        v->cu_supported = 0;
+        v->cu_enabled = 0;
+        v->cu_resize_pending = 0;
+        v->stat_start_ms = g_time3();
         error = send_update_request_for_resize_status(v);
     }
 
@@ -2203,7 +2744,14 @@ lib_mod_suppress_output(struct vnc *v, int suppress,
 
     error = 0;
     v->suppress_output = suppress;
-    if (suppress == 0)
+    if (suppress != 0)
+    {
+        if (v->cu_enabled)
+        {
+            error = send_enable_continuous_updates(v, 0);
+        }
+    }
+    else
     {
         make_stream(s);
         init_stream(s, 8192);
@@ -2216,6 +2764,10 @@ lib_mod_suppress_output(struct vnc *v, int suppress,
         s_mark_end(s);
         error = lib_send_copy(v, s);
         free_stream(s);
+        if (error == 0)
+        {
+            error = start_continuous_updates(v);
+        }
     }
     return error;
 }
@@ -2235,8 +2787,18 @@ lib_mod_server_monitor_resize(struct vnc *v, int width, int height)
 {
     int error = 0;
     set_single_screen_layout(&v->client_layout, width, height);
-    v->resize_status = VRS_WAITING_FOR_FIRST_UPDATE;
-    error = send_update_request_for_resize_status(v);
+    if (v->cu_enabled)
+    {
+        /* The resize state machine expects replies to its own
+         * requests, so stop updates first */
+        v->cu_resize_pending = 1;
+        error = send_enable_continuous_updates(v, 0);
+    }
+    else if (!v->cu_resize_pending)
+    {
+        v->resize_status = VRS_WAITING_FOR_FIRST_UPDATE;
+        error = send_update_request_for_resize_status(v);
+    }
     return error;
 }
 
@@ -2280,6 +2842,30 @@ mod_init(void)
     return (tintptr) v;
 }
 
+/**************************************************************************//**
+ * Logs the update counters for the connection
+ *
+ * @param v VNC object
+ */
+static void
+log_update_stats(struct vnc *v)
+{
+    int elapsed;
+
+    if (v->stat_updates > 0)
+    {
+        elapsed = MAX(g_time3() - v->stat_start_ms, 1);
+        LOG(LOG_LEVEL_INFO, "VNC %d updates in %d ms (%d per second), "
+            "%d rectangles painted as %d, update time mean %d ms max %d ms%s",
+            v->stat_updates, elapsed,
+            (int)((long long)v->stat_updates * 1000 / elapsed),
+            v->stat_rects, v->stat_paints,
+            (int)(v->stat_update_ms / v->stat_updates),
+            v->stat_max_update_ms,
+            v->cu_supported ? ", continuous updates" : "");
+    }
+}
+
 /******************************************************************************/
 int EXPORT_CC
 mod_exit(tintptr handle)
@@ -2294,6 +2880,9 @@ mod_exit(tintptr handle)
     trans_delete(v->trans);
     g_free(v->client_layout.s);
     vnc_clip_exit(v);
+    log_update_stats(v);
+    vnc_decoder_delete(v->decoder);
+    g_free(v->fb);
     g_free(v);
     return 0;
 }
@@ -27,6 +27,7 @@
 #include "os_calls.h"
 #include "defines.h"
 #include "guid.h"
+#include "vnc_dirty.h"
 
 #define CURRENT_MOD_VER 4
 
@@ -65,6 +66,9 @@ struct source_info;
 /* Defined in vnc_clip.c */
 struct vnc_clipboard_data;
 
+/* Defined in vnc_decode.c */
+struct vnc_decoder;
+
 struct vnc
 {
     int size; /* size of this struct */
@@ -163,6 +167,24 @@ struct vnc
     struct guid guid;
     int suppress_output;
     unsigned int enabled_encodings_mask;
+    struct vnc_decoder *decoder; /* ZRLE and Tight */
+    /* Server framebuffer, so rectangles in an update can be merged
+     * before they're painted */
+    char *fb;
+    int fb_width;
+    int fb_height;
+    struct vnc_dirty dirty;
+    /* ContinuousUpdates support */
+    int cu_supported; /* Server has sent EndOfContinuousUpdates */
+    int cu_enabled;
+    int cu_resize_pending; /* Resize waits for updates to stop */
+    /* Counters, logged when the module exits */
+    int stat_updates;
+    int stat_rects;
+    int stat_paints;
+    int stat_start_ms;
+    long long stat_update_ms;
+    int stat_max_update_ms;
     /* Resizeable support */
     struct vnc_screen_layout client_layout;
     enum vnc_resize_status resize_status;
@@ -0,0 +1,1185 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * libvnc - decoders for the ZRLE and Tight encodings
+ *
+ * ZRLE is described in RFC6143. Tight is documented in the RFB community
+ * wiki (https://github.com/rfbproto/rfbproto).
+ *
+ * Both decode into the pixel format lib_mod_connect() asks the server
+ * for, which is in host byte order:-
+ *   8 bpp  : palette
+ *   15 bpp : 16 bit pixels, RGB555
+ *   16 bpp : 16 bit pixels, RGB565
+ *   24/32  : 32 bit pixels, depth 24, red in bits 16-23
+ */
+
+#if defined(HAVE_CONFIG_H)
+#include <config_ac.h>
+#endif
+
+#include <zlib.h>
+#if defined(XRDP_JPEG)
+#include <stdio.h>
+#include <setjmp.h>
+#include <jpeglib.h>
+#endif
+
+#include "arch.h"
+#include "parse.h"
+#include "os_calls.h"
+#include "defines.h"
+#include "log.h"
+#include "vnc_decode.h"
+
+#define ZRLE_TILE_SIZE 64
+
+#define TIGHT_STREAMS 4
+#define TIGHT_FILL 0x08
+#define TIGHT_JPEG 0x09
+#define TIGHT_EXPLICIT_FILTER 0x04
+#define TIGHT_FILTER_COPY 0
+#define TIGHT_FILTER_PALETTE 1
+#define TIGHT_FILTER_GRADIENT 2
+/* smaller amounts of data aren't compressed */
+#define TIGHT_MIN_TO_COMPRESS 12
+
+/* most compressed data we accept for one rectangle */
+#define VNC_DECODE_MAX_IN (64 * 1024 * 1024)
+
+struct vnc_decoder
+{
+    int bpp;
+    int Bpp;                    /* bytes per pixel we output */
+    int cpixel_bytes;           /* ZRLE CPIXEL */
+    int tpixel_bytes;           /* Tight TPIXEL */
+    int true_colour;
+    int max[3];                 /* red, green, blue */
+    int shift[3];
+    int loss[3];                /* bits dropped from 8 bit components */
+    z_stream zrle_zs;
+    int zrle_zs_init;
+    z_stream tight_zs[TIGHT_STREAMS];
+    int tight_zs_init[TIGHT_STREAMS];
+    struct stream *in_s;        /* as read from the server */
+    char *inflated;             /* zlib output */
+    int inflated_size;
+    char *pixels;               /* decoded rectangle */
+    int pixels_size;
+    tui8 *row;                  /* JPEG scanline */
+    int row_size;
+    struct vnc_decoder_stats stats;
+};
+
+/*****************************************************************************/
+static int
+decoder_set_format(struct vnc_decoder *d, int bpp)
+{
+    d->bpp = bpp;
+    switch (bpp)
+    {
+        case 8:
+            d->Bpp = 1;
+            d->cpixel_bytes = 1;
+            d->tpixel_bytes = 1;
+            return 0;
+        case 15:
+            d->Bpp = 2;
+            d->max[0] = 31;
+            d->max[1] = 31;
+            d->max[2] = 31;
+            d->shift[0] = 10;
+            d->shift[1] = 5;
+            break;
+        case 16:
+            d->Bpp = 2;
+            d->max[0] = 31;
+            d->max[1] = 63;
+            d->max[2] = 31;
+            d->shift[0] = 11;
+            d->shift[1] = 5;
+            break;
+        case 24:
+        case 32:
+            d->Bpp = 4;
+            d->max[0] = 255;
+            d->max[1] = 255;
+            d->max[2] = 255;
+            d->shift[0] = 16;
+            d->shift[1] = 8;
+            break;
+        default:
+            return 1;
+    }
+    d->true_colour = 1;
+    d->shift[2] = 0;
+    d->loss[0] = (d->max[0] == 31) ? 3 : 0;
+    d->loss[1] = (d->max[1] == 31) ? 3 : (d->max[1] == 63) ? 2 : 0;
+    d->loss[2] = (d->max[2] == 31) ? 3 : 0;
+    /* depth 24 in 32 bits travels as 3 bytes */
+    d->cpixel_bytes = (d->Bpp == 4) ? 3 : d->Bpp;
+    d->tpixel_bytes = d->cpixel_bytes;
+    return 0;
+}
+
+/*****************************************************************************/
+static void
+put_pixel(const struct vnc_decoder *d, char *dst, tui32 pixel)
+{
+    switch (d->Bpp)
+    {
+        case 1:
+            *((tui8 *) dst) = (tui8) pixel;
+            break;
+        case 2:
+            *((tui16 *) dst) = (tui16) pixel;
+            break;
+        default:
+            *((tui32 *) dst) = pixel;
+            break;
+    }
+}
+
+/*****************************************************************************/
+static void
+fill_pixels(const struct vnc_decoder *d, char *dst, int stride,
+            int cx, int cy, tui32 pixel)
+{
+    int x;
+    int y;
+
+    for (y = 0; y < cy; y++)
+    {
+        for (x = 0; x < cx; x++)
+        {
+            put_pixel(d, dst + x * d->Bpp, pixel);
+        }
+        dst += stride;
+    }
+}
+
+/*****************************************************************************/
+/* a ZRLE CPIXEL is a pixel, less its unused top byte for depth 24 */
+static tui32
+get_cpixel(const struct vnc_decoder *d, const tui8 *p)
+{
+    tui16 pixel16;
+
+    switch (d->cpixel_bytes)
+    {
+        case 1:
+            return p[0];
+        case 2:
+            g_memcpy(&pixel16, p, 2);
+            return pixel16;
+        default:
+#if defined(B_ENDIAN)
+            return (p[0] << 16) | (p[1] << 8) | p[2];
+#else
+            return p[0] | (p[1] << 8) | (p[2] << 16);
+#endif
+    }
+}
+
+/*****************************************************************************/
+/* a Tight TPIXEL for depth 24 is red, green, blue */
+static tui32
+get_tpixel(const struct vnc_decoder *d, const tui8 *p)
+{
+    if (d->tpixel_bytes == 3)
+    {
+        return (p[0] << 16) | (p[1] << 8) | p[2];
+    }
+    return get_cpixel(d, p);
+}
+
+/*****************************************************************************/
+/* makes room for a cx x cy rectangle, returns 0 if ok */
+static int
+pixels_alloc(struct vnc_decoder *d, int cx, int cy)
+{
+    long long bytes;
+
+    bytes = (long long) cx * cy * d->Bpp;
+    if (cx < 0 || cy < 0 || bytes > 0x7fffffff)
+    {
+        LOG(LOG_LEVEL_ERROR, "vnc_decoder: bad rectangle %dx%d", cx, cy);
+        return 1;
+    }
+    if (bytes > d->pixels_size)
+    {
+        g_free(d->pixels);
+        d->pixels = (char *) g_malloc((int) bytes, 0);
+        if (d->pixels == NULL)
+        {
+            d->pixels_size = 0;
+            return 1;
+        }
+        d->pixels_size = (int) bytes;
+    }
+    return 0;
+}
+
+/*****************************************************************************/
+/* inflates in_bytes from a stream which lasts the whole connection.
+   Returns the number of bytes out, or -1 */
+static int
+decoder_inflate(struct vnc_decoder *d, z_stream *zs, char *in, int in_bytes,
+                int max_out)
+{
+    char *inflated;
+    int out_bytes;
+    int size;
+    int rv;
+
+    zs->next_in = (Bytef *) in;
+    zs->avail_in = in_bytes;
+    out_bytes = 0;
+    for (;;)
+    {
+        if (out_bytes == d->inflated_size)
+        {
+            if (out_bytes >= max_out)
+            {
+                if (zs->avail_in == 0)
+                {
+                    break;
+                }
+                LOG(LOG_LEVEL_ERROR, "vnc_decoder: more than %d bytes of "
+                    "inflated data", max_out);
+                return -1;
+            }
+            size = MIN(MAX(out_bytes * 2, 64 * 1024), max_out);
+            inflated = (char *) g_malloc(size, 0);
+            if (inflated == NULL)
+            {
+                return -1;
+            }
+            g_memcpy(inflated, d->inflated, out_bytes);
+            g_free(d->inflated);
+            d->inflated = inflated;
+            d->inflated_size = size;
+        }
+        zs->next_out = (Bytef *) (d->inflated + out_bytes);
+        zs->avail_out = d->inflated_size - out_bytes;
+        rv = inflate(zs, Z_SYNC_FLUSH);
+        out_bytes = d->inflated_size - zs->avail_out;
+        if (rv != Z_OK && rv != Z_BUF_ERROR)
+        {
+            LOG(LOG_LEVEL_ERROR, "vnc_decoder: inflate error %d", rv);
+            return -1;
+        }
+        if (zs->avail_out > 0)
+        {
+            if (zs->avail_in == 0)
+            {
+                break;
+            }
+            if (rv != Z_OK)
+            {
+                LOG(LOG_LEVEL_ERROR, "vnc_decoder: inflate stalled");
+                return -1;
+            }
+        }
+    }
+    return out_bytes;
+}
+
+/*****************************************************************************/
+/* returns 0 if ok */
+static int
+decoder_inflate_init(z_stream *zs, int *init)
+{
+    if (!*init)
+    {
+        g_memset(zs, 0, sizeof(*zs));
+        if (inflateInit(zs) != Z_OK)
+        {
+            LOG(LOG_LEVEL_ERROR, "vnc_decoder: inflateInit failed");
+            return 1;
+        }
+        *init = 1;
+    }
+    return 0;
+}
+
+/*****************************************************************************/
+struct vnc_decoder *
+vnc_decoder_create(int bpp)
+{
+    struct vnc_decoder *d;
+
+    d = g_new0(struct vnc_decoder, 1);
+    if (d == NULL)
+    {
+        return NULL;
+    }
+    if (decoder_set_format(d, bpp) != 0)
+    {
+        LOG(LOG_LEVEL_ERROR, "vnc_decoder_create: bpp %d not supported", bpp);
+        g_free(d);
+        return NULL;
+    }
+    make_stream(d->in_s);
+    return d;
+}
+
+/*****************************************************************************/
+void
+vnc_decoder_delete(struct vnc_decoder *d)
+{
+    int index;
+
+    if (d == NULL)
+    {
+        return;
+    }
+    if (d->stats.zrle_rects > 0 || d->stats.tight_rects > 0)
+    {
+        LOG(LOG_LEVEL_DEBUG, "vnc_decoder_delete: %d ZRLE and %d Tight "
+            "rectangles (%d JPEG), %lld bytes in, %lld pixels out",
+            d->stats.zrle_rects, d->stats.tight_rects,
+            d->stats.tight_jpeg_rects, d->stats.bytes_in,
+            d->stats.pixels_out);
+    }
+    if (d->zrle_zs_init)
+    {
+        inflateEnd(&d->zrle_zs);
+    }
+    for (index = 0; index < TIGHT_STREAMS; index++)
+    {
+        if (d->tight_zs_init[index])
+        {
+            inflateEnd(&d->tight_zs[index]);
+        }
+    }
+    free_stream(d->in_s);
+    g_free(d->inflated);
+    g_free(d->pixels);
+    g_free(d->row);
+    g_free(d);
+}
+
+/*****************************************************************************/
+int
+vnc_decoder_jpeg_supported(void)
+{
+#if defined(XRDP_JPEG)
+    return 1;
+#else
+    return 0;
+#endif
+}
+
+/*****************************************************************************/
+const struct vnc_decoder_stats *
+vnc_decoder_get_stats(const struct vnc_decoder *d)
+{
+    return &d->stats;
+}
+
+/*****************************************************************************/
+/* a run length is 1 plus the sum of its bytes, the last of which
+   isn't 255 */
+static int
+zrle_run_length(const tui8 **pp, const tui8 *end, int *run)
+{
+    const tui8 *p;
+    int b;
+
+    p = *pp;
+    *run = 1;
+    do
+    {
+        if (p >= end || *run > 0x1000000)
+        {
+            return 1;
+        }
+        b = *p++;
+        *run += b;
+    }
+    while (b == 255);
+    *pp = p;
+    return 0;
+}
+
+/*****************************************************************************/
+/* sets run pixels of a tile, starting at pixel k */
+static void
+zrle_put_run(const struct vnc_decoder *d, char *dst, int stride, int tw,
+             int k, int run, tui32 pixel)
+{
+    int x;
+    int y;
+
+    x = k % tw;
+    y = k / tw;
+    while (run > 0)
+    {
+        put_pixel(d, dst + y * stride + x * d->Bpp, pixel);
+        run--;
+        x++;
+        if (x == tw)
+        {
+            x = 0;
+            y++;
+        }
+    }
+}
+
+/*****************************************************************************/
+/* reads size CPIXELs, returns 0 if ok */
+static int
+zrle_read_palette(const struct vnc_decoder *d, const tui8 **pp,
+                  const tui8 *end, tui32 *palette, int size)
+{
+    const tui8 *p;
+    int index;
+
+    p = *pp;
+    if (end - p < size * d->cpixel_bytes)
+    {
+        return 1;
+    }
+    for (index = 0; index < size; index++)
+    {
+        palette[index] = get_cpixel(d, p);
+        p += d->cpixel_bytes;
+    }
+    *pp = p;
+    return 0;
+}
+
+/*****************************************************************************/
+/* decodes one tile, returns 0 if ok */
+static int
+zrle_tile(const struct vnc_decoder *d, const tui8 **pp, const tui8 *end,
+          char *dst, int stride, int tw, int th)
+{
+    tui32 palette[128];
+    const tui8 *p;
+    tui32 pixel;
+    int cpb;
+    int subenc;
+    int palette_size;
+    int bits;
+    int shift;
+    int count;
+    int k;
+    int run;
+    int index;
+    int x;
+    int y;
+
+    p = *pp;
+    cpb = d->cpixel_bytes;
+    count = tw * th;
+    if (p >= end)
+    {
+        return 1;
+    }
+    subenc = *p++;
+    if (subenc == 0)
+    {
+        /* raw */
+        if (end - p < count * cpb)
+        {
+            return 1;
+        }
+        for (y = 0; y < th; y++)
+        {
+            for (x = 0; x < tw; x++)
+            {
+                put_pixel(d, dst + y * stride + x * d->Bpp, get_cpixel(d, p));
+                p += cpb;
+            }
+        }
+    }
+    else if (subenc == 1)
+    {
+        /* solid */
+        if (end - p < cpb)
+        {
+            return 1;
+        }
+        fill_pixels(d, dst, stride, tw, th, get_cpixel(d, p));
+        p += cpb;
+    }
+    else if (subenc <= 16)
+    {
+        /* packed palette, rows padded to a byte */
+        palette_size = subenc;
+        if (zrle_read_palette(d, &p, end, palette, palette_size) != 0)
+        {
+            return 1;
+        }
+        for (index = palette_size; index < 16; index++)
+        {
+            palette[index] = 0;
+        }
+        bits = (palette_size <= 2) ? 1 : (palette_size <= 4) ? 2 : 4;
+        if (end - p < ((tw * bits + 7) / 8) * th)
+        {
+            return 1;
+        }
+        for (y = 0; y < th; y++)
+        {
+            shift = 8;
+            for (x = 0; x < tw; x++)
+            {
+                if (shift == 0)
+                {
+                    p++;
+                    shift = 8;
+                }
+                shift -= bits;
+                index = (*p >> shift) & ((1 << bits) - 1);
+                put_pixel(d, dst + y * stride + x * d->Bpp, palette[index]);
+            }
+            p++;
+        }
+    }
+    else if (subenc == 128)
+    {
+        /* plain RLE */
+        for (k = 0; k < count; k += run)
+        {
+            if (end - p < cpb)
+            {
+                return 1;
+            }
+            pixel = get_cpixel(d, p);
+            p += cpb;
+            if (zrle_run_length(&p, end, &run) != 0 || run > count - k)
+            {
+                return 1;
+            }
+            zrle_put_run(d, dst, stride, tw, k, run, pixel);
+        }
+    }
+    else if (subenc >= 130)
+    {
+        /* palette RLE */
+        palette_size = subenc - 128;
+        if (zrle_read_palette(d, &p, end, palette, palette_size) != 0)
+        {
+            return 1;
+        }
+        for (k = 0; k < count; k += run)
+        {
+            if (p >= end)
+            {
+                return 1;
+            }
+            index = *p++;
+            run = 1;
+            if (index & 128)
+            {
+                index &= 127;
+                if (zrle_run_length(&p, end, &run) != 0)
+                {
+                    return 1;
+                }
+            }
+            if (index >= palette_size || run > count - k)
+            {
+                return 1;
+            }
+            zrle_put_run(d, dst, stride, tw, k, run, palette[index]);
+        }
+    }
+    else
+    {
+        /* 17 to 127 and 129 aren't used */
+        return 1;
+    }
+    *pp = p;
+    return 0;
+}
+
+/*****************************************************************************/
+int
+vnc_decode_zrle(struct vnc_decoder *d, vnc_decoder_read_fn read,
+                void *handle, int cx, int cy, char **data)
+{
+    const tui8 *p;
+    const tui8 *end;
+    long long max_out;
+    int length;
+    int out_bytes;
+    int stride;
+    int tx;
+    int ty;
+    int error;
+
+    error = read(handle, d->in_s, 4);
+    if (error != 0)
+    {
+        return error;
+    }
+    in_uint32_be(d->in_s, length);
+    if (length < 0 || length > VNC_DECODE_MAX_IN)
+    {
+        LOG(LOG_LEVEL_ERROR, "vnc_decode_zrle: bad length %d", length);
+        return 1;
+    }
+    error = read(handle, d->in_s, length);
+    if (error != 0)
+    {
+        return error;
+    }
+    d->stats.bytes_in += 4 + length;
+    if (pixels_alloc(d, cx, cy) != 0 ||
+            decoder_inflate_init(&d->zrle_zs, &d->zrle_zs_init) != 0)
+    {
+        return 1;
+    }
+
+    /* the most a valid rectangle can inflate to */
+    max_out = (long long) ((cx + ZRLE_TILE_SIZE - 1) / ZRLE_TILE_SIZE) *
+              ((cy + ZRLE_TILE_SIZE - 1) / ZRLE_TILE_SIZE) *
+              (1 + 127 * d->cpixel_bytes) +
+              (long long) cx * cy * (d->cpixel_bytes + 1);
+    out_bytes = decoder_inflate(d, &d->zrle_zs, d->in_s->data, length,
+                                (int) MIN(max_out, 0x7fffffff));
+    if (out_bytes < 0)
+    {
+        return 1;
+    }
+
+    p = (const tui8 *) d->inflated;
+    end = p + out_bytes;
+    stride = cx * d->Bpp;
+    for (ty = 0; ty < cy; ty += ZRLE_TILE_SIZE)
+    {
+        for (tx = 0; tx < cx; tx += ZRLE_TILE_SIZE)
+        {
+            if (zrle_tile(d, &p, end, d->pixels + ty * stride + tx * d->Bpp,
+                          stride, MIN(ZRLE_TILE_SIZE, cx - tx),
+                          MIN(ZRLE_TILE_SIZE, cy - ty)) != 0)
+            {
+                LOG(LOG_LEVEL_ERROR, "vnc_decode_zrle: bad tile at %d,%d "
+                    "in %dx%d rectangle", tx, ty, cx, cy);
+                return 1;
+            }
+        }
+    }
+    d->stats.zrle_rects++;
+    d->stats.pixels_out += (long long) cx * cy;
+    *data = d->pixels;
+    return 0;
+}
+
+/*****************************************************************************/
+/* reads a Tight compact length, 7 bits a byte then 8 in the third */
+static int
+tight_read_length(struct vnc_decoder *d, vnc_decoder_read_fn read,
+                  void *handle, int *length)
+{
+    int index;
+    int b;
+    int error;
+
+    *length = 0;
+    for (index = 0; index < 3; index++)
+    {
+        error = read(handle, d->in_s, 1);
+        if (error != 0)
+        {
+            return error;
+        }
+        in_uint8(d->in_s, b);
+        d->stats.bytes_in++;
+        if (index == 2)
+        {
+            *length |= b << 14;
+            break;
+        }
+        *length |= (b & 0x7f) << (7 * index);
+        if ((b & 0x80) == 0)
+        {
+            break;
+        }
+    }
+    return 0;
+}
+
+/*****************************************************************************/
+/* reads bytes of filtered data, compressed if there's enough of it */
+static int
+tight_read_data(struct vnc_decoder *d, vnc_decoder_read_fn read,
+                void *handle, int stream_id, int bytes, const tui8 **data)
+{
+    int length;
+    int error;
+
+    if (bytes < TIGHT_MIN_TO_COMPRESS)
+    {
+        error = read(handle, d->in_s, bytes);
+        d->stats.bytes_in += bytes;
+        *data = (const tui8 *) d->in_s->data;
+        return error;
+    }
+    error = tight_read_length(d, read, handle, &length);
+    if (error != 0)
+    {
+        return error;
+    }
+    if (length > VNC_DECODE_MAX_IN)
+    {
+        LOG(LOG_LEVEL_ERROR, "vnc_decode_tight: bad length %d", length);
+        return 1;
+    }
+    error = read(handle, d->in_s, length);
+    if (error != 0)
+    {
+        return error;
+    }
+    d->stats.bytes_in += length;
+    if (decoder_inflate_init(&d->tight_zs[stream_id],
+                             &d->tight_zs_init[stream_id]) != 0 ||
+            decoder_inflate(d, &d->tight_zs[stream_id], d->in_s->data,
+                            length, bytes) != bytes)
+    {
+        LOG(LOG_LEVEL_ERROR, "vnc_decode_tight: stream %d didn't inflate "
+            "to %d bytes", stream_id, bytes);
+        return 1;
+    }
+    *data = (const tui8 *) d->inflated;
+    return 0;
+}
+
+/*****************************************************************************/
+/* undoes the gradient filter. Each component was sent as the difference
+   from left + above - above left */
+static int
+tight_gradient(struct vnc_decoder *d, const tui8 *src, int cx, int cy)
+{
+    char *dst;
+    int *rows;
+    int *prev_row;
+    int *this_row;
+    int *tmp;
+    int est;
+    int left;
+    int above_left;
+    int c;
+    int x;
+    int y;
+    tui32 pixel;
+
+    /* the row above the first is zeros */
+    rows = g_new0(int, cx * 3 * 2);
+    if (rows == NULL)
+    {
+        return 1;
+    }
+    prev_row = rows;
+    this_row = rows + cx * 3;
+    dst = d->pixels;
+    for (y = 0; y < cy; y++)
+    {
+        for (x = 0; x < cx; x++)
+        {
+            pixel = get_tpixel(d, src);
+            src += d->tpixel_bytes;
+            for (c = 0; c < 3; c++)
+            {
+                left = (x > 0) ? this_row[(x - 1) * 3 + c] : 0;
+                above_left = (x > 0) ? prev_row[(x - 1) * 3 + c] : 0;
+                est = prev_row[x * 3 + c] + left - above_left;
+                est = MAX(0, MIN(est, d->max[c]));
+                this_row[x * 3 + c] =
+                    (((pixel >> d->shift[c]) & d->max[c]) + est) & d->max[c];
+            }
+            put_pixel(d, dst, (this_row[x * 3] << d->shift[0]) |
+                      (this_row[x * 3 + 1] << d->shift[1]) |
+                      (this_row[x * 3 + 2] << d->shift[2]));
+            dst += d->Bpp;
+        }
+        tmp = prev_row;
+        prev_row = this_row;
+        this_row = tmp;
+    }
+    g_free(rows);
+    return 0;
+}
+
+/*****************************************************************************/
+static int
+tight_basic(struct vnc_decoder *d, vnc_decoder_read_fn read, void *handle,
+            int cx, int cy, int ctl)
+{
+    tui32 palette[256];
+    const tui8 *src;
+    char *dst;
+    int stream_id;
+    int filter;
+    int colours;
+    int row_bytes;
+    int index;
+    int x;
+    int y;
+    int error;
+
+    stream_id = ctl & 3;
+    filter = TIGHT_FILTER_COPY;
+    if (ctl & TIGHT_EXPLICIT_FILTER)
+    {
+        error = read(handle, d->in_s, 1);
+        if (error != 0)
+        {
+            return error;
+        }
+        in_uint8(d->in_s, filter);
+        d->stats.bytes_in++;
+    }
+    dst = d->pixels;
+    switch (filter)
+    {
+        case TIGHT_FILTER_COPY:
+            error = tight_read_data(d, read, handle, stream_id,
+                                    cx * cy * d->tpixel_bytes, &src);
+            if (error != 0)
+            {
+                return error;
+            }
+            for (index = cx * cy; index > 0; index--)
+            {
+                put_pixel(d, dst, get_tpixel(d, src));
+                src += d->tpixel_bytes;
+                dst += d->Bpp;
+            }
+            break;
+
+        case TIGHT_FILTER_PALETTE:
+            error = read(handle, d->in_s, 1);
+            if (error != 0)
+            {
+                return error;
+            }
+            in_uint8(d->in_s, colours);
+            colours++;
+            error = read(handle, d->in_s, colours * d->tpixel_bytes);
+            if (error != 0)
+            {
+                return error;
+            }
+            d->stats.bytes_in += 1 + colours * d->tpixel_bytes;
+            g_memset(palette, 0, sizeof(palette));
+            for (index = 0; index < colours; index++)
+            {
+                palette[index] = get_tpixel(d, (const tui8 *) d->in_s->data +
+                                            index * d->tpixel_bytes);
+            }
+            /* two colours are a bitmap, rows padded to a byte */
+            row_bytes = (colours == 2) ? (cx + 7) / 8 : cx;
+            error = tight_read_data(d, read, handle, stream_id,
+                                    row_bytes * cy, &src);
+            if (error != 0)
+            {
+                return error;
+            }
+            for (y = 0; y < cy; y++)
+            {
+                for (x = 0; x < cx; x++)
+                {
+                    if (colours == 2)
+                    {
+                        index = (src[x / 8] >> (7 - (x % 8))) & 1;
+                    }
+                    else
+                    {
+                        index = src[x];
+                    }
+                    put_pixel(d, dst, palette[index]);
+                    dst += d->Bpp;
+                }
+                src += row_bytes;
+            }
+            break;
+
+        case TIGHT_FILTER_GRADIENT:
+            if (!d->true_colour)
+            {
+                LOG(LOG_LEVEL_ERROR, "vnc_decode_tight: gradient filter "
+                    "needs true colour");
+                return 1;
+            }
+            error = tight_read_data(d, read, handle, stream_id,
+                                    cx * cy * d->tpixel_bytes, &src);
+            if (error != 0)
+            {
+                return error;
+            }
+            return tight_gradient(d, src, cx, cy);
+
+        default:
+            LOG(LOG_LEVEL_ERROR, "vnc_decode_tight: unknown filter %d",
+                filter);
+            return 1;
+    }
+    return 0;
+}
+
+#if defined(XRDP_JPEG)
+/* libjpeg's default error handler exits the process */
+struct tight_jpeg_error
+{
+    struct jpeg_error_mgr pub;
+    jmp_buf jmp;
+};
+
+/*****************************************************************************/
+static void
+tight_jpeg_error_exit(j_common_ptr cinfo)
+{
+    char msg[JMSG_LENGTH_MAX];
+
+    cinfo->err->format_message(cinfo, msg);
+    LOG(LOG_LEVEL_ERROR, "vnc_decode_tight: JPEG error: %s", msg);
+    longjmp(((struct tight_jpeg_error *) cinfo->err)->jmp, 1);
+}
+
+/*****************************************************************************/
+static void
+tight_jpeg_output_message(j_common_ptr cinfo)
+{
+}
+
+/*****************************************************************************/
+static void
+tight_jpeg_init_source(j_decompress_ptr cinfo)
+{
+}
+
+/*****************************************************************************/
+/* all the data is in the buffer already, anything more is an error which
+   an end of image marker lets libjpeg report */
+static boolean
+tight_jpeg_fill_input_buffer(j_decompress_ptr cinfo)
+{
+    static const JOCTET eoi[2] = { 0xff, JPEG_EOI };
+
+    cinfo->src->next_input_byte = eoi;
+    cinfo->src->bytes_in_buffer = 2;
+    return TRUE;
+}
+
+/*****************************************************************************/
+static void
+tight_jpeg_skip_input_data(j_decompress_ptr cinfo, long num_bytes)
+{
+    if (num_bytes > (long) cinfo->src->bytes_in_buffer)
+    {
+        tight_jpeg_fill_input_buffer(cinfo);
+    }
+    else if (num_bytes > 0)
+    {
+        cinfo->src->next_input_byte += num_bytes;
+        cinfo->src->bytes_in_buffer -= num_bytes;
+    }
+}
+
+/*****************************************************************************/
+static void
+tight_jpeg_term_source(j_decompress_ptr cinfo)
+{
+}
+
+/*****************************************************************************/
+static tui32
+rgb_to_pixel(const struct vnc_decoder *d, int r, int g, int b)
+{
+    return ((r >> d->loss[0]) << d->shift[0]) |
+           ((g >> d->loss[1]) << d->shift[1]) |
+           ((b >> d->loss[2]) << d->shift[2]);
+}
+
+/*****************************************************************************/
+static int
+tight_jpeg_decode(struct vnc_decoder *d, const tui8 *data, int bytes,
+                  int cx, int cy)
+{
+    struct jpeg_decompress_struct cinfo;
+    struct tight_jpeg_error jerr;
+    struct jpeg_source_mgr src_mgr;
+    JSAMPROW row_pointer[1];
+    const tui8 *rgb;
+    char *dst;
+    int x;
+
+    if (cx * 3 > d->row_size)
+    {
+        g_free(d->row);
+        d->row = (tui8 *) g_malloc(cx * 3, 0);
+        d->row_size = (d->row == NULL) ? 0 : cx * 3;
+        if (d->row == NULL)
+        {
+            return 1;
+        }
+    }
+    g_memset(&cinfo, 0, sizeof(cinfo));
+    cinfo.err = jpeg_std_error(&jerr.pub);
+    jerr.pub.error_exit = tight_jpeg_error_exit;
+    jerr.pub.output_message = tight_jpeg_output_message;
+    if (setjmp(jerr.jmp))
+    {
+        jpeg_destroy_decompress(&cinfo);
+        return 1;
+    }
+    jpeg_create_decompress(&cinfo);
+    g_memset(&src_mgr, 0, sizeof(src_mgr));
+    src_mgr.init_source = tight_jpeg_init_source;
+    src_mgr.fill_input_buffer = tight_jpeg_fill_input_buffer;
+    src_mgr.skip_input_data = tight_jpeg_skip_input_data;
+    src_mgr.resync_to_restart = jpeg_resync_to_restart;
+    src_mgr.term_source = tight_jpeg_term_source;
+    src_mgr.next_input_byte = data;
+    src_mgr.bytes_in_buffer = bytes;
+    cinfo.src = &src_mgr;
+    jpeg_read_header(&cinfo, TRUE);
+    cinfo.out_color_space = JCS_RGB;
+    jpeg_start_decompress(&cinfo);
+    if ((int) cinfo.output_width != cx || (int) cinfo.output_height != cy ||
+            cinfo.output_components != 3)
+    {
+        LOG(LOG_LEVEL_ERROR, "vnc_decode_tight: JPEG is %dx%d, expected "
+            "%dx%d", cinfo.output_width, cinfo.output_height, cx, cy);
+        jpeg_destroy_decompress(&cinfo);
+        return 1;
+    }
+    dst = d->pixels;
+    row_pointer[0] = d->row;
+    while (cinfo.output_scanline < cinfo.output_height)
+    {
+        jpeg_read_scanlines(&cinfo, row_pointer, 1);
+        rgb = d->row;
+        for (x = 0; x < cx; x++)
+        {
+            put_pixel(d, dst, rgb_to_pixel(d, rgb[0], rgb[1], rgb[2]));
+            rgb += 3;
+            dst += d->Bpp;
+        }
+    }
+    jpeg_finish_decompress(&cinfo);
+    jpeg_destroy_decompress(&cinfo);
+    return 0;
+}
+#endif
+
+/*****************************************************************************/
+static int
+tight_jpeg(struct vnc_decoder *d, vnc_decoder_read_fn read, void *handle,
+           int cx, int cy)
+{
+#if defined(XRDP_JPEG)
+    int length;
+    int error;
+
+    if (!d->true_colour)
+    {
+        LOG(LOG_LEVEL_ERROR, "vnc_decode_tight: JPEG needs true colour");
+        return 1;
+    }
+    error = tight_read_length(d, read, handle, &length);
+    if (error != 0)
+    {
+        return error;
+    }
+    if (length > VNC_DECODE_MAX_IN)
+    {
+        LOG(LOG_LEVEL_ERROR, "vnc_decode_tight: bad length %d", length);
+        return 1;
+    }
+    error = read(handle, d->in_s, length);
+    if (error != 0)
+    {
+        return error;
+    }
+    d->stats.bytes_in += length;
+    d->stats.tight_jpeg_rects++;
+    return tight_jpeg_decode(d, (const tui8 *) d->in_s->data, length, cx, cy);
+#else
+    /* we don't send a quality level, so the server shouldn't do this */
+    LOG(LOG_LEVEL_ERROR, "vnc_decode_tight: JPEG not supported");
+    return 1;
+#endif
+}
+
+/*****************************************************************************/
+int
+vnc_decode_tight(struct vnc_decoder *d, vnc_decoder_read_fn read,
+                 void *handle, int cx, int cy, char **data)
+{
+    int ctl;
+    int index;
+    int error;
+
+    if (pixels_alloc(d, cx, cy) != 0)
+    {
+        return 1;
+    }
+    error = read(handle, d->in_s, 1);
+    if (error != 0)
+    {
+        return error;
+    }
+    in_uint8(d->in_s, ctl);
+    d->stats.bytes_in++;
+
+    /* low bits ask for zlib streams to be reset */
+    for (index = 0; index < TIGHT_STREAMS; index++)
+    {
+        if ((ctl & (1 << index)) && d->tight_zs_init[index])
+        {
+            inflateReset(&d->tight_zs[index]);
+        }
+    }
+    ctl >>= 4;
+    if (ctl == TIGHT_FILL)
+    {
+        error = read(handle, d->in_s, d->tpixel_bytes);
+        if (error != 0)
+        {
+            return error;
+        }
+        d->stats.bytes_in += d->tpixel_bytes;
+        fill_pixels(d, d->pixels, cx * d->Bpp, cx, cy,
+                    get_tpixel(d, (const tui8 *) d->in_s->data));
+    }
+    else if (ctl == TIGHT_JPEG)
+    {
+        error = tight_jpeg(d, read, handle, cx, cy);
+    }
+    else if (ctl & 0x08)
+    {
+        LOG(LOG_LEVEL_ERROR, "vnc_decode_tight: compression type %d not "
+            "supported", ctl);
+        error = 1;
+    }
+    else
+    {
+        error = tight_basic(d, read, handle, cx, cy, ctl);
+    }
+    if (error != 0)
+    {
+        return error;
+    }
+    d->stats.tight_rects++;
+    d->stats.pixels_out += (long long) cx * cy;
+    *data = d->pixels;
+    return 0;
+}
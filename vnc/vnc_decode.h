@@ -0,0 +1,100 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * libvnc - decoders for the ZRLE and Tight encodings
+ */
+
+#ifndef VNC_DECODE_H
+#define VNC_DECODE_H
+
+struct stream;
+struct vnc_decoder;
+
+/**
+ * Reads exactly 'bytes' from the server into s, replacing its contents
+ *
+ * @return != 0 for error
+ */
+typedef int (*vnc_decoder_read_fn)(void *handle, struct stream *s,
+                                   int bytes);
+
+/**
+ * Counters kept by a decoder over a connection
+ */
+struct vnc_decoder_stats
+{
+    int zrle_rects;
+    int tight_rects;
+    int tight_jpeg_rects;
+    long long bytes_in;     /* encoded bytes read from the server */
+    long long pixels_out;   /* pixels decoded */
+};
+
+/**
+ * Creates a decoder for the pixel format libvnc asks the server for
+ *
+ * The zlib streams in the decoder live as long as the RFB connection
+ *
+ * @param bpp server_bpp of the connection (8, 15, 16, 24 or 32)
+ * @return decoder, or NULL on error
+ */
+struct vnc_decoder *
+vnc_decoder_create(int bpp);
+
+/**
+ * Frees a decoder and its zlib streams
+ */
+void
+vnc_decoder_delete(struct vnc_decoder *d);
+
+/**
+ * Returns non-zero if the decoder can handle Tight JPEG rectangles
+ */
+int
+vnc_decoder_jpeg_supported(void);
+
+/**
+ * Reads and decodes a ZRLE rectangle
+ *
+ * @param d Decoder
+ * @param read Function to read from the server
+ * @param handle Passed to read
+ * @param cx Rectangle width
+ * @param cy Rectangle height
+ * @param [out] data cx * cy pixels, owned by the decoder
+ * @return != 0 for error
+ *
+ * @pre On entry the input is positioned after the rectangle header
+ */
+int
+vnc_decode_zrle(struct vnc_decoder *d, vnc_decoder_read_fn read,
+                void *handle, int cx, int cy, char **data);
+
+/**
+ * Reads and decodes a Tight rectangle
+ *
+ * Parameters are as for vnc_decode_zrle()
+ */
+int
+vnc_decode_tight(struct vnc_decoder *d, vnc_decoder_read_fn read,
+                 void *handle, int cx, int cy, char **data);
+
+/**
+ * Returns the counters of a decoder
+ */
+const struct vnc_decoder_stats *
+vnc_decoder_get_stats(const struct vnc_decoder *d);
+
+#endif /* VNC_DECODE_H */
@@ -0,0 +1,127 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * libvnc - areas of the framebuffer waiting to be painted
+ */
+
+#if defined(HAVE_CONFIG_H)
+#include <config_ac.h>
+#endif
+
+#include "arch.h"
+#include "defines.h"
+#include "vnc_dirty.h"
+
+/*****************************************************************************/
+static void
+dirty_union(struct vnc_dirty_rect *a, const struct vnc_dirty_rect *b)
+{
+    int right;
+    int bottom;
+
+    right = MAX(a->x + a->cx, b->x + b->cx);
+    bottom = MAX(a->y + a->cy, b->y + b->cy);
+    a->x = MIN(a->x, b->x);
+    a->y = MIN(a->y, b->y);
+    a->cx = right - a->x;
+    a->cy = bottom - a->y;
+}
+
+/*****************************************************************************/
+/* pixels in the union of a and b which are in neither */
+static long long
+dirty_merge_waste(const struct vnc_dirty_rect *a,
+                  const struct vnc_dirty_rect *b)
+{
+    struct vnc_dirty_rect u;
+    long long overlap;
+    int cx;
+    int cy;
+
+    u = *a;
+    dirty_union(&u, b);
+    cx = MIN(a->x + a->cx, b->x + b->cx) - MAX(a->x, b->x);
+    cy = MIN(a->y + a->cy, b->y + b->cy) - MAX(a->y, b->y);
+    overlap = (cx > 0 && cy > 0) ? (long long) cx * cy : 0;
+    return (long long) u.cx * u.cy -
+           ((long long) a->cx * a->cy + (long long) b->cx * b->cy - overlap);
+}
+
+/*****************************************************************************/
+void
+vnc_dirty_add(struct vnc_dirty *d, int x, int y, int cx, int cy)
+{
+    struct vnc_dirty_rect r;
+    long long waste;
+    long long best_waste;
+    int best;
+    int index;
+
+    if (cx <= 0 || cy <= 0)
+    {
+        return;
+    }
+    r.x = x;
+    r.y = y;
+    r.cx = cx;
+    r.cy = cy;
+    for (;;)
+    {
+        /* a merged rectangle may now merge with others */
+        index = 0;
+        while (index < d->count)
+        {
+            if (dirty_merge_waste(d->rects + index, &r) <=
+                    VNC_DIRTY_MERGE_WASTE)
+            {
+                dirty_union(&r, d->rects + index);
+                d->count--;
+                d->rects[index] = d->rects[d->count];
+                index = 0;
+            }
+            else
+            {
+                index++;
+            }
+        }
+        if (d->count < VNC_DIRTY_MAX_RECTS)
+        {
+            break;
+        }
+        best = 0;
+        best_waste = dirty_merge_waste(d->rects, &r);
+        for (index = 1; index < d->count; index++)
+        {
+            waste = dirty_merge_waste(d->rects + index, &r);
+            if (waste < best_waste)
+            {
+                best = index;
+                best_waste = waste;
+            }
+        }
+        dirty_union(&r, d->rects + best);
+        d->count--;
+        d->rects[best] = d->rects[d->count];
+    }
+    d->rects[d->count] = r;
+    d->count++;
+}
+
+/*****************************************************************************/
+void
+vnc_dirty_clear(struct vnc_dirty *d)
+{
+    d->count = 0;
+}
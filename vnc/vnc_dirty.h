@@ -0,0 +1,57 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * libvnc - areas of the framebuffer waiting to be painted
+ */
+
+#ifndef VNC_DIRTY_H
+#define VNC_DIRTY_H
+
+#define VNC_DIRTY_MAX_RECTS 32
+
+/* pixels a merge may add which weren't dirty */
+#define VNC_DIRTY_MERGE_WASTE (64 * 64)
+
+struct vnc_dirty_rect
+{
+    int x;
+    int y;
+    int cx;
+    int cy;
+};
+
+struct vnc_dirty
+{
+    int count;
+    struct vnc_dirty_rect rects[VNC_DIRTY_MAX_RECTS];
+};
+
+/**
+ * Adds a rectangle to a dirty list
+ *
+ * Rectangles which overlap or nearly touch one already in the list are
+ * merged with it. When the list is full the rectangle is merged with
+ * whichever one wastes least.
+ */
+void
+vnc_dirty_add(struct vnc_dirty *d, int x, int y, int cx, int cy);
+
+/**
+ * Empties a dirty list
+ */
+void
+vnc_dirty_clear(struct vnc_dirty *d);
+
+#endif /* VNC_DIRTY_H */
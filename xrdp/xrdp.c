@@ -482,6 +482,7 @@ main(int argc, char **argv)
             g_exit(0);
         }
 
+        log_after_fork();
         g_sleep(1000);
         /* write the pid to file */
         pid = g_getpid();
@@ -18,6 +18,9 @@
  * main include file
  */
 
+#ifndef _XRDP_XRDP_H
+#define _XRDP_XRDP_H
+
 /* include other h files */
 #include "arch.h"
 #include "parse.h"
@@ -103,6 +106,48 @@ xrdp_cache_remove_os_bitmap(struct xrdp_cache *self, int rdpindex);
 struct xrdp_os_bitmap_item *
 xrdp_cache_get_os_bitmap(struct xrdp_cache *self, int rdpindex);
 
+/* xrdp_cache_index.c */
+struct xrdp_cache_index *
+xrdp_cache_index_create(int entries);
+void
+xrdp_cache_index_delete(struct xrdp_cache_index *self);
+/* returns the cache index for key, or -1 */
+int
+xrdp_cache_index_find(struct xrdp_cache_index *self, tui64 key);
+/* makes cache_idx the most recently used */
+void
+xrdp_cache_index_touch(struct xrdp_cache_index *self, int cache_idx);
+/* reuses the least recently used entry for key, returns its cache index */
+int
+xrdp_cache_index_add(struct xrdp_cache_index *self, tui64 key);
+/* puts key at cache_idx, returns non zero if key is already there */
+int
+xrdp_cache_index_set(struct xrdp_cache_index *self, int cache_idx,
+                     tui64 key);
+
+/* xrdp_chan_sched.c */
+struct xrdp_chan_sched *
+xrdp_chan_sched_create(struct source_info *si, void *handle,
+                       int (*send)(void *handle, int chan_id, char *data,
+                                   int bytes, int total_bytes, int flags),
+                       int (*get_backlog)(void *handle));
+void
+xrdp_chan_sched_delete(struct xrdp_chan_sched *self);
+/* names a channel, which picks its class */
+void
+xrdp_chan_sched_add_channel(struct xrdp_chan_sched *self, int chan_id,
+                            const char *name);
+/* copies a fragment in, returns non zero on error */
+int
+xrdp_chan_sched_queue(struct xrdp_chan_sched *self, int chan_id, int flags,
+                      int total_bytes, const char *data, int bytes);
+/* sends what the client link has room for, returns non zero on error */
+int
+xrdp_chan_sched_send(struct xrdp_chan_sched *self);
+/* returns NULL if chan_id is out of range */
+const struct xrdp_chan_sched_stats *
+xrdp_chan_sched_get_stats(struct xrdp_chan_sched *self, int chan_id);
+
 /* xrdp_wm.c */
 struct xrdp_wm *
 xrdp_wm_create(struct xrdp_process *owner,
@@ -595,3 +640,4 @@ server_add_char_alpha(struct xrdp_mod *mod, int font, int character,
 int
 server_session_info(struct xrdp_mod *mod, const char *data, int data_bytes);
 
+#endif
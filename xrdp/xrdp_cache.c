@@ -25,59 +25,98 @@
 #include "xrdp.h"
 #include "log.h"
 
-
+/* persistent cache key of a bitmap, the crc and its size */
+#define XRDP_CACHE_KEY(_b) \
+    (((tui64) ((_b)->width & 0xfff) | \
+      ((tui64) ((_b)->height & 0xfff) << 12) | \
+      ((tui64) ((_b)->bpp & 0xff) << 24)) << 32 | (tui32) ((_b)->crc32))
 
 /*****************************************************************************/
 static int
-xrdp_cache_reset_lru(struct xrdp_cache *self)
+xrdp_cache_get_entries(struct xrdp_cache *self, int cache_id)
 {
-    int index;
-    int jndex;
-    struct xrdp_lru_item *lru;
-
-    for (index = 0; index < XRDP_MAX_BITMAP_CACHE_ID; index++)
+    switch (cache_id)
     {
-        /* fist item */
-        lru = &(self->bitmap_lrus[index][0]);
-        lru->next = 1;
-        lru->prev = -1;
-        /* middle items */
-        for (jndex = 1; jndex < XRDP_MAX_BITMAP_CACHE_IDX - 1; jndex++)
-        {
-            lru = &(self->bitmap_lrus[index][jndex]);
-            lru->next = jndex + 1;
-            lru->prev = jndex - 1;
-        }
-        /* last item */
-        lru = &(self->bitmap_lrus[index][XRDP_MAX_BITMAP_CACHE_IDX - 1]);
-        lru->next = -1;
-        lru->prev = XRDP_MAX_BITMAP_CACHE_IDX - 2;
+        case 0:
+            return self->cache1_entries;
+        case 1:
+            return self->cache2_entries;
+        case 2:
+            return self->cache3_entries;
+    }
+    return 0;
+}
 
-        self->lru_head[index] = 0;
-        self->lru_tail[index] = XRDP_MAX_BITMAP_CACHE_IDX - 1;
+/*****************************************************************************/
+static void
+xrdp_cache_create_index(struct xrdp_cache *self)
+{
+    int cache_id;
 
-        self->lru_reset[index] = 1;
+    for (cache_id = 0; cache_id < XRDP_MAX_BITMAP_CACHE_ID; cache_id++)
+    {
+        self->bitmap_index[cache_id] =
+            xrdp_cache_index_create(xrdp_cache_get_entries(self, cache_id));
     }
-    return 0;
 }
 
 /*****************************************************************************/
+/* persistent caching needs bitmap cache v2 and the client to ask for it */
 static int
-xrdp_cache_reset_crc(struct xrdp_cache *self)
+xrdp_cache_persist_enabled(struct xrdp_client_info *client_info)
 {
-    int index;
-    int jndex;
+    return client_info->use_bitmap_cache_persist &&
+           (client_info->bitmap_cache_version & 2) &&
+           (client_info->bitmap_cache_persist_enable &
+            PERSISTENT_KEYS_EXPECTED_FLAG);
+}
+
+/*****************************************************************************/
+/* the client loaded these bitmaps from its persistent cache into the first
+   entries of each cache before the session started, enter them as if they
+   had been sent so matching bitmaps are not sent again */
+static void
+xrdp_cache_seed_persistent(struct xrdp_cache *self)
+{
+    const unsigned int *keys;
+    tui64 key;
+    int cache_id;
+    int cache_idx;
+    int count;
+    int seeded;
 
-    for (index = 0; index < XRDP_MAX_BITMAP_CACHE_ID; index++)
+    for (cache_id = 0; cache_id < XRDP_MAX_BITMAP_CACHE_ID; cache_id++)
     {
-        for (jndex = 0; jndex < 64 * 1024; jndex++)
+        if (self->bitmap_index[cache_id] == NULL)
         {
-            /* it's ok to deinit a zeroed out struct list16 */
-            list16_deinit(&(self->crc16[index][jndex]));
-            list16_init(&(self->crc16[index][jndex]));
+            continue;
+        }
+        count = libxrdp_get_persistent_keys(self->session, cache_id, &keys);
+        count = MIN(count, xrdp_cache_get_entries(self, cache_id));
+        seeded = 0;
+        for (cache_idx = 0; cache_idx < count; cache_idx++)
+        {
+            if (keys[cache_idx * 2 + 1] == 0)
+            {
+                /* not one of ours */
+                continue;
+            }
+            key = ((tui64) keys[cache_idx * 2 + 1] << 32) | keys[cache_idx * 2];
+            if (xrdp_cache_index_set(self->bitmap_index[cache_id],
+                                     cache_idx, key) == 0)
+            {
+                self->bitmap_items[cache_id][cache_idx].stamp =
+                    self->bitmap_stamp;
+                seeded++;
+            }
+        }
+        if (count > 0)
+        {
+            LOG(LOG_LEVEL_INFO, "xrdp_cache_seed_persistent: cache %d, %d of "
+                "%d entries from the client's persistent cache", cache_id,
+                seeded, count);
         }
     }
-    return 0;
 }
 
 /*****************************************************************************/
@@ -108,12 +147,15 @@ xrdp_cache_create(struct xrdp_wm *owner,
     self->cache3_entries = MAX(self->cache3_entries, 0);
     self->cache3_size = client_info->cache3_size;
 
-    self->bitmap_cache_persist_enable = client_info->bitmap_cache_persist_enable;
+    self->bitmap_cache_persist_enable = xrdp_cache_persist_enabled(client_info);
     self->bitmap_cache_version = client_info->bitmap_cache_version;
     self->pointer_cache_entries = client_info->pointer_cache_entries;
     self->xrdp_os_del_list = list_create();
-    xrdp_cache_reset_lru(self);
-    xrdp_cache_reset_crc(self);
+    xrdp_cache_create_index(self);
+    if (self->bitmap_cache_persist_enable)
+    {
+        xrdp_cache_seed_persistent(self);
+    }
     LOG_DEVEL(LOG_LEVEL_DEBUG, "xrdp_cache_create: 0 %d 1 %d 2 %d",
               self->cache1_entries, self->cache2_entries, self->cache3_entries);
     return self;
@@ -157,13 +199,9 @@ clear_all_cached_items(struct xrdp_cache *self)
 
     list_delete(self->xrdp_os_del_list);
 
-    /* free all crc lists */
     for (i = 0; i < XRDP_MAX_BITMAP_CACHE_ID; i++)
     {
-        for (j = 0; j < 64 * 1024; j++)
-        {
-            list16_deinit(&(self->crc16[i][j]));
-        }
+        xrdp_cache_index_delete(self->bitmap_index[i]);
     }
 }
 
@@ -200,86 +238,12 @@ xrdp_cache_reset(struct xrdp_cache *self,
     self->cache2_size = client_info->cache2_size;
     self->cache3_entries = client_info->cache3_entries;
     self->cache3_size = client_info->cache3_size;
-    self->bitmap_cache_persist_enable = client_info->bitmap_cache_persist_enable;
+    /* the client's persistent list is only sent once, so nothing is
+       seeded here */
+    self->bitmap_cache_persist_enable = xrdp_cache_persist_enabled(client_info);
     self->bitmap_cache_version = client_info->bitmap_cache_version;
     self->pointer_cache_entries = client_info->pointer_cache_entries;
-    xrdp_cache_reset_lru(self);
-    xrdp_cache_reset_crc(self);
-    return 0;
-}
-
-#define COMPARE_WITH_CRC32(_b1, _b2) \
-    ((_b1->crc32 == _b2->crc32) && \
-     (_b1->bpp == _b2->bpp) && \
-     (_b1->width == _b2->width) && (_b1->height == _b2->height))
-
-/*****************************************************************************/
-static int
-xrdp_cache_update_lru(struct xrdp_cache *self, int cache_id, int lru_index)
-{
-    int tail_index;
-    struct xrdp_lru_item *nextlru;
-    struct xrdp_lru_item *prevlru;
-    struct xrdp_lru_item *thislru;
-    struct xrdp_lru_item *taillru;
-
-    LOG_DEVEL(LOG_LEVEL_DEBUG, "xrdp_cache_update_lru: lru_index %d", lru_index);
-    if ((lru_index < 0) || (lru_index >= XRDP_MAX_BITMAP_CACHE_IDX))
-    {
-        LOG(LOG_LEVEL_ERROR, "xrdp_cache_update_lru: error");
-        return 1;
-    }
-    if (self->lru_tail[cache_id] == lru_index)
-    {
-        /* nothing to do */
-        return 0;
-    }
-    else if (self->lru_head[cache_id] == lru_index)
-    {
-        /* moving head item to tail */
-
-        thislru = &(self->bitmap_lrus[cache_id][lru_index]);
-        nextlru = &(self->bitmap_lrus[cache_id][thislru->next]);
-        tail_index = self->lru_tail[cache_id];
-        taillru = &(self->bitmap_lrus[cache_id][tail_index]);
-
-        /* unhook old */
-        nextlru->prev = -1;
-
-        /* set head to next */
-        self->lru_head[cache_id] = thislru->next;
-
-        /* move to tail and hook up */
-        taillru->next = lru_index;
-        thislru->prev = tail_index;
-        thislru->next = -1;
-
-        /* update tail */
-        self->lru_tail[cache_id] = lru_index;
-
-    }
-    else
-    {
-        /* move middle item */
-
-        thislru = &(self->bitmap_lrus[cache_id][lru_index]);
-        prevlru = &(self->bitmap_lrus[cache_id][thislru->prev]);
-        nextlru = &(self->bitmap_lrus[cache_id][thislru->next]);
-        tail_index = self->lru_tail[cache_id];
-        taillru = &(self->bitmap_lrus[cache_id][tail_index]);
-
-        /* unhook old */
-        prevlru->next = thislru->next;
-        nextlru->prev = thislru->prev;
-
-        /* move to tail and hook up */
-        taillru->next = lru_index;
-        thislru->prev = tail_index;
-        thislru->next = -1;
-
-        /* update tail */
-        self->lru_tail[cache_id] = lru_index;
-    }
+    xrdp_cache_create_index(self);
     return 0;
 }
 
@@ -289,30 +253,23 @@ int
 xrdp_cache_add_bitmap(struct xrdp_cache *self, struct xrdp_bitmap *bitmap,
                       int hints)
 {
-    int index;
-    int jndex;
     int cache_id;
     int cache_idx;
     int bmp_size;
     int e;
     int Bpp;
-    int crc16;
-    int iig;
-    int found;
-    int cache_entries;
-    int lru_index;
-    struct list16 *ll;
-    struct xrdp_bitmap *lbm;
-    struct xrdp_lru_item *llru;
+    int key1;
+    int key2;
+    tui64 key;
+    struct xrdp_cache_index *index;
+    struct xrdp_bitmap_item *item;
 
     LOG_DEVEL(LOG_LEVEL_DEBUG, "xrdp_cache_add_bitmap:");
-    LOG_DEVEL(LOG_LEVEL_DEBUG, "xrdp_cache_add_bitmap: crc16 0x%4.4x",
-              bitmap->crc16);
+    LOG_DEVEL(LOG_LEVEL_DEBUG, "xrdp_cache_add_bitmap: crc32 0x%8.8x",
+              bitmap->crc32);
 
     e = (4 - (bitmap->width % 4)) & 3;
-    found = 0;
     cache_id = 0;
-    cache_entries = 0;
 
     /* client Bpp, bmp_size */
     Bpp = (bitmap->bpp + 7) / 8;
@@ -322,17 +279,14 @@ xrdp_cache_add_bitmap(struct xrdp_cache *self, struct xrdp_bitmap *bitmap,
     if (bmp_size <= self->cache1_size)
     {
         cache_id = 0;
-        cache_entries = self->cache1_entries;
     }
     else if (bmp_size <= self->cache2_size)
     {
         cache_id = 1;
-        cache_entries = self->cache2_entries;
     }
     else if (bmp_size <= self->cache3_size)
     {
         cache_id = 2;
-        cache_entries = self->cache3_entries;
     }
     else
     {
@@ -340,90 +294,51 @@ xrdp_cache_add_bitmap(struct xrdp_cache *self, struct xrdp_bitmap *bitmap,
             "too big(%d) bpp %d", bmp_size, bitmap->bpp);
         return 0;
     }
-
-    crc16 = bitmap->crc16;
-    ll = &(self->crc16[cache_id][crc16]);
-    for (jndex = 0; jndex < ll->count; jndex++)
+    index = self->bitmap_index[cache_id];
+    if (index == NULL)
     {
-        cache_idx = list16_get_item(ll, jndex);
-        lbm = self->bitmap_items[cache_id][cache_idx].bitmap;
-        if ((lbm != NULL) && COMPARE_WITH_CRC32(lbm, bitmap))
-        {
-            LOG_DEVEL(LOG_LEVEL_DEBUG, "found bitmap at %d %d", cache_idx, jndex);
-            found = 1;
-            break;
-        }
+        LOG(LOG_LEVEL_ERROR, "error in xrdp_cache_add_bitmap, "
+            "client has no cache %d", cache_id);
+        return 0;
     }
-    if (found)
+
+    key = XRDP_CACHE_KEY(bitmap);
+    cache_idx = xrdp_cache_index_find(index, key);
+    if (cache_idx >= 0)
     {
-        lru_index = self->bitmap_items[cache_id][cache_idx].lru_index;
+        LOG_DEVEL(LOG_LEVEL_DEBUG, "found bitmap at %d %d", cache_id, cache_idx);
         self->bitmap_items[cache_id][cache_idx].stamp = self->bitmap_stamp;
         xrdp_bitmap_delete(bitmap);
 
         /* update lru to end */
-        xrdp_cache_update_lru(self, cache_id, lru_index);
+        xrdp_cache_index_touch(index, cache_idx);
 
         return MAKELONG(cache_idx, cache_id);
     }
 
-    /* find lru */
-
-    /* check for reset */
-    if (self->lru_reset[cache_id])
-    {
-        self->lru_reset[cache_id] = 0;
-        LOG_DEVEL(LOG_LEVEL_INFO, "xrdp_cache_add_bitmap: reset detected cache_id %d",
-                  cache_id);
-        self->lru_tail[cache_id] = cache_entries - 1;
-        index = self->lru_tail[cache_id];
-        llru = &(self->bitmap_lrus[cache_id][index]);
-        llru->next = -1;
-    }
-
-    /* lru is item at head */
-    lru_index = self->lru_head[cache_id];
-    cache_idx = lru_index;
-
-    /* update lru to end */
-    xrdp_cache_update_lru(self, cache_id, lru_index);
-
-    LOG_DEVEL(LOG_LEVEL_DEBUG, "xrdp_cache_add_bitmap: oldest %d %d", cache_id, cache_idx);
+    /* reuse the oldest */
+    cache_idx = xrdp_cache_index_add(index, key);
 
     LOG_DEVEL(LOG_LEVEL_DEBUG, "adding bitmap at %d %d old ptr %p new ptr %p",
               cache_id, cache_idx,
               self->bitmap_items[cache_id][cache_idx].bitmap,
               bitmap);
 
-    /* remove old, about to be deleted, from crc16 list */
-    lbm = self->bitmap_items[cache_id][cache_idx].bitmap;
-    if (lbm != 0)
+    /* set, send bitmap and return */
+    item = &(self->bitmap_items[cache_id][cache_idx]);
+    xrdp_bitmap_delete(item->bitmap);
+    item->bitmap = bitmap;
+    item->stamp = self->bitmap_stamp;
+    if (self->bitmap_cache_persist_enable)
     {
-        crc16 = lbm->crc16;
-        ll = &(self->crc16[cache_id][crc16]);
-        iig = list16_index_of(ll, cache_idx);
-        if (iig == -1)
-        {
-            LOG_DEVEL(LOG_LEVEL_INFO, "xrdp_cache_add_bitmap: error removing cache_idx");
-        }
-        LOG_DEVEL(LOG_LEVEL_DEBUG, "xrdp_cache_add_bitmap: removing index %d from crc16 %d",
-                  iig, crc16);
-        list16_remove_item(ll, iig);
-        xrdp_bitmap_delete(lbm);
+        key1 = (int) key;
+        key2 = (int) (key >> 32);
     }
-
-    /* set, send bitmap and return */
-
-    self->bitmap_items[cache_id][cache_idx].bitmap = bitmap;
-    self->bitmap_items[cache_id][cache_idx].stamp = self->bitmap_stamp;
-    self->bitmap_items[cache_id][cache_idx].lru_index = lru_index;
-
-    /* add to crc16 list */
-    crc16 = bitmap->crc16;
-    ll = &(self->crc16[cache_id][crc16]);
-    list16_add_item(ll, cache_idx);
-    if (ll->count > 1)
+    else
     {
-        LOG_DEVEL(LOG_LEVEL_DEBUG, "xrdp_cache_add_bitmap: count %d", ll->count);
+        /* don't send keys */
+        key1 = 0;
+        key2 = 0;
     }
 
     if (self->use_bitmap_comp)
@@ -444,7 +359,7 @@ xrdp_cache_add_bitmap(struct xrdp_cache *self, struct xrdp_bitmap *bitmap,
             libxrdp_orders_send_bitmap2(self->session, bitmap->width,
                                         bitmap->height, bitmap->bpp,
                                         bitmap->data, cache_id, cache_idx,
-                                        hints);
+                                        hints, key1, key2);
         }
         else if (self->bitmap_cache_version & 1)
         {
@@ -459,7 +374,8 @@ xrdp_cache_add_bitmap(struct xrdp_cache *self, struct xrdp_bitmap *bitmap,
         {
             libxrdp_orders_send_raw_bitmap2(self->session, bitmap->width,
                                             bitmap->height, bitmap->bpp,
-                                            bitmap->data, cache_id, cache_idx);
+                                            bitmap->data, cache_id, cache_idx,
+                                            key1, key2);
         }
         else if (self->bitmap_cache_version & 1)
         {
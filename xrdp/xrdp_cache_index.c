@@ -0,0 +1,278 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * bitmap cache index, key to cache index hash table and lru order
+ */
+
+#if defined(HAVE_CONFIG_H)
+#include <config_ac.h>
+#endif
+
+#include "xrdp.h"
+#include "log.h"
+
+#define MIN_SLOTS 16
+
+/*****************************************************************************/
+static tui32
+xrdp_cache_index_hash(tui64 key)
+{
+    /* fibonacci hashing, the top bits are the best mixed */
+    return (tui32) ((key * 0x9E3779B97F4A7C15ULL) >> 32);
+}
+
+/*****************************************************************************/
+/* returns the slot key is in, or -1 */
+static int
+xrdp_cache_index_find_slot(struct xrdp_cache_index *self, tui64 key)
+{
+    struct xrdp_cache_index_slot *slot;
+    tui32 hash;
+    int index;
+
+    hash = xrdp_cache_index_hash(key);
+    index = hash & self->slot_mask;
+    for (;;)
+    {
+        slot = self->slots + index;
+        if (slot->cache_idx < 0)
+        {
+            return -1;
+        }
+        if ((slot->hash == hash) && (self->items[slot->cache_idx].key == key))
+        {
+            return index;
+        }
+        index = (index + 1) & self->slot_mask;
+    }
+}
+
+/*****************************************************************************/
+static void
+xrdp_cache_index_insert_slot(struct xrdp_cache_index *self, tui64 key,
+                             int cache_idx)
+{
+    tui32 hash;
+    int index;
+
+    hash = xrdp_cache_index_hash(key);
+    index = hash & self->slot_mask;
+    while (self->slots[index].cache_idx >= 0)
+    {
+        index = (index + 1) & self->slot_mask;
+    }
+    self->slots[index].hash = hash;
+    self->slots[index].cache_idx = cache_idx;
+    self->items[cache_idx].slot = index;
+}
+
+/*****************************************************************************/
+/* empties a slot, moving back any later entries in the same run that
+   could be there so lookups never need tombstones */
+static void
+xrdp_cache_index_remove_slot(struct xrdp_cache_index *self, int index)
+{
+    int next;
+    int home;
+    int mask;
+
+    mask = self->slot_mask;
+    next = index;
+    for (;;)
+    {
+        self->slots[index].cache_idx = -1;
+        for (;;)
+        {
+            next = (next + 1) & mask;
+            if (self->slots[next].cache_idx < 0)
+            {
+                return;
+            }
+            home = self->slots[next].hash & mask;
+            /* it can move if the hole is between its home and here */
+            if (((next - home) & mask) >= ((next - index) & mask))
+            {
+                break;
+            }
+        }
+        self->slots[index] = self->slots[next];
+        self->items[self->slots[index].cache_idx].slot = index;
+        index = next;
+    }
+}
+
+/*****************************************************************************/
+/* moves cache_idx to the most recently used end of the lru */
+static void
+xrdp_cache_index_lru_move_to_tail(struct xrdp_cache_index *self,
+                                  int cache_idx)
+{
+    struct xrdp_cache_index_item *item;
+
+    if (self->lru_tail == cache_idx)
+    {
+        return;
+    }
+    item = self->items + cache_idx;
+    /* unhook */
+    if (item->prev < 0)
+    {
+        self->lru_head = item->next;
+    }
+    else
+    {
+        self->items[item->prev].next = item->next;
+    }
+    self->items[item->next].prev = item->prev;
+    /* hook up at the tail */
+    item->prev = self->lru_tail;
+    item->next = -1;
+    self->items[self->lru_tail].next = cache_idx;
+    self->lru_tail = cache_idx;
+}
+
+/*****************************************************************************/
+/* replaces whatever key cache_idx had */
+static void
+xrdp_cache_index_replace(struct xrdp_cache_index *self, int cache_idx,
+                         tui64 key)
+{
+    struct xrdp_cache_index_item *item;
+
+    item = self->items + cache_idx;
+    if (item->slot >= 0)
+    {
+        xrdp_cache_index_remove_slot(self, item->slot);
+    }
+    item->key = key;
+    xrdp_cache_index_insert_slot(self, key, cache_idx);
+    xrdp_cache_index_lru_move_to_tail(self, cache_idx);
+}
+
+/*****************************************************************************/
+struct xrdp_cache_index *
+xrdp_cache_index_create(int entries)
+{
+    struct xrdp_cache_index *self;
+    int slots;
+    int index;
+
+    if ((entries < 1) || (entries > XRDP_MAX_BITMAP_CACHE_IDX))
+    {
+        return NULL;
+    }
+    /* kept at most an eighth full so probe runs stay short */
+    slots = MIN_SLOTS;
+    while (slots < entries * 8)
+    {
+        slots *= 2;
+    }
+    self = g_new0(struct xrdp_cache_index, 1);
+    if (self == NULL)
+    {
+        return NULL;
+    }
+    self->items = g_new0(struct xrdp_cache_index_item, entries);
+    self->slots = g_new(struct xrdp_cache_index_slot, slots);
+    if ((self->items == NULL) || (self->slots == NULL))
+    {
+        xrdp_cache_index_delete(self);
+        return NULL;
+    }
+    self->entries = entries;
+    self->slot_mask = slots - 1;
+    for (index = 0; index < slots; index++)
+    {
+        self->slots[index].cache_idx = -1;
+    }
+    /* unused entries in index order */
+    for (index = 0; index < entries; index++)
+    {
+        self->items[index].prev = index - 1;
+        self->items[index].next = index + 1;
+        self->items[index].slot = -1;
+    }
+    self->items[entries - 1].next = -1;
+    self->lru_head = 0;
+    self->lru_tail = entries - 1;
+    return self;
+}
+
+/*****************************************************************************/
+void
+xrdp_cache_index_delete(struct xrdp_cache_index *self)
+{
+    if (self == NULL)
+    {
+        return;
+    }
+    g_free(self->items);
+    g_free(self->slots);
+    g_free(self);
+}
+
+/*****************************************************************************/
+int
+xrdp_cache_index_find(struct xrdp_cache_index *self, tui64 key)
+{
+    int index;
+
+    index = xrdp_cache_index_find_slot(self, key);
+    if (index < 0)
+    {
+        return -1;
+    }
+    return self->slots[index].cache_idx;
+}
+
+/*****************************************************************************/
+void
+xrdp_cache_index_touch(struct xrdp_cache_index *self, int cache_idx)
+{
+    if ((cache_idx >= 0) && (cache_idx < self->entries))
+    {
+        xrdp_cache_index_lru_move_to_tail(self, cache_idx);
+    }
+}
+
+/*****************************************************************************/
+int
+xrdp_cache_index_add(struct xrdp_cache_index *self, tui64 key)
+{
+    int cache_idx;
+
+    cache_idx = self->lru_head;
+    LOG_DEVEL(LOG_LEVEL_DEBUG, "xrdp_cache_index_add: reusing %d", cache_idx);
+    xrdp_cache_index_replace(self, cache_idx, key);
+    return cache_idx;
+}
+
+/*****************************************************************************/
+int
+xrdp_cache_index_set(struct xrdp_cache_index *self, int cache_idx,
+                     tui64 key)
+{
+    if ((cache_idx < 0) || (cache_idx >= self->entries))
+    {
+        return 1;
+    }
+    if (xrdp_cache_index_find_slot(self, key) >= 0)
+    {
+        /* already there, the first one is kept */
+        return 1;
+    }
+    xrdp_cache_index_replace(self, cache_idx, key);
+    return 0;
+}
@@ -0,0 +1,345 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * virtual channel scheduler, weighted sending of chansrv channel data
+ */
+
+#if defined(HAVE_CONFIG_H)
+#include <config_ac.h>
+#endif
+
+#include "xrdp.h"
+#include "log.h"
+#include "string_calls.h"
+#include "ms-rdpbcgr.h"
+
+/* chan_id, flags and total_bytes in front of each queued fragment */
+#define FRAGMENT_HEADER_BYTES 12
+
+/* chansrv data held before chansrv stops being read */
+#define XRDP_CHAN_SCHED_READ_AHEAD (1024 * 1024)
+
+/* bytes a class may send each round, relative weights of the classes */
+static const int g_class_quantum[XRDP_CHAN_CLASS_COUNT] =
+{
+    4 * CHANNEL_CHUNK_LENGTH, /* audio */
+    2 * CHANNEL_CHUNK_LENGTH, /* interactive */
+    1 * CHANNEL_CHUNK_LENGTH  /* bulk */
+};
+
+/* a class only sends while less than this is waiting for the client.
+   Bulk data stays under the encoder's backlog thresholds so graphics
+   isn't stuck behind it */
+static const int g_class_backlog_max[XRDP_CHAN_CLASS_COUNT] =
+{
+    0x7fffffff, /* audio */
+    512 * 1024, /* interactive */
+    16 * 1024   /* bulk */
+};
+
+static const char *g_class_names[XRDP_CHAN_CLASS_COUNT] =
+{
+    "audio", "interactive", "bulk"
+};
+
+/*****************************************************************************/
+static enum xrdp_chan_class
+xrdp_chan_sched_class_from_name(const char *name)
+{
+    if (g_strcasecmp(name, "rdpsnd") == 0)
+    {
+        return XRDP_CHAN_CLASS_AUDIO;
+    }
+    if (g_strncasecmp(name, "rail", 4) == 0)
+    {
+        return XRDP_CHAN_CLASS_INTERACTIVE;
+    }
+    /* cliprdr, rdpdr and anything we don't know */
+    return XRDP_CHAN_CLASS_BULK;
+}
+
+/*****************************************************************************/
+/* makes what's over the read ahead count against chansrv */
+static void
+xrdp_chan_sched_update_charge(struct xrdp_chan_sched *self)
+{
+    int owed;
+
+    owed = self->queued_bytes - XRDP_CHAN_SCHED_READ_AHEAD;
+    if (owed < 0)
+    {
+        owed = 0;
+    }
+    if (self->si != NULL)
+    {
+        self->si->source[XRDP_SOURCE_CHANSRV] += owed - self->charged_bytes;
+    }
+    self->charged_bytes = owed;
+}
+
+/*****************************************************************************/
+struct xrdp_chan_sched *
+xrdp_chan_sched_create(struct source_info *si, void *handle,
+                       int (*send)(void *handle, int chan_id, char *data,
+                                   int bytes, int total_bytes, int flags),
+                       int (*get_backlog)(void *handle))
+{
+    struct xrdp_chan_sched *self;
+    int index;
+
+    self = g_new0(struct xrdp_chan_sched, 1);
+    if (self == NULL)
+    {
+        return NULL;
+    }
+    self->si = si;
+    self->handle = handle;
+    self->send = send;
+    self->get_backlog = get_backlog;
+    for (index = 0; index < XRDP_CHAN_SCHED_MAX_CHANNELS; index++)
+    {
+        self->chans[index].chan_class = XRDP_CHAN_CLASS_BULK;
+    }
+    return self;
+}
+
+/*****************************************************************************/
+void
+xrdp_chan_sched_delete(struct xrdp_chan_sched *self)
+{
+    struct xrdp_chan_sched_stats *stats;
+    struct stream *s;
+    int index;
+
+    if (self == NULL)
+    {
+        return;
+    }
+    for (index = 0; index < XRDP_CHAN_SCHED_MAX_CHANNELS; index++)
+    {
+        stats = self->chans + index;
+        if (stats->fragments > 0)
+        {
+            LOG(LOG_LEVEL_DEBUG, "xrdp_chan_sched_delete: channel %d (%s, "
+                "%s) sent %lld bytes in %d fragments, at most %d queued, "
+                "%d unsent", index, stats->name,
+                g_class_names[stats->chan_class], stats->sent_bytes,
+                stats->fragments, stats->queued_bytes_max,
+                stats->queued_bytes);
+        }
+    }
+    for (index = 0; index < XRDP_CHAN_CLASS_COUNT; index++)
+    {
+        while (self->queues[index].head != NULL)
+        {
+            s = self->queues[index].head;
+            self->queues[index].head = s->next;
+            free_stream(s);
+        }
+    }
+    self->queued_bytes = 0;
+    xrdp_chan_sched_update_charge(self);
+    g_free(self);
+}
+
+/*****************************************************************************/
+void
+xrdp_chan_sched_add_channel(struct xrdp_chan_sched *self, int chan_id,
+                            const char *name)
+{
+    struct xrdp_chan_sched_stats *stats;
+
+    if ((chan_id < 0) || (chan_id >= XRDP_CHAN_SCHED_MAX_CHANNELS))
+    {
+        return;
+    }
+    stats = self->chans + chan_id;
+    g_strncpy(stats->name, name, sizeof(stats->name) - 1);
+    stats->chan_class = xrdp_chan_sched_class_from_name(stats->name);
+    LOG(LOG_LEVEL_DEBUG, "xrdp_chan_sched_add_channel: channel %d (%s) is %s",
+        chan_id, stats->name, g_class_names[stats->chan_class]);
+}
+
+/*****************************************************************************/
+int
+xrdp_chan_sched_queue(struct xrdp_chan_sched *self, int chan_id, int flags,
+                      int total_bytes, const char *data, int bytes)
+{
+    struct xrdp_chan_sched_queue *queue;
+    struct xrdp_chan_sched_stats *stats;
+    struct stream *s;
+    enum xrdp_chan_class chan_class;
+
+    stats = NULL;
+    chan_class = XRDP_CHAN_CLASS_BULK;
+    if ((chan_id >= 0) && (chan_id < XRDP_CHAN_SCHED_MAX_CHANNELS))
+    {
+        stats = self->chans + chan_id;
+        chan_class = stats->chan_class;
+    }
+    make_stream(s);
+    if (s == NULL)
+    {
+        return 1;
+    }
+    init_stream(s, FRAGMENT_HEADER_BYTES + bytes);
+    out_uint32_le(s, chan_id);
+    out_uint32_le(s, flags);
+    out_uint32_le(s, total_bytes);
+    out_uint8a(s, data, bytes);
+    s_mark_end(s);
+    s->p = s->data;
+    s->next = NULL;
+
+    queue = self->queues + chan_class;
+    if (queue->tail == NULL)
+    {
+        queue->head = s;
+    }
+    else
+    {
+        queue->tail->next = s;
+    }
+    queue->tail = s;
+
+    self->queued_bytes += bytes;
+    if (stats != NULL)
+    {
+        stats->queued_bytes += bytes;
+        if (stats->queued_bytes > stats->queued_bytes_max)
+        {
+            stats->queued_bytes_max = stats->queued_bytes;
+        }
+    }
+    xrdp_chan_sched_update_charge(self);
+    return 0;
+}
+
+/*****************************************************************************/
+/* sends the oldest fragment of a class, returns its size or -1 */
+static int
+xrdp_chan_sched_send_head(struct xrdp_chan_sched *self,
+                          struct xrdp_chan_sched_queue *queue)
+{
+    struct xrdp_chan_sched_stats *stats;
+    struct stream *s;
+    int chan_id;
+    int flags;
+    int total_bytes;
+    int bytes;
+    int rv;
+
+    s = queue->head;
+    queue->head = s->next;
+    if (queue->head == NULL)
+    {
+        queue->tail = NULL;
+    }
+    in_uint32_le(s, chan_id);
+    in_uint32_le(s, flags);
+    in_uint32_le(s, total_bytes);
+    bytes = (int) (s->end - s->p);
+    rv = self->send(self->handle, chan_id, s->p, bytes, total_bytes, flags);
+    free_stream(s);
+
+    self->queued_bytes -= bytes;
+    if ((chan_id >= 0) && (chan_id < XRDP_CHAN_SCHED_MAX_CHANNELS))
+    {
+        stats = self->chans + chan_id;
+        stats->queued_bytes -= bytes;
+        stats->sent_bytes += bytes;
+        stats->fragments++;
+    }
+    return (rv == 0) ? bytes : -1;
+}
+
+/*****************************************************************************/
+/* deficit round robin over the classes, most urgent first. A class takes
+   no part while the client backlog is over its limit */
+int
+xrdp_chan_sched_send(struct xrdp_chan_sched *self)
+{
+    struct xrdp_chan_sched_queue *queue;
+    enum xrdp_source cur_source;
+    int index;
+    int progress;
+    int bytes;
+    int rv;
+
+    if (self->queued_bytes == 0)
+    {
+        return 0;
+    }
+    /* what goes out from here is accounted for by the scheduler */
+    cur_source = XRDP_SOURCE_NONE;
+    if (self->si != NULL)
+    {
+        cur_source = self->si->cur_source;
+        self->si->cur_source = XRDP_SOURCE_NONE;
+    }
+    rv = 0;
+    do
+    {
+        progress = 0;
+        for (index = 0; index < XRDP_CHAN_CLASS_COUNT && rv == 0; index++)
+        {
+            queue = self->queues + index;
+            if ((queue->head == NULL) ||
+                    (self->get_backlog(self->handle) >=
+                     g_class_backlog_max[index]))
+            {
+                continue;
+            }
+            queue->deficit += g_class_quantum[index];
+            progress = 1;
+            while ((queue->head != NULL) &&
+                    ((int) (queue->head->end - queue->head->data) -
+                     FRAGMENT_HEADER_BYTES <= queue->deficit) &&
+                    (self->get_backlog(self->handle) <
+                     g_class_backlog_max[index]))
+            {
+                bytes = xrdp_chan_sched_send_head(self, queue);
+                if (bytes < 0)
+                {
+                    rv = 1;
+                    break;
+                }
+                queue->deficit -= bytes;
+            }
+            if (queue->head == NULL)
+            {
+                queue->deficit = 0;
+            }
+        }
+    }
+    while (progress && rv == 0);
+    if (self->si != NULL)
+    {
+        self->si->cur_source = cur_source;
+    }
+    xrdp_chan_sched_update_charge(self);
+    return rv;
+}
+
+/*****************************************************************************/
+const struct xrdp_chan_sched_stats *
+xrdp_chan_sched_get_stats(struct xrdp_chan_sched *self, int chan_id)
+{
+    if ((chan_id < 0) || (chan_id >= XRDP_CHAN_SCHED_MAX_CHANNELS))
+    {
+        return NULL;
+    }
+    return self->chans + chan_id;
+}
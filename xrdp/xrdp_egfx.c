@@ -753,6 +753,23 @@ xrdp_egfx_send_reset_graphics(struct xrdp_egfx *egfx, int width, int height,
     return error;
 }
 
+/******************************************************************************/
+/* returns non zero if a caps set allows AVC420 */
+int
+xrdp_egfx_caps_avc420(int version, int flags)
+{
+    if (version == XR_RDPGFX_CAPVERSION_81)
+    {
+        return (flags & XR_RDPGFX_CAPS_FLAG_AVC420_ENABLED) != 0;
+    }
+    if ((version >= XR_RDPGFX_CAPVERSION_10) &&
+            (version <= XR_RDPGFX_CAPVERSION_107))
+    {
+        return (flags & XR_RDPGFX_CAPS_FLAG_AVC_DISABLED) == 0;
+    }
+    return 0;
+}
+
 /******************************************************************************/
 /* RDPGFX_CMDID_FRAMEACKNOWLEDGE */
 static int
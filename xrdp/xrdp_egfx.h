@@ -127,6 +127,8 @@ struct xrdp_egfx
     int channel_id;
     int surface_id;
     int frame_id;
+    int caps_version; /* confirmed caps */
+    int caps_flags;
     struct stream *s;
     void *user;
     struct xrdp_egfx_bulk *bulk;
@@ -228,5 +230,7 @@ xrdp_egfx_reset_graphics(struct xrdp_egfx_bulk *bulk, int width, int height,
 int
 xrdp_egfx_send_reset_graphics(struct xrdp_egfx *egfx, int width, int height,
                               int monitor_count, struct monitor_info *mi);
+int
+xrdp_egfx_caps_avc420(int version, int flags);
 
 #endif
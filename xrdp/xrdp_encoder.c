@@ -32,19 +32,252 @@
 #include "rfxcodec_encode.h"
 #endif
 
+#include "xrdp_egfx.h"
+
+#ifdef XRDP_X264
+#include "xrdp_encoder_x264.h"
+#endif
+
 
 
 #define XRDP_SURCMD_PREFIX_BYTES 256
+#define XRDP_ENC_MAX_WORKERS 32
+/* EGFX is not limited by the fastpath fragment size */
+#define XRDP_ENC_GFX_MAX_COMPRESSED_BYTES (512 * 1024)
+
+/* adaptive quality
+   if more than XRDP_ENC_BACKLOG_HIGH bytes are waiting to be sent when a
+   frame is done, quality is lowered by one level, once
+   XRDP_ENC_GOOD_FRAMES frames in a row are done with no more than
+   XRDP_ENC_BACKLOG_LOW bytes waiting it is raised by one level */
+#define XRDP_ENC_QUALITY_LEVELS 5
+#define XRDP_ENC_BACKLOG_HIGH (256 * 1024)
+#define XRDP_ENC_BACKLOG_LOW (16 * 1024)
+#define XRDP_ENC_GOOD_FRAMES 8
+
+/* NSCodec ColorLossLevel at quality level 0, each level after adds 1 up
+   to what the client allows */
+#define XRDP_ENC_NS_COLOR_LOSS_LEVEL 3
+/* widest band of a rect encoded as one NSCodec bitmap */
+#define XRDP_ENC_NS_MAX_BAND_WIDTH 1024
+
+/* jpeg quality for each level, percent of what the client asked for */
+static const int g_jpeg_quality_percent[XRDP_ENC_QUALITY_LEVELS] =
+{
+    100, 85, 70, 55, 40
+};
+
+#ifdef XRDP_RFXCODEC
+/* TS_RFX_CODEC_QUANT for each level, level 0 is the default
+   LL3 6, LH3 6, HL3 6, HH3 6, LH2 7, HL2 7, HH2 8, LH1 8, HL1 8, HH1 9
+   and each level after adds 1 to every value */
+static const unsigned char g_rfx_quants[XRDP_ENC_QUALITY_LEVELS][5] =
+{
+    { 0x66, 0x66, 0x77, 0x88, 0x98 },
+    { 0x77, 0x77, 0x88, 0x99, 0xa9 },
+    { 0x88, 0x88, 0x99, 0xaa, 0xba },
+    { 0x99, 0x99, 0xaa, 0xbb, 0xcb },
+    { 0xaa, 0xaa, 0xbb, 0xcc, 0xdc }
+};
+#endif
+
+#ifdef XRDP_X264
+/* x264 constant rate factor for each level */
+static const int g_h264_rate_factor[XRDP_ENC_QUALITY_LEVELS] =
+{
+    23, 26, 29, 32, 35
+};
+#endif
+
+/* a range of crects from one XRDP_ENC_DATA */
+struct xrdp_enc_job
+{
+    XRDP_ENC_DATA *enc;
+    int first_crect;
+    int num_crects;
+    int quality_level;
+    void *codec_handle;
+    FIFO *fifo_done; /* results kept here if not NULL, else sent to
+                        fifo_processed as they are produced */
+};
+
+/* a thread in the encoder pool */
+struct xrdp_enc_worker
+{
+    struct xrdp_encoder *encoder;
+    struct xrdp_enc_job job;
+    tbus sem_work; /* posted when job is ready or term is set */
+    tbus sem_done; /* posted when job is done or thread exits */
+    int term;
+};
 
 /*****************************************************************************/
 static int
-process_enc_jpg(struct xrdp_encoder *self, XRDP_ENC_DATA *enc);
+process_enc_jpg(struct xrdp_encoder *self, struct xrdp_enc_job *job);
+static int
+process_enc_ns(struct xrdp_encoder *self, struct xrdp_enc_job *job);
 #ifdef XRDP_RFXCODEC
 static int
-process_enc_rfx(struct xrdp_encoder *self, XRDP_ENC_DATA *enc);
+process_enc_rfx(struct xrdp_encoder *self, struct xrdp_enc_job *job);
 #endif
+#ifdef XRDP_X264
 static int
-process_enc_h264(struct xrdp_encoder *self, XRDP_ENC_DATA *enc);
+process_enc_h264(struct xrdp_encoder *self, struct xrdp_enc_job *job);
+#endif
+static THREAD_RV THREAD_CC
+proc_enc_worker(void *arg);
+
+/*****************************************************************************/
+static void
+xrdp_enc_worker_delete_codec(struct xrdp_encoder *self,
+                             struct xrdp_enc_worker *worker)
+{
+    if (worker->job.codec_handle == NULL)
+    {
+        return;
+    }
+    if (self->process_enc == process_enc_jpg)
+    {
+        libxrdp_codec_jpeg_deinit(worker->job.codec_handle);
+    }
+#ifdef XRDP_RFXCODEC
+    else if (self->process_enc == process_enc_rfx)
+    {
+        rfxcodec_encode_destroy(worker->job.codec_handle);
+    }
+#endif
+    worker->job.codec_handle = NULL;
+}
+
+/*****************************************************************************/
+static void
+xrdp_encoder_create_workers(struct xrdp_encoder *self, int num_workers)
+{
+    struct xrdp_enc_worker *worker;
+    int index;
+
+    num_workers = MIN(num_workers, XRDP_ENC_MAX_WORKERS);
+    if (num_workers < 2)
+    {
+        return;
+    }
+    self->workers = g_new0(struct xrdp_enc_worker, num_workers);
+    if (self->workers == NULL)
+    {
+        return;
+    }
+    for (index = 0; index < num_workers; index++)
+    {
+        worker = self->workers + index;
+        worker->encoder = self;
+        worker->job.fifo_done = fifo_create();
+        worker->sem_work = tc_sem_create(0);
+        worker->sem_done = tc_sem_create(0);
+        if (self->process_enc == process_enc_jpg)
+        {
+            /* jpeg handles are not thread safe */
+            worker->job.codec_handle = libxrdp_codec_jpeg_init();
+        }
+#ifdef XRDP_RFXCODEC
+        else if (self->process_enc == process_enc_rfx)
+        {
+            /* rfxcodec handles are not thread safe */
+            worker->job.codec_handle =
+                rfxcodec_encode_create(self->mm->wm->screen->width,
+                                       self->mm->wm->screen->height,
+                                       RFX_FORMAT_YUV, 0);
+        }
+#endif
+        if (tc_thread_create(proc_enc_worker, worker) != 0)
+        {
+            LOG(LOG_LEVEL_WARNING, "xrdp_encoder_create_workers: "
+                "can not create thread %d, using %d encoder threads",
+                index, index);
+            /* not started, so cleaned up here */
+            xrdp_enc_worker_delete_codec(self, worker);
+            fifo_delete(worker->job.fifo_done);
+            tc_sem_delete(worker->sem_work);
+            tc_sem_delete(worker->sem_done);
+            break;
+        }
+    }
+    self->num_workers = index;
+    LOG(LOG_LEVEL_INFO, "xrdp_encoder_create_workers: using %d encoder "
+        "threads", self->num_workers);
+}
+
+/*****************************************************************************/
+/* called from encoder thread when it exits, stops the pool threads and
+   waits for them to finish */
+static void
+xrdp_encoder_delete_workers(struct xrdp_encoder *self)
+{
+    struct xrdp_enc_worker *worker;
+    int index;
+
+    for (index = 0; index < self->num_workers; index++)
+    {
+        worker = self->workers + index;
+        worker->term = 1;
+        tc_sem_inc(worker->sem_work);
+        tc_sem_dec(worker->sem_done);
+        xrdp_enc_worker_delete_codec(self, worker);
+        fifo_delete(worker->job.fifo_done);
+        tc_sem_delete(worker->sem_work);
+        tc_sem_delete(worker->sem_done);
+    }
+    self->num_workers = 0;
+    g_free(self->workers);
+    self->workers = NULL;
+}
+
+/*****************************************************************************/
+/* picks the codec for output over EGFX, H.264 if the confirmed caps allow
+   it, else RemoteFX
+   returns non zero if there is no codec that can be used */
+static int
+xrdp_encoder_init_gfx(struct xrdp_encoder *self,
+                      struct xrdp_client_info *client_info)
+{
+    struct xrdp_egfx *egfx;
+
+    egfx = self->mm->egfx;
+    self->gfx = 1;
+#ifdef XRDP_X264
+    if (xrdp_egfx_caps_avc420(egfx->caps_version, egfx->caps_flags))
+    {
+        LOG(LOG_LEVEL_INFO, "xrdp_encoder_init_gfx: using H.264, caps "
+            "version 0x%8.8x", egfx->caps_version);
+        self->codec_id = XR_RDPGFX_CODECID_AVC420;
+        self->in_codec_mode = 1;
+        client_info->capture_code = 3;
+        client_info->capture_format =
+            /* XRDP_nv12 */
+            (12 << 24) | (64 << 16) | (0 << 12) | (0 << 8) | (0 << 4) | 0;
+        self->process_enc = process_enc_h264;
+        self->codec_handle = xrdp_encoder_x264_create();
+        return 0;
+    }
+#endif
+#ifdef XRDP_RFXCODEC
+    LOG(LOG_LEVEL_INFO, "xrdp_encoder_init_gfx: using RemoteFX, caps "
+        "version 0x%8.8x", egfx->caps_version);
+    self->codec_id = XR_RDPGFX_CODECID_CAVIDEO;
+    self->in_codec_mode = 1;
+    client_info->capture_code = 2;
+    self->process_enc = process_enc_rfx;
+    self->min_crects_per_job = 16;
+    self->codec_handle = rfxcodec_encode_create(self->mm->wm->screen->width,
+                         self->mm->wm->screen->height,
+                         RFX_FORMAT_YUV, 0);
+    return 0;
+#else
+    LOG(LOG_LEVEL_ERROR, "xrdp_encoder_init_gfx: no codec for EGFX, caps "
+        "version 0x%8.8x flags 0x%8.8x", egfx->caps_version,
+        egfx->caps_flags);
+    return 1;
+#endif
+}
 
 /*****************************************************************************/
 struct xrdp_encoder *
@@ -57,10 +290,6 @@ xrdp_encoder_create(struct xrdp_mm *mm)
 
     client_info = mm->wm->client_info;
 
-    if (client_info->mcs_connection_type != CONNECTION_TYPE_LAN)
-    {
-        return 0;
-    }
     if (client_info->bpp < 24)
     {
         return 0;
@@ -69,7 +298,15 @@ xrdp_encoder_create(struct xrdp_mm *mm)
     self = (struct xrdp_encoder *)g_malloc(sizeof(struct xrdp_encoder), 1);
     self->mm = mm;
 
-    if (client_info->jpeg_codec_id != 0)
+    if (mm->egfx_up)
+    {
+        if (xrdp_encoder_init_gfx(self, client_info) != 0)
+        {
+            g_free(self);
+            return 0;
+        }
+    }
+    else if (client_info->jpeg_codec_id != 0)
     {
         LOG_DEVEL(LOG_LEVEL_INFO, "xrdp_encoder_create: starting jpeg codec session");
         self->codec_id = client_info->jpeg_codec_id;
@@ -80,6 +317,7 @@ xrdp_encoder_create(struct xrdp_mm *mm)
             /* XRDP_a8b8g8r8 */
             (32 << 24) | (3 << 16) | (8 << 12) | (8 << 8) | (8 << 4) | 8;
         self->process_enc = process_enc_jpg;
+        self->min_crects_per_job = 1;
     }
 #ifdef XRDP_RFXCODEC
     else if (client_info->rfx_codec_id != 0)
@@ -89,21 +327,34 @@ xrdp_encoder_create(struct xrdp_mm *mm)
         self->in_codec_mode = 1;
         client_info->capture_code = 2;
         self->process_enc = process_enc_rfx;
+        /* each job is a separate RFX message, don't split too finely */
+        self->min_crects_per_job = 16;
         self->codec_handle = rfxcodec_encode_create(mm->wm->screen->width,
                              mm->wm->screen->height,
                              RFX_FORMAT_YUV, 0);
     }
 #endif
-    else if (client_info->h264_codec_id != 0)
+    else if (client_info->ns_codec_id != 0)
     {
-        LOG_DEVEL(LOG_LEVEL_INFO, "xrdp_encoder_create: starting h264 codec session");
-        self->codec_id = client_info->h264_codec_id;
+        LOG(LOG_LEVEL_INFO, "xrdp_encoder_create: starting NSCodec session");
+        self->codec_id = client_info->ns_codec_id;
         self->in_codec_mode = 1;
-        client_info->capture_code = 3;
+        /* TS_NSCODEC_CAPABILITYSET, fAllowDynamicFidelity,
+           fAllowSubsampling, colorLossLevel */
+        self->ns_max_color_loss_level = 1;
+        if ((client_info->ns_prop_len >= 3) && (client_info->ns_prop[0] != 0))
+        {
+            self->ns_max_color_loss_level =
+                MAX(MIN(client_info->ns_prop[2], 7), 1);
+        }
+        self->ns_subsampling = (client_info->ns_prop_len >= 2) &&
+                               (client_info->ns_prop[1] != 0);
+        client_info->capture_code = 0;
         client_info->capture_format =
-            /* XRDP_nv12 */
-            (12 << 24) | (64 << 16) | (0 << 12) | (0 << 8) | (0 << 4) | 0;
-        self->process_enc = process_enc_h264;
+            /* XRDP_a8r8g8b8 */
+            (32 << 24) | (2 << 16) | (8 << 12) | (8 << 8) | (8 << 4) | 8;
+        self->process_enc = process_enc_ns;
+        self->min_crects_per_job = 1;
     }
     else
     {
@@ -127,10 +378,19 @@ xrdp_encoder_create(struct xrdp_mm *mm)
     g_snprintf(buf, 1024, "xrdp_%8.8x_encoder_term", pid);
     self->xrdp_encoder_term = g_create_wait_obj(buf);
     self->max_compressed_bytes = client_info->max_fastpath_frag_bytes & ~15;
+    if (self->gfx)
+    {
+        self->max_compressed_bytes = XRDP_ENC_GFX_MAX_COMPRESSED_BYTES;
+    }
     self->frames_in_flight = client_info->max_unacknowledged_frame_count;
     /* make sure frames_in_flight is at least 1 */
     self->frames_in_flight = MAX(self->frames_in_flight, 1);
 
+    if (self->min_crects_per_job > 0)
+    {
+        xrdp_encoder_create_workers(self, client_info->encoder_threads);
+    }
+
     /* create thread to process messages */
     tc_thread_create(proc_enc_msg, self);
 
@@ -169,6 +429,12 @@ xrdp_encoder_delete(struct xrdp_encoder *self)
         rfxcodec_encode_destroy(self->codec_handle);
     }
 #endif
+#ifdef XRDP_X264
+    else if (self->process_enc == process_enc_h264)
+    {
+        xrdp_encoder_x264_delete(self->codec_handle);
+    }
+#endif
 
     /* destroy wait objects used for signalling */
     g_delete_wait_obj(self->xrdp_encoder_event_to_proc);
@@ -213,10 +479,80 @@ xrdp_encoder_delete(struct xrdp_encoder *self)
     g_free(self);
 }
 
+/*****************************************************************************/
+/* called from main thread when a frame is done
+   wait_bytes is what is waiting to be sent to the client */
+void
+xrdp_encoder_update_quality(struct xrdp_encoder *self, int wait_bytes)
+{
+    int level;
+
+    level = self->quality_level;
+    if (wait_bytes > XRDP_ENC_BACKLOG_HIGH)
+    {
+        self->quality_good_frames = 0;
+        level = MIN(level + 1, XRDP_ENC_QUALITY_LEVELS - 1);
+    }
+    else if (wait_bytes <= XRDP_ENC_BACKLOG_LOW)
+    {
+        self->quality_good_frames++;
+        if (self->quality_good_frames >= XRDP_ENC_GOOD_FRAMES)
+        {
+            self->quality_good_frames = 0;
+            level = MAX(level - 1, 0);
+        }
+    }
+    else
+    {
+        self->quality_good_frames = 0;
+    }
+    if (level != self->quality_level)
+    {
+        LOG(LOG_LEVEL_DEBUG, "xrdp_encoder_update_quality: %d bytes waiting, "
+            "quality level %d -> %d", wait_bytes, self->quality_level,
+            level);
+        tc_mutex_lock(self->mutex);
+        self->quality_level = level;
+        tc_mutex_unlock(self->mutex);
+    }
+}
+
+/*****************************************************************************/
+/* called from encoder thread, passes enc_done to the main thread */
+static void
+xrdp_encoder_add_processed(struct xrdp_encoder *self,
+                           XRDP_ENC_DATA_DONE *enc_done)
+{
+    /* inform main thread done */
+    tc_mutex_lock(self->mutex);
+    fifo_add_item(self->fifo_processed, enc_done);
+    tc_mutex_unlock(self->mutex);
+    /* signal completion for main thread */
+    g_set_wait_obj(self->xrdp_encoder_event_processed);
+}
+
+/*****************************************************************************/
+/* called from encoder or pool thread */
+static void
+xrdp_enc_job_add_done(struct xrdp_encoder *self, struct xrdp_enc_job *job,
+                      XRDP_ENC_DATA_DONE *enc_done)
+{
+    if (job->fifo_done != NULL)
+    {
+        /* pool thread, the encoder thread collects these in order
+           once the job is done */
+        fifo_add_item(job->fifo_done, enc_done);
+    }
+    else
+    {
+        xrdp_encoder_add_processed(self, enc_done);
+    }
+}
+
 /*****************************************************************************/
 /* called from encoder thread */
 static int
-process_enc_jpg(struct xrdp_encoder *self, XRDP_ENC_DATA *enc)
+process_enc_jpg(struct xrdp_encoder *self, struct xrdp_enc_job *job)
 {
     int index;
     int x;
@@ -228,23 +564,23 @@ process_enc_jpg(struct xrdp_encoder *self, XRDP_ENC_DATA *enc)
     int out_data_bytes;
     int count;
     char *out_data;
+    short *crects;
+    XRDP_ENC_DATA *enc;
     XRDP_ENC_DATA_DONE *enc_done;
-    FIFO *fifo_processed;
-    tbus mutex;
-    tbus event_processed;
 
     LOG_DEVEL(LOG_LEVEL_DEBUG, "process_enc_jpg:");
-    quality = self->codec_quality;
-    fifo_processed = self->fifo_processed;
-    mutex = self->mutex;
-    event_processed = self->xrdp_encoder_event_processed;
-    count = enc->num_crects;
+    quality = self->codec_quality *
+              g_jpeg_quality_percent[job->quality_level] / 100;
+    quality = MAX(quality, 10);
+    enc = job->enc;
+    crects = enc->crects + job->first_crect * 4;
+    count = job->num_crects;
     for (index = 0; index < count; index++)
     {
-        x = enc->crects[index * 4 + 0];
-        y = enc->crects[index * 4 + 1];
-        cx = enc->crects[index * 4 + 2];
-        cy = enc->crects[index * 4 + 3];
+        x = crects[index * 4 + 0];
+        y = crects[index * 4 + 1];
+        cx = crects[index * 4 + 2];
+        cy = crects[index * 4 + 3];
         if (cx < 1 || cy < 1)
         {
             LOG_DEVEL(LOG_LEVEL_WARNING, "process_enc_jpg: error 1");
@@ -268,11 +604,27 @@ process_enc_jpg(struct xrdp_encoder *self, XRDP_ENC_DATA *enc)
 
         out_data[256] = 0; /* header bytes */
         out_data[257] = 0;
-        error = libxrdp_codec_jpeg_compress(self->mm->wm->session, 0, enc->data,
-                                            enc->width, enc->height,
-                                            enc->width * 4, x, y, cx, cy,
-                                            quality,
-                                            out_data + 256 + 2, &out_data_bytes);
+        if (job->codec_handle != NULL)
+        {
+            /* pool thread, has its own jpeg handle */
+            error = libxrdp_codec_jpeg_compress_han(job->codec_handle, 0,
+                                                    enc->data,
+                                                    enc->width, enc->height,
+                                                    enc->width * 4,
+                                                    x, y, cx, cy, quality,
+                                                    out_data + 256 + 2,
+                                                    &out_data_bytes);
+        }
+        else
+        {
+            error = libxrdp_codec_jpeg_compress(self->mm->wm->session, 0,
+                                                enc->data,
+                                                enc->width, enc->height,
+                                                enc->width * 4, x, y, cx, cy,
+                                                quality,
+                                                out_data + 256 + 2,
+                                                &out_data_bytes);
+        }
         if (error < 0)
         {
             LOG_DEVEL(LOG_LEVEL_ERROR, "process_enc_jpg: jpeg error %d bytes %d",
@@ -287,18 +639,152 @@ process_enc_jpg(struct xrdp_encoder *self, XRDP_ENC_DATA *enc)
         enc_done->pad_bytes = 256;
         enc_done->comp_pad_data = out_data;
         enc_done->enc = enc;
-        enc_done->last = index == (enc->num_crects - 1);
+        enc_done->last = index == (count - 1);
+        enc_done->continuation = index > 0;
         enc_done->x = x;
         enc_done->y = y;
         enc_done->cx = cx;
         enc_done->cy = cy;
         /* done with msg */
-        /* inform main thread done */
-        tc_mutex_lock(mutex);
-        fifo_add_item(fifo_processed, enc_done);
-        tc_mutex_unlock(mutex);
-        /* signal completion for main thread */
-        g_set_wait_obj(event_processed);
+        xrdp_enc_job_add_done(self, job, enc_done);
+    }
+    return 0;
+}
+
+/*****************************************************************************/
+/* called from encoder or pool thread
+   returns the NSCodec bitmap for one band of a crect, NULL on error */
+static XRDP_ENC_DATA_DONE *
+process_enc_ns_band(struct xrdp_encoder *self, struct xrdp_enc_job *job,
+                    int color_loss_level, int x, int y, int cx, int cy)
+{
+    int out_data_bytes;
+    int error;
+    char *out_data;
+    XRDP_ENC_DATA *enc;
+    XRDP_ENC_DATA_DONE *enc_done;
+
+    enc = job->enc;
+    /* room for the header and three raw planes, padded */
+    out_data_bytes = ((cx + 7) & ~7) * (cy + 1) * 3 + 64;
+    out_data = g_new(char, XRDP_SURCMD_PREFIX_BYTES + out_data_bytes);
+    if (out_data == NULL)
+    {
+        return NULL;
+    }
+    error = libxrdp_codec_nscodec_encode(enc->data, enc->width * 4,
+                                         x, y, cx, cy, color_loss_level,
+                                         self->ns_subsampling,
+                                         out_data + XRDP_SURCMD_PREFIX_BYTES,
+                                         &out_data_bytes);
+    if (error != 0)
+    {
+        LOG(LOG_LEVEL_ERROR, "process_enc_ns_band: encode error %d", error);
+        g_free(out_data);
+        return NULL;
+    }
+    enc_done = g_new0(XRDP_ENC_DATA_DONE, 1);
+    if (enc_done == NULL)
+    {
+        g_free(out_data);
+        return NULL;
+    }
+    enc_done->comp_bytes = out_data_bytes;
+    enc_done->pad_bytes = XRDP_SURCMD_PREFIX_BYTES;
+    enc_done->comp_pad_data = out_data;
+    enc_done->enc = enc;
+    enc_done->x = x;
+    enc_done->y = y;
+    enc_done->cx = cx;
+    enc_done->cy = cy;
+    return enc_done;
+}
+
+/*****************************************************************************/
+/* called from encoder or pool thread
+   each crect is sent as one or more bands that fit in a fastpath update */
+static int
+process_enc_ns(struct xrdp_encoder *self, struct xrdp_enc_job *job)
+{
+    int index;
+    int x;
+    int y;
+    int cx;
+    int cy;
+    int band_x;
+    int band_y;
+    int band_cx;
+    int band_cy;
+    int padded_cx;
+    int color_loss_level;
+    short *crects;
+    XRDP_ENC_DATA *enc;
+    XRDP_ENC_DATA_DONE *enc_done;
+    XRDP_ENC_DATA_DONE *pending;
+
+    LOG_DEVEL(LOG_LEVEL_DEBUG, "process_enc_ns:");
+    color_loss_level = MIN(XRDP_ENC_NS_COLOR_LOSS_LEVEL + job->quality_level,
+                           self->ns_max_color_loss_level);
+    enc = job->enc;
+    crects = enc->crects + job->first_crect * 4;
+    pending = NULL;
+    for (index = 0; index < job->num_crects; index++)
+    {
+        x = crects[index * 4 + 0];
+        y = crects[index * 4 + 1];
+        cx = crects[index * 4 + 2];
+        cy = crects[index * 4 + 3];
+        if ((cx < 1) || (cy < 1) || (x < 0) || (y < 0) ||
+                (x + cx > enc->width) || (y + cy > enc->height))
+        {
+            LOG_DEVEL(LOG_LEVEL_WARNING, "process_enc_ns: bad rect x %d y %d "
+                      "cx %d cy %d", x, y, cx, cy);
+            continue;
+        }
+        band_cx = MIN(cx, XRDP_ENC_NS_MAX_BAND_WIDTH);
+        padded_cx = (band_cx + 7) & ~7;
+        /* a band is never bigger than its header and three raw planes,
+           leave room for the fastpath headers */
+        band_cy = (self->max_compressed_bytes - 256 - padded_cx) /
+                  (padded_cx * 3);
+        band_cy = MAX(MIN(band_cy, cy), 1);
+        for (band_y = 0; band_y < cy; band_y += band_cy)
+        {
+            for (band_x = 0; band_x < cx; band_x += band_cx)
+            {
+                enc_done = process_enc_ns_band(self, job, color_loss_level,
+                                               x + band_x, y + band_y,
+                                               MIN(band_cx, cx - band_x),
+                                               MIN(band_cy, cy - band_y));
+                if (enc_done == NULL)
+                {
+                    continue;
+                }
+                /* held back by one so the last one can be flagged */
+                if (pending != NULL)
+                {
+                    enc_done->continuation = 1;
+                    xrdp_enc_job_add_done(self, job, pending);
+                }
+                pending = enc_done;
+            }
+        }
+    }
+    if ((pending == NULL) && (job->fifo_done == NULL))
+    {
+        /* nothing was encoded, must still send something back so
+           Xorg can get ack */
+        pending = g_new0(XRDP_ENC_DATA_DONE, 1);
+        if (pending == NULL)
+        {
+            return 1;
+        }
+        pending->enc = enc;
+    }
+    if (pending != NULL)
+    {
+        pending->last = 1;
+        xrdp_enc_job_add_done(self, job, pending);
     }
     return 0;
 }
@@ -307,7 +793,7 @@ process_enc_jpg(struct xrdp_encoder *self, XRDP_ENC_DATA *enc)
 /*****************************************************************************/
 /* called from encoder thread */
 static int
-process_enc_rfx(struct xrdp_encoder *self, XRDP_ENC_DATA *enc)
+process_enc_rfx(struct xrdp_encoder *self, struct xrdp_enc_job *job)
 {
     int index;
     int x;
@@ -321,26 +807,24 @@ process_enc_rfx(struct xrdp_encoder *self, XRDP_ENC_DATA *enc)
     int tiles_left;
     int finished;
     char *out_data;
+    short *crects;
+    XRDP_ENC_DATA *enc;
     XRDP_ENC_DATA_DONE *enc_done;
-    FIFO *fifo_processed;
-    tbus mutex;
-    tbus event_processed;
     struct rfx_tile *tiles;
     struct rfx_rect *rfxrects;
     int alloc_bytes;
 
+    enc = job->enc;
+    crects = enc->crects + job->first_crect * 4;
     LOG_DEVEL(LOG_LEVEL_DEBUG, "process_enc_rfx:");
     LOG_DEVEL(LOG_LEVEL_DEBUG, "process_enc_rfx: num_crects %d num_drects %d",
-              enc->num_crects, enc->num_drects);
-    fifo_processed = self->fifo_processed;
-    mutex = self->mutex;
-    event_processed = self->xrdp_encoder_event_processed;
+              job->num_crects, enc->num_drects);
 
     all_tiles_written = 0;
     do
     {
         tiles_written = 0;
-        tiles_left = enc->num_crects - all_tiles_written;
+        tiles_left = job->num_crects - all_tiles_written;
         out_data = NULL;
         out_data_bytes = 0;
 
@@ -361,10 +845,10 @@ process_enc_rfx(struct xrdp_encoder *self, XRDP_ENC_DATA *enc)
                 count = tiles_left;
                 for (index = 0; index < count; index++)
                 {
-                    x = enc->crects[(index + all_tiles_written) * 4 + 0];
-                    y = enc->crects[(index + all_tiles_written) * 4 + 1];
-                    cx = enc->crects[(index + all_tiles_written) * 4 + 2];
-                    cy = enc->crects[(index + all_tiles_written) * 4 + 3];
+                    x = crects[(index + all_tiles_written) * 4 + 0];
+                    y = crects[(index + all_tiles_written) * 4 + 1];
+                    cx = crects[(index + all_tiles_written) * 4 + 2];
+                    cy = crects[(index + all_tiles_written) * 4 + 3];
                     tiles[index].x = x;
                     tiles[index].y = y;
                     tiles[index].cx = cx;
@@ -388,12 +872,15 @@ process_enc_rfx(struct xrdp_encoder *self, XRDP_ENC_DATA *enc)
                 }
 
                 out_data_bytes = self->max_compressed_bytes;
-                tiles_written = rfxcodec_encode(self->codec_handle,
+                tiles_written = rfxcodec_encode(job->codec_handle,
                                                 out_data + XRDP_SURCMD_PREFIX_BYTES,
                                                 &out_data_bytes, enc->data,
                                                 enc->width, enc->height, enc->width * 4,
                                                 rfxrects, enc->num_drects,
-                                                tiles, tiles_left, 0, 0);
+                                                tiles, tiles_left,
+                                                (const char *)
+                                                g_rfx_quants[job->quality_level],
+                                                1);
             }
         }
 
@@ -421,17 +908,11 @@ process_enc_rfx(struct xrdp_encoder *self, XRDP_ENC_DATA *enc)
             all_tiles_written += tiles_written;
         }
         finished =
-            (all_tiles_written == enc->num_crects) || (tiles_written < 0);
+            (all_tiles_written == job->num_crects) || (tiles_written < 0);
         enc_done->last = finished;
 
         /* done with msg */
-        /* inform main thread done */
-        tc_mutex_lock(mutex);
-        fifo_add_item(fifo_processed, enc_done);
-        tc_mutex_unlock(mutex);
-        /* signal completion for main thread */
-        g_set_wait_obj(event_processed);
-
+        xrdp_enc_job_add_done(self, job, enc_done);
     }
     while (!finished);
 
@@ -439,12 +920,253 @@ process_enc_rfx(struct xrdp_encoder *self, XRDP_ENC_DATA *enc)
 }
 #endif
 
+#ifdef XRDP_X264
 /*****************************************************************************/
-/* called from encoder thread */
+/* called from encoder thread
+   encodes the whole NV12 frame and outputs one RDPGFX_AVC420_BITMAP_STREAM,
+   the damaged rects go in the metablock so the client only updates them */
 static int
-process_enc_h264(struct xrdp_encoder *self, XRDP_ENC_DATA *enc)
+process_enc_h264(struct xrdp_encoder *self, struct xrdp_enc_job *job)
 {
-    LOG_DEVEL(LOG_LEVEL_INFO, "process_enc_x264:");
+    int index;
+    int x;
+    int y;
+    int cx;
+    int cy;
+    int screen_width;
+    int screen_height;
+    int num_rects;
+    int num_region_rects;
+    int meta_bytes;
+    int out_data_bytes;
+    int rate_factor;
+    int error;
+    short *rects;
+    char *out_data;
+    struct stream ls;
+    struct stream *s;
+    XRDP_ENC_DATA *enc;
+    XRDP_ENC_DATA_DONE *enc_done;
+
+    LOG_DEVEL(LOG_LEVEL_DEBUG, "process_enc_h264:");
+    enc = job->enc;
+    screen_width = self->mm->wm->screen->width;
+    screen_height = self->mm->wm->screen->height;
+    rects = enc->drects;
+    num_rects = enc->num_drects;
+    if (num_rects < 1)
+    {
+        rects = enc->crects;
+        num_rects = enc->num_crects;
+    }
+    /* count the rects left after clipping to the surface */
+    num_region_rects = 0;
+    for (index = 0; index < num_rects; index++)
+    {
+        x = MAX(rects[index * 4 + 0], 0);
+        y = MAX(rects[index * 4 + 1], 0);
+        cx = MIN(rects[index * 4 + 0] + rects[index * 4 + 2], screen_width);
+        cy = MIN(rects[index * 4 + 1] + rects[index * 4 + 3], screen_height);
+        if ((cx > x) && (cy > y))
+        {
+            num_region_rects++;
+        }
+    }
+
+    out_data = NULL;
+    out_data_bytes = 0;
+    if (num_region_rects > 0)
+    {
+        meta_bytes = 4 + num_region_rects * 10;
+        out_data_bytes = MAX(enc->width * enc->height * 3 / 2, 64 * 1024);
+        out_data = g_new(char, XRDP_SURCMD_PREFIX_BYTES + meta_bytes +
+                         out_data_bytes);
+    }
+    if (out_data != NULL)
+    {
+        rate_factor = g_h264_rate_factor[job->quality_level];
+        error = xrdp_encoder_x264_encode(job->codec_handle,
+                                         enc->width & ~1, enc->height & ~1,
+                                         rate_factor, enc->data,
+                                         enc->data + enc->width * enc->height,
+                                         enc->width,
+                                         out_data + XRDP_SURCMD_PREFIX_BYTES +
+                                         meta_bytes,
+                                         &out_data_bytes);
+        if (error == 0)
+        {
+            /* RDPGFX_H264_METABLOCK */
+            g_memset(&ls, 0, sizeof(ls));
+            ls.data = out_data + XRDP_SURCMD_PREFIX_BYTES;
+            ls.p = ls.data;
+            ls.size = meta_bytes;
+            ls.end = ls.data + meta_bytes;
+            s = &ls;
+            out_uint32_le(s, num_region_rects); /* numRegionRects */
+            for (index = 0; index < num_rects; index++)
+            {
+                x = MAX(rects[index * 4 + 0], 0);
+                y = MAX(rects[index * 4 + 1], 0);
+                cx = MIN(rects[index * 4 + 0] + rects[index * 4 + 2],
+                         screen_width);
+                cy = MIN(rects[index * 4 + 1] + rects[index * 4 + 3],
+                         screen_height);
+                if ((cx > x) && (cy > y))
+                {
+                    /* RDPGFX_RECT16 */
+                    out_uint16_le(s, x);
+                    out_uint16_le(s, y);
+                    out_uint16_le(s, cx);
+                    out_uint16_le(s, cy);
+                }
+            }
+            for (index = 0; index < num_region_rects; index++)
+            {
+                /* RDPGFX_H264_QUANT_QUALITY */
+                out_uint8(s, rate_factor); /* qpVal */
+                out_uint8(s, 100); /* qualityVal */
+            }
+            out_data_bytes += meta_bytes;
+        }
+        else
+        {
+            out_data_bytes = 0;
+        }
+    }
+
+    /* must always send something back even on error so Xorg can get
+       ack */
+    enc_done = g_new0(XRDP_ENC_DATA_DONE, 1);
+    if (enc_done == NULL)
+    {
+        g_free(out_data);
+        return 1;
+    }
+    enc_done->comp_bytes = out_data_bytes;
+    enc_done->pad_bytes = XRDP_SURCMD_PREFIX_BYTES;
+    enc_done->comp_pad_data = out_data;
+    enc_done->enc = enc;
+    enc_done->last = 1;
+    enc_done->cx = screen_width;
+    enc_done->cy = screen_height;
+    xrdp_enc_job_add_done(self, job, enc_done);
+    return 0;
+}
+#endif
+
+/**
+ * Pool thread main loop
+ *****************************************************************************/
+static THREAD_RV THREAD_CC
+proc_enc_worker(void *arg)
+{
+    struct xrdp_enc_worker *worker;
+
+    worker = (struct xrdp_enc_worker *) arg;
+    while (1)
+    {
+        tc_sem_dec(worker->sem_work);
+        if (worker->term)
+        {
+            break;
+        }
+        worker->encoder->process_enc(worker->encoder, &worker->job);
+        tc_sem_inc(worker->sem_done);
+    }
+    /* let the encoder thread know we are finished with worker */
+    tc_sem_inc(worker->sem_done);
+    return 0;
+}
+
+/*****************************************************************************/
+/* called from encoder thread
+   splits the crects of enc into consecutive ranges, one per pool thread,
+   and passes the results to the main thread in the original order */
+static int
+xrdp_encoder_process_enc(struct xrdp_encoder *self, XRDP_ENC_DATA *enc)
+{
+    struct xrdp_enc_job job;
+    struct xrdp_enc_worker *worker;
+    XRDP_ENC_DATA_DONE *enc_done;
+    XRDP_ENC_DATA_DONE *pending;
+    int num_jobs;
+    int first_crect;
+    int quality_level;
+    int index;
+
+    tc_mutex_lock(self->mutex);
+    quality_level = self->quality_level;
+    tc_mutex_unlock(self->mutex);
+
+    num_jobs = 0;
+    if (self->min_crects_per_job > 0)
+    {
+        num_jobs = MIN(self->num_workers,
+                       enc->num_crects / self->min_crects_per_job);
+    }
+    if (num_jobs < 2)
+    {
+        job.enc = enc;
+        job.first_crect = 0;
+        job.num_crects = enc->num_crects;
+        job.quality_level = quality_level;
+        job.codec_handle = self->codec_handle;
+        job.fifo_done = NULL;
+        return self->process_enc(self, &job);
+    }
+
+    first_crect = 0;
+    for (index = 0; index < num_jobs; index++)
+    {
+        worker = self->workers + index;
+        worker->job.enc = enc;
+        worker->job.first_crect = first_crect;
+        worker->job.quality_level = quality_level;
+        worker->job.num_crects = enc->num_crects / num_jobs;
+        if (index < enc->num_crects % num_jobs)
+        {
+            worker->job.num_crects++;
+        }
+        first_crect += worker->job.num_crects;
+        tc_sem_inc(worker->sem_work);
+    }
+
+    /* results are held back by one so the last one can be flagged */
+    pending = NULL;
+    for (index = 0; index < num_jobs; index++)
+    {
+        worker = self->workers + index;
+        tc_sem_dec(worker->sem_done);
+        while ((enc_done = (XRDP_ENC_DATA_DONE *)
+                           fifo_remove_item(worker->job.fifo_done)) != NULL)
+        {
+            enc_done->last = 0;
+            if (pending != NULL)
+            {
+                enc_done->continuation = 1;
+                xrdp_encoder_add_processed(self, pending);
+            }
+            else
+            {
+                enc_done->continuation = 0;
+            }
+            pending = enc_done;
+        }
+    }
+
+    if (pending == NULL)
+    {
+        /* nothing was encoded, must still send something back so
+           Xorg can get ack */
+        pending = g_new0(XRDP_ENC_DATA_DONE, 1);
+        if (pending == NULL)
+        {
+            return 1;
+        }
+        pending->enc = enc;
+    }
+    pending->last = 1;
+    xrdp_encoder_add_processed(self, pending);
     return 0;
 }
 
@@ -524,7 +1246,7 @@ proc_enc_msg(void *arg)
             while (enc != 0)
             {
                 /* do work */
-                self->process_enc(self, enc);
+                xrdp_encoder_process_enc(self, enc);
                 /* get next msg */
                 tc_mutex_lock(mutex);
                 enc = (XRDP_ENC_DATA *) fifo_remove_item(fifo_to_proc);
@@ -533,6 +1255,7 @@ proc_enc_msg(void *arg)
         }
 
     } /* end while (cont) */
+    xrdp_encoder_delete_workers(self);
     LOG_DEVEL(LOG_LEVEL_DEBUG, "proc_enc_msg: thread exit");
     return 0;
 }
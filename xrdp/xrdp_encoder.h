@@ -6,14 +6,20 @@
 #include "fifo.h"
 
 struct xrdp_enc_data;
+struct xrdp_enc_job;
+struct xrdp_enc_worker;
 
 /* for codec mode operations */
 struct xrdp_encoder
 {
     struct xrdp_mm *mm;
     int in_codec_mode;
-    int codec_id;
+    int codec_id; /* RDPGFX codec id if gfx is set */
+    int gfx; /* output is sent over EGFX instead of surface bits */
+    int gfx_ack_off; /* client suspended EGFX frame acks */
     int codec_quality;
+    int ns_max_color_loss_level; /* NSCodec limits from the client's caps */
+    int ns_subsampling;
     int max_compressed_bytes;
     tbus xrdp_encoder_event_to_proc;
     tbus xrdp_encoder_event_processed;
@@ -21,12 +27,20 @@ struct xrdp_encoder
     FIFO *fifo_to_proc;
     FIFO *fifo_processed;
     tbus mutex;
-    int (*process_enc)(struct xrdp_encoder *self, struct xrdp_enc_data *enc);
+    int (*process_enc)(struct xrdp_encoder *self, struct xrdp_enc_job *job);
     void *codec_handle;
+    /* optional pool of threads the crects of a frame are split across */
+    int num_workers;
+    int min_crects_per_job;
+    struct xrdp_enc_worker *workers;
     int frame_id_client; /* last frame id received from client */
     int frame_id_server; /* last frame id received from Xorg */
     int frame_id_server_sent;
     int frames_in_flight;
+    /* adaptive quality, 0 is best, changed by the main thread from the
+       amount of data waiting to be sent to the client */
+    int quality_level;
+    int quality_good_frames;
 };
 
 /* used when scheduling tasks in xrdp_encoder.c */
@@ -67,6 +81,8 @@ struct xrdp_encoder *
 xrdp_encoder_create(struct xrdp_mm *mm);
 void
 xrdp_encoder_delete(struct xrdp_encoder *self);
+void
+xrdp_encoder_update_quality(struct xrdp_encoder *self, int wait_bytes);
 THREAD_RV THREAD_CC
 proc_enc_msg(void *arg);
 
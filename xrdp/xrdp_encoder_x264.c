@@ -0,0 +1,187 @@
+/**
+ * xrdp: A Remote Desktop Protocol server.
+ *
+ * Licensed under the Apache License, Version 2.0 (the "License");
+ * you may not use this file except in compliance with the License.
+ * You may obtain a copy of the License at
+ *
+ *     http://www.apache.org/licenses/LICENSE-2.0
+ *
+ * Unless required by applicable law or agreed to in writing, software
+ * distributed under the License is distributed on an "AS IS" BASIS,
+ * WITHOUT WARRANTIES OR CONDITIONS OF ANY KIND, either express or implied.
+ * See the License for the specific language governing permissions and
+ * limitations under the License.
+ *
+ * x264 Encoder
+ */
+
+#if defined(HAVE_CONFIG_H)
+#include <config_ac.h>
+#endif
+
+#include <stdint.h>
+#include <x264.h>
+
+#include "xrdp_encoder_x264.h"
+#include "os_calls.h"
+#include "log.h"
+
+struct x264_global
+{
+    x264_t *x264_enc_han;
+    x264_param_t x264_params;
+    int width;
+    int height;
+    int rate_factor;
+    int64_t pts;
+};
+
+/*****************************************************************************/
+void *
+xrdp_encoder_x264_create(void)
+{
+    struct x264_global *xg;
+
+    LOG_DEVEL(LOG_LEVEL_TRACE, "xrdp_encoder_x264_create:");
+    xg = g_new0(struct x264_global, 1);
+    return xg;
+}
+
+/*****************************************************************************/
+int
+xrdp_encoder_x264_delete(void *handle)
+{
+    struct x264_global *xg;
+
+    if (handle == NULL)
+    {
+        return 0;
+    }
+    xg = (struct x264_global *) handle;
+    if (xg->x264_enc_han != NULL)
+    {
+        x264_encoder_close(xg->x264_enc_han);
+    }
+    g_free(xg);
+    return 0;
+}
+
+/*****************************************************************************/
+/* (re)open the x264 encoder for a new frame size */
+static int
+xrdp_encoder_x264_open(struct x264_global *xg, int width, int height,
+                       int rate_factor)
+{
+    if (xg->x264_enc_han != NULL)
+    {
+        x264_encoder_close(xg->x264_enc_han);
+        xg->x264_enc_han = NULL;
+    }
+    x264_param_default_preset(&(xg->x264_params), "ultrafast",
+                              "zerolatency");
+    xg->x264_params.i_width = width;
+    xg->x264_params.i_height = height;
+    xg->x264_params.i_csp = X264_CSP_NV12;
+    xg->x264_params.i_fps_num = 24;
+    xg->x264_params.i_fps_den = 1;
+    /* screen content, only send a key frame when a decoder is new */
+    xg->x264_params.i_keyint_max = X264_KEYINT_MAX_INFINITE;
+    xg->x264_params.b_repeat_headers = 1;
+    xg->x264_params.b_annexb = 1;
+    xg->x264_params.rc.i_rc_method = X264_RC_CRF;
+    xg->x264_params.rc.f_rf_constant = rate_factor;
+    xg->x264_params.i_log_level = X264_LOG_ERROR;
+    x264_param_apply_profile(&(xg->x264_params), "main");
+    xg->x264_enc_han = x264_encoder_open(&(xg->x264_params));
+    if (xg->x264_enc_han == NULL)
+    {
+        LOG(LOG_LEVEL_ERROR, "xrdp_encoder_x264_open: x264_encoder_open "
+            "failed for %dx%d", width, height);
+        return 1;
+    }
+    xg->width = width;
+    xg->height = height;
+    xg->rate_factor = rate_factor;
+    xg->pts = 0;
+    return 0;
+}
+
+/*****************************************************************************/
+/* input is NV12, a Y plane and an interleaved UV plane, both stride
+   bytes per line
+   on entry cdata_bytes is the size of cdata, on return the size of the
+   annex B bitstream written there */
+int
+xrdp_encoder_x264_encode(void *handle, int width, int height,
+                         int rate_factor, const char *y_data,
+                         const char *uv_data, int stride,
+                         char *cdata, int *cdata_bytes)
+{
+    struct x264_global *xg;
+    x264_picture_t pic_in;
+    x264_picture_t pic_out;
+    x264_nal_t *nals;
+    int num_nals;
+    int frame_size;
+    int index;
+    int bytes;
+
+    xg = (struct x264_global *) handle;
+    if ((width < 2) || (height < 2) || (width & 1) || (height & 1))
+    {
+        LOG(LOG_LEVEL_ERROR, "xrdp_encoder_x264_encode: bad frame size "
+            "%dx%d", width, height);
+        return 1;
+    }
+    if ((xg->x264_enc_han == NULL) || (xg->width != width) ||
+            (xg->height != height))
+    {
+        if (xrdp_encoder_x264_open(xg, width, height, rate_factor) != 0)
+        {
+            return 1;
+        }
+    }
+    else if (xg->rate_factor != rate_factor)
+    {
+        xg->x264_params.rc.f_rf_constant = rate_factor;
+        if (x264_encoder_reconfig(xg->x264_enc_han, &(xg->x264_params)) == 0)
+        {
+            xg->rate_factor = rate_factor;
+        }
+    }
+
+    x264_picture_init(&pic_in);
+    pic_in.img.i_csp = X264_CSP_NV12;
+    pic_in.img.i_plane = 2;
+    pic_in.img.plane[0] = (uint8_t *) y_data;
+    pic_in.img.i_stride[0] = stride;
+    pic_in.img.plane[1] = (uint8_t *) uv_data;
+    pic_in.img.i_stride[1] = stride;
+    pic_in.i_pts = xg->pts++;
+
+    num_nals = 0;
+    frame_size = x264_encoder_encode(xg->x264_enc_han, &nals, &num_nals,
+                                     &pic_in, &pic_out);
+    if (frame_size < 0)
+    {
+        LOG(LOG_LEVEL_ERROR, "xrdp_encoder_x264_encode: "
+            "x264_encoder_encode failed %d", frame_size);
+        return 1;
+    }
+    bytes = 0;
+    for (index = 0; index < num_nals; index++)
+    {
+        if (bytes + nals[index].i_payload > *cdata_bytes)
+        {
+            LOG(LOG_LEVEL_ERROR, "xrdp_encoder_x264_encode: output "
+                "buffer too small");
+            return 1;
+        }
+        g_memcpy(cdata + bytes, nals[index].p_payload,
+                 nals[index].i_payload);
+        bytes += nals[index].i_payload;
+    }
+    *cdata_bytes = bytes;
+    return 0;
+}
@@ -112,6 +112,8 @@ xrdp_child_fork(void)
     int pid;
     char text[256];
 
+    /* the child logs a lot, give it its own log writer */
+    log_after_fork();
     /* close, don't delete these */
     g_close_wait_obj(g_term_event);
     g_close_wait_obj(g_sync_event);
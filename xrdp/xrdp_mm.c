@@ -33,6 +33,7 @@
 #include <ctype.h>
 
 #include "xrdp_encoder.h"
+#include "xrdp_egfx.h"
 #include "xrdp_sockets.h"
 #include <limits.h>
 
@@ -42,6 +43,12 @@ static int
 xrdp_mm_chansrv_connect(struct xrdp_mm *self, const char *port);
 static void
 xrdp_mm_connect_sm(struct xrdp_mm *self);
+static int
+xrdp_mm_egfx_create_surface(struct xrdp_mm *self);
+static int
+xrdp_mm_egfx_initialize(struct xrdp_mm *self);
+static int
+xrdp_mm_update_module_frame_ack(struct xrdp_mm *self);
 
 /*****************************************************************************/
 struct xrdp_mm *
@@ -125,6 +132,8 @@ xrdp_mm_module_cleanup(struct xrdp_mm *self)
 
     trans_delete(self->chan_trans);
     self->chan_trans = 0;
+    xrdp_chan_sched_delete(self->chan_sched);
+    self->chan_sched = NULL;
     self->mod_init = 0;
     self->mod_exit = 0;
     self->mod = 0;
@@ -153,6 +162,7 @@ xrdp_mm_delete(struct xrdp_mm *self)
 
     /* shutdown thread */
     xrdp_encoder_delete(self->encoder);
+    xrdp_egfx_shutdown_delete(self->egfx);
 
     trans_delete(self->sesman_trans);
     self->sesman_trans = 0;
@@ -617,6 +627,60 @@ xrdp_mm_trans_send_channel_setup(struct xrdp_mm *self, struct trans *trans)
     return trans_force_write(trans);
 }
 
+/*****************************************************************************/
+/* xrdp_chan_sched callback */
+static int
+xrdp_mm_chan_sched_send(void *handle, int chan_id, char *data, int bytes,
+                        int total_bytes, int flags)
+{
+    struct xrdp_mm *self = (struct xrdp_mm *)handle;
+
+    return libxrdp_send_to_channel(self->wm->session, chan_id, data, bytes,
+                                   total_bytes, flags);
+}
+
+/*****************************************************************************/
+/* xrdp_chan_sched callback */
+static int
+xrdp_mm_chan_sched_get_backlog(void *handle)
+{
+    struct xrdp_mm *self = (struct xrdp_mm *)handle;
+
+    return trans_get_wait_bytes(self->wm->session->trans);
+}
+
+/*****************************************************************************/
+/* sets up the scheduler for channel data from a new chansrv */
+static void
+xrdp_mm_chan_sched_create(struct xrdp_mm *self)
+{
+    char chan_name[16];
+    int chan_count;
+    int chan_flags;
+    int chan_id;
+
+    xrdp_chan_sched_delete(self->chan_sched);
+    self->chan_sched = xrdp_chan_sched_create(&(self->wm->session->si), self,
+                       xrdp_mm_chan_sched_send,
+                       xrdp_mm_chan_sched_get_backlog);
+    if (self->chan_sched == NULL)
+    {
+        LOG(LOG_LEVEL_WARNING, "xrdp_mm_chan_sched_create: no scheduler, "
+            "channel data will be sent as it arrives");
+        return;
+    }
+    chan_count = libxrdp_get_channel_count(self->wm->session);
+    for (chan_id = 0; chan_id < chan_count; chan_id++)
+    {
+        g_memset(chan_name, 0, sizeof(chan_name));
+        if (libxrdp_query_channel(self->wm->session, chan_id, chan_name,
+                                  &chan_flags) == 0)
+        {
+            xrdp_chan_sched_add_channel(self->chan_sched, chan_id, chan_name);
+        }
+    }
+}
+
 /*****************************************************************************/
 /* returns error
    data coming in from the channel handler, send it to the client */
@@ -643,6 +707,15 @@ xrdp_mm_trans_process_channel_data(struct xrdp_mm *self, struct stream *s)
         {
             rv = 1;
         }
+        else if (self->chan_sched != NULL)
+        {
+            rv = xrdp_chan_sched_queue(self->chan_sched, chan_id, chan_flags,
+                                       total_size, s->p, size);
+            if (rv == 0)
+            {
+                rv = xrdp_chan_sched_send(self->chan_sched);
+            }
+        }
         else
         {
             rv = libxrdp_send_to_channel(self->wm->session, chan_id,
@@ -1180,6 +1253,25 @@ process_display_control_monitor_layout_data(struct xrdp_wm *wm)
                 xrdp_encoder_delete(mm->encoder);
                 mm->encoder = NULL;
             }
+            if (mm->egfx_up)
+            {
+                advance_resize_state_machine(mm, WMRZ_EGFX_DELETE_SURFACE);
+            }
+            else
+            {
+                advance_resize_state_machine(mm, WMRZ_SERVER_MONITOR_RESIZE);
+            }
+            break;
+        case WMRZ_EGFX_DELETE_SURFACE:
+            error = xrdp_egfx_send_delete_surface(mm->egfx,
+                                                  mm->egfx->surface_id);
+            if (error != 0)
+            {
+                LOG_DEVEL(LOG_LEVEL_INFO,
+                          "process_display_control_monitor_layout_data:"
+                          " xrdp_egfx_send_delete_surface failed %d", error);
+                return advance_error(error, mm);
+            }
             advance_resize_state_machine(mm, WMRZ_SERVER_MONITOR_RESIZE);
             break;
         case WMRZ_SERVER_MONITOR_RESIZE:
@@ -1207,14 +1299,19 @@ process_display_control_monitor_layout_data(struct xrdp_wm *wm)
             break;
         case WMRZ_XRDP_CORE_RESIZE:
             // TODO: Unify this logic with server_reset
-            error = libxrdp_reset(
-                        wm->session, desc_width, desc_height, wm->screen->bpp);
-            if (error != 0)
+            if (!mm->egfx_up)
             {
-                LOG_DEVEL(LOG_LEVEL_INFO,
-                          "process_display_control_monitor_layout_data:"
-                          " libxrdp_reset failed %d", error);
-                return advance_error(error, mm);
+                /* with EGFX, RDPGFX_RESET_GRAPHICS_PDU does this */
+                error = libxrdp_reset(
+                            wm->session, desc_width, desc_height,
+                            wm->screen->bpp);
+                if (error != 0)
+                {
+                    LOG_DEVEL(LOG_LEVEL_INFO,
+                              "process_display_control_monitor_layout_data:"
+                              " libxrdp_reset failed %d", error);
+                    return advance_error(error, mm);
+                }
             }
             /* reset cache */
             error = xrdp_cache_reset(wm->cache, wm->client_info);
@@ -1254,6 +1351,24 @@ process_display_control_monitor_layout_data(struct xrdp_wm *wm)
                 return advance_error(error, mm);
             }
             sync_dynamic_monitor_data(wm, &(description->description));
+            if (mm->egfx_up)
+            {
+                advance_resize_state_machine(mm, WMRZ_EGFX_INITIALIZE);
+            }
+            else
+            {
+                advance_resize_state_machine(mm, WMRZ_ENCODER_CREATE);
+            }
+            break;
+        case WMRZ_EGFX_INITIALIZE:
+            error = xrdp_mm_egfx_create_surface(mm);
+            if (error != 0)
+            {
+                LOG_DEVEL(LOG_LEVEL_INFO,
+                          "process_display_control_monitor_layout_data:"
+                          " xrdp_mm_egfx_create_surface failed %d", error);
+                return advance_error(error, mm);
+            }
             advance_resize_state_machine(mm, WMRZ_ENCODER_CREATE);
             break;
         case WMRZ_ENCODER_CREATE:
@@ -1427,6 +1542,237 @@ dynamic_monitor_initialize(struct xrdp_mm *self)
     return error;
 }
 
+/******************************************************************************/
+/* sends RDPGFX_RESET_GRAPHICS_PDU for the current screen size and creates
+   and maps the surface the encoder output goes to */
+static int
+xrdp_mm_egfx_create_surface(struct xrdp_mm *self)
+{
+    struct display_size_description *display_sizes;
+    struct xrdp_egfx *egfx;
+    int width;
+    int height;
+    int error;
+
+    LOG_DEVEL(LOG_LEVEL_TRACE, "xrdp_mm_egfx_create_surface:");
+    egfx = self->egfx;
+    display_sizes = &(self->wm->client_info->display_sizes);
+    width = self->wm->screen->width;
+    height = self->wm->screen->height;
+    error = xrdp_egfx_send_reset_graphics(egfx, width, height,
+                                          display_sizes->monitorCount,
+                                          display_sizes->minfo_wm);
+    if (error == 0)
+    {
+        error = xrdp_egfx_send_create_surface(egfx, egfx->surface_id,
+                                              width, height,
+                                              XR_PIXEL_FORMAT_XRGB_8888);
+    }
+    if (error == 0)
+    {
+        error = xrdp_egfx_send_map_surface(egfx, egfx->surface_id, 0, 0);
+    }
+    return error;
+}
+
+#if defined(XRDP_X264) || defined(XRDP_RFXCODEC)
+/******************************************************************************/
+/* returns the index of the caps set to confirm or -1 if none can be used
+   the highest version that allows AVC420 is preferred if H.264 is built
+   in, else the highest version, RemoteFX is allowed by all of them */
+static int
+xrdp_mm_egfx_select_caps(int caps_count, const int *versions,
+                         const int *flags)
+{
+    int index;
+    int best_index;
+    int best_avc420_index;
+
+    best_index = -1;
+    best_avc420_index = -1;
+    for (index = 0; index < caps_count; index++)
+    {
+        if ((versions[index] < XR_RDPGFX_CAPVERSION_8) ||
+                (versions[index] > XR_RDPGFX_CAPVERSION_107))
+        {
+            continue;
+        }
+        if ((best_index < 0) || (versions[index] > versions[best_index]))
+        {
+            best_index = index;
+        }
+        if (xrdp_egfx_caps_avc420(versions[index], flags[index]) &&
+                ((best_avc420_index < 0) ||
+                 (versions[index] > versions[best_avc420_index])))
+        {
+            best_avc420_index = index;
+        }
+    }
+#if defined(XRDP_X264)
+    if (best_avc420_index >= 0)
+    {
+        return best_avc420_index;
+    }
+#endif
+#if defined(XRDP_RFXCODEC)
+    return best_index;
+#else
+    return -1;
+#endif
+}
+
+/******************************************************************************/
+/* RDPGFX_CAPS_ADVERTISE_PDU from client, start the graphics pipeline */
+static int
+xrdp_mm_egfx_caps_advertise(void *user, int caps_count,
+                            int *versions, int *flags)
+{
+    struct xrdp_mm *self;
+    int index;
+    int error;
+
+    self = (struct xrdp_mm *) user;
+    index = xrdp_mm_egfx_select_caps(caps_count, versions, flags);
+    if (index < 0)
+    {
+        LOG(LOG_LEVEL_INFO, "xrdp_mm_egfx_caps_advertise: no usable caps "
+            "from client, not using EGFX");
+        return xrdp_egfx_shutdown_close_connection(self->egfx);
+    }
+    LOG(LOG_LEVEL_INFO, "xrdp_mm_egfx_caps_advertise: confirming version "
+        "0x%8.8x flags 0x%8.8x", versions[index], flags[index]);
+    self->egfx->caps_version = versions[index];
+    self->egfx->caps_flags = flags[index];
+    error = xrdp_egfx_send_capsconfirm(self->egfx, versions[index],
+                                       flags[index]);
+    if (error == 0)
+    {
+        error = xrdp_mm_egfx_create_surface(self);
+    }
+    if (error != 0)
+    {
+        LOG(LOG_LEVEL_ERROR, "xrdp_mm_egfx_caps_advertise: error %d", error);
+        return error;
+    }
+
+    /* switch the encoder and Xorg capture to EGFX */
+    self->egfx_up = 1;
+    xrdp_encoder_delete(self->encoder);
+    self->encoder = xrdp_encoder_create(self);
+    if (self->mod != NULL)
+    {
+        self->mod->mod_set_param(self->mod, "client_info",
+                                 (const char *) (self->wm->client_info));
+        error = self->mod->mod_server_version_message(self->mod);
+        if (error != 0)
+        {
+            LOG(LOG_LEVEL_ERROR, "xrdp_mm_egfx_caps_advertise: "
+                "mod_server_version_message failed %d", error);
+            return error;
+        }
+        xrdp_bitmap_invalidate(self->wm->screen, 0);
+        /* frames sent to the old encoder are lost, ack them all */
+        self->mod->mod_frame_ack(self->mod, 0, INT_MAX);
+    }
+    return 0;
+}
+
+/******************************************************************************/
+/* RDPGFX_FRAME_ACKNOWLEDGE_PDU from client */
+static int
+xrdp_mm_egfx_frame_ack(void *user, uint32_t queue_depth, int frame_id,
+                       int frames_decoded)
+{
+    struct xrdp_mm *self;
+    struct xrdp_encoder *encoder;
+
+    self = (struct xrdp_mm *) user;
+    encoder = self->encoder;
+    if ((encoder == NULL) || !encoder->gfx)
+    {
+        return 0;
+    }
+    if (queue_depth == XR_SUSPEND_FRAME_ACKNOWLEDGEMENT)
+    {
+        if (!encoder->gfx_ack_off)
+        {
+            LOG(LOG_LEVEL_INFO, "xrdp_mm_egfx_frame_ack: client suspended "
+                "frame acks");
+            encoder->gfx_ack_off = 1;
+        }
+        /* nothing more will be acked, release everything sent */
+        frame_id = -1;
+    }
+    else if (encoder->gfx_ack_off)
+    {
+        LOG(LOG_LEVEL_INFO, "xrdp_mm_egfx_frame_ack: client resumed "
+            "frame acks");
+        encoder->gfx_ack_off = 0;
+    }
+    LOG_DEVEL(LOG_LEVEL_DEBUG, "xrdp_mm_egfx_frame_ack: incoming %d, "
+              "client %d, server %d", frame_id, encoder->frame_id_client,
+              encoder->frame_id_server);
+    if ((frame_id < 0) || (frame_id > encoder->frame_id_server))
+    {
+        encoder->frame_id_client = encoder->frame_id_server;
+    }
+    else
+    {
+        /* frame acks can come out of order so ignore older one */
+        encoder->frame_id_client = MAX(frame_id, encoder->frame_id_client);
+    }
+    xrdp_mm_update_module_frame_ack(self);
+    return 0;
+}
+#endif
+
+/******************************************************************************/
+/* opens the EGFX channel once both the dynamic channels and the Xorg
+   session are up, the pipeline starts when the client sends its caps
+   can be turned off for a session with enable_egfx=false */
+static int
+xrdp_mm_egfx_initialize(struct xrdp_mm *self)
+{
+#if defined(XRDP_X264) || defined(XRDP_RFXCODEC)
+    struct xrdp_client_info *client_info;
+    const char *enable_egfx;
+    int error;
+
+    client_info = self->wm->client_info;
+    if ((self->egfx != NULL) || !self->drdynvc_up ||
+            (self->connect_state != MMCS_DONE) || (self->mod == NULL) ||
+            (self->code != XORG_SESSION_CODE))
+    {
+        return 0;
+    }
+    enable_egfx = xrdp_mm_get_value(self, "enable_egfx");
+    if (enable_egfx != NULL && enable_egfx[0] != '\0' &&
+            !g_text2bool(enable_egfx))
+    {
+        LOG(LOG_LEVEL_INFO, "EGFX is disabled for this session.");
+        return 0;
+    }
+    if (!(client_info->mcs_early_capability_flags &
+            RNS_UD_CS_SUPPORT_DYNVC_GFX_PROTOCOL) || (client_info->bpp < 24))
+    {
+        LOG(LOG_LEVEL_DEBUG, "xrdp_mm_egfx_initialize: client does not "
+            "support EGFX");
+        return 0;
+    }
+    error = xrdp_egfx_create(self, &(self->egfx));
+    if (error != 0)
+    {
+        LOG(LOG_LEVEL_ERROR, "xrdp_mm_egfx_initialize: xrdp_egfx_create "
+            "failed %d", error);
+        return error;
+    }
+    self->egfx->user = self;
+    self->egfx->caps_advertise = xrdp_mm_egfx_caps_advertise;
+    self->egfx->frame_ack = xrdp_mm_egfx_frame_ack;
+#endif
+    return 0;
+}
+
 /******************************************************************************/
 int
 xrdp_mm_drdynvc_up(struct xrdp_mm *self)
@@ -1437,6 +1783,9 @@ xrdp_mm_drdynvc_up(struct xrdp_mm *self)
 
     LOG_DEVEL(LOG_LEVEL_TRACE, "xrdp_mm_drdynvc_up:");
 
+    self->drdynvc_up = 1;
+    xrdp_mm_egfx_initialize(self);
+
     enable_dynamic_resize = xrdp_mm_get_value(self, "enable_dynamic_resizing");
     /*
      * User can disable dynamic resizing if necessary
@@ -1474,22 +1823,15 @@ xrdp_mm_suppress_output(struct xrdp_mm *self, int suppress,
 }
 
 /*****************************************************************************/
-/* open response from client going to channel server */
+/* open response going to channel server */
 static int
-xrdp_mm_drdynvc_open_response(intptr_t id, int chan_id, int creation_status)
+xrdp_mm_chan_send_open_response(struct xrdp_mm *self, int chansrv_chan_id,
+                                int creation_status)
 {
     struct trans *trans;
     struct stream *s;
-    struct xrdp_wm *wm;
-    struct xrdp_process *pro;
-    int chansrv_chan_id;
 
-    LOG_DEVEL(LOG_LEVEL_DEBUG, "xrdp_mm_drdynvc_open_response: "
-              " chan_id %d creation_status %d",
-              chan_id, creation_status);
-    pro = (struct xrdp_process *) id;
-    wm = pro->wm;
-    trans = wm->mm->chan_trans;
+    trans = self->chan_trans;
     s = trans_get_out_s(trans, 8192);
     if (s == NULL)
     {
@@ -1499,13 +1841,30 @@ xrdp_mm_drdynvc_open_response(intptr_t id, int chan_id, int creation_status)
     out_uint32_le(s, 24); /* size */
     out_uint32_le(s, 13); /* msg id */
     out_uint32_le(s, 16); /* size */
-    chansrv_chan_id = wm->mm->xr2cr_cid_map[chan_id];
     out_uint32_le(s, chansrv_chan_id);
     out_uint32_le(s, creation_status); /* status */
     s_mark_end(s);
     return trans_write_copy(trans);
 }
 
+/*****************************************************************************/
+/* open response from client going to channel server */
+static int
+xrdp_mm_drdynvc_open_response(intptr_t id, int chan_id, int creation_status)
+{
+    struct xrdp_wm *wm;
+    struct xrdp_process *pro;
+
+    LOG_DEVEL(LOG_LEVEL_DEBUG, "xrdp_mm_drdynvc_open_response: "
+              " chan_id %d creation_status %d",
+              chan_id, creation_status);
+    pro = (struct xrdp_process *) id;
+    wm = pro->wm;
+    return xrdp_mm_chan_send_open_response(wm->mm,
+                                           wm->mm->xr2cr_cid_map[chan_id],
+                                           creation_status);
+}
+
 /*****************************************************************************/
 /* close response from client going to channel server */
 static int
@@ -1644,6 +2003,7 @@ xrdp_mm_trans_process_drdynvc_channel_open(struct xrdp_mm *self,
     if (flags == 0)
     {
         /* open static channel, not supported */
+        xrdp_mm_chan_send_open_response(self, chansrv_chan_id, -1);
         return 1;
     }
     else
@@ -1659,6 +2019,8 @@ xrdp_mm_trans_process_drdynvc_channel_open(struct xrdp_mm *self,
                                      &chan_id);
         if (error != 0)
         {
+            /* so chansrv doesn't wait for the client */
+            xrdp_mm_chan_send_open_response(self, chansrv_chan_id, -1);
             return 1;
         }
         self->xr2cr_cid_map[chan_id] = chansrv_chan_id;
@@ -2298,6 +2660,8 @@ xrdp_mm_chansrv_connect(struct xrdp_mm *self, const char *port)
         return 0;
     }
 
+    xrdp_mm_chan_sched_create(self);
+
     /* connect channel redir */
     self->chan_trans = trans_create(TRANS_MODE_UNIX, 8192, 8192);
 
@@ -2630,6 +2994,10 @@ xrdp_mm_connect_sm(struct xrdp_mm *self)
         {
             xrdp_mm_module_cleanup(self);
         }
+        else
+        {
+            xrdp_mm_egfx_initialize(self);
+        }
     }
 }
 
@@ -2784,6 +3152,8 @@ static int
 xrdp_mm_process_enc_done(struct xrdp_mm *self)
 {
     XRDP_ENC_DATA_DONE *enc_done;
+    struct xrdp_egfx_rect rect;
+    int frame_acks;
     int x;
     int y;
     int cx;
@@ -2806,7 +3176,35 @@ xrdp_mm_process_enc_done(struct xrdp_mm *self)
         y = enc_done->y;
         cx = enc_done->cx;
         cy = enc_done->cy;
-        if (enc_done->comp_bytes > 0)
+        if (self->encoder->gfx)
+        {
+            /* empty frames are sent too, the client acks them */
+            if (!enc_done->continuation)
+            {
+                xrdp_egfx_send_frame_start(self->egfx,
+                                           enc_done->enc->frame_id, 0);
+            }
+            if (enc_done->comp_bytes > 0)
+            {
+                rect.x1 = x;
+                rect.y1 = y;
+                rect.x2 = x + cx;
+                rect.y2 = y + cy;
+                xrdp_egfx_send_wire_to_surface1(self->egfx,
+                                                self->egfx->surface_id,
+                                                self->encoder->codec_id,
+                                                XR_PIXEL_FORMAT_XRGB_8888,
+                                                &rect,
+                                                enc_done->comp_pad_data +
+                                                enc_done->pad_bytes,
+                                                enc_done->comp_bytes);
+            }
+            if (enc_done->last)
+            {
+                xrdp_egfx_send_frame_end(self->egfx, enc_done->enc->frame_id);
+            }
+        }
+        else if (enc_done->comp_bytes > 0)
         {
             if (!enc_done->continuation)
             {
@@ -2830,7 +3228,15 @@ xrdp_mm_process_enc_done(struct xrdp_mm *self)
         if (enc_done->last)
         {
             LOG_DEVEL(LOG_LEVEL_DEBUG, "xrdp_mm_process_enc_done: last set");
-            if (self->wm->client_info->use_frame_acks == 0)
+            if (self->encoder->gfx)
+            {
+                frame_acks = !self->encoder->gfx_ack_off;
+            }
+            else
+            {
+                frame_acks = self->wm->client_info->use_frame_acks;
+            }
+            if (!frame_acks)
             {
                 self->mod->mod_frame_ack(self->mod,
                                          enc_done->enc->flags,
@@ -2841,6 +3247,8 @@ xrdp_mm_process_enc_done(struct xrdp_mm *self)
                 self->encoder->frame_id_server = enc_done->enc->frame_id;
                 xrdp_mm_update_module_frame_ack(self);
             }
+            xrdp_encoder_update_quality(self->encoder,
+                                        trans_get_wait_bytes(self->wm->session->trans));
             g_free(enc_done->enc->drects);
             g_free(enc_done->enc->crects);
             g_free(enc_done->enc);
@@ -2896,6 +3304,14 @@ xrdp_mm_check_wait_objs(struct xrdp_mm *self)
         }
     }
 
+    /* the client link may have room for more channel data now */
+    if (self->chan_sched != NULL &&
+            xrdp_chan_sched_send(self->chan_sched) != 0)
+    {
+        LOG(LOG_LEVEL_ERROR, "xrdp_mm_check_wait_objs: "
+            "xrdp_chan_sched_send failed");
+    }
+
     if (self->mod != NULL)
     {
         if (self->mod->mod_check_wait_objs != NULL)
@@ -214,14 +214,87 @@ struct xrdp_palette_item
 struct xrdp_bitmap_item
 {
     int stamp;
-    int lru_index;
+    /* NULL for items the client loaded from its persistent cache */
     struct xrdp_bitmap *bitmap;
 };
 
-struct xrdp_lru_item
+/* an entry of a struct xrdp_cache_index */
+struct xrdp_cache_index_item
 {
-    int next;
-    int prev;
+    tui64 key;
+    int slot; /* where key is in slots, -1 if the entry is not in use */
+    int prev; /* lru, -1 at the least recently used end */
+    int next; /* -1 at the most recently used end */
+};
+
+struct xrdp_cache_index_slot
+{
+    tui32 hash; /* of the key, to skip most other keys without looking */
+    int cache_idx; /* -1 if the slot is empty */
+};
+
+/* index of one bitmap cache, an open addressing hash table from key to
+   cache index and the lru order of the cache's entries */
+struct xrdp_cache_index
+{
+    int entries;
+    int slot_mask;
+    int lru_head; /* least recently used */
+    int lru_tail; /* most recently used */
+    struct xrdp_cache_index_item *items; /* one per cache entry */
+    struct xrdp_cache_index_slot *slots;
+};
+
+/* most static channels the channel scheduler keeps apart */
+#define XRDP_CHAN_SCHED_MAX_CHANNELS 32
+
+/* classes of virtual channel data from chansrv, most urgent first.
+   Graphics doesn't go through the scheduler, it sits between
+   XRDP_CHAN_CLASS_INTERACTIVE and XRDP_CHAN_CLASS_BULK */
+enum xrdp_chan_class
+{
+    XRDP_CHAN_CLASS_AUDIO = 0,
+    XRDP_CHAN_CLASS_INTERACTIVE,
+    XRDP_CHAN_CLASS_BULK,
+    XRDP_CHAN_CLASS_COUNT
+};
+
+/* per channel counters of a struct xrdp_chan_sched */
+struct xrdp_chan_sched_stats
+{
+    char name[9];
+    enum xrdp_chan_class chan_class;
+    int queued_bytes; /* waiting in the scheduler now */
+    int queued_bytes_max;
+    int fragments;
+    long long sent_bytes;
+};
+
+/* fragments of one class waiting to be sent, oldest first */
+struct xrdp_chan_sched_queue
+{
+    struct stream *head;
+    struct stream *tail;
+    int deficit; /* bytes the class may still send this round */
+};
+
+/* Holds channel data from chansrv and hands it to the client by class,
+   while the client link's backlog leaves room for that class. Queued
+   bytes over the read ahead are charged to XRDP_SOURCE_CHANSRV so
+   chansrv isn't read while the scheduler is full */
+struct xrdp_chan_sched
+{
+    struct xrdp_chan_sched_queue queues[XRDP_CHAN_CLASS_COUNT];
+    struct xrdp_chan_sched_stats chans[XRDP_CHAN_SCHED_MAX_CHANNELS];
+    int queued_bytes;
+    int charged_bytes; /* of queued_bytes, added to si */
+    struct source_info *si;
+    void *handle;
+    /* sends a fragment to the client, returns non zero on error */
+    int (*send)(void *handle, int chan_id, char *data, int bytes,
+                int total_bytes, int flags);
+    /* returns the bytes already waiting to go to the client */
+    int (*get_backlog)(void *handle);
 };
 
 struct xrdp_os_bitmap_item
@@ -269,16 +342,8 @@ struct xrdp_cache
     int bitmap_stamp;
     struct xrdp_bitmap_item bitmap_items[XRDP_MAX_BITMAP_CACHE_ID]
         [XRDP_MAX_BITMAP_CACHE_IDX];
-
-    /* lru optimize */
-    struct xrdp_lru_item bitmap_lrus[XRDP_MAX_BITMAP_CACHE_ID]
-        [XRDP_MAX_BITMAP_CACHE_IDX];
-    int lru_head[XRDP_MAX_BITMAP_CACHE_ID];
-    int lru_tail[XRDP_MAX_BITMAP_CACHE_ID];
-    int lru_reset[XRDP_MAX_BITMAP_CACHE_ID];
-
-    /* crc optimize */
-    struct list16 crc16[XRDP_MAX_BITMAP_CACHE_ID][64 * 1024];
+    /* key lookup and lru, sized to the cache entries */
+    struct xrdp_cache_index *bitmap_index[XRDP_MAX_BITMAP_CACHE_ID];
 
     int use_bitmap_comp;
     int cache1_entries;
@@ -369,6 +434,7 @@ struct xrdp_mm
     int use_chansrv; /* true if chansrvport is set in xrdp.ini or using sesman */
     struct trans *sesman_trans; /* connection to sesman */
     struct trans *chan_trans; /* connection to chansrv */
+    struct xrdp_chan_sched *chan_sched; /* chansrv channel data to send */
 
     /* We can't delete transports while we're in a callback for that
      * transport, as this causes trans.c to reference undefined memory.
@@ -390,7 +456,9 @@ struct xrdp_mm
     int cs2xr_cid_map[256];
     int xr2cr_cid_map[256];
     int dynamic_monitor_chanid;
+    int drdynvc_up; /* true once the client's drdynvc channel is up */
     struct xrdp_egfx *egfx;
+    int egfx_up; /* true once EGFX surface is mapped, encoder uses it */
 
     /* Resize on-the-fly control */
     struct display_control_monitor_layout_data *resize_data;